@@ -46,6 +46,11 @@ int main(int argc, char *argv[]) {
 			("transform-levels,L", bpo::value< size_t > (), "number of multi-resolution levels for the transform")
 			("output-prefix,o", bpo::value < std::string > (&outPrefix)->default_value("regseg"), "prefix for output files")
 			("logfile,l", bpo::value<std::string>(&logFileName), "log filename")
+			("checkpoint", bpo::value<std::string>(), "file where the state of the registration is periodically stored")
+			("checkpoint-every", bpo::value<size_t>()->default_value(10), "number of iterations between checkpoints")
+			("resume", bpo::value<std::string>(), "continue the registration stored in this checkpoint file")
+			("initial-coeff", bpo::value < std::vector<std::string> >()->multitoken(), "coefficients of a previous run to start each level from")
+			("initial-field", bpo::value<std::string>(), "displacement field of a previous run to start the first level from")
 			("monitoring-verbosity,v", bpo::value<size_t>()->default_value(DEFAULT_VERBOSITY), "verbosity level of intermediate results monitoring ( 0 = no output; 5 = verbose )");
 
 	bpo::options_description opt_desc("Optimizer options (by levels)");
@@ -134,6 +139,15 @@ int main(int argc, char *argv[]) {
 	acwereg->SetOutputPrefix( outPrefix );
 	acwereg->SetVerbosity( vm_general["monitoring-verbosity"].as< size_t >() );
 
+	if( vm_general.count("checkpoint") ) {
+		acwereg->SetCheckpointFileName( vm_general["checkpoint"].as< std::string >() );
+		acwereg->SetCheckpointPeriod( vm_general["checkpoint-every"].as< size_t >() );
+	}
+
+	if( vm_general.count("resume") ) {
+		acwereg->SetResumeFileName( vm_general["resume"].as< std::string >() );
+	}
+
 	// Create the JSON output object
 	Json::Value root;
 	root["description"]["title"] = "RegSeg Summary File";
@@ -190,6 +204,65 @@ int main(int argc, char *argv[]) {
 	// Set target surfaces(s) ---------------------------------------------------------
 	acwereg->SetTargetNames( targetSurfaceNames );
 
+	// Read initial transform (warm start) --------------------------------------------
+	if( vm_general.count("initial-coeff") ) {
+		std::vector< std::string > coeffNames = vm_general["initial-coeff"].as< std::vector< std::string > >();
+		CoefficientsImageList allcoeff;
+		for ( size_t i = 0; i < coeffNames.size(); i++ ) {
+			CoefficientsFileReader::Pointer r = CoefficientsFileReader::New();
+			r->SetFileName( coeffNames[i] );
+			r->Update();
+			CoefficientsFileType::Pointer f = r->GetOutput();
+
+			CoefficientsType::SizeType size;
+			CoefficientsType::SpacingType sp;
+			for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+				size[dim] = f->GetLargestPossibleRegion().GetSize()[dim];
+				sp[dim] = f->GetSpacing()[dim];
+			}
+
+			CoefficientsImageArray coeffarr;
+			size_t np = f->GetLargestPossibleRegion().GetNumberOfPixels() / DIMENSION;
+			const ScalarType* sbuff = f->GetBufferPointer();
+			for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+				coeffarr[dim] = CoefficientsType::New();
+				coeffarr[dim]->SetRegions( size );
+				coeffarr[dim]->SetSpacing( sp );
+				coeffarr[dim]->Allocate();
+				std::copy( sbuff + dim * np, sbuff + ( dim + 1 ) * np, coeffarr[dim]->GetBufferPointer() );
+			}
+			allcoeff.push_back( coeffarr );
+		}
+		acwereg->SetInitialCoefficients( allcoeff );
+	} else if( vm_general.count("initial-field") ) {
+		CoefficientsFileReader::Pointer r = CoefficientsFileReader::New();
+		r->SetFileName( vm_general["initial-field"].as< std::string >() );
+		r->Update();
+		CoefficientsFileType::Pointer f = r->GetOutput();
+
+		FieldType::SizeType size;
+		FieldType::SpacingType sp;
+		for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+			size[dim] = f->GetLargestPossibleRegion().GetSize()[dim];
+			sp[dim] = f->GetSpacing()[dim];
+		}
+
+		typename FieldType::Pointer field = FieldType::New();
+		field->SetRegions( size );
+		field->SetSpacing( sp );
+		field->Allocate();
+
+		size_t np = field->GetLargestPossibleRegion().GetNumberOfPixels();
+		const ScalarType* sbuff = f->GetBufferPointer();
+		typename FieldType::PixelType* dbuff = field->GetBufferPointer();
+		for ( size_t pix = 0; pix < np; pix++ ) {
+			for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+				dbuff[pix][dim] = sbuff[dim * np + pix];
+			}
+		}
+		acwereg->SetInitialDisplacementField( field );
+	}
+
 	// Set up registration ------------------------------------------------------------
 	if ( vm_general.count("transform-levels") && cli_nlevels == 0 ) {
 		acwereg->SetNumberOfLevels( vm_general["transform-levels"].as<size_t>() );
@@ -242,6 +315,39 @@ int main(int argc, char *argv[]) {
 	fwrite->SetInput( acwereg->GetDisplacementField() );
 	fwrite->Update();
 
+	// Coefficients of each level, to warm start later runs
+	CoefficientsImageList levcoeff = acwereg->GetLevelCoefficients();
+	for ( size_t l = 0; l < levcoeff.size(); l++ ) {
+		CoefficientsType::SizeType csize = levcoeff[l][0]->GetLargestPossibleRegion().GetSize();
+		CoefficientsFileType::SizeType size;
+		CoefficientsFileType::SpacingType sp;
+		for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+			size[dim] = csize[dim];
+			sp[dim] = levcoeff[l][0]->GetSpacing()[dim];
+		}
+		size[DIMENSION] = DIMENSION;
+		sp[DIMENSION] = 1.0;
+
+		CoefficientsFileType::Pointer out = CoefficientsFileType::New();
+		out->SetRegions( size );
+		out->SetSpacing( sp );
+		out->Allocate();
+
+		size_t np = levcoeff[l][0]->GetLargestPossibleRegion().GetNumberOfPixels();
+		ScalarType* obuff = out->GetBufferPointer();
+		for ( size_t dim = 0; dim < DIMENSION; dim++ ) {
+			const ScalarType* cbuff = levcoeff[l][dim]->GetBufferPointer();
+			std::copy( cbuff, cbuff + np, obuff + dim * np );
+		}
+
+		std::stringstream ss;
+		ss << outPrefix << "_coeff_lev" << l << ".nii.gz";
+		CoefficientsFileWriter::Pointer w = CoefficientsFileWriter::New();
+		w->SetFileName( ss.str().c_str() );
+		w->SetInput( out );
+		w->Update();
+	}
+
 	// Contours and regions
 	ContourList conts = acwereg->GetCurrentContours();
     size_t nCont = conts.size();
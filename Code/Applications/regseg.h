@@ -110,6 +110,12 @@ typedef itk::ImageFileWriter< CoefficientsType >             CoefficientsWriter;
 typedef rstk::DisplacementFieldFileWriter< FieldType >       FieldWriter;
 typedef rstk::CoefficientsWriter< AltCoeffType >             CoeffWriter;
 
+typedef typename RegistrationType::CoefficientsImageArray    CoefficientsImageArray;
+typedef typename RegistrationType::CoefficientsImageList     CoefficientsImageList;
+typedef itk::Image< ScalarType, DIMENSION + 1 >              CoefficientsFileType;  // components stacked on the last axis
+typedef itk::ImageFileReader< CoefficientsFileType >         CoefficientsFileReader;
+typedef itk::ImageFileWriter< CoefficientsFileType >         CoefficientsFileWriter;
+
 typedef itk::WarpImageFilter
 		         < ChannelType, ChannelType, FieldType >     WarpFilter;
 typedef typename WarpFilter::Pointer                         WarpFilterPointer;
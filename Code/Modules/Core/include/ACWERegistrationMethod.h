@@ -40,12 +40,18 @@
 #include "FunctionalBase.h"
 #include "OptimizerBase.h"
 #include "SpectralGradientDescentOptimizer.h"
+#include "SpectralNesterovOptimizer.h"
+#include "SpectralBarzilaiBorweinOptimizer.h"
+#include "SpectralLBFGSOptimizer.h"
+#include "SpectralADMMOptimizer.h"
 #include "SegmentationOptimizer.h"
 #include "CompositeMatrixTransform.h"
 
 #include "IterationJSONUpdate.h"
 #include "IterationStdOutUpdate.h"
 #include "IterationResultsWriterUpdate.h"
+#include "IterationCheckpointUpdate.h"
+#include "CheckpointFile.h"
 
 namespace bpo = boost::program_options;
 
@@ -134,6 +140,10 @@ public:
 	typedef typename OptimizerType::SizeValueType             NumberValueType;
 	typedef std::vector< NumberValueType >                    NumberValueList;
 
+	typedef typename OptimizerType::CoefficientsImageType     CoefficientsImageType;
+	typedef typename OptimizerType::CoefficientsImageArray    CoefficientsImageArray;
+	typedef std::vector< CoefficientsImageArray >             CoefficientsImageList;
+
 	typedef typename OptimizerType::FieldType                 FieldType;
 	typedef typename FieldType::Pointer                       FieldPointer;
 	typedef typename FieldType::ConstPointer                  FieldConstPointer;
@@ -141,6 +151,14 @@ public:
 
 	typedef SpectralGradientDescentOptimizer
 			                            < FunctionalType >    DefaultOptimizerType;
+	typedef SpectralNesterovOptimizer
+			                            < FunctionalType >    NesterovOptimizerType;
+	typedef SpectralBarzilaiBorweinOptimizer
+			                            < FunctionalType >    BBOptimizerType;
+	typedef SpectralLBFGSOptimizer
+			                            < FunctionalType >    LBFGSOptimizerType;
+	typedef SpectralADMMOptimizer
+			                            < FunctionalType >    ADMMOptimizerType;
 
 	typedef Json::Value                                       JSONRoot;
 	typedef IterationJSONUpdate< OptimizerType >              JSONLoggerType;
@@ -152,6 +170,9 @@ public:
 	typedef IterationResultWriterUpdate< OptimizerType >      IterationWriterUpdate;
 	typedef typename IterationWriterUpdate::Pointer           IterationWriterPointer;
 
+	typedef IterationCheckpointUpdate< OptimizerType, Self >  CheckpointUpdateType;
+	typedef typename CheckpointUpdateType::Pointer            CheckpointUpdatePointer;
+
 	/** Codes of stopping conditions. */
 	typedef enum {
 		ALL_LEVELS_DONE,
@@ -206,6 +227,30 @@ public:
 	itkSetClampMacro( TransformNumberOfThreads, size_t, 1, ITK_MAX_THREADS );
 	itkGetConstMacro( TransformNumberOfThreads, size_t );
 
+	/** Checkpoint written every CheckpointPeriod iterations (0 disables it) */
+	itkSetMacro( CheckpointFileName, std::string );
+	itkGetConstMacro( CheckpointFileName, std::string );
+
+	itkSetMacro( CheckpointPeriod, size_t );
+	itkGetConstMacro( CheckpointPeriod, size_t );
+
+	/** Checkpoint from which GenerateData() resumes a preempted run */
+	itkSetMacro( ResumeFileName, std::string );
+	itkGetConstMacro( ResumeFileName, std::string );
+
+	/** Coefficients of a previous run to start each level from */
+	void SetInitialCoefficients( const CoefficientsImageList& c ) {
+		this->m_InitialCoefficients = c;
+		this->Modified();
+	}
+
+	/** Displacement on the reference grid to start the first level from,
+	 *  used when no initial coefficients are given */
+	itkSetObjectMacro( InitialDisplacementField, FieldType );
+
+	/** Coefficients found at each of the finished levels */
+	const CoefficientsImageList& GetLevelCoefficients() const { return this->m_LevelCoefficients; }
+
 	itkGetConstObjectMacro(OutputTransform, OutputTransformType );
 	itkGetConstObjectMacro(OutputInverseTransform, OutputTransformType );
 	itkGetConstObjectMacro(DisplacementField, FieldType );
@@ -252,6 +297,9 @@ public:
 		return this->m_Functional->GetCurrentRegion( contour_id );
 	}
 
+	/** Store the state of the current level into CheckpointFileName */
+	void SaveCheckpoint() const;
+
 protected:
 	ACWERegistrationMethod();
 	~ACWERegistrationMethod() {}
@@ -266,6 +314,9 @@ protected:
 	void SetUpLevel( size_t level );
 	void Stop( StopConditionType code, std::string msg );
 
+	void WriteCheckpoint( size_t level, const PriorsList& priors, bool optimizer ) const;
+	void RestoreCheckpoint();
+
 	virtual void ParseSettings() override {};
 private:
 	ACWERegistrationMethod( const Self & );
@@ -301,6 +352,7 @@ private:
 	// OptimizerList m_Optimizers;
 	PriorsList m_Target;
 	PriorsList m_CurrentContours;
+	PriorsList m_LevelPriors;
 	SettingsList m_Config;
 	OutputTransformPointer m_OutputTransform;
 	OutputTransformPointer m_OutputInverseTransform;
@@ -316,11 +368,21 @@ private:
 	JSONLoggerPointer m_CurrentLogger;
 	IterationWriterPointer m_ImageLogger;
 	STDOutLoggerPointer m_OutLogger;
+	CheckpointUpdatePointer m_Checkpointer;
 
 	size_t m_Verbosity;
 
 	size_t m_TransformNumberOfThreads;
 
+	std::string m_CheckpointFileName;
+	size_t m_CheckpointPeriod;
+	std::string m_ResumeFileName;
+	CheckpointFile m_ResumeState;
+	bool m_ResumeOptimizer;
+	CoefficientsImageList m_LevelCoefficients;
+	CoefficientsImageList m_InitialCoefficients;
+	FieldPointer m_InitialDisplacementField;
+
 	std::vector< std::string > m_ReferenceNames;
 	std::vector< std::string > m_PriorsNames;
 	std::vector< std::string > m_TargetNames;
@@ -45,7 +45,11 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
                             m_AutoSmoothing(false),
                             m_Stop(false),
                             m_Verbosity(1),
-                            m_TransformNumberOfThreads(0) {
+                            m_TransformNumberOfThreads(0),
+                            m_CheckpointFileName(""),
+                            m_CheckpointPeriod(0),
+                            m_ResumeFileName(""),
+                            m_ResumeOptimizer(false) {
 	this->m_StopCondition      = ALL_LEVELS_DONE;
 	this->m_StopConditionDescription << this->GetNameOfClass() << ": ";
 
@@ -90,6 +94,10 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	size_t nPriors = this->m_PriorsNames.size();
 	this->Initialize();
 
+	if ( this->m_ResumeFileName.size() > 0 ) {
+		this->RestoreCheckpoint();
+	}
+
 	while( this->m_CurrentLevel < this->m_NumberOfLevels ) {
 		std::cout << "Starting registration level " << this->m_CurrentLevel << "." << std::endl;
 		try {
@@ -100,6 +108,11 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 			throw err;  // Pass exception to caller
 		}
 
+		if ( this->m_ResumeOptimizer ) {
+			this->m_Optimizer->SetInitialState( &this->m_ResumeState );
+			this->m_ResumeOptimizer = false;
+		}
+
 		try {
 			m_Optimizer->Start();
 		} catch ( itk::ExceptionObject & err ) {
@@ -111,6 +124,7 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 		// Add JSON tree to the general logging facility
 		this->m_JSONRoot.append( this->m_CurrentLogger->GetJSONRoot() );
 		this->m_OutputTransform->PushBackTransform(this->m_Optimizer->GetTransform());
+		this->m_LevelCoefficients.push_back( this->m_Optimizer->GetOutputCoefficients() );
 
 		this->m_CurrentContours.resize(nPriors);
 		for (size_t i = 0; i < nPriors; i++ ) {
@@ -128,6 +142,11 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 			break;
 		}
 
+		if ( this->m_CheckpointPeriod > 0 && this->m_CheckpointFileName.size() > 0 ) {
+			// The next level starts from these contours and transforms
+			this->WriteCheckpoint( this->m_CurrentLevel + 1, this->m_CurrentContours, false );
+		}
+
 		this->m_Functional = NULL;
 		this->m_Optimizer = NULL;
 
@@ -159,6 +178,8 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 		for ( size_t i = 0; i<this->m_PriorsNames.size(); i++ ) {
 			this->m_Functional->AddShapePrior( this->m_CurrentContours[i] );
 		}
+		// Kept to checkpoint the level
+		this->m_LevelPriors.swap( this->m_CurrentContours );
 		this->m_CurrentContours.clear();
 	}
 
@@ -168,7 +189,25 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	}
 
 	// Connect Optimizer
-	this->m_Optimizer = DefaultOptimizerType::New();
+	std::string scheme = "gd";
+	if( this->m_Config[level].count( "optimizer" ) ) {
+		bpo::variable_value v = this->m_Config[level]["optimizer"];
+		scheme = v.as< std::string >();
+	}
+
+	if ( scheme == "nesterov" ) {
+		this->m_Optimizer = NesterovOptimizerType::New();
+	} else if ( scheme == "bb" ) {
+		this->m_Optimizer = BBOptimizerType::New();
+	} else if ( scheme == "lbfgs" ) {
+		this->m_Optimizer = LBFGSOptimizerType::New();
+	} else if ( scheme == "admm" ) {
+		this->m_Optimizer = ADMMOptimizerType::New();
+	} else if ( scheme == "gd" ) {
+		this->m_Optimizer = DefaultOptimizerType::New();
+	} else {
+		itkExceptionMacro(<< "unknown optimizer " << scheme << ".");
+	}
 	this->m_Optimizer->SetFunctional( this->m_Functional );
 	this->m_Optimizer->SetSettings( this->m_Config[level] );
 
@@ -176,6 +215,20 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 		this->m_Optimizer->GetTransform()->SetNumberOfThreads( this->m_TransformNumberOfThreads );
 	}
 
+	// Warm start from the results of a previous run
+	if ( level < this->m_InitialCoefficients.size() ) {
+		this->m_Optimizer->SetInitialCoefficients( this->m_InitialCoefficients[level] );
+	} else if ( level == 0 && this->m_InitialDisplacementField.IsNotNull() ) {
+		const ReferenceImageType* ref = this->m_Functional->GetReferenceImage();
+		if ( this->m_InitialDisplacementField->GetLargestPossibleRegion().GetSize() != ref->GetLargestPossibleRegion().GetSize() ) {
+			itkExceptionMacro(<< "initial displacement field of size " << this->m_InitialDisplacementField->GetLargestPossibleRegion().GetSize()
+					<< " is not defined on the reference grid of size " << ref->GetLargestPossibleRegion().GetSize() << "." );
+		}
+		// Written fields do not keep the physical placement of the reference
+		this->m_InitialDisplacementField->CopyInformation( ref );
+		this->m_Optimizer->SetInitialDisplacementField( this->m_InitialDisplacementField );
+	}
+
 	this->m_CurrentLogger = JSONLoggerType::New();
 	this->m_CurrentLogger->SetOptimizer( this->m_Optimizer );
 	this->m_CurrentLogger->SetLevel( level );
@@ -192,6 +245,12 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 		this->m_OutLogger->SetLevel( level );
 	}
 
+	if ( this->m_CheckpointPeriod > 0 && this->m_CheckpointFileName.size() > 0 ) {
+		this->m_Checkpointer = CheckpointUpdateType::New();
+		this->m_Checkpointer->SetRegistrationMethod( this );
+		this->m_Checkpointer->SetOptimizer( this->m_Optimizer );
+		this->m_Checkpointer->SetPeriod( this->m_CheckpointPeriod );
+	}
 
 }
 
@@ -277,6 +336,121 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	this->m_DisplacementField = this->m_OutputTransform->GetDisplacementField();
 }
 
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+void
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::SaveCheckpoint() const {
+	this->WriteCheckpoint( this->m_CurrentLevel, this->m_LevelPriors, true );
+}
+
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+void
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::WriteCheckpoint( size_t level, const PriorsList& priors, bool optimizer ) const {
+	CheckpointFile f;
+	f.Write< std::uint64_t >( this->m_NumberOfLevels );
+	f.Write< std::uint64_t >( level );
+
+	// Transforms of the finished levels
+	f.Write< std::uint64_t >( this->m_LevelCoefficients.size() );
+	for( size_t l = 0; l < this->m_LevelCoefficients.size(); l++ ) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			f.WriteImage( this->m_LevelCoefficients[l][d].GetPointer() );
+		}
+	}
+
+	// Contours the level started from (level 0 reads them from the priors files)
+	size_t nPriors = ( level > 0 )?priors.size():0;
+	f.Write< std::uint64_t >( nPriors );
+	for( size_t i = 0; i < nPriors; i++ ) {
+		typedef typename PriorsType::PointsContainer::ConstIterator PointsIterator;
+		f.Write< std::uint64_t >( priors[i]->GetNumberOfPoints() );
+		PointsIterator p_it = priors[i]->GetPoints()->Begin();
+		PointsIterator p_end = priors[i]->GetPoints()->End();
+		for( ; p_it != p_end; ++p_it ) {
+			f.Write< std::uint64_t >( p_it.Index() );
+			for( size_t d = 0; d < Dimension; d++ ) {
+				f.Write< double >( p_it.Value()[d] );
+			}
+		}
+	}
+
+	f.Write< bool >( optimizer );
+	if ( optimizer ) {
+		this->m_Optimizer->SaveState( f );
+	}
+
+	if ( !f.Save( this->m_CheckpointFileName ) ) {
+		itkWarningMacro(<< "could not write checkpoint file " << this->m_CheckpointFileName );
+	}
+}
+
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+void
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::RestoreCheckpoint() {
+	if ( !this->m_ResumeState.Load( this->m_ResumeFileName ) ) {
+		itkExceptionMacro(<< "cannot read checkpoint file " << this->m_ResumeFileName << "." );
+	}
+	CheckpointFile& f = this->m_ResumeState;
+
+	size_t nlevels = f.Read< std::uint64_t >();
+	size_t level = f.Read< std::uint64_t >();
+	if ( nlevels != this->m_NumberOfLevels || level >= nlevels ) {
+		itkExceptionMacro(<< "checkpoint of level " << level << " (out of " << nlevels
+				<< ") does not match the " << this->m_NumberOfLevels << " levels set up." );
+	}
+
+	size_t ndone = f.Read< std::uint64_t >();
+	if ( ndone != level ) {
+		itkExceptionMacro(<< "checkpoint holds " << ndone << " transforms before level " << level << "." );
+	}
+
+	this->m_LevelCoefficients.clear();
+	for( size_t l = 0; l < ndone; l++ ) {
+		CoefficientsImageArray coeff;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			coeff[d] = f.ReadImage< CoefficientsImageType >();
+		}
+		this->m_LevelCoefficients.push_back( coeff );
+		this->m_OutputTransform->PushBackCoefficients( coeff );
+	}
+
+	// Take the topology from the priors and the vertices from the checkpoint
+	size_t nPriors = f.Read< std::uint64_t >();
+	if ( nPriors > 0 && nPriors != this->m_PriorsNames.size() ) {
+		itkExceptionMacro(<< "checkpoint holds " << nPriors << " contours, but "
+				<< this->m_PriorsNames.size() << " priors were given." );
+	}
+
+	this->m_CurrentContours.resize( nPriors );
+	for( size_t i = 0; i < nPriors; i++ ) {
+		typename FunctionalType::PriorReader::Pointer polyDataReader = FunctionalType::PriorReader::New();
+		polyDataReader->SetFileName( this->m_PriorsNames[i] );
+		polyDataReader->Update();
+		PriorPointer prior = polyDataReader->GetOutput();
+
+		size_t npoints = f.Read< std::uint64_t >();
+		if ( npoints != prior->GetNumberOfPoints() ) {
+			itkExceptionMacro(<< "checkpoint contour " << i << " has " << npoints << " vertices, but "
+					<< this->m_PriorsNames[i] << " has " << prior->GetNumberOfPoints() << "." );
+		}
+
+		typename PriorsType::PointType p;
+		for( size_t k = 0; k < npoints; k++ ) {
+			size_t id = f.Read< std::uint64_t >();
+			for( size_t d = 0; d < Dimension; d++ ) {
+				p[d] = f.Read< double >();
+			}
+			prior->SetPoint( id, p );
+		}
+		this->m_CurrentContours[i] = prior;
+	}
+
+	this->m_ResumeOptimizer = f.Read< bool >();
+	this->m_CurrentLevel = level;
+}
+
 /*
  *  Get output transform
  */
@@ -0,0 +1,312 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CHECKPOINTFILE_H_
+#define CHECKPOINTFILE_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+#include <itkMacro.h>
+#include <itkImage.h>
+
+#include "CSRMatrix.h"
+
+namespace rstk {
+
+/** \class CheckpointFile
+ *  \brief Binary snapshot of the state of a registration run.
+ *
+ *  Values are appended to an in-memory buffer with the Write methods and
+ *  read back, in the same order, with the Read methods. The whole buffer is
+ *  stored by Save() in a single versioned file, written aside under a unique
+ *  name and renamed so that an interrupted run never leaves a partial
+ *  snapshot behind. Values are
+ *  stored in their native binary representation, so a restored state is
+ *  bit-identical to the saved one.
+ *
+ *  Reads past the end of the snapshot or with mismatching sizes throw.
+ *
+ *  \ingroup RSTK
+ */
+class CheckpointFile {
+public:
+	typedef std::vector< char >  BufferType;
+
+	CheckpointFile(): m_Position(0) {}
+
+	/** Drop the contents of the snapshot */
+	void Clear() {
+		this->m_Buffer.clear();
+		this->m_Position = 0;
+	}
+
+	/** Restart reading from the first value */
+	void Rewind() { this->m_Position = 0; }
+
+	size_t GetSize() const { return this->m_Buffer.size(); }
+	bool IsAtEnd() const { return this->m_Position >= this->m_Buffer.size(); }
+
+	template< typename T >
+	void Write( const T& v ) {
+		static_assert( std::is_trivially_copyable< T >::value, "only plain values can be written" );
+		this->WriteBytes( &v, sizeof( T ) );
+	}
+
+	template< typename T >
+	void Read( T& v ) {
+		static_assert( std::is_trivially_copyable< T >::value, "only plain values can be read" );
+		this->ReadBytes( &v, sizeof( T ) );
+	}
+
+	template< typename T >
+	T Read() {
+		T v;
+		this->Read( v );
+		return v;
+	}
+
+	/** Write n values, preceded by their number */
+	template< typename T >
+	void WriteArray( const T* v, size_t n ) {
+		this->Write< std::uint64_t >( n );
+		this->WriteBytes( v, n * sizeof( T ) );
+	}
+
+	/** Read exactly n values written by WriteArray */
+	template< typename T >
+	void ReadArray( T* v, size_t n ) {
+		std::uint64_t stored = this->Read< std::uint64_t >();
+		if ( stored != n ) {
+			itkGenericExceptionMacro( << "checkpoint holds " << stored << " values where " << n << " were expected." );
+		}
+		this->ReadBytes( v, n * sizeof( T ) );
+	}
+
+	template< typename T >
+	void WriteVector( const std::vector< T >& v ) {
+		this->WriteArray( v.data(), v.size() );
+	}
+
+	template< typename T >
+	void ReadVector( std::vector< T >& v ) {
+		std::uint64_t n = this->Read< std::uint64_t >();
+		v.resize( n );
+		this->ReadBytes( v.data(), n * sizeof( T ) );
+	}
+
+	void WriteString( const std::string& s ) {
+		this->WriteArray( s.data(), s.size() );
+	}
+
+	std::string ReadString() {
+		std::vector< char > chars;
+		this->ReadVector( chars );
+		return std::string( chars.begin(), chars.end() );
+	}
+
+	/** Write the geometry and the pixels of a scalar image */
+	template< typename TImage >
+	void WriteImage( const TImage* image );
+
+	/** Read an image written by WriteImage into an allocated image of the same size */
+	template< typename TImage >
+	void ReadImage( TImage* image );
+
+	/** Read an image written by WriteImage into a new image */
+	template< typename TImage >
+	typename TImage::Pointer ReadImage();
+
+	/** Store the snapshot. Returns false if the file could not be written */
+	bool Save( const std::string& filename ) const;
+
+	/** Load a snapshot stored by Save() and rewind it. Returns false if the
+	 *  file is missing, truncated, corrupted or of another version */
+	bool Load( const std::string& filename );
+
+private:
+	/** Layout of the files written by Save(), followed by the buffer */
+	struct FileHeader {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t reserved;
+		std::uint64_t size;
+		std::uint64_t checksum;
+	};
+	static const std::uint32_t FileVersion = 1;
+
+	void WriteBytes( const void* data, size_t n ) {
+		const char* c = static_cast< const char* >( data );
+		this->m_Buffer.insert( this->m_Buffer.end(), c, c + n );
+	}
+
+	void ReadBytes( void* data, size_t n ) {
+		if ( this->m_Position + n > this->m_Buffer.size() ) {
+			itkGenericExceptionMacro( << "unexpected end of checkpoint." );
+		}
+		std::memcpy( data, this->m_Buffer.data() + this->m_Position, n );
+		this->m_Position += n;
+	}
+
+	template< typename TImage >
+	void ReadGeometry( typename TImage::SizeType& size, typename TImage::PointType& origin,
+	                   typename TImage::SpacingType& spacing, typename TImage::DirectionType& direction );
+
+	BufferType m_Buffer;
+	size_t m_Position;
+};
+
+template< typename TImage >
+void
+CheckpointFile
+::WriteImage( const TImage* image ) {
+	const unsigned int Dimension = TImage::ImageDimension;
+	typename TImage::SizeType size = image->GetLargestPossibleRegion().GetSize();
+	for( unsigned int i = 0; i < Dimension; i++ ) {
+		this->Write< std::uint64_t >( size[i] );
+		this->Write< double >( image->GetOrigin()[i] );
+		this->Write< double >( image->GetSpacing()[i] );
+		for( unsigned int j = 0; j < Dimension; j++ ) {
+			this->Write< double >( image->GetDirection()(i, j) );
+		}
+	}
+	this->WriteArray( image->GetBufferPointer(), image->GetLargestPossibleRegion().GetNumberOfPixels() );
+}
+
+template< typename TImage >
+void
+CheckpointFile
+::ReadGeometry( typename TImage::SizeType& size, typename TImage::PointType& origin,
+                typename TImage::SpacingType& spacing, typename TImage::DirectionType& direction ) {
+	const unsigned int Dimension = TImage::ImageDimension;
+	for( unsigned int i = 0; i < Dimension; i++ ) {
+		size[i] = this->Read< std::uint64_t >();
+		origin[i] = this->Read< double >();
+		spacing[i] = this->Read< double >();
+		for( unsigned int j = 0; j < Dimension; j++ ) {
+			direction(i, j) = this->Read< double >();
+		}
+	}
+}
+
+template< typename TImage >
+void
+CheckpointFile
+::ReadImage( TImage* image ) {
+	typename TImage::SizeType size;
+	typename TImage::PointType origin;
+	typename TImage::SpacingType spacing;
+	typename TImage::DirectionType direction;
+	this->ReadGeometry< TImage >( size, origin, spacing, direction );
+
+	if ( size != image->GetLargestPossibleRegion().GetSize() ) {
+		itkGenericExceptionMacro( << "checkpoint image of size " << size << " does not match the grid of size "
+				<< image->GetLargestPossibleRegion().GetSize() << "." );
+	}
+	this->ReadArray( image->GetBufferPointer(), image->GetLargestPossibleRegion().GetNumberOfPixels() );
+	image->Modified();
+}
+
+template< typename TImage >
+typename TImage::Pointer
+CheckpointFile
+::ReadImage() {
+	typename TImage::SizeType size;
+	typename TImage::PointType origin;
+	typename TImage::SpacingType spacing;
+	typename TImage::DirectionType direction;
+	this->ReadGeometry< TImage >( size, origin, spacing, direction );
+
+	typename TImage::Pointer image = TImage::New();
+	image->SetRegions( size );
+	image->SetOrigin( origin );
+	image->SetSpacing( spacing );
+	image->SetDirection( direction );
+	image->Allocate();
+	this->ReadArray( image->GetBufferPointer(), image->GetLargestPossibleRegion().GetNumberOfPixels() );
+	return image;
+}
+
+inline bool
+CheckpointFile
+::Save( const std::string& filename ) const {
+	FileHeader h;
+	std::memset( &h, 0, sizeof( FileHeader ) );
+	std::memcpy( h.magic, "RSTKCKP", 8 );
+	h.version = FileVersion;
+	h.size = this->m_Buffer.size();
+	h.checksum = HashBytes( this->m_Buffer.data(), this->m_Buffer.size() );
+
+	// Written aside under a unique name and renamed, so a preempted run always
+	// finds a complete snapshot and concurrent runs never share the temporary file
+	const void* data[2] = { &h, this->m_Buffer.data() };
+	size_t sizes[2] = { sizeof( FileHeader ), this->m_Buffer.size() };
+	return WriteFileAtomically( filename, data, sizes, 2 );
+}
+
+inline bool
+CheckpointFile
+::Load( const std::string& filename ) {
+	std::ifstream in( filename.c_str(), std::ios::binary | std::ios::ate );
+	if ( !in.good() ) {
+		return false;
+	}
+	std::uint64_t length = static_cast< std::uint64_t >( in.tellg() );
+	if ( length < sizeof( FileHeader ) ) {
+		return false;
+	}
+	in.seekg( 0, std::ios::beg );
+
+	FileHeader h;
+	in.read( reinterpret_cast< char* >( &h ), sizeof( FileHeader ) );
+	if ( !in.good() || std::memcmp( h.magic, "RSTKCKP", 8 ) != 0 || h.version != FileVersion ) {
+		return false;
+	}
+
+	// Check the stored size before allocating, a corrupted header must not
+	// trigger a huge allocation
+	if ( h.size != length - sizeof( FileHeader ) ) {
+		return false;
+	}
+
+	BufferType buffer( h.size );
+	in.read( buffer.data(), h.size );
+	if ( static_cast< std::uint64_t >( in.gcount() ) != h.size ||
+			HashBytes( buffer.data(), buffer.size() ) != h.checksum ) {
+		return false;
+	}
+
+	this->m_Buffer.swap( buffer );
+	this->m_Position = 0;
+	return true;
+}
+
+} // end namespace rstk
+
+#endif /* CHECKPOINTFILE_H_ */
@@ -0,0 +1,329 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <itkObject.h>
+#include <itkNumericTraits.h>
+#include <itkObjectFactory.h>
+#include <itkMultiThreader.h>
+
+namespace rstk {
+/** \class ThreadPool
+ *  \brief Persistent pool of worker threads with chunked work-stealing.
+ *
+ *  Workers are spawned once and sleep between calls to ParallelFor, so
+ *  repeated parallel sections (e.g. one per optimizer iteration) do not
+ *  pay for thread creation. The iteration range [0, total) is split in
+ *  one contiguous slice per worker; each worker consumes its slice in
+ *  chunks of ChunkSize items and, once exhausted, steals chunks from the
+ *  slices of the other workers. Chunks are claimed with an atomic
+ *  fetch-and-add, so no lock is taken on the hot path.
+ *
+ *  The calling thread acts as worker 0. ParallelFor is not reentrant:
+ *  it must not be called from inside a RangeFunction.
+ *
+ *  \ingroup RSTK
+ */
+class ThreadPool: public itk::Object {
+public:
+	typedef ThreadPool                      Self;
+	typedef itk::Object                     Superclass;
+	typedef itk::SmartPointer<Self>         Pointer;
+	typedef itk::SmartPointer< const Self > ConstPointer;
+
+	itkTypeMacro(ThreadPool, itk::Object);
+	itkNewMacro(Self);
+
+	/** Functor processing items [begin, end) in worker threadId */
+	typedef std::function< void (size_t, size_t, itk::ThreadIdType) > RangeFunction;
+
+	/** Timings of the last call to ParallelFor */
+	struct LoadStatistics {
+		double wall;        // elapsed time of the parallel section (s)
+		double maxBusy;     // busy time of the most loaded worker (s)
+		double meanBusy;    // average busy time across workers (s)
+		double imbalance;   // maxBusy / meanBusy, 1.0 is a perfect balance
+		size_t chunks;      // number of chunks processed
+		size_t stolen;      // number of chunks processed by a non-owner
+
+		LoadStatistics(): wall(0.0), maxBusy(0.0), meanBusy(0.0), imbalance(1.0), chunks(0), stolen(0) {}
+	};
+
+	void SetNumberOfThreads( itk::ThreadIdType n ) {
+		if ( n < 1 ) n = 1;
+		if ( n == this->m_NumberOfThreads ) return;
+		this->StopWorkers();
+		this->m_NumberOfThreads = n;
+		this->StartWorkers();
+		this->Modified();
+	}
+	itkGetConstMacro( NumberOfThreads, itk::ThreadIdType );
+
+	itkSetClampMacro( ChunkSize, size_t, 1, itk::NumericTraits<size_t>::max() );
+	itkGetConstMacro( ChunkSize, size_t );
+
+	const LoadStatistics& GetLastStatistics() const { return this->m_LastStatistics; }
+
+	/** Run func over [0, total) on all the workers and wait for completion.
+	 *  Exceptions thrown by any worker are rethrown in the calling thread. */
+	void ParallelFor( size_t total, const RangeFunction& func ) {
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point t0 = Clock::now();
+
+		size_t nworkers = this->m_NumberOfThreads;
+		size_t slice = (total + nworkers - 1) / nworkers;
+		for ( size_t w = 0; w < nworkers; w++ ) {
+			size_t b = std::min( w * slice, total );
+			this->m_Slots[w].next.store( b, std::memory_order_relaxed );
+			this->m_Slots[w].end = std::min( b + slice, total );
+			this->m_Slots[w].busy = 0.0;
+			this->m_Slots[w].chunks = 0;
+			this->m_Slots[w].stolen = 0;
+		}
+		this->m_Error = std::exception_ptr();
+
+		{
+			std::lock_guard<std::mutex> lock( this->m_Mutex );
+			this->m_Function = &func;
+			this->m_Pending = nworkers - 1;
+			this->m_Generation++;
+		}
+		this->m_Wake.notify_all();
+
+		this->Work( 0 );
+
+		{
+			std::unique_lock<std::mutex> lock( this->m_Mutex );
+			this->m_Done.wait( lock, [this]{ return this->m_Pending == 0; } );
+			this->m_Function = nullptr;
+		}
+
+		LoadStatistics s;
+		s.wall = std::chrono::duration<double>( Clock::now() - t0 ).count();
+		for ( size_t w = 0; w < nworkers; w++ ) {
+			s.maxBusy = std::max( s.maxBusy, this->m_Slots[w].busy );
+			s.meanBusy += this->m_Slots[w].busy;
+			s.chunks += this->m_Slots[w].chunks;
+			s.stolen += this->m_Slots[w].stolen;
+		}
+		s.meanBusy /= nworkers;
+		s.imbalance = ( s.meanBusy > 0.0 )?( s.maxBusy / s.meanBusy ):1.0;
+		this->m_LastStatistics = s;
+
+		if ( this->m_Error ) {
+			std::rethrow_exception( this->m_Error );
+		}
+	}
+
+	/** Reduce [0, total) to a single value. The range is split in blocks of
+	 *  ChunkSize items regardless of the number of threads; reduce( begin,
+	 *  end, threadId ) returns the value of one block, and the block values
+	 *  are folded with combine( accumulated, block ) in ascending block
+	 *  order, starting from identity. The result is thus bitwise identical
+	 *  for any number of threads and any scheduling of the chunks. */
+	template< typename TValue, typename TReduce, typename TCombine >
+	TValue ParallelReduce( size_t total, const TValue& identity, const TReduce& reduce, const TCombine& combine ) {
+		size_t block = this->m_ChunkSize;
+		size_t nblocks = ( total + block - 1 ) / block;
+		std::vector< TValue > partial( nblocks, identity );
+
+		this->ParallelFor( nblocks, [&]( size_t first, size_t last, itk::ThreadIdType tid ) {
+			for ( size_t b = first; b < last; b++ ) {
+				partial[b] = reduce( b * block, std::min( ( b + 1 ) * block, total ), tid );
+			}
+		});
+
+		TValue result = identity;
+		for ( size_t b = 0; b < nblocks; b++ ) {
+			result = combine( result, partial[b] );
+		}
+		return result;
+	}
+
+	/** ParallelReduce summing the block values */
+	template< typename TValue, typename TReduce >
+	TValue ParallelReduce( size_t total, const TValue& identity, const TReduce& reduce ) {
+		return this->ParallelReduce( total, identity, reduce,
+				[]( const TValue& a, const TValue& b ) { return a + b; } );
+	}
+
+protected:
+	ThreadPool(): m_NumberOfThreads(0), m_ChunkSize(64), m_Slots(nullptr), m_Generation(0), m_Pending(0),
+	              m_Stop(false), m_Function(nullptr) {
+		this->SetNumberOfThreads( itk::MultiThreader::GetGlobalDefaultNumberOfThreads() );
+	}
+
+	~ThreadPool() {
+		this->StopWorkers();
+	}
+
+	void PrintSelf( std::ostream & os, itk::Indent indent ) const override {
+		Superclass::PrintSelf( os, indent );
+		os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+		os << indent << "ChunkSize: " << this->m_ChunkSize << std::endl;
+	}
+
+private:
+	ThreadPool(const Self &);      //purposely not implemented
+	void operator=(const Self &);  //purposely not implemented
+
+	static const size_t CacheLineSize = 64;
+
+	/** Work queue of one worker, on its own cache line to avoid false sharing */
+	struct alignas( CacheLineSize ) WorkerSlot {
+		std::atomic<size_t> next;
+		size_t end;
+		double busy;
+		size_t chunks;
+		size_t stolen;
+	};
+
+	/** operator new[] does not honor over-aligned types before C++17, so
+	 *  the slots are placed on an aligned offset of a raw buffer */
+	void AllocateSlots( size_t n ) {
+		this->m_SlotBuffer.reset( new char[ n * sizeof( WorkerSlot ) + CacheLineSize ] );
+		size_t offset = reinterpret_cast< std::uintptr_t >( this->m_SlotBuffer.get() ) % CacheLineSize;
+		char* aligned = this->m_SlotBuffer.get() + ( ( offset == 0 )?0:( CacheLineSize - offset ) );
+		this->m_Slots = reinterpret_cast< WorkerSlot* >( aligned );
+		for ( size_t w = 0; w < n; w++ ) {
+			new ( this->m_Slots + w ) WorkerSlot();
+		}
+	}
+
+	void StartWorkers() {
+		this->AllocateSlots( this->m_NumberOfThreads );
+		this->m_Stop = false;
+		for ( itk::ThreadIdType w = 1; w < this->m_NumberOfThreads; w++ ) {
+			this->m_Workers.push_back( std::thread( &Self::WorkerLoop, this, w, this->m_Generation ) );
+		}
+	}
+
+	void StopWorkers() {
+		{
+			std::lock_guard<std::mutex> lock( this->m_Mutex );
+			this->m_Stop = true;
+		}
+		this->m_Wake.notify_all();
+		for ( size_t w = 0; w < this->m_Workers.size(); w++ ) {
+			this->m_Workers[w].join();
+		}
+		this->m_Workers.clear();
+	}
+
+	void WorkerLoop( itk::ThreadIdType tid, size_t seen ) {
+		while( true ) {
+			{
+				std::unique_lock<std::mutex> lock( this->m_Mutex );
+				this->m_Wake.wait( lock, [this, seen]{ return this->m_Stop || this->m_Generation != seen; } );
+				if ( this->m_Stop ) return;
+				seen = this->m_Generation;
+			}
+
+			this->Work( tid );
+
+			bool last;
+			{
+				std::lock_guard<std::mutex> lock( this->m_Mutex );
+				last = ( --this->m_Pending == 0 );
+			}
+			if ( last ) this->m_Done.notify_one();
+		}
+	}
+
+	/** Claim a chunk from the queue of worker victim */
+	bool Claim( size_t victim, size_t& begin, size_t& end ) {
+		WorkerSlot& s = this->m_Slots[victim];
+		if ( s.next.load( std::memory_order_relaxed ) >= s.end ) return false;
+		begin = s.next.fetch_add( this->m_ChunkSize, std::memory_order_relaxed );
+		if ( begin >= s.end ) return false;
+		end = std::min( begin + this->m_ChunkSize, s.end );
+		return true;
+	}
+
+	void Work( itk::ThreadIdType tid ) {
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point t0 = Clock::now();
+		WorkerSlot& self = this->m_Slots[tid];
+		size_t nworkers = this->m_NumberOfThreads;
+		size_t begin, end;
+
+		try {
+			while ( this->Claim( tid, begin, end ) ) {
+				(*this->m_Function)( begin, end, tid );
+				self.chunks++;
+			}
+			for ( size_t k = 1; k < nworkers; k++ ) {
+				size_t victim = ( tid + k ) % nworkers;
+				while ( this->Claim( victim, begin, end ) ) {
+					(*this->m_Function)( begin, end, tid );
+					self.chunks++;
+					self.stolen++;
+				}
+			}
+		} catch ( ... ) {
+			std::lock_guard<std::mutex> lock( this->m_ErrorMutex );
+			if ( !this->m_Error ) this->m_Error = std::current_exception();
+		}
+
+		self.busy = std::chrono::duration<double>( Clock::now() - t0 ).count();
+	}
+
+	itk::ThreadIdType                m_NumberOfThreads;
+	size_t                           m_ChunkSize;
+	std::vector< std::thread >       m_Workers;
+	std::unique_ptr< char[] >        m_SlotBuffer;
+	WorkerSlot*                      m_Slots;
+
+	std::mutex                       m_Mutex;
+	std::condition_variable          m_Wake;
+	std::condition_variable          m_Done;
+	size_t                           m_Generation;
+	size_t                           m_Pending;
+	bool                             m_Stop;
+	const RangeFunction*             m_Function;
+
+	std::mutex                       m_ErrorMutex;
+	std::exception_ptr               m_Error;
+	LoadStatistics                   m_LastStatistics;
+};
+
+} // end namespace rstk
+
+#endif /* THREADPOOL_H_ */
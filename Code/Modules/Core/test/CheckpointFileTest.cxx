@@ -0,0 +1,264 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+#include <itkImage.h>
+
+#include "CheckpointFile.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace rstk {
+
+/** Small deterministic run keeping the kind of state the optimizers save:
+ *  an image of coefficients, the step size and a window of past energies */
+class CheckpointRun {
+public:
+	typedef itk::Image< float, 3 >  ImageType;
+
+	CheckpointRun(): m_Iteration( 0 ), m_StepSize( 0.5 ) {
+		ImageType::SizeType size;
+		size[0] = 7; size[1] = 5; size[2] = 4;
+		m_Image = ImageType::New();
+		m_Image->SetRegions( size );
+		m_Image->Allocate();
+		float* u = m_Image->GetBufferPointer();
+		for ( size_t i = 0; i < this->GetNumberOfPixels(); i++ ) {
+			u[i] = static_cast< float >( ( i * 37 ) % 11 ) - 5.0f;
+		}
+	}
+
+	size_t GetNumberOfPixels() const { return m_Image->GetLargestPossibleRegion().GetNumberOfPixels(); }
+
+	void Step() {
+		float* u = m_Image->GetBufferPointer();
+		size_t n = this->GetNumberOfPixels();
+		std::vector< float > next( n );
+		double energy = 0.0;
+		for ( size_t i = 0; i < n; i++ ) {
+			float avg = 0.5f * ( u[( i + n - 1 ) % n] + u[( i + 1 ) % n] );
+			next[i] = u[i] + static_cast< float >( m_StepSize ) * ( avg - u[i] );
+			energy += next[i] * next[i];
+		}
+		std::copy( next.begin(), next.end(), u );
+
+		if ( !m_History.empty() && energy > m_History.back() ) {
+			m_StepSize *= 0.5;
+		}
+		m_History.push_back( energy );
+		if ( m_History.size() > 3 ) {
+			m_History.pop_front();
+		}
+		m_Iteration++;
+	}
+
+	void SaveState( CheckpointFile& f ) const {
+		f.Write( m_Iteration );
+		f.Write( m_StepSize );
+		std::vector< double > history( m_History.begin(), m_History.end() );
+		f.WriteVector( history );
+		f.WriteImage( m_Image.GetPointer() );
+	}
+
+	void LoadState( CheckpointFile& f ) {
+		f.Read( m_Iteration );
+		f.Read( m_StepSize );
+		std::vector< double > history;
+		f.ReadVector( history );
+		m_History.assign( history.begin(), history.end() );
+		f.ReadImage( m_Image.GetPointer() );
+	}
+
+	unsigned int m_Iteration;
+	double m_StepSize;
+	std::deque< double > m_History;
+	ImageType::Pointer m_Image;
+};
+
+class CheckpointFileTests : public ::testing::Test {
+public:
+	virtual void SetUp() {
+		m_filename = "checkpointfile_test.ckp";
+		std::remove( m_filename.c_str() );
+	}
+
+	virtual void TearDown() {
+		std::remove( m_filename.c_str() );
+	}
+
+	std::vector< char > ReadBytes() const {
+		std::ifstream in( m_filename.c_str(), std::ios::binary );
+		return std::vector< char >( std::istreambuf_iterator< char >( in ), std::istreambuf_iterator< char >() );
+	}
+
+	void WriteBytes( const std::vector< char >& bytes, size_t n ) const {
+		std::ofstream out( m_filename.c_str(), std::ios::binary | std::ios::trunc );
+		out.write( bytes.data(), n );
+	}
+
+	/** Save a snapshot of a few values and return its bytes on disk */
+	std::vector< char > SaveSample() const {
+		CheckpointFile f;
+		f.Write< double >( 1.5 );
+		f.WriteString( "checkpoint" );
+		std::vector< float > v( 100 );
+		for ( size_t i = 0; i < v.size(); i++ ) v[i] = 0.25f * i;
+		f.WriteVector( v );
+		EXPECT_TRUE( f.Save( m_filename ) );
+		return this->ReadBytes();
+	}
+
+	std::string m_filename;
+};
+
+TEST_F( CheckpointFileTests, SaveAndLoad ) {
+	std::vector< char > bytes = this->SaveSample();
+	ASSERT_FALSE( bytes.empty() );
+
+	CheckpointFile f;
+	ASSERT_TRUE( f.Load( m_filename ) );
+	EXPECT_EQ( 1.5, f.Read< double >() );
+	EXPECT_EQ( "checkpoint", f.ReadString() );
+	std::vector< float > v;
+	f.ReadVector( v );
+	ASSERT_EQ( 100u, v.size() );
+	for ( size_t i = 0; i < v.size(); i++ ) {
+		EXPECT_EQ( 0.25f * i, v[i] );
+	}
+	EXPECT_TRUE( f.IsAtEnd() );
+	EXPECT_THROW( f.Read< double >(), itk::ExceptionObject );
+}
+
+TEST_F( CheckpointFileTests, ContinueRunIdentically ) {
+	const unsigned int total = 12, saved = 5;
+
+	CheckpointRun reference;
+	for ( unsigned int i = 0; i < total; i++ ) reference.Step();
+
+	{
+		CheckpointRun interrupted;
+		for ( unsigned int i = 0; i < saved; i++ ) interrupted.Step();
+		CheckpointFile f;
+		interrupted.SaveState( f );
+		ASSERT_TRUE( f.Save( m_filename ) );
+	}
+
+	CheckpointRun resumed;
+	CheckpointFile f;
+	ASSERT_TRUE( f.Load( m_filename ) );
+	resumed.LoadState( f );
+	EXPECT_TRUE( f.IsAtEnd() );
+	EXPECT_EQ( saved, resumed.m_Iteration );
+	for ( unsigned int i = saved; i < total; i++ ) resumed.Step();
+
+	EXPECT_EQ( reference.m_Iteration, resumed.m_Iteration );
+	EXPECT_EQ( reference.m_StepSize, resumed.m_StepSize );
+	EXPECT_EQ( reference.m_History, resumed.m_History );
+	EXPECT_EQ( 0, std::memcmp( reference.m_Image->GetBufferPointer(), resumed.m_Image->GetBufferPointer(),
+	                           reference.GetNumberOfPixels() * sizeof( float ) ) );
+}
+
+TEST_F( CheckpointFileTests, RejectsTruncatedFiles ) {
+	std::vector< char > bytes = this->SaveSample();
+
+	CheckpointFile f;
+	f.Write< int >( 7 );
+	size_t lengths[] = { 0, 4, 24, bytes.size() / 2, bytes.size() - 1 };
+	for ( size_t k = 0; k < 5; k++ ) {
+		this->WriteBytes( bytes, lengths[k] );
+		EXPECT_FALSE( f.Load( m_filename ) ) << "truncated to " << lengths[k] << " bytes";
+	}
+
+	// A failed load leaves the snapshot untouched
+	EXPECT_EQ( sizeof( int ), f.GetSize() );
+	EXPECT_EQ( 7, f.Read< int >() );
+
+	std::remove( m_filename.c_str() );
+	EXPECT_FALSE( f.Load( m_filename ) );
+}
+
+TEST_F( CheckpointFileTests, RejectsCorruptedFiles ) {
+	std::vector< char > bytes = this->SaveSample();
+	CheckpointFile f;
+
+	// Magic, version, stored size, checksum and payload
+	size_t offsets[] = { 0, 8, 16, 24, 40, bytes.size() - 1 };
+	for ( size_t k = 0; k < 6; k++ ) {
+		std::vector< char > corrupted( bytes );
+		corrupted[offsets[k]] ^= 0x20;
+		this->WriteBytes( corrupted, corrupted.size() );
+		EXPECT_FALSE( f.Load( m_filename ) ) << "byte " << offsets[k] << " flipped";
+	}
+
+	// A trailing byte does not match the stored size either
+	std::vector< char > longer( bytes );
+	longer.push_back( 0 );
+	this->WriteBytes( longer, longer.size() );
+	EXPECT_FALSE( f.Load( m_filename ) );
+
+	this->WriteBytes( bytes, bytes.size() );
+	EXPECT_TRUE( f.Load( m_filename ) );
+}
+
+TEST_F( CheckpointFileTests, SaveReplacesWithoutLeftovers ) {
+	this->SaveSample();
+
+	CheckpointFile f;
+	f.Write< int >( 3 );
+	ASSERT_TRUE( f.Save( m_filename ) );
+	ASSERT_TRUE( f.Load( m_filename ) );
+	EXPECT_EQ( 3, f.Read< int >() );
+
+	// Writing into a missing directory fails
+	EXPECT_FALSE( f.Save( "checkpointfile_missing_dir/test.ckp" ) );
+
+	// No temporary file is left next to the snapshot
+	DIR* dir = opendir( "." );
+	ASSERT_TRUE( dir != NULL );
+	std::string prefix = m_filename + ".";
+	while ( struct dirent* entry = readdir( dir ) ) {
+		EXPECT_NE( 0, std::strncmp( entry->d_name, prefix.c_str(), prefix.size() ) ) << entry->d_name;
+	}
+	closedir( dir );
+}
+
+} // namespace rstk
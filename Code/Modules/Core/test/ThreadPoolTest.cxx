@@ -0,0 +1,216 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace rstk {
+
+class ThreadPoolTests : public ::testing::Test {
+public:
+	virtual void SetUp() {
+		m_pool = ThreadPool::New();
+		m_pool->SetNumberOfThreads( 4 );
+	}
+
+	/** Number of times each item of [0, total) is visited by one ParallelFor */
+	std::vector< int > Visit( size_t total ) {
+		std::vector< std::atomic< int > > hits( total );
+		for ( size_t i = 0; i < total; i++ ) hits[i] = 0;
+
+		m_pool->ParallelFor( total, [&]( size_t start, size_t stop, itk::ThreadIdType tid ) {
+			EXPECT_LT( tid, m_pool->GetNumberOfThreads() );
+			EXPECT_LE( start, stop );
+			EXPECT_LE( stop, total );
+			for ( size_t i = start; i < stop; i++ ) hits[i]++;
+		});
+
+		std::vector< int > out( total );
+		for ( size_t i = 0; i < total; i++ ) out[i] = hits[i];
+		return out;
+	}
+
+	ThreadPool::Pointer m_pool;
+};
+
+TEST_F( ThreadPoolTests, EveryItemOnce ) {
+	size_t totals[] = { 1, 63, 64, 65, 1000, 100003 };
+	size_t chunks[] = { 1, 7, 64, 4096 };
+
+	for ( size_t c = 0; c < 4; c++ ) {
+		m_pool->SetChunkSize( chunks[c] );
+		for ( size_t t = 0; t < 6; t++ ) {
+			std::vector< int > hits = this->Visit( totals[t] );
+			for ( size_t i = 0; i < totals[t]; i++ ) {
+				ASSERT_EQ( 1, hits[i] ) << "item " << i << " of " << totals[t] << ", chunk size " << chunks[c];
+			}
+			EXPECT_LE( m_pool->GetLastStatistics().stolen, m_pool->GetLastStatistics().chunks );
+		}
+	}
+}
+
+TEST_F( ThreadPoolTests, ZeroItems ) {
+	size_t calls = 0;
+	m_pool->ParallelFor( 0, [&]( size_t, size_t, itk::ThreadIdType ) { calls++; } );
+	EXPECT_EQ( 0u, calls );
+	EXPECT_EQ( 0u, m_pool->GetLastStatistics().chunks );
+}
+
+TEST_F( ThreadPoolTests, FewerItemsThanWorkers ) {
+	m_pool->SetNumberOfThreads( 8 );
+	m_pool->SetChunkSize( 1 );
+	for ( size_t total = 1; total < 8; total++ ) {
+		std::vector< int > hits = this->Visit( total );
+		for ( size_t i = 0; i < total; i++ ) {
+			EXPECT_EQ( 1, hits[i] );
+		}
+		EXPECT_EQ( total, m_pool->GetLastStatistics().chunks );
+	}
+}
+
+TEST_F( ThreadPoolTests, SingleThread ) {
+	m_pool->SetNumberOfThreads( 1 );
+	std::vector< int > hits = this->Visit( 1000 );
+	for ( size_t i = 0; i < hits.size(); i++ ) {
+		EXPECT_EQ( 1, hits[i] );
+	}
+	EXPECT_EQ( 0u, m_pool->GetLastStatistics().stolen );
+}
+
+TEST_F( ThreadPoolTests, PartialSums ) {
+	size_t total = 12345;
+	std::vector< double > partial( m_pool->GetNumberOfThreads(), 0.0 );
+	for ( size_t rep = 0; rep < 50; rep++ ) {
+		std::fill( partial.begin(), partial.end(), 0.0 );
+		m_pool->ParallelFor( total, [&]( size_t start, size_t stop, itk::ThreadIdType tid ) {
+			for ( size_t i = start; i < stop; i++ ) partial[tid]+= i;
+		});
+		double sum = 0.0;
+		for ( size_t t = 0; t < partial.size(); t++ ) sum+= partial[t];
+		EXPECT_DOUBLE_EQ( 0.5 * total * ( total - 1 ), sum );
+	}
+}
+
+TEST_F( ThreadPoolTests, ReduceIsIndependentOfThreads ) {
+	size_t total = 100003;
+	std::vector< double > values( total );
+	for ( size_t i = 0; i < total; i++ ) values[i] = 1.0 / ( 1.0 + i ) * ( ( i % 3 )?1.0:-1e3 );
+
+	auto block = [&]( size_t start, size_t stop, itk::ThreadIdType ) {
+		double sum = 0.0;
+		for ( size_t i = start; i < stop; i++ ) sum+= values[i];
+		return sum;
+	};
+
+	size_t chunks[] = { 1, 7, 64 };
+	for ( size_t c = 0; c < 3; c++ ) {
+		m_pool->SetChunkSize( chunks[c] );
+
+		// Serial sum of the blocks, in ascending order
+		double expected = 0.0;
+		for ( size_t b = 0; b < total; b+= chunks[c] ) {
+			expected+= block( b, std::min( b + chunks[c], total ), 0 );
+		}
+
+		size_t threads[] = { 1, 3, 4, 8 };
+		for ( size_t t = 0; t < 4; t++ ) {
+			m_pool->SetNumberOfThreads( threads[t] );
+			for ( size_t rep = 0; rep < 10; rep++ ) {
+				double sum = m_pool->ParallelReduce( total, 0.0, block );
+				ASSERT_EQ( expected, sum ) << threads[t] << " threads, chunk size " << chunks[c];
+			}
+		}
+	}
+}
+
+TEST_F( ThreadPoolTests, ReduceWithCombine ) {
+	typedef std::pair< double, double > SumMax;
+	size_t total = 5000;
+	m_pool->SetChunkSize( 16 );
+	SumMax r = m_pool->ParallelReduce( total, SumMax( 0.0, 0.0 ),
+		[&]( size_t start, size_t stop, itk::ThreadIdType ) {
+			SumMax v( 0.0, 0.0 );
+			for ( size_t i = start; i < stop; i++ ) {
+				v.first+= i;
+				v.second = std::max( v.second, double( ( i * 37 ) % total ) );
+			}
+			return v;
+		},
+		[]( const SumMax& a, const SumMax& b ) {
+			return SumMax( a.first + b.first, std::max( a.second, b.second ) );
+		});
+	EXPECT_DOUBLE_EQ( 0.5 * total * ( total - 1 ), r.first );
+	EXPECT_DOUBLE_EQ( total - 1.0, r.second );
+
+	EXPECT_EQ( 1.5, m_pool->ParallelReduce( 0, 1.5, [&]( size_t, size_t, itk::ThreadIdType ) { return 2.0; } ) );
+}
+
+TEST_F( ThreadPoolTests, ExceptionIsRethrown ) {
+	m_pool->SetChunkSize( 10 );
+	EXPECT_THROW(
+		m_pool->ParallelFor( 1000, [&]( size_t start, size_t stop, itk::ThreadIdType ) {
+			if ( start <= 500 && 500 < stop ) throw std::runtime_error( "item 500" );
+		}), std::runtime_error );
+
+	// Every worker throws
+	EXPECT_THROW(
+		m_pool->ParallelFor( 1000, [&]( size_t, size_t, itk::ThreadIdType ) {
+			throw std::runtime_error( "all" );
+		}), std::runtime_error );
+
+	// The pool is still usable and the error is not reported again
+	std::vector< int > hits = this->Visit( 1000 );
+	for ( size_t i = 0; i < hits.size(); i++ ) {
+		EXPECT_EQ( 1, hits[i] );
+	}
+}
+
+TEST_F( ThreadPoolTests, ResizeBetweenCalls ) {
+	size_t sizes[] = { 3, 1, 6, 2 };
+	for ( size_t s = 0; s < 4; s++ ) {
+		m_pool->SetNumberOfThreads( sizes[s] );
+		EXPECT_EQ( sizes[s], m_pool->GetNumberOfThreads() );
+		std::vector< int > hits = this->Visit( 777 );
+		for ( size_t i = 0; i < hits.size(); i++ ) {
+			EXPECT_EQ( 1, hits[i] );
+		}
+	}
+}
+
+} // namespace rstk
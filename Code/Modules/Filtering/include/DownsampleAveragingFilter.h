@@ -36,6 +36,7 @@
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkSize.h>
 #include <itkDefaultConvertPixelTraits.h>
+#include <vector>
 
 namespace rstk
 {
@@ -245,6 +246,12 @@ protected:
   virtual void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
 		  itk::ThreadIdType threadId) override;
 
+  /** Fast path for grids sharing the direction cosines and related by an
+   * integer factor: the averaging window is separable, so it is computed
+   * with slice, row and column reductions on the raw interleaved buffers. */
+  void ThreadedSeparableGenerateData(const OutputImageRegionType & outputRegionForThread,
+		  itk::ThreadIdType threadId);
+
 private:
   DownsampleAveragingFilter(const Self &); //purposely not implemented
   void operator=(const Self &);      //purposely not implemented
@@ -262,6 +269,11 @@ private:
   IndexType       m_OutputStartIndex;     // output image start index
   size_t          m_NumberOfComponents;
   bool            m_UseReferenceImage;
+  bool            m_UseSeparable;         // take the separable fast path
+
+  /** Clamped averaging window along each axis, for each output index */
+  std::vector< long > m_WindowStart[ImageDimension];
+  std::vector< long > m_WindowLength[ImageDimension];
 
 };
 } // end namespace itk
@@ -36,6 +36,7 @@
 #include <itkSpecialCoordinatesImage.h>
 #include <itkDefaultConvertPixelTraits.h>
 #include <itkNumericTraitsVectorPixel.h>
+#include <algorithm>
 
 namespace rstk {
 /**
@@ -45,7 +46,8 @@ template<class TInputImage, class TOutputImage, class TPrecisionType>
 DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::DownsampleAveragingFilter() :
   m_UseReferenceImage(false),
   m_NumberOfComponents(0),
-  m_WindowN(0) {
+  m_WindowN(0),
+  m_UseSeparable(false) {
 	m_OutputOrigin.Fill(0.0);
 	m_OutputSpacing.Fill(1.0);
 	m_OutputDirection.SetIdentity();
@@ -134,6 +136,55 @@ void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::Befor
 	}
 	m_WindowN = tmpN;
 
+	// The separable path needs interleaved output buffers, aligned grids and integer ratios
+	InputImageConstPointer inputPtr = this->GetInput();
+	OutputImagePointer outputPtr = this->GetOutput();
+	m_UseSeparable = ( outputPtr->GetNumberOfComponentsPerPixel() == m_NumberOfComponents ) &&
+			( inputPtr->GetNumberOfComponentsPerPixel() == m_NumberOfComponents - 1 );
+	for (size_t i = 0; i < ImageDimension; i++) {
+		double ratio = outputPtr->GetSpacing()[i] / inputSpacing[i];
+		m_UseSeparable = m_UseSeparable && ( fabs( ratio - vnl_math_rnd( ratio ) ) < 1.0e-4 ) && ( vnl_math_rnd( ratio ) >= 1 );
+		for (size_t j = 0; j < ImageDimension; j++) {
+			m_UseSeparable = m_UseSeparable &&
+					( fabs( outputPtr->GetDirection()(i, j) - inputPtr->GetDirection()(i, j) ) < 1.0e-6 );
+		}
+	}
+
+	if (m_UseSeparable) {
+		// Same windows as ThreadedGenerateData, tabulated once per axis
+		OutputImageRegionType outRegion = outputPtr->GetLargestPossibleRegion();
+		PointType p;
+		IndexType inputIndex;
+		for (size_t i = 0; i < ImageDimension; i++) {
+			long offset = - static_cast<long>( vcl_floor( 0.5 * m_WindowSize[i] ) );
+			long wsize = static_cast<long>( m_WindowSize[i] );
+			m_WindowStart[i].resize( outRegion.GetSize()[i] );
+			m_WindowLength[i].resize( outRegion.GetSize()[i] );
+
+			IndexType index = outRegion.GetIndex();
+			for (size_t o = 0; o < outRegion.GetSize()[i]; o++) {
+				index[i] = outRegion.GetIndex()[i] + o;
+				outputPtr->TransformIndexToPhysicalPoint(index, p);
+				inputPtr->TransformPhysicalPointToIndex(p, inputIndex);
+
+				long start = inputIndex[i] + offset;
+				long size = wsize;
+				if (start < 0) {
+					size += start;
+					start = 0;
+				}
+				if (start + size > static_cast<long>(inputSize[i]) - 1) {
+					size = static_cast<long>(inputSize[i]) - start - 1;
+				}
+				if (size > wsize || size < 0) {
+					size = 0;
+				}
+				m_WindowStart[i][o] = start;
+				m_WindowLength[i][o] = size;
+			}
+		}
+	}
+
 	// find the actual number of threads
 	long nbOfThreads = this->GetNumberOfThreads();
 	if (itk::MultiThreader::GetGlobalMaximumNumberOfThreads() != 0) {
@@ -163,6 +214,11 @@ template<class TInputImage, class TOutputImage, class TPrecisionType>
 void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::ThreadedGenerateData(
 		const OutputImageRegionType & outputRegionForThread,
 		itk::ThreadIdType threadId) {
+	if (m_UseSeparable) {
+		this->ThreadedSeparableGenerateData(outputRegionForThread, threadId);
+		return;
+	}
+
 	// Get the output pointers
 	OutputImagePointer outputPtr = this->GetOutput();
 
@@ -297,6 +353,128 @@ void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::Threa
 	return;
 }
 
+/**
+ * ThreadedSeparableGenerateData
+ */
+template<class TInputImage, class TOutputImage, class TPrecisionType>
+void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::ThreadedSeparableGenerateData(
+		const OutputImageRegionType & outputRegionForThread,
+		itk::ThreadIdType threadId) {
+	OutputImagePointer outputPtr = this->GetOutput();
+	InputImageConstPointer inputPtr = this->GetInput();
+	typename MaskImageType::ConstPointer mask = this->GetMaskImage();
+
+	itk::ProgressReporter progress(this, threadId,
+			outputRegionForThread.GetNumberOfPixels());
+
+	const size_t nin = m_NumberOfComponents - 1;
+	const size_t nout = m_NumberOfComponents;
+	const IndexType outStart = outputPtr->GetLargestPossibleRegion().GetIndex();
+	const IndexType& regStart = outputRegionForThread.GetIndex();
+	const SizeType& regSize = outputRegionForThread.GetSize();
+
+	// Input rows and columns covered by the windows of this region
+	long lo[ImageDimension], hi[ImageDimension];
+	const long* wstart[ImageDimension];
+	const long* wlength[ImageDimension];
+	for (size_t i = 0; i < ImageDimension; i++) {
+		wstart[i] = &m_WindowStart[i][regStart[i] - outStart[i]];
+		wlength[i] = &m_WindowLength[i][regStart[i] - outStart[i]];
+		lo[i] = itk::NumericTraits<long>::max();
+		hi[i] = 0;
+		for (size_t o = 0; o < regSize[i]; o++) {
+			if (wlength[i][o] > 0) {
+				lo[i] = std::min(lo[i], wstart[i][o]);
+				hi[i] = std::max(hi[i], wstart[i][o] + wlength[i][o]);
+			}
+		}
+		lo[i] = std::min(lo[i], hi[i]);
+	}
+
+	const InputPixelValueType* inBuffer = inputPtr->GetBufferPointer();
+	const SizeType inSize = inputPtr->GetBufferedRegion().GetSize();
+	const IndexType inStart = inputPtr->GetBufferedRegion().GetIndex();
+	const size_t rowStride = inSize[0] * nin;
+	const size_t sliceStride = inSize[1] * rowStride;
+
+	const size_t nx = regSize[0];
+	const size_t planeWidth = (hi[0] - lo[0]) * nin;
+	const size_t planeRows = hi[1] - lo[1];
+
+	// Work space, allocated once per thread
+	std::vector<TPrecisionType> plane(planeWidth * planeRows);  // sum of the window slices
+	std::vector<TPrecisionType> rows(nx * nin * planeRows);     // plane summed along x
+	std::vector<TPrecisionType> acc(nin);
+
+	IndexType index = regStart;
+	for (size_t oz = 0; oz < regSize[2]; oz++) {
+		index[2] = regStart[2] + oz;
+
+		// Slice reduction
+		std::fill(plane.begin(), plane.end(), 0.0);
+		for (long z = wstart[2][oz]; z < wstart[2][oz] + wlength[2][oz]; z++) {
+			for (size_t y = 0; y < planeRows; y++) {
+				const InputPixelValueType* src = inBuffer + (z - inStart[2]) * sliceStride +
+						(lo[1] + y - inStart[1]) * rowStride + (lo[0] - inStart[0]) * nin;
+				TPrecisionType* dst = &plane[y * planeWidth];
+				for (size_t k = 0; k < planeWidth; k++) {
+					dst[k] += src[k];
+				}
+			}
+		}
+
+		// Row reduction
+		for (size_t y = 0; y < planeRows; y++) {
+			for (size_t ox = 0; ox < nx; ox++) {
+				TPrecisionType* dst = &rows[(y * nx + ox) * nin];
+				std::fill(dst, dst + nin, 0.0);
+				if (wlength[0][ox] == 0) {
+					continue;
+				}
+				const TPrecisionType* src = &plane[y * planeWidth + (wstart[0][ox] - lo[0]) * nin];
+				for (long x = 0; x < wlength[0][ox]; x++, src += nin) {
+					for (size_t c = 0; c < nin; c++) {
+						dst[c] += src[c];
+					}
+				}
+			}
+		}
+
+		// Column reduction, normalization and masking
+		for (size_t oy = 0; oy < regSize[1]; oy++) {
+			index[1] = regStart[1] + oy;
+			index[0] = regStart[0];
+			OutputPixelValueType* out = outputPtr->GetBufferPointer() + outputPtr->ComputeOffset(index) * nout;
+			const OutputPixelValueType* msk = mask.IsNotNull()?
+					(mask->GetBufferPointer() + mask->ComputeOffset(index)):ITK_NULLPTR;
+
+			for (size_t ox = 0; ox < nx; ox++, out += nout) {
+				size_t N = wlength[0][ox] * wlength[1][oy] * wlength[2][oz];
+				std::fill(acc.begin(), acc.end(), 0.0);
+				for (long y = wstart[1][oy]; y < wstart[1][oy] + wlength[1][oy]; y++) {
+					const TPrecisionType* src = &rows[((y - lo[1]) * nx + ox) * nin];
+					for (size_t c = 0; c < nin; c++) {
+						acc[c] += src[c];
+					}
+				}
+
+				bool any = false;
+				for (size_t c = 0; c < nin; c++) {
+					out[c] = (N > 0)?static_cast<OutputPixelValueType>(acc[c] / N):0.0;
+					any = any || ((c + 1 < nin) && (out[c] > 0.0));
+				}
+				out[nin] = 0.0;
+
+				if (msk != ITK_NULLPTR && msk[ox] > 0.0) {
+					std::fill(out, out + nout, 0.0);
+					out[nin] = any?1.0:0.0;
+				}
+				progress.CompletedPixel();
+			}
+		}
+	}
+}
+
 /**
  * Inform pipeline of necessary input image region
  *
@@ -30,9 +30,23 @@
 #include <itkImageBase.h>
 #include <itkImageSource.h>
 #include <itkVectorImage.h>
-#include <itkTriangleMeshToBinaryImageFilter.h>
+
+#include "ThreadPool.h"
+#include "PartialVolumeRasterizer.h"
 
 namespace rstk {
+/** \class MultilabelBinarizeMeshFilter
+ *  \brief Labels the voxels of a grid by the nested surfaces that contain
+ *  their centers.
+ *
+ *  All the surfaces are rasterized in one pass by a scanline
+ *  PartialVolumeRasterizer with one sample per voxel, processing z slabs in
+ *  parallel. The label image and the one-hot component image are written
+ *  directly, voxels inside several surfaces taking the lowest mesh index.
+ *
+ *  \ingroup Filtering
+ *  \ingroup RSTK
+ */
 template< typename TInputMesh, typename TOutputPixelType = unsigned char, unsigned int VDimension = 3 >
 class MultilabelBinarizeMeshFilter: public itk::ImageSource< itk::VectorImage< TOutputPixelType, VDimension > >
 {
@@ -83,9 +97,9 @@ public:
 
 	  typedef itk::Image< OutputPixelValueType, VDimension >      OutputComponentType;
 	  typedef typename OutputComponentType::Pointer               OutputComponentPointer;
-	  typedef itk::TriangleMeshToBinaryImageFilter
-				          <InputMeshType, OutputComponentType>	  BinarizeMeshFilterType;
-	  typedef typename BinarizeMeshFilterType::Pointer            BinarizeMeshFilterPointer;
+	  typedef PartialVolumeRasterizer< double >                   RasterizerType;
+	  typedef typename RasterizerType::Pointer                    RasterizerPointer;
+	  typedef typename RasterizerType::IdentifierType             IdentifierType;
 
 	  typedef itk::ProcessObject                                  ProcessObject;
 
@@ -124,25 +138,19 @@ public:
 	  itkGetObjectMacro(OutputSegmentation, OutputComponentType)
 	  itkGetConstObjectMacro(OutputSegmentation, OutputComponentType)
 
-	  struct ThreadStruct { Pointer Filter; };
-	  itk::MultiThreader * GetPreMultiThreader() const { return m_PreThreader; }
+	  itkSetObjectMacro(ThreadPool, ThreadPool);
+	  itkGetObjectMacro(ThreadPool, ThreadPool);
 protected:
-	  void BeforeThreadedGenerateData() override;
-	  void ThreadedGenerateData(const RegionType & inputRegionForThread, itk::ThreadIdType threadId) override;
+	  void GenerateData() override;
 	  virtual void GenerateOutputInformation() override;
 
-	  static ITK_THREAD_RETURN_TYPE BinarizeThreaderCallback(void *arg);
-	  void BinarizeThreaded(size_t num);
-	  void SplitRequestedFilters(itk::ThreadIdType id, itk::ThreadIdType num, std::vector<size_t>& res);
-
 	  MultilabelBinarizeMeshFilter();
 	  ~MultilabelBinarizeMeshFilter() {}
 	  virtual void PrintSelf(std::ostream & os, itk::Indent indent) const override
 	  { Superclass::PrintSelf(os, indent); }
 
 		/** Support processing data in multiple threads. */
-		itk::MultiThreader::Pointer m_PreThreader;
-		itk::ThreadIdType           m_NumberOfThreads;
+		ThreadPool::Pointer         m_ThreadPool;
 private:
 	  MultilabelBinarizeMeshFilter(const Self &); //purposely not implemented
 	  void operator=(const Self &);                  //purposely not implemented
@@ -155,8 +163,12 @@ private:
 
 	  size_t m_NumberOfMeshes;
 	  size_t m_NumberOfRegions;
-	  std::vector< BinarizeMeshFilterPointer > m_Components;
 	  OutputComponentPointer m_OutputSegmentation;
+
+	  /** All the meshes, flattened for the rasterizer */
+	  std::vector< double > m_Coordinates[Dimension];
+	  std::vector< IdentifierType > m_Faces;
+	  std::vector< IdentifierType > m_FaceOffsets;
 }; // class
 
 } // namespace rstk
@@ -27,8 +27,8 @@
 #define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELBINARIZEMESHFILTER_HXX_
 
 #include "MultilabelBinarizeMeshFilter.h"
+#include <algorithm>
 #include <itkProcessObject.h>
-#include <itkImageRegionIterator.h>
 
 namespace rstk
 {
@@ -43,9 +43,6 @@ MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 	m_Spacing.Fill(0.0);
 	m_Origin.Fill(0.0);
 	m_Direction.GetVnlMatrix().set_identity();
-
-	this->m_PreThreader = itk::MultiThreader::New();
-	this->m_NumberOfThreads = this->m_PreThreader->GetNumberOfThreads();
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
@@ -79,13 +76,6 @@ MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 	output->SetNumberOfComponentsPerPixel(m_NumberOfRegions);
 	output->Allocate();
 
-
-	OutputPixelType zero;
-	zero.SetSize(m_NumberOfRegions);
-	zero.Fill(0);
-	zero[m_NumberOfMeshes] = 1;
-	output->FillBuffer(zero);
-
 	m_OutputSegmentation = OutputComponentType::New();
 	m_OutputSegmentation->SetLargestPossibleRegion(region); //
 	m_OutputSegmentation->SetBufferedRegion(region);        // set the region
@@ -94,134 +84,69 @@ MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 	m_OutputSegmentation->SetOrigin(m_Origin);              //   and origin
 	m_OutputSegmentation->SetDirection(m_Direction);        // direction cosines
 	m_OutputSegmentation->Allocate();
-	m_OutputSegmentation->FillBuffer(m_NumberOfMeshes);
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
 void
 MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::BinarizeThreaded(size_t num) {
-	this->m_Components[num]->Update();
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-void
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::SplitRequestedFilters(itk::ThreadIdType id, itk::ThreadIdType num, std::vector<size_t>& res) {
-	size_t total = this->m_Components.size();
-
-	if (num > total)
-		itkExceptionMacro(<< "total number of threads overs number of filters")
-
-	res.push_back(id);
-
-	for(int rem = total; rem > num; ) {
-		size_t nextId = id + num;
-		if( nextId < total )
-			res.push_back(nextId);
-		else
-			return;
-
-		rem-=num;
-	}
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-ITK_THREAD_RETURN_TYPE
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::BinarizeThreaderCallback(void *arg) {
-	ThreadStruct *str;
-	itk::ThreadIdType total, threadId, threadCount;
-
-	threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
-	threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
-	str = (ThreadStruct *)(((itk::MultiThreader::ThreadInfoStruct *)(arg))->UserData);
-
-	std::vector<size_t> filters;
-	str->Filter->SplitRequestedFilters(threadId, threadCount, filters);
-
-	for (size_t id = 0; id < filters.size(); id++)
-		str->Filter->BinarizeThreaded(filters[id]);
-
-	return ITK_THREAD_RETURN_VALUE;
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-void
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::BeforeThreadedGenerateData() {
-	// Get the input and output pointers
+::GenerateData() {
 	OutputImagePointer output = this->GetOutput();
-	m_Components.clear();
 
-	// find the actual number of threads
-	m_NumberOfThreads = this->GetNumberOfThreads();
-	if ( itk::MultiThreader::GetGlobalMaximumNumberOfThreads() != 0 ) {
-		m_NumberOfThreads = vnl_math_min( this->GetNumberOfThreads(), itk::MultiThreader::GetGlobalMaximumNumberOfThreads() );
+	// Flatten all the meshes: point ids are shifted by the points of previous meshes
+	for( size_t d = 0; d < Dimension; d++ ) {
+		m_Coordinates[d].clear();
 	}
+	m_Faces.clear();
+	m_FaceOffsets.assign(1, 0);
+
+	for( size_t idx = 0; idx < m_NumberOfMeshes; idx++ ) {
+		const InputMeshType* mesh = this->GetInput(idx);
+		size_t offset = m_Coordinates[0].size();
+
+		typename InputPointsContainer::ConstIterator p_it = mesh->GetPoints()->Begin();
+		typename InputPointsContainer::ConstIterator p_end = mesh->GetPoints()->End();
+		size_t npoints = 0;
+		for( ; p_it != p_end; ++p_it ) {
+			npoints = std::max( npoints, static_cast<size_t>( p_it.Index() ) + 1 );
+		}
+		for( size_t d = 0; d < Dimension; d++ ) {
+			m_Coordinates[d].resize( offset + npoints, 0.0 );
+		}
+		for( p_it = mesh->GetPoints()->Begin(); p_it != p_end; ++p_it ) {
+			for( size_t d = 0; d < Dimension; d++ ) {
+				m_Coordinates[d][offset + p_it.Index()] = p_it.Value()[d];
+			}
+		}
 
-	long nbOfThreads = (m_NumberOfMeshes > m_NumberOfThreads)?m_NumberOfThreads:m_NumberOfMeshes;
-	struct ThreadStruct str;
-	str.Filter = this;
-
-	for (size_t idx = 0; idx < m_NumberOfMeshes; idx++ ) {
-		BinarizeMeshFilterPointer meshFilter = BinarizeMeshFilterType::New();
-		meshFilter->SetSpacing( m_Spacing );
-		meshFilter->SetDirection( m_Direction );
-		meshFilter->SetOrigin( m_Origin );
-		meshFilter->SetSize( m_Size );
-		meshFilter->SetInput( GetInput(idx) );
-		m_Components.push_back(meshFilter);
+		typename InputMeshType::CellsContainer::ConstIterator c_it = mesh->GetCells()->Begin();
+		for( ; c_it != mesh->GetCells()->End(); ++c_it ) {
+			const CellType* cell = c_it.Value();
+			if ( cell->GetNumberOfPoints() != 3 ) {
+				continue;
+			}
+			typename CellType::PointIdConstIterator pit = cell->PointIdsBegin();
+			for( size_t k = 0; k < 3; ++pit, k++ ) {
+				m_Faces.push_back( offset + *pit );
+			}
+		}
+		m_FaceOffsets.push_back( m_Faces.size() / 3 );
 	}
 
-	this->GetPreMultiThreader()->SetNumberOfThreads( nbOfThreads );
-	this->GetPreMultiThreader()->SetSingleMethod( this->BinarizeThreaderCallback, &str );
-	this->GetPreMultiThreader()->SingleMethodExecute();
-
-	// number of threads can be constrained by the region size, so call the
-	// SplitRequestedRegion
-	// to get the real number of threads which will be used
-	RegionType splitRegion;  // dummy region - just to call the following method
-	nbOfThreads = this->SplitRequestedRegion(0, m_NumberOfThreads, splitRegion);
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-void
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::ThreadedGenerateData(const RegionType & inputRegionForThread, itk::ThreadIdType threadId) {
-	size_t nPix = inputRegionForThread.GetNumberOfPixels();
-	itk::ProgressReporter progress( this, threadId, nPix );
-
-	const OutputPixelValueType* compBuffer[m_NumberOfMeshes];
-	for( size_t comp = 0; comp < m_NumberOfMeshes; comp++ ) {
-		compBuffer[comp] = m_Components[comp]->GetOutput()->GetBufferPointer();
+	const double* coords[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		coords[d] = m_Coordinates[d].data();
 	}
-	OutputComponentPointer ref = m_OutputSegmentation;
-	OutputPixelValueType* segBuffer = ref->GetBufferPointer();
-
-	itk::ImageRegionIterator< OutputImageType > outIt( this->GetOutput(), inputRegionForThread );
- 	outIt.GoToBegin();
-
- 	size_t pix;
- 	OutputPixelValueType* outBuffer = this->GetOutput()->GetBufferPointer();
- 	OutputPixelValueType v;
- 	while ( !outIt.IsAtEnd() ) {
- 		pix = ref->ComputeOffset(outIt.GetIndex());
-
-		for( size_t comp = 0; comp < m_NumberOfMeshes; comp++ ) {
-			v = *( compBuffer[comp] + pix );
-
-			if( v > 0 ) {
-				*( outBuffer + pix * m_NumberOfRegions + comp ) = 1;
-				*( outBuffer + pix * m_NumberOfRegions + m_NumberOfMeshes ) = 0;
-				*( segBuffer + pix ) = comp;
-				break;
-			}
-		}
-		progress.CompletedPixel();
-		++outIt;
- 	}
 
+	// One sample at the center of each voxel, all the meshes at once
+	RasterizerPointer rasterizer = RasterizerType::New();
+	rasterizer->SetGeometry( output );
+	rasterizer->SetSamplingFactor( 1 );
+	if ( m_ThreadPool.IsNotNull() ) {
+		rasterizer->SetThreadPool( m_ThreadPool );
+	}
+	rasterizer->SetSurfaces( m_NumberOfMeshes, coords, m_Faces.data(), m_FaceOffsets.data() );
+	rasterizer->Update();
+	rasterizer->Rasterize( output->GetLargestPossibleRegion(), output.GetPointer(), m_OutputSegmentation.GetPointer() );
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
@@ -0,0 +1,206 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PARTIALVOLUMERASTERIZER_H_
+#define PARTIALVOLUMERASTERIZER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImageBase.h>
+
+#include "ThreadPool.h"
+
+namespace rstk {
+/** \class PartialVolumeRasterizer
+ *  \brief Computes the partial volume of every region delimited by a set of
+ *  nested, closed triangulated surfaces directly on the grid of a reference
+ *  image.
+ *
+ *  Each voxel is subsampled on the fly with SamplingFactor^3 points, so no
+ *  supersampled image is ever allocated. Samples are classified along rays
+ *  cast in the x direction: the crossings of the ray with the triangles are
+ *  sorted once and swept in order, toggling the parity of the surface they
+ *  belong to. A sample gets the label of the lowest surface it is inside of,
+ *  or the background label (the number of surfaces) if none. Rays running
+ *  exactly through an edge or a vertex are resolved with a half-open,
+ *  top-left rule, so they cross every closed surface an even number of
+ *  times even on meshes aligned with the grid.
+ *
+ *  Triangles are transformed to the continuous index space of the reference
+ *  grid and bucketed by z slab in Update(), which must be called whenever
+ *  the vertex coordinates change. Rasterize() then processes the slabs of
+ *  the requested region in parallel, so it can be used on sub-regions to
+ *  refresh a narrow band.
+ *
+ *  Surfaces are given as flat arrays, with the same layout as
+ *  FlatContourStore: one coordinate array per dimension, vertex id triplets
+ *  and per-surface offsets into the list of faces.
+ *
+ *  \ingroup Filtering
+ *  \ingroup RSTK
+ */
+template< typename TCoordRep = float >
+class PartialVolumeRasterizer: public itk::Object {
+public:
+	typedef PartialVolumeRasterizer          Self;
+	typedef itk::Object                      Superclass;
+	typedef itk::SmartPointer<Self>          Pointer;
+	typedef itk::SmartPointer< const Self >  ConstPointer;
+
+	itkTypeMacro(PartialVolumeRasterizer, itk::Object);
+	itkNewMacro(Self);
+
+	itkStaticConstMacro( Dimension, unsigned int, 3u );
+
+	typedef TCoordRep                                 CoordRepType;
+	typedef std::uint32_t                             IdentifierType;
+	typedef itk::ImageBase< Dimension >               GeometryType;
+	typedef typename GeometryType::ConstPointer       GeometryConstPointer;
+	typedef typename GeometryType::RegionType         RegionType;
+	typedef typename GeometryType::IndexType          IndexType;
+	typedef typename GeometryType::SizeType           SizeType;
+	typedef typename GeometryType::PointType          PointType;
+	typedef typename GeometryType::DirectionType      MatrixType;
+
+	/** Set the grid the surfaces are rasterized onto */
+	void SetGeometry( const GeometryType* reference );
+	itkGetConstObjectMacro( Geometry, GeometryType );
+
+	/** Set the surfaces. Arrays are not copied, they must outlive Update() */
+	void SetSurfaces( size_t nsurfaces, const CoordRepType* const coords[Dimension],
+	                  const IdentifierType* faces, const IdentifierType* faceOffsets );
+
+	/** Set the current coordinates of all the surfaces held by a FlatContourStore */
+	template< typename TStore >
+	void SetSurfaces( const TStore* store ) {
+		const CoordRepType* coords[Dimension];
+		for( size_t d = 0; d < Dimension; d++ ) {
+			coords[d] = store->GetCurrent(d).data();
+		}
+		this->SetSurfaces( store->GetNumberOfSurfaces(), coords,
+		                   store->GetFaces().data(), store->GetFaceOffsets().data() );
+	}
+
+	/** Read the vertex coordinates and rebuild the slab buckets */
+	void Update();
+
+	/** Number of labels, including the background */
+	size_t GetNumberOfLabels() const { return this->m_NumberOfSurfaces + 1; }
+
+	itkSetClampMacro( SamplingFactor, unsigned int, 1, 16 );
+	itkGetConstMacro( SamplingFactor, unsigned int );
+
+	itkSetObjectMacro( ThreadPool, ThreadPool );
+	itkGetObjectMacro( ThreadPool, ThreadPool );
+
+	/** Write the fraction of each label and the most represented label of each
+	 *  voxel in region. Outputs must share the geometry given in SetGeometry;
+	 *  fractions are written in the first GetNumberOfLabels() components and
+	 *  the remaining ones are zeroed. Any of the outputs can be null. */
+	template< typename TFractionsImage, typename TLabelImage >
+	void Rasterize( const RegionType& region, TFractionsImage* fractions, TLabelImage* labels ) const;
+
+	/** Label of an arbitrary physical point */
+	size_t GetLabel( const PointType& point ) const;
+
+protected:
+	PartialVolumeRasterizer();
+	~PartialVolumeRasterizer() {}
+
+	void PrintSelf( std::ostream & os, itk::Indent indent ) const override;
+
+	/** Triangle in continuous index space, ready for ray-casting along x */
+	struct Triangle {
+		double v[3][Dimension];    // vertices, counter-clockwise in the yz projection
+		double lo[Dimension];      // bounding box
+		double hi[Dimension];
+		IdentifierType sid;        // surface id
+	};
+
+	struct Crossing {
+		double x;
+		IdentifierType sid;
+		bool operator<( const Crossing& other ) const { return this->x < other.x; }
+	};
+
+	/** Per-thread work space of Rasterize */
+	struct ScanlineBuffer {
+		std::vector< size_t > bucket;         // triangles of the slab, sorted by y
+		std::vector< size_t > active;         // triangles overlapping the current row
+		std::vector< Crossing > crossings;
+		std::vector< unsigned char > parity;
+		std::vector< std::uint32_t > counts;  // row of per-label sample counts
+	};
+
+	/** Intersect the ray at (y, z) with a triangle, true if it is hit at x */
+	static bool Intersect( const Triangle& t, double y, double z, double& x );
+
+	/** Signed area of (a, b, (y, z)) in the yz plane, exactly antisymmetric in a and b */
+	static double EdgeFunction( const double* a, const double* b, double y, double z );
+
+	/** True if a ray lying exactly on the edge from a to b hits the triangle on its left */
+	static bool IsTopLeft( const double* a, const double* b );
+
+	/** Lowest surface with odd parity, or the background label */
+	size_t ParityToLabel( const std::vector< unsigned char >& parity ) const;
+
+	void ToContinuousIndex( const double* p, double* cidx ) const;
+
+	/** Count the samples of each label in all the rows of slab z within region,
+	 *  calling write(y, buf) after each row */
+	template< typename TRowWriter >
+	void RasterizeSlab( long z, const RegionType& region, ScanlineBuffer& buf, TRowWriter write ) const;
+
+private:
+	PartialVolumeRasterizer(const Self &);  //purposely not implemented
+	void operator=(const Self &);           //purposely not implemented
+
+	GeometryConstPointer m_Geometry;
+	MatrixType m_PhysicalPointToIndex;
+	PointType m_Origin;
+
+	size_t m_NumberOfSurfaces;
+	const CoordRepType* m_Coordinates[Dimension];
+	const IdentifierType* m_Faces;
+	const IdentifierType* m_FaceOffsets;
+
+	std::vector< Triangle > m_Triangles;
+	std::vector< size_t > m_SlabOffsets;   // CSR row pointers, one row per z slab
+	std::vector< size_t > m_SlabTriangles; // CSR columns, triangle ids
+
+	unsigned int m_SamplingFactor;
+	ThreadPool::Pointer m_ThreadPool;
+};
+
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "PartialVolumeRasterizer.hxx"
+#endif
+
+#endif /* PARTIALVOLUMERASTERIZER_H_ */
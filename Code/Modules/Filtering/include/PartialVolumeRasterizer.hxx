@@ -0,0 +1,420 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef PARTIALVOLUMERASTERIZER_HXX_
+#define PARTIALVOLUMERASTERIZER_HXX_
+
+#include "PartialVolumeRasterizer.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vnl/algo/vnl_matrix_inverse.h>
+
+namespace rstk {
+
+template< typename TCoordRep >
+PartialVolumeRasterizer<TCoordRep>
+::PartialVolumeRasterizer():
+ m_NumberOfSurfaces(0),
+ m_Faces(ITK_NULLPTR),
+ m_FaceOffsets(ITK_NULLPTR),
+ m_SamplingFactor(4) {
+	for( size_t d = 0; d < Dimension; d++ ) {
+		this->m_Coordinates[d] = ITK_NULLPTR;
+	}
+	this->m_PhysicalPointToIndex.SetIdentity();
+	this->m_Origin.Fill(0.0);
+}
+
+template< typename TCoordRep >
+void
+PartialVolumeRasterizer<TCoordRep>
+::SetGeometry( const GeometryType* reference ) {
+	this->m_Geometry = reference;
+	this->m_Origin = reference->GetOrigin();
+
+	MatrixType scale;
+	scale.Fill(0.0);
+	for( size_t d = 0; d < Dimension; d++ ) {
+		scale(d, d) = reference->GetSpacing()[d];
+	}
+	MatrixType toPhysical = reference->GetDirection() * scale;
+	this->m_PhysicalPointToIndex = vnl_matrix_inverse<double>( toPhysical.GetVnlMatrix() ).inverse();
+	this->Modified();
+}
+
+template< typename TCoordRep >
+void
+PartialVolumeRasterizer<TCoordRep>
+::SetSurfaces( size_t nsurfaces, const CoordRepType* const coords[Dimension],
+               const IdentifierType* faces, const IdentifierType* faceOffsets ) {
+	this->m_NumberOfSurfaces = nsurfaces;
+	for( size_t d = 0; d < Dimension; d++ ) {
+		this->m_Coordinates[d] = coords[d];
+	}
+	this->m_Faces = faces;
+	this->m_FaceOffsets = faceOffsets;
+	this->Modified();
+}
+
+template< typename TCoordRep >
+void
+PartialVolumeRasterizer<TCoordRep>
+::ToContinuousIndex( const double* p, double* cidx ) const {
+	for( size_t i = 0; i < Dimension; i++ ) {
+		cidx[i] = 0.0;
+		for( size_t j = 0; j < Dimension; j++ ) {
+			cidx[i] += this->m_PhysicalPointToIndex(i, j) * ( p[j] - this->m_Origin[j] );
+		}
+	}
+}
+
+template< typename TCoordRep >
+void
+PartialVolumeRasterizer<TCoordRep>
+::Update() {
+	if ( this->m_Geometry.IsNull() ) {
+		itkExceptionMacro(<< "reference geometry has not been set.");
+	}
+
+	if ( this->m_ThreadPool.IsNull() ) {
+		this->m_ThreadPool = ThreadPool::New();
+	}
+
+	this->m_Triangles.clear();
+	if ( this->m_NumberOfSurfaces > 0 ) {
+		this->m_Triangles.reserve( this->m_FaceOffsets[this->m_NumberOfSurfaces] );
+	}
+
+	Triangle t;
+	double p[Dimension], v[3][Dimension];
+	for( size_t sid = 0; sid < this->m_NumberOfSurfaces; sid++ ) {
+		t.sid = sid;
+		for( size_t f = this->m_FaceOffsets[sid]; f < this->m_FaceOffsets[sid + 1]; f++ ) {
+			for( size_t k = 0; k < 3; k++ ) {
+				for( size_t d = 0; d < Dimension; d++ ) {
+					p[d] = this->m_Coordinates[d][this->m_Faces[3 * f + k]];
+				}
+				this->ToContinuousIndex( p, v[k] );
+			}
+
+			// Triangles parallel to x are never crossed by the rays. Others are
+			// stored counter-clockwise, so that edge functions are positive inside
+			double det = EdgeFunction( v[0], v[1], v[2][1], v[2][2] );
+			if ( det == 0.0 ) {
+				continue;
+			}
+			size_t order[3] = { 0, 1, 2 };
+			if ( det < 0.0 ) {
+				std::swap( order[1], order[2] );
+			}
+
+			for( size_t d = 0; d < Dimension; d++ ) {
+				for( size_t k = 0; k < 3; k++ ) {
+					t.v[k][d] = v[order[k]][d];
+				}
+				t.lo[d] = std::min( v[0][d], std::min( v[1][d], v[2][d] ) );
+				t.hi[d] = std::max( v[0][d], std::max( v[1][d], v[2][d] ) );
+			}
+			this->m_Triangles.push_back( t );
+		}
+	}
+
+	// Bucket triangles by z slab, slab z spans [z - 0.5, z + 0.5)
+	const RegionType& largest = this->m_Geometry->GetLargestPossibleRegion();
+	long z0 = largest.GetIndex()[2];
+	long nz = largest.GetSize()[2];
+	std::vector< long > first( this->m_Triangles.size() ), last( this->m_Triangles.size() );
+
+	this->m_SlabOffsets.assign( nz + 1, 0 );
+	for( size_t i = 0; i < this->m_Triangles.size(); i++ ) {
+		first[i] = std::max( static_cast<long>( floor( this->m_Triangles[i].lo[2] + 0.5 ) ) - z0, 0L );
+		last[i] = std::min( static_cast<long>( floor( this->m_Triangles[i].hi[2] + 0.5 ) ) - z0, nz - 1 );
+		for( long z = first[i]; z <= last[i]; z++ ) {
+			this->m_SlabOffsets[z + 1]++;
+		}
+	}
+	for( long z = 0; z < nz; z++ ) {
+		this->m_SlabOffsets[z + 1] += this->m_SlabOffsets[z];
+	}
+
+	std::vector< size_t > fill( this->m_SlabOffsets.begin(), this->m_SlabOffsets.end() - 1 );
+	this->m_SlabTriangles.resize( this->m_SlabOffsets.back() );
+	for( size_t i = 0; i < this->m_Triangles.size(); i++ ) {
+		for( long z = first[i]; z <= last[i]; z++ ) {
+			this->m_SlabTriangles[fill[z]++] = i;
+		}
+	}
+}
+
+template< typename TCoordRep >
+double
+PartialVolumeRasterizer<TCoordRep>
+::EdgeFunction( const double* a, const double* b, double y, double z ) {
+	// Always evaluated from the lowest endpoint, so that the two triangles
+	// sharing an edge get exactly opposite values
+	if ( b[1] < a[1] || ( b[1] == a[1] && b[2] < a[2] ) ) {
+		return -EdgeFunction( b, a, y, z );
+	}
+	return ( b[1] - a[1] ) * ( z - a[2] ) - ( b[2] - a[2] ) * ( y - a[1] );
+}
+
+template< typename TCoordRep >
+bool
+PartialVolumeRasterizer<TCoordRep>
+::IsTopLeft( const double* a, const double* b ) {
+	// Equivalent to nudging the ray towards -y, then very slightly towards -z.
+	// The rule is antisymmetric, so a shared edge belongs to exactly one of
+	// its two triangles and a shared vertex to exactly one triangle of its fan.
+	double dz = b[2] - a[2];
+	return ( dz > 0.0 ) || ( dz == 0.0 && b[1] < a[1] );
+}
+
+template< typename TCoordRep >
+bool
+PartialVolumeRasterizer<TCoordRep>
+::Intersect( const Triangle& t, double y, double z, double& x ) {
+	double w[3];
+	for( size_t k = 0; k < 3; k++ ) {
+		const double* a = t.v[( k + 1 ) % 3];
+		const double* b = t.v[( k + 2 ) % 3];
+		w[k] = EdgeFunction( a, b, y, z );
+		if ( w[k] < 0.0 || ( w[k] == 0.0 && !IsTopLeft( a, b ) ) ) {
+			return false;
+		}
+	}
+
+	double sum = w[0] + w[1] + w[2];
+	if ( sum <= 0.0 ) {
+		return false;
+	}
+	x = ( w[0] * t.v[0][0] + w[1] * t.v[1][0] + w[2] * t.v[2][0] ) / sum;
+	return true;
+}
+
+template< typename TCoordRep >
+size_t
+PartialVolumeRasterizer<TCoordRep>
+::ParityToLabel( const std::vector< unsigned char >& parity ) const {
+	for( size_t sid = 0; sid < this->m_NumberOfSurfaces; sid++ ) {
+		if ( parity[sid] ) {
+			return sid;
+		}
+	}
+	return this->m_NumberOfSurfaces;
+}
+
+template< typename TCoordRep >
+template< typename TRowWriter >
+void
+PartialVolumeRasterizer<TCoordRep>
+::RasterizeSlab( long z, const RegionType& region, ScanlineBuffer& buf, TRowWriter write ) const {
+	const size_t s = this->m_SamplingFactor;
+	const size_t nlabels = this->GetNumberOfLabels();
+	const long x0 = region.GetIndex()[0];
+	const long y0 = region.GetIndex()[1];
+	const long nx = region.GetSize()[0];
+	const long ny = region.GetSize()[1];
+
+	// Sample offsets within the voxel
+	std::vector< double > offsets( s );
+	for( size_t k = 0; k < s; k++ ) {
+		offsets[k] = ( k + 0.5 ) / s - 0.5;
+	}
+
+	long slab = z - this->m_Geometry->GetLargestPossibleRegion().GetIndex()[2];
+	buf.bucket.assign( this->m_SlabTriangles.begin() + this->m_SlabOffsets[slab],
+	                   this->m_SlabTriangles.begin() + this->m_SlabOffsets[slab + 1] );
+	const std::vector< Triangle >& tris = this->m_Triangles;
+	std::sort( buf.bucket.begin(), buf.bucket.end(),
+			[&tris](size_t i, size_t j) { return tris[i].lo[1] < tris[j].lo[1]; } );
+
+	buf.active.clear();
+	buf.parity.resize( this->m_NumberOfSurfaces );
+	buf.counts.resize( nx * nlabels );
+
+	size_t next = 0;
+	for( long y = y0; y < y0 + ny; y++ ) {
+		double ylo = y - 0.5;
+		double yhi = y + 0.5;
+		while( next < buf.bucket.size() && tris[buf.bucket[next]].lo[1] <= yhi ) {
+			buf.active.push_back( buf.bucket[next++] );
+		}
+		buf.active.erase( std::remove_if( buf.active.begin(), buf.active.end(),
+				[&tris, ylo](size_t i) { return tris[i].hi[1] < ylo; } ), buf.active.end() );
+
+		std::fill( buf.counts.begin(), buf.counts.end(), 0 );
+		for( size_t ky = 0; ky < s; ky++ ) {
+			double yy = y + offsets[ky];
+			for( size_t kz = 0; kz < s; kz++ ) {
+				double zz = z + offsets[kz];
+
+				buf.crossings.clear();
+				Crossing c;
+				for( size_t a = 0; a < buf.active.size(); a++ ) {
+					const Triangle& t = tris[buf.active[a]];
+					if ( yy < t.lo[1] || yy > t.hi[1] || zz < t.lo[2] || zz > t.hi[2] ) {
+						continue;
+					}
+					if ( Intersect( t, yy, zz, c.x ) ) {
+						c.sid = t.sid;
+						buf.crossings.push_back( c );
+					}
+				}
+				std::sort( buf.crossings.begin(), buf.crossings.end() );
+
+				// Sweep the row from -inf, where every sample is background
+				std::fill( buf.parity.begin(), buf.parity.end(), 0 );
+				size_t label = this->m_NumberOfSurfaces;
+				size_t ci = 0;
+				for( long x = 0; x < nx; x++ ) {
+					std::uint32_t* row = &buf.counts[x * nlabels];
+					for( size_t kx = 0; kx < s; kx++ ) {
+						double xx = x0 + x + offsets[kx];
+						if ( ci < buf.crossings.size() && buf.crossings[ci].x < xx ) {
+							do {
+								buf.parity[buf.crossings[ci].sid] ^= 1;
+								ci++;
+							} while( ci < buf.crossings.size() && buf.crossings[ci].x < xx );
+							label = this->ParityToLabel( buf.parity );
+						}
+						row[label]++;
+					}
+				}
+			}
+		}
+		write( y, buf );
+	}
+}
+
+template< typename TCoordRep >
+template< typename TFractionsImage, typename TLabelImage >
+void
+PartialVolumeRasterizer<TCoordRep>
+::Rasterize( const RegionType& region, TFractionsImage* fractions, TLabelImage* labels ) const {
+	typedef typename TFractionsImage::InternalPixelType FractionType;
+	typedef typename TLabelImage::PixelType             LabelType;
+
+	if ( this->m_ThreadPool.IsNull() ) {
+		itkExceptionMacro(<< "rasterizer has not been updated.");
+	}
+	if ( !this->m_Geometry->GetLargestPossibleRegion().IsInside( region ) ) {
+		itkExceptionMacro(<< "region is outside the reference grid.");
+	}
+
+	size_t ncomps = 0;
+	if ( fractions != ITK_NULLPTR ) {
+		ncomps = fractions->GetNumberOfComponentsPerPixel();
+		if ( ncomps < this->GetNumberOfLabels() || !fractions->GetBufferedRegion().IsInside( region ) ) {
+			itkExceptionMacro(<< "fractions image does not fit the rasterized region.");
+		}
+	}
+	if ( labels != ITK_NULLPTR && !labels->GetBufferedRegion().IsInside( region ) ) {
+		itkExceptionMacro(<< "labels image does not fit the rasterized region.");
+	}
+
+	const size_t nlabels = this->GetNumberOfLabels();
+	const long nx = region.GetSize()[0];
+	const double norm = 1.0 / ( this->m_SamplingFactor * this->m_SamplingFactor * this->m_SamplingFactor );
+
+	std::vector< ScanlineBuffer > buffers( this->m_ThreadPool->GetNumberOfThreads() );
+	this->m_ThreadPool->ParallelFor( region.GetSize()[2],
+			[&](size_t start, size_t stop, itk::ThreadIdType tid) {
+		IndexType idx = region.GetIndex();
+		for( size_t k = start; k < stop; k++ ) {
+			idx[2] = region.GetIndex()[2] + k;
+			this->RasterizeSlab( idx[2], region, buffers[tid],
+					[&](long y, const ScanlineBuffer& buf) {
+				idx[1] = y;
+				for( long x = 0; x < nx; x++ ) {
+					const std::uint32_t* row = &buf.counts[x * nlabels];
+
+					if ( fractions != ITK_NULLPTR ) {
+						FractionType* px = fractions->GetBufferPointer() +
+								( fractions->ComputeOffset( idx ) + x ) * ncomps;
+						for( size_t c = 0; c < nlabels; c++ ) {
+							px[c] = static_cast<FractionType>( row[c] * norm );
+						}
+						std::fill( px + nlabels, px + ncomps, 0.0 );
+					}
+
+					if ( labels != ITK_NULLPTR ) {
+						size_t best = 0;
+						for( size_t c = 1; c < nlabels; c++ ) {
+							best = ( row[c] > row[best] )?c:best;
+						}
+						*( labels->GetBufferPointer() + labels->ComputeOffset( idx ) + x ) =
+								static_cast<LabelType>( best );
+					}
+				}
+			});
+		}
+	});
+}
+
+template< typename TCoordRep >
+size_t
+PartialVolumeRasterizer<TCoordRep>
+::GetLabel( const PointType& point ) const {
+	double p[Dimension], cidx[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		p[d] = point[d];
+	}
+	this->ToContinuousIndex( p, cidx );
+
+	// Use the slab bucket when the point falls within the grid
+	long slab = static_cast<long>( floor( cidx[2] + 0.5 ) ) - this->m_Geometry->GetLargestPossibleRegion().GetIndex()[2];
+	bool inGrid = ( slab >= 0 ) && ( slab + 1 < static_cast<long>( this->m_SlabOffsets.size() ) );
+	size_t ntris = inGrid?( this->m_SlabOffsets[slab + 1] - this->m_SlabOffsets[slab] ):this->m_Triangles.size();
+
+	// Count the crossings of the ray going towards +x. Crossings at the point
+	// itself are counted, as Rasterize only toggles parity past them
+	std::vector< unsigned char > parity( this->m_NumberOfSurfaces, 0 );
+	double x;
+	for( size_t i = 0; i < ntris; i++ ) {
+		const Triangle& t = this->m_Triangles[inGrid?this->m_SlabTriangles[this->m_SlabOffsets[slab] + i]:i];
+		if ( cidx[0] > t.hi[0] || cidx[1] < t.lo[1] || cidx[1] > t.hi[1] || cidx[2] < t.lo[2] || cidx[2] > t.hi[2] ) {
+			continue;
+		}
+		if ( Intersect( t, cidx[1], cidx[2], x ) && x >= cidx[0] ) {
+			parity[t.sid] ^= 1;
+		}
+	}
+	return this->ParityToLabel( parity );
+}
+
+template< typename TCoordRep >
+void
+PartialVolumeRasterizer<TCoordRep>
+::PrintSelf( std::ostream & os, itk::Indent indent ) const {
+	Superclass::PrintSelf( os, indent );
+	os << indent << "NumberOfSurfaces: " << this->m_NumberOfSurfaces << std::endl;
+	os << indent << "NumberOfTriangles: " << this->m_Triangles.size() << std::endl;
+	os << indent << "SamplingFactor: " << this->m_SamplingFactor << std::endl;
+}
+
+} // end namespace rstk
+
+#endif /* PARTIALVOLUMERASTERIZER_HXX_ */
@@ -0,0 +1,253 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <vector>
+
+#include <itkImage.h>
+#include <itkVectorImage.h>
+
+#include "PartialVolumeRasterizer.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace rstk {
+
+class PartialVolumeRasterizerTests : public ::testing::Test {
+public:
+	typedef PartialVolumeRasterizer< float >          RasterizerType;
+	typedef RasterizerType::IdentifierType            IdentifierType;
+	typedef itk::Image< unsigned char, 3u >           LabelImageType;
+	typedef itk::VectorImage< float, 3u >             FractionsImageType;
+
+	/** Flat mesh, with the layout expected by SetSurfaces */
+	struct Mesh {
+		std::vector< float > coords[3];
+		std::vector< IdentifierType > faces;
+		std::vector< IdentifierType > offsets;
+
+		IdentifierType AddVertex( double x, double y, double z ) {
+			coords[0].push_back( x );
+			coords[1].push_back( y );
+			coords[2].push_back( z );
+			return coords[0].size() - 1;
+		}
+
+		void AddFace( IdentifierType a, IdentifierType b, IdentifierType c ) {
+			faces.push_back( a );
+			faces.push_back( b );
+			faces.push_back( c );
+		}
+
+		/** Volume enclosed by the last surface, from the divergence theorem */
+		double Volume() const {
+			double vol = 0.0;
+			for( size_t f = offsets[offsets.size() - 2]; f < offsets.back(); f++ ) {
+				double p[3][3];
+				for( size_t k = 0; k < 3; k++ ) {
+					for( size_t d = 0; d < 3; d++ ) p[k][d] = coords[d][faces[3 * f + k]];
+				}
+				vol += p[0][0] * ( p[1][1] * p[2][2] - p[1][2] * p[2][1] )
+				     - p[0][1] * ( p[1][0] * p[2][2] - p[1][2] * p[2][0] )
+				     + p[0][2] * ( p[1][0] * p[2][1] - p[1][1] * p[2][0] );
+			}
+			return fabs( vol ) / 6.0;
+		}
+	};
+
+	virtual void SetUp() {
+		LabelImageType::SizeType size;
+		size.Fill( 20 );
+		LabelImageType::SpacingType spacing;
+		spacing.Fill( 1.0 );
+		LabelImageType::PointType origin;
+		origin.Fill( 0.0 );
+
+		m_labels = LabelImageType::New();
+		m_labels->SetRegions( size );
+		m_labels->SetSpacing( spacing );
+		m_labels->SetOrigin( origin );
+		m_labels->Allocate();
+
+		m_fractions = FractionsImageType::New();
+		m_fractions->SetRegions( size );
+		m_fractions->SetSpacing( spacing );
+		m_fractions->SetOrigin( origin );
+		m_fractions->SetNumberOfComponentsPerPixel( 2 );
+		m_fractions->Allocate();
+
+		m_mesh = Mesh();
+		m_mesh.offsets.push_back( 0 );
+	}
+
+	/** Axis-aligned box between lo and hi, two triangles per face */
+	void AddBox( double lo, double hi ) {
+		IdentifierType v[8];
+		for( size_t i = 0; i < 8; i++ ) {
+			v[i] = m_mesh.AddVertex( ( i & 1 )?hi:lo, ( i & 2 )?hi:lo, ( i & 4 )?hi:lo );
+		}
+		const IdentifierType quads[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+		                                     { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+		for( size_t q = 0; q < 6; q++ ) {
+			m_mesh.AddFace( v[quads[q][0]], v[quads[q][1]], v[quads[q][2]] );
+			m_mesh.AddFace( v[quads[q][0]], v[quads[q][2]], v[quads[q][3]] );
+		}
+		m_mesh.offsets.push_back( m_mesh.faces.size() / 3 );
+	}
+
+	/** Latitude-longitude sphere */
+	void AddSphere( double c, double r, size_t nlat, size_t nlon ) {
+		IdentifierType north = m_mesh.AddVertex( c, c, c + r );
+		IdentifierType first = north + 1;
+		for( size_t i = 1; i < nlat; i++ ) {
+			double theta = M_PI * i / nlat;
+			for( size_t j = 0; j < nlon; j++ ) {
+				double phi = 2.0 * M_PI * j / nlon;
+				m_mesh.AddVertex( c + r * sin( theta ) * cos( phi ), c + r * sin( theta ) * sin( phi ), c + r * cos( theta ) );
+			}
+		}
+		IdentifierType south = m_mesh.AddVertex( c, c, c - r );
+
+		for( size_t j = 0; j < nlon; j++ ) {
+			size_t jn = ( j + 1 ) % nlon;
+			m_mesh.AddFace( north, first + j, first + jn );
+			for( size_t i = 0; i + 2 < nlat; i++ ) {
+				IdentifierType a = first + i * nlon + j, b = first + i * nlon + jn;
+				m_mesh.AddFace( a, a + nlon, b + nlon );
+				m_mesh.AddFace( a, b + nlon, b );
+			}
+			IdentifierType last = first + ( nlat - 2 ) * nlon;
+			m_mesh.AddFace( last + j, south, last + jn );
+		}
+		m_mesh.offsets.push_back( m_mesh.faces.size() / 3 );
+	}
+
+	RasterizerType::Pointer Rasterize( unsigned int factor ) {
+		const float* coords[3] = { m_mesh.coords[0].data(), m_mesh.coords[1].data(), m_mesh.coords[2].data() };
+		RasterizerType::Pointer r = RasterizerType::New();
+		r->SetGeometry( m_labels );
+		r->SetSurfaces( m_mesh.offsets.size() - 1, coords, m_mesh.faces.data(), m_mesh.offsets.data() );
+		r->SetSamplingFactor( factor );
+		r->Update();
+		r->Rasterize( m_labels->GetLargestPossibleRegion(), m_fractions.GetPointer(), m_labels.GetPointer() );
+		return r;
+	}
+
+	/** Sum of the fractions of the first surface */
+	double InnerVolume() const {
+		double vol = 0.0;
+		size_t nvox = m_labels->GetLargestPossibleRegion().GetNumberOfPixels();
+		const float* px = m_fractions->GetBufferPointer();
+		for( size_t i = 0; i < nvox; i++ ) {
+			EXPECT_NEAR( 1.0, px[2 * i] + px[2 * i + 1], 1.0e-6 ) << "voxel " << i;
+			vol += px[2 * i];
+		}
+		return vol;
+	}
+
+	size_t InnerLabels() const {
+		size_t count = 0;
+		size_t nvox = m_labels->GetLargestPossibleRegion().GetNumberOfPixels();
+		for( size_t i = 0; i < nvox; i++ ) {
+			count += ( m_labels->GetBufferPointer()[i] == 0 );
+		}
+		return count;
+	}
+
+	Mesh m_mesh;
+	LabelImageType::Pointer m_labels;
+	FractionsImageType::Pointer m_fractions;
+};
+
+TEST_F( PartialVolumeRasterizerTests, CubeOnVoxelBoundaries ) {
+	this->AddBox( 4.5, 12.5 );
+	this->Rasterize( 4 );
+
+	EXPECT_DOUBLE_EQ( 512.0, this->InnerVolume() );
+	EXPECT_EQ( 512u, this->InnerLabels() );
+}
+
+TEST_F( PartialVolumeRasterizerTests, CubeThroughSamples ) {
+	// Faces, edges and face diagonals run exactly through the sample rays
+	// (offsets of +/-0.125 and +/-0.375 with a sampling factor of 4)
+	this->AddBox( 4.375, 12.375 );
+	this->Rasterize( 4 );
+
+	EXPECT_DOUBLE_EQ( 512.0, this->InnerVolume() );
+}
+
+TEST_F( PartialVolumeRasterizerTests, CubeThroughVoxelCenters ) {
+	this->AddBox( 4.0, 12.0 );
+	RasterizerType::Pointer r = this->Rasterize( 1 );
+
+	EXPECT_DOUBLE_EQ( 512.0, this->InnerVolume() );
+	EXPECT_EQ( 512u, this->InnerLabels() );
+
+	// GetLabel agrees with Rasterize on every voxel center
+	LabelImageType::IndexType idx;
+	LabelImageType::PointType p;
+	for( idx[2] = 0; idx[2] < 20; idx[2]++ ) {
+		for( idx[1] = 0; idx[1] < 20; idx[1]++ ) {
+			for( idx[0] = 0; idx[0] < 20; idx[0]++ ) {
+				m_labels->TransformIndexToPhysicalPoint( idx, p );
+				ASSERT_EQ( m_labels->GetPixel( idx ), r->GetLabel( p ) ) << "index " << idx;
+			}
+		}
+	}
+}
+
+TEST_F( PartialVolumeRasterizerTests, Sphere ) {
+	this->AddSphere( 10.0, 6.0, 24, 48 );
+	RasterizerType::Pointer r = this->Rasterize( 4 );
+
+	double expected = m_mesh.Volume();
+	EXPECT_NEAR( expected, this->InnerVolume(), 0.01 * expected );
+	EXPECT_NEAR( expected, this->InnerLabels(), 0.03 * expected );
+
+	LabelImageType::PointType p;
+	p.Fill( 10.0 );
+	EXPECT_EQ( 0u, r->GetLabel( p ) );
+	p.Fill( 1.0 );
+	EXPECT_EQ( 1u, r->GetLabel( p ) );
+}
+
+TEST_F( PartialVolumeRasterizerTests, SphereThroughVoxelCenters ) {
+	// Poles and the equator lie on voxel centers, so rays hit vertices
+	this->AddSphere( 10.0, 6.0, 12, 4 );
+	this->Rasterize( 1 );
+
+	double expected = m_mesh.Volume();
+	EXPECT_NEAR( expected, this->InnerVolume(), 0.1 * expected );
+}
+
+}
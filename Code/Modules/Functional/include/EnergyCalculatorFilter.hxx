@@ -29,6 +29,7 @@
 #include "EnergyCalculatorFilter.h"
 #include <itkImageBase.h>
 #include <itkProgressReporter.h>
+#include <vector>
 
 namespace rstk {
 
@@ -82,7 +83,6 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
 
 	itk::ImageRegionConstIterator< TInputVectorImage > inputIt( this->GetInput(), inputRegionForThread );
 	itk::ImageRegionConstIterator< PriorsImageType >   priorIt( this->GetPriorsMap(), inputRegionForThread );
-	itk::ImageRegionConstIterator< MaskType >          maskIt ( this->GetMask(), inputRegionForThread );
  	inputIt.GoToBegin();
 
  	EnergyModelConstPointer model = this->GetModel();
@@ -95,30 +95,46 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
  	volumes.SetSize(this->m_NumberOfRegions);
  	volumes.Fill(0.0);
 
- 	size_t lastroi = this->m_NumberOfRegions - 1;
+	// Samples are gathered in blocks and all the regions evaluated at once
+ 	const size_t BlockSize = 256;
+ 	size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+ 	std::vector< typename EnergyModelType::PixelValueType > values(BlockSize * ncomps);
+ 	std::vector< PriorsPrecisionType > weights(BlockSize * this->m_NumberOfRegions);
+ 	std::vector< typename EnergyModelType::MeasureType > e(BlockSize * this->m_NumberOfRegions);
+
  	PriorsPixelType w;
- 	double bgw;
- 	PriorsPrecisionType vol;
  	PixelType val;
- 	MeasureType e;
+ 	PriorsPrecisionType vol;
+ 	size_t bn;
 	while ( !inputIt.IsAtEnd() ) {
-		bgw = maskIt.Get();
-		val = inputIt.Get();
-		w = priorIt.Get();
-
-		for(size_t roi = 0; roi < m_NumberOfRegions; roi++ ) {
-			if( w[roi] < 1.0e-8 )
-				continue;
-
-			e = model->Evaluate(val, roi);
-			vol = w[roi] * this->m_PixelVolume;
-			volumes[roi]+= vol;
-			energies[roi]+= vol * e;
+		for( bn = 0; bn < BlockSize && !inputIt.IsAtEnd(); bn++ ) {
+			val = inputIt.Get();
+			w = priorIt.Get();
+			for( size_t c = 0; c < ncomps; c++ ) {
+				values[bn * ncomps + c] = val[c];
+			}
+			for( size_t roi = 0; roi < m_NumberOfRegions; roi++ ) {
+				weights[bn * m_NumberOfRegions + roi] = w[roi];
+			}
+
+			++inputIt;
+			++priorIt;
+			progress.CompletedPixel();
 		}
 
-		++inputIt;
-	    ++priorIt;
-	    progress.CompletedPixel();
+		model->EvaluateBatch(bn, ncomps, values.data(), e.data());
+
+		for( size_t i = 0; i < bn; i++ ) {
+			for(size_t roi = 0; roi < m_NumberOfRegions; roi++ ) {
+				PriorsPrecisionType wr = weights[i * m_NumberOfRegions + roi];
+				if( wr < 1.0e-8 )
+					continue;
+
+				vol = wr * this->m_PixelVolume;
+				volumes[roi]+= vol;
+				energies[roi]+= vol * e[i * m_NumberOfRegions + roi];
+			}
+		}
 	}
 
 	this->m_Energies[threadId] = energies;
@@ -0,0 +1,173 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FLATCONTOURSTORE_H_
+#define FLATCONTOURSTORE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <itkObject.h>
+#include <itkPoint.h>
+#include <itkVector.h>
+#include <itkQuadEdgeMeshPolygonCell.h>
+
+namespace rstk {
+/** \class FlatContourStore
+ *  \brief Structure-of-arrays storage of all the contours handled by a functional.
+ *
+ *  Vertices of all the surfaces are concatenated (universal vertex id, uvid) and
+ *  each coordinate is kept in its own contiguous array, for the reference
+ *  (initial) positions, the current displacements and the current positions.
+ *  Triangles are stored as a CSR list (one row per surface) of uvid triplets,
+ *  and the vertices lying on a boundary between two regions are indexed in a
+ *  valid-vertex table carrying their surface, local id and adjacent regions.
+ *
+ *  Meshes are only used to load the surfaces (AddSurface) and to write back the
+ *  current state (CopyToMesh) when required for output.
+ *
+ *  \ingroup Functional
+ *  \ingroup RSTK
+ */
+template< typename TValue, unsigned int VDimension = 3 >
+class FlatContourStore: public itk::Object {
+public:
+	typedef FlatContourStore                 Self;
+	typedef itk::Object                      Superclass;
+	typedef itk::SmartPointer<Self>          Pointer;
+	typedef itk::SmartPointer< const Self >  ConstPointer;
+
+	itkTypeMacro(FlatContourStore, itk::Object);
+	itkNewMacro(Self);
+
+	itkStaticConstMacro( Dimension, unsigned int, VDimension );
+
+	typedef TValue                                 ValueType;
+	typedef itk::Point< ValueType, VDimension >    PointType;
+	typedef itk::Vector< ValueType, VDimension >   VectorType;
+	typedef std::uint32_t                          IdentifierType;
+	typedef std::vector< ValueType >               CoordinateArray;
+	typedef std::vector< IdentifierType >          IdentifierArray;
+
+	/** Entry of the valid-vertex table */
+	struct ValidVertex {
+		IdentifierType uvid;    // universal vertex id
+		IdentifierType svid;    // vertex id within its surface
+		std::uint16_t  sid;     // surface id
+		std::uint8_t   inner;   // region inside the surface at this vertex
+		std::uint8_t   outer;   // region outside the surface at this vertex
+
+		ValidVertex( IdentifierType u, IdentifierType s, std::uint16_t c, std::uint8_t i, std::uint8_t o ):
+			uvid(u), svid(s), sid(c), inner(i), outer(o) {}
+	};
+	typedef std::vector< ValidVertex >             ValidVertexTable;
+
+	/** Append the vertices and triangles of a surface. Returns the surface id. */
+	template< typename TMesh >
+	size_t AddSurface( const TMesh* mesh );
+
+	/** Write current positions (and optionally, a vector per vertex given in
+	 *  SoA form) of surface sid into mesh, which must have the same points. */
+	template< typename TMesh >
+	void CopyToMesh( size_t sid, TMesh* mesh, const CoordinateArray* data = ITK_NULLPTR ) const;
+
+	void AddValidVertex( size_t uvid, size_t sid, size_t inner, size_t outer ) {
+		this->m_ValidVertices.push_back( ValidVertex( uvid, uvid - this->m_SurfaceOffsets[sid], sid, inner, outer ) );
+	}
+	void ClearValidVertices() { this->m_ValidVertices.clear(); }
+
+	/** Reset current positions and displacements to the reference */
+	void ResetDisplacements();
+
+	size_t GetNumberOfSurfaces() const { return this->m_SurfaceOffsets.size() - 1; }
+	size_t GetNumberOfVertices() const { return this->m_SurfaceOffsets.back(); }
+	size_t GetNumberOfVertices( size_t sid ) const { return this->m_SurfaceOffsets[sid + 1] - this->m_SurfaceOffsets[sid]; }
+	size_t GetNumberOfFaces() const { return this->m_Faces.size() / 3; }
+	size_t GetNumberOfValidVertices() const { return this->m_ValidVertices.size(); }
+
+	const IdentifierArray& GetSurfaceOffsets() const { return this->m_SurfaceOffsets; }
+	const IdentifierArray& GetFaceOffsets() const { return this->m_FaceOffsets; }
+	const IdentifierArray& GetFaces() const { return this->m_Faces; }
+	const ValidVertexTable& GetValidVertices() const { return this->m_ValidVertices; }
+
+	CoordinateArray& GetReference( size_t d ) { return this->m_Reference[d]; }
+	const CoordinateArray& GetReference( size_t d ) const { return this->m_Reference[d]; }
+	CoordinateArray& GetCurrent( size_t d ) { return this->m_Current[d]; }
+	const CoordinateArray& GetCurrent( size_t d ) const { return this->m_Current[d]; }
+	CoordinateArray& GetDisplacement( size_t d ) { return this->m_Displacement[d]; }
+	const CoordinateArray& GetDisplacement( size_t d ) const { return this->m_Displacement[d]; }
+
+	PointType GetReferencePoint( size_t uvid ) const {
+		PointType p;
+		for( size_t d = 0; d < VDimension; d++ ) p[d] = this->m_Reference[d][uvid];
+		return p;
+	}
+
+	PointType GetCurrentPoint( size_t uvid ) const {
+		PointType p;
+		for( size_t d = 0; d < VDimension; d++ ) p[d] = this->m_Current[d][uvid];
+		return p;
+	}
+
+	void SetCurrentPoint( size_t uvid, const PointType& p ) {
+		for( size_t d = 0; d < VDimension; d++ ) this->m_Current[d][uvid] = p[d];
+	}
+
+protected:
+	FlatContourStore() {
+		this->m_SurfaceOffsets.push_back(0);
+		this->m_FaceOffsets.push_back(0);
+	}
+	~FlatContourStore() {}
+
+	void PrintSelf( std::ostream & os, itk::Indent indent ) const override {
+		Superclass::PrintSelf( os, indent );
+		os << indent << "NumberOfSurfaces: " << this->GetNumberOfSurfaces() << std::endl;
+		os << indent << "NumberOfVertices: " << this->GetNumberOfVertices() << std::endl;
+		os << indent << "NumberOfFaces: " << this->GetNumberOfFaces() << std::endl;
+		os << indent << "NumberOfValidVertices: " << this->GetNumberOfValidVertices() << std::endl;
+	}
+
+private:
+	FlatContourStore(const Self &);  //purposely not implemented
+	void operator=(const Self &);    //purposely not implemented
+
+	CoordinateArray  m_Reference[VDimension];
+	CoordinateArray  m_Displacement[VDimension];
+	CoordinateArray  m_Current[VDimension];
+
+	IdentifierArray  m_SurfaceOffsets;  // first uvid of each surface, plus the end
+	IdentifierArray  m_FaceOffsets;     // first face of each surface, plus the end
+	IdentifierArray  m_Faces;           // three uvids per triangle
+	ValidVertexTable m_ValidVertices;
+};
+
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "FlatContourStore.hxx"
+#endif
+
+#endif /* FLATCONTOURSTORE_H_ */
@@ -0,0 +1,135 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef FLATCONTOURSTORE_HXX_
+#define FLATCONTOURSTORE_HXX_
+
+#include "FlatContourStore.h"
+
+#include <algorithm>
+
+namespace rstk {
+
+template< typename TValue, unsigned int VDimension >
+template< typename TMesh >
+size_t
+FlatContourStore< TValue, VDimension >
+::AddSurface( const TMesh* mesh ) {
+	typedef typename TMesh::PointsContainerConstIterator          PointsConstIterator;
+	typedef typename TMesh::CellsContainerConstIterator           CellsConstIterator;
+	typedef itk::QuadEdgeMeshPolygonCell< typename TMesh::CellType > PolygonType;
+	typedef typename PolygonType::PointIdConstIterator            PolygonPointIterator;
+
+	size_t offset = this->GetNumberOfVertices();
+	size_t npoints = mesh->GetNumberOfPoints();
+
+	for( size_t d = 0; d < VDimension; d++ ) {
+		this->m_Reference[d].resize( offset + npoints );
+		this->m_Displacement[d].resize( offset + npoints, 0.0 );
+	}
+
+	PointsConstIterator p_it = mesh->GetPoints()->Begin();
+	PointsConstIterator p_end = mesh->GetPoints()->End();
+	for( ; p_it != p_end; ++p_it ) {
+		if ( p_it.Index() >= npoints ) {
+			itkExceptionMacro(<< "surface " << this->GetNumberOfSurfaces() << " has non-contiguous point ids.");
+		}
+		for( size_t d = 0; d < VDimension; d++ ) {
+			this->m_Reference[d][offset + p_it.Index()] = p_it.Value()[d];
+		}
+	}
+
+	for( size_t d = 0; d < VDimension; d++ ) {
+		this->m_Current[d] = this->m_Reference[d];
+	}
+
+	for( CellsConstIterator c_it = mesh->GetCells()->Begin(); c_it != mesh->GetCells()->End(); ++c_it ) {
+		const PolygonType* poly = dynamic_cast< const PolygonType* >( c_it.Value() );
+		if ( poly == ITK_NULLPTR || poly->GetNumberOfPoints() != 3 ) {
+			continue;
+		}
+
+		PolygonPointIterator pit = poly->PointIdsBegin();
+		for( size_t k = 0; k < 3; ++pit, k++ ) {
+			this->m_Faces.push_back( offset + *pit );
+		}
+	}
+
+	this->m_SurfaceOffsets.push_back( offset + npoints );
+	this->m_FaceOffsets.push_back( this->GetNumberOfFaces() );
+	this->Modified();
+	return this->GetNumberOfSurfaces() - 1;
+}
+
+template< typename TValue, unsigned int VDimension >
+template< typename TMesh >
+void
+FlatContourStore< TValue, VDimension >
+::CopyToMesh( size_t sid, TMesh* mesh, const CoordinateArray* data ) const {
+	typedef typename TMesh::PointsContainerIterator   PointsIterator;
+	typedef typename TMesh::PointDataContainer        PointDataContainer;
+	typedef typename TMesh::PixelType                 PixelType;
+
+	size_t offset = this->m_SurfaceOffsets[sid];
+	if ( mesh->GetNumberOfPoints() != this->GetNumberOfVertices(sid) ) {
+		itkExceptionMacro(<< "mesh does not match surface " << sid << ".");
+	}
+
+	PointsIterator p_it = mesh->GetPoints()->Begin();
+	PointsIterator p_end = mesh->GetPoints()->End();
+	for( ; p_it != p_end; ++p_it ) {
+		for( size_t d = 0; d < VDimension; d++ ) {
+			p_it.Value()[d] = this->m_Current[d][offset + p_it.Index()];
+		}
+	}
+
+	if ( data != ITK_NULLPTR ) {
+		if ( mesh->GetPointData() == ITK_NULLPTR ) {
+			mesh->SetPointData( PointDataContainer::New() );
+		}
+		typename PointDataContainer::Pointer pdata = mesh->GetPointData();
+		PixelType v;
+		for( size_t svid = 0; svid < this->GetNumberOfVertices(sid); svid++ ) {
+			for( size_t d = 0; d < VDimension; d++ ) {
+				v[d] = data[d][offset + svid];
+			}
+			pdata->InsertElement( svid, v );
+		}
+	}
+}
+
+template< typename TValue, unsigned int VDimension >
+void
+FlatContourStore< TValue, VDimension >
+::ResetDisplacements() {
+	for( size_t d = 0; d < VDimension; d++ ) {
+		std::fill( this->m_Displacement[d].begin(), this->m_Displacement[d].end(), 0.0 );
+		this->m_Current[d] = this->m_Reference[d];
+	}
+}
+
+} // end namespace rstk
+
+#endif /* FLATCONTOURSTORE_HXX_ */
@@ -64,7 +64,10 @@
 
 
 #include "rstkMacro.h"
+#include "ThreadPool.h"
 #include "NormalQuadEdgeMeshFilter.h"
+#include "FlatContourStore.h"
+#include "SurfaceNormalsEngine.h"
 #include "ConfigurableObject.h"
 #include "CopyQuadEdgeMeshFilter.h"
 #include "CopyCastMeshFilter.h"
@@ -72,7 +75,7 @@
 #include "WarpQEMeshFilter.h"
 #include "SparseMatrixTransform.h"
 #include "DownsampleAveragingFilter.h"
-#include "MultilabelBinarizeMeshFilter.h"
+#include "PartialVolumeRasterizer.h"
 
 #include "EnergyCalculatorFilter.h"
 #include "MahalanobisDistanceModel.h"
@@ -149,6 +152,12 @@ public:
 			< ReferenceImageType >                                    InterpolatorType;
 	typedef typename InterpolatorType::Pointer                        InterpolatorPointer;
 
+	typedef itk::VectorImage< float, Dimension >                      EnergyMapsType;
+	typedef typename EnergyMapsType::Pointer                          EnergyMapsPointer;
+	typedef rstk::VectorLinearInterpolateImageFunction
+			< EnergyMapsType >                                        EnergyMapsInterpolatorType;
+	typedef typename EnergyMapsInterpolatorType::Pointer              EnergyMapsInterpolatorPointer;
+
 	typedef itk::QuadEdgeMesh< VectorType, Dimension >                VectorContourType;
 	typedef typename VectorContourType::Pointer                       VectorContourPointer;
 	typedef typename VectorContourType::PointType                     VectorContourPointType;
@@ -191,6 +200,15 @@ public:
 	typedef typename NormalFilterType::AreaContainerType              NormalFilterAreasContainer;
 	typedef std::vector< NormalFilterPointer >                        NormalFilterList;
 
+	typedef FlatContourStore< PointValueType, Dimension >             ContourStoreType;
+	typedef typename ContourStoreType::Pointer                        ContourStorePointer;
+	typedef typename ContourStoreType::CoordinateArray                CoordinateArray;
+	typedef typename ContourStoreType::ValidVertex                    ValidVertex;
+	typedef typename ContourStoreType::ValidVertexTable               ValidVertexTable;
+
+	typedef SurfaceNormalsEngine< ContourStoreType >                  NormalsEngineType;
+	typedef typename NormalsEngineType::Pointer                       NormalsEnginePointer;
+
 	// Contour copiers
 	typedef typename rstk::CopyQuadEdgeMeshFilter
 				  <ScalarContourType, ScalarContourType>              ScalarContourCopyType;
@@ -244,13 +262,8 @@ public:
 	typedef typename PriorsImageType::PixelType                       PriorsPixelType;
 	typedef typename PriorsImageType::InternalPixelType               PriorsValueType;
 
-	typedef MultilabelBinarizeMeshFilter< VectorContourType >         BinarizeMeshFilterType;
-	typedef typename BinarizeMeshFilterType::Pointer                  BinarizeMeshFilterPointer;
-	typedef typename BinarizeMeshFilterType::OutputImageType          BinarizationImageType;
-
-	typedef DownsampleAveragingFilter
-			< BinarizationImageType, PriorsImageType >                DownsampleFilter;
-	typedef typename DownsampleFilter::Pointer                        DownsamplePointer;
+	typedef PartialVolumeRasterizer< PointValueType >                 RasterizerType;
+	typedef typename RasterizerType::Pointer                          RasterizerPointer;
 
 	typedef itk::Image< float, Dimension >                            ProbabilityMapType;
 	typedef typename ProbabilityMapType::Pointer                      ProbabilityMapPointer;
@@ -293,6 +306,7 @@ public:
 	// 		                <VectorContourType,ShapeGradientType>     ShapeCopyType;
 	// typedef typename ShapeCopyType::Pointer                           ShapeCopyPointer;
 	typedef itk::FixedArray< PointValueType, 7u >                     GradientStatsArray;
+	typedef ThreadPool::LoadStatistics                                LoadStatistics;
 
 	struct GradientSample {
 		PointValueType grad;
@@ -343,10 +357,16 @@ public:
 	itkSetClampMacro( DecileThreshold, float, 0.0, 0.5 );
 	itkGetMacro( DecileThreshold, float );
 
-	itkGetMacro( CurrentContours, VectorContourList);
+	/** Current contours, with the shape gradient as point data. Meshes are
+	 *  synchronized with the contour store only when requested. */
+	const VectorContourList& GetCurrentContours() {
+		this->MaterializeContours(true);
+		return this->m_CurrentContours;
+	}
 	itkGetMacro( Gradients, VectorContourList );
-	itkGetMacro( Vertices, PointsVector );
-	itkGetMacro( ValidVertices, PointIdContainer );
+	PointsVector GetVertices() const;
+	PointIdContainer GetValidVertices() const;
+	itkGetConstObjectMacro( ContourStore, ContourStoreType );
 
 	virtual void SetCurrentDisplacements( const VNLVectorContainer& vals );
 
@@ -364,6 +384,20 @@ public:
 	itkGetMacro( Sigma, SigmaArrayType );
 	itkSetMacro( Sigma, SigmaArrayType );
 
+	/** Energy map cache mode: the energy of every region is rasterized on the
+	 *  reference grid after each model update, and gradients are sampled by
+	 *  interpolating these maps instead of the reference features. */
+	itkSetMacro( UseEnergyMaps, bool );
+	itkGetConstMacro( UseEnergyMaps, bool );
+	itkBooleanMacro( UseEnergyMaps );
+	itkGetConstObjectMacro( EnergyMaps, EnergyMapsType );
+
+	/** Narrow-band mode: only the bricks of the reference grid covered by
+	 *  faces that moved since the last rasterization are updated. */
+	itkSetMacro( UseNarrowBand, bool );
+	itkGetConstMacro( UseNarrowBand, bool );
+	itkBooleanMacro( UseNarrowBand );
+
 	itkGetMacro( MaxEnergy, MeasureType );
 
 	void SetSigma( float s ) {
@@ -384,7 +418,15 @@ public:
 
 	MeasureType GetValue();
 	itkGetConstMacro(RegionValue, MeasureArray);
+
+	/** Evaluate the functional for several candidate displacements at once.
+	 *  Each candidate is rasterized as a task of a persistent pool, in its own
+	 *  workspace and with a separate group of threads; the current contours,
+	 *  maps and energy are left untouched. */
+	void EvaluateCandidates( const std::vector< VNLVectorContainer >& candidates, std::vector< MeasureType >& values );
 	itkGetConstMacro(GradientStatistics, GradientStatsArray);
+	/** Load-balance of the threaded gradient computation in the last iteration */
+	const LoadStatistics& GetLoadStatistics() const { return this->m_ThreadPool->GetLastStatistics(); }
 	void ComputeDerivative(PointValueType* gradVector, ScalesType scales);
 
 	virtual void Initialize();
@@ -392,6 +434,21 @@ public:
 		this->m_Model->SetPriorsMap(this->m_CurrentMaps);
 		this->m_Model->Update();
 		this->m_MaxEnergy = this->m_Model->GetMaxEnergy();
+		this->m_EnergyMaps = ITK_NULLPTR;
+	}
+
+	/** Append the region descriptors to f, see OptimizerBase::SaveState */
+	void SaveState( CheckpointFile& f ) const {
+		f.Write( this->m_MaxEnergy );
+		this->m_Model->SaveDescriptors( f );
+	}
+
+	/** Restore descriptors saved by SaveState, once the functional is initialized */
+	void LoadState( CheckpointFile& f ) {
+		f.Read( this->m_MaxEnergy );
+		this->m_Model->LoadDescriptors( f );
+		this->m_EnergyMaps = ITK_NULLPTR;
+		this->m_EnergyUpdated = false;
 	}
 
 	virtual std::string PrintFormattedDescriptors() {
@@ -423,8 +480,8 @@ public:
 		return result;
 	}
 
-    /** Return the multithreader used by this class. */
-    itk::MultiThreader * GetMultiThreader() const { return m_Threader; }
+    /** Return the persistent thread pool used by this class. */
+    ThreadPool * GetThreadPool() const { return m_ThreadPool; }
     itkSetClampMacro( NumberOfThreads, itk::ThreadIdType, 1, ITK_MAX_THREADS);
     itkGetConstReferenceMacro(NumberOfThreads, itk::ThreadIdType);
 
@@ -438,33 +495,27 @@ protected:
 		os << std::endl;
 	}
 
-	void InitializeSamplingGrid( void );
-
 	//virtual MeasureType GetEnergyOfSample( ReferencePixelType sample, size_t roim, bool bias = false ) const = 0;
 	MeasureType GetEnergyAtPoint( const PointType& point, size_t roi ) const;
 	MeasureType GetEnergyAtPoint( const PointType& point, size_t roi, ReferencePixelType& value ) const;
 	inline MeasureType EvaluateGradient( const PointType& point, size_t outer_roi, size_t inner_roi ) const;
+	inline MeasureType EvaluateGradientOfSample( const ReferencePixelType& value, size_t outer_roi, size_t inner_roi ) const;
 
 	inline bool CheckExtent( VectorContourPointType& p, ContinuousIndex& idx ) const;
 	virtual void ParseSettings() override;
 	//virtual MeasureType GetEnergyOffset(size_t roi) const = 0;
 
 	// Methods for multithreading
-	struct ParallelGradientStruct {
-		Self* selfptr;
-		size_t total;
-		PointValuesVector* gradients;
-		std::mutex mutex;
-		std::vector<NormalFilterAreasContainer> areas;
-		std::vector<PointsContainerPointer> points;
-		std::vector< double > totalAreas;
+	void ThreadedDerivativeCompute(size_t start, size_t stop, itk::ThreadIdType tid, PointValueType* gradients);
+
+	/** Per-thread scratch used to sample the reference in batches */
+	struct SampleBuffer {
+		std::vector< PointValueType > coords[Dimension];
+		std::vector< ChannelPixelType > values;
+		std::vector< MeasureType > energies;
+		std::vector< unsigned char > inside;
 	};
-
-	static ITK_THREAD_RETURN_TYPE ThreadedDerivativeCallback(void *arg);
-	PointValuesVector ThreadedDerivativeCompute(size_t start, size_t stop,
-			std::vector<PointsContainerPointer> points,
-			std::vector<NormalFilterAreasContainer> areas,
-			std::vector< double > totalAreas);
+	static const size_t SampleBlockSize = 64;
 
 
 
@@ -479,11 +530,12 @@ protected:
 	bool m_RegionsUpdated;
 	bool m_ApplySmoothing;
 	bool m_UseBackground;
+	bool m_UseEnergyMaps;
+	bool m_UseNarrowBand;
 
 	mutable MeasureType m_Value;
 	mutable MeasureArray m_RegionValue;
 	mutable MeasureType m_MaxEnergy;
-	FieldPointer m_ReferenceSamplingGrid;
 	VectorContourList m_CurrentContours;
 	VectorContourList m_Gradients;
 	ScalarConstContourList m_Priors;
@@ -505,18 +557,22 @@ protected:
 
 
 	InterpolatorPointer m_Interp;
+	EnergyMapsPointer m_EnergyMaps;
+	EnergyMapsInterpolatorPointer m_EnergyMapsInterp;
+	itk::TimeStamp m_EnergyMapsTime;
 	MaskInterpolatorPointer m_MaskInterp;
-	PointDataContainerPointer m_CurrentDisplacements;
-	PointsVector m_Vertices;
-	PointIdContainer m_ValidVertices;
-	PointIdContainer m_OuterRegion;
-	PointIdContainer m_InnerRegion;
-	PointIdContainer m_ContainerId;
-	PointIdContainer m_Offsets;
+	ContourStorePointer m_ContourStore;
+	NormalsEnginePointer m_NormalsEngine;
+	RasterizerPointer m_Rasterizer;
+	CoordinateArray m_ShapeGradients[Dimension];
+	bool m_MeshPointsUpdated;
+	bool m_MeshDataUpdated;
 
 	std::vector<size_t> m_OffMaskVertices;
 
 	GradientStatsArray m_GradientStatistics;
+	PointValuesVector m_GradientBuffer;
+	std::vector< SampleBuffer > m_SampleBuffers;
 
 	mutable std::stringstream m_InfoBuffer;
 
@@ -526,12 +582,33 @@ private:
 
 	void UpdateContour();
 	void ComputeCurrentRegions();
+	void UpdateEnergyMaps();
+	bool UpdateCurrentRegionsNarrowBand();
+	void MaskPriorsMap( PriorsImageType* maps, const typename PriorsImageType::RegionType& region ) const;
+	PriorsImagePointer AllocatePriorsMap() const;
+
+	/** Private copy of the state needed to evaluate one candidate contour */
+	struct CandidateWorkspace {
+		CoordinateArray current[Dimension];
+		ThreadPool::Pointer pool;
+		RasterizerPointer rasterizer;
+		PriorsImagePointer maps;
+		EnergyFilterPointer calculator;
+	};
+	void InitializeCandidateWorkspaces( size_t ncandidates );
+	void RasterizeCandidate( const VNLVectorContainer& disp, CandidateWorkspace& ws ) const;
+
+	static const size_t BrickSize = 8;  // side of narrow-band bricks, in reference voxels
+	CoordinateArray m_RasterizedPoints[Dimension];  // positions at the last rasterization
+	std::vector< CandidateWorkspace > m_CandidateWorkspaces;
+	ThreadPool::Pointer m_CandidatePool;  // one worker per candidate, kept between iterations
 	void InitializeContours();
+	void MaterializeContours(bool withData);
 	void InitializeInterpolatorGrid();
 	double ComputePointArea( const PointIdentifier &iId, VectorContourType *mesh );
 
 	/** Support processing data in multiple threads. */
-	itk::MultiThreader::Pointer m_Threader;
+	ThreadPool::Pointer         m_ThreadPool;
 	itk::ThreadIdType           m_NumberOfThreads;
 }; // end FunctionalBase Class
 
@@ -36,6 +36,7 @@
 #include <assert.h>
 #include <vnl/vnl_random.h>
 #include <itkImageAlgorithm.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 #include <itkOrientImageFilter.h>
 #include <itkContinuousIndex.h>
 #include <itkComposeImageFilter.h>
@@ -52,6 +53,16 @@
 
 namespace rstk {
 
+template< typename TReferenceImageType, typename TCoordRepType >
+const size_t
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::SampleBlockSize;
+
+template< typename TReferenceImageType, typename TCoordRepType >
+const size_t
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::BrickSize;
+
 template< typename TReferenceImageType, typename TCoordRepType >
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::FunctionalBase():
@@ -65,17 +76,23 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     m_RegionsUpdated(false),
     m_ApplySmoothing(false),
     m_UseBackground(false),
+    m_UseEnergyMaps(false),
+    m_UseNarrowBand(false),
     m_Value(0.0),
-    m_MaxEnergy(0.0)
+    m_MaxEnergy(0.0),
+    m_MeshPointsUpdated(true),
+    m_MeshDataUpdated(true)
  {
 
-    this->m_Threader = itk::MultiThreader::New();
-    this->m_NumberOfThreads = this->m_Threader->GetNumberOfThreads();
+    this->m_ThreadPool = ThreadPool::New();
+    this->m_NumberOfThreads = this->m_ThreadPool->GetNumberOfThreads();
 
     this->m_Value = itk::NumericTraits<MeasureType>::infinity();
     this->m_Sigma.Fill(0.0);
     this->m_Interp = InterpolatorType::New();
     this->m_MaskInterp = MaskInterpolatorType::New();
+    this->m_EnergyMapsInterp = EnergyMapsInterpolatorType::New();
+    this->m_ContourStore = ContourStoreType::New();
 
     m_InfoBuffer << "{ \"info\": {";
 }
@@ -89,7 +106,9 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
             ("smoothing", bpo::value< float > (), "apply isotropic smoothing filter on target image, with kernel sigma=S mm.")
             ("smooth-auto", bpo::bool_switch(), "apply isotropic smoothing filter on target image, with automatic computation of kernel sigma.")
             ("uniform-bg-membership", bpo::bool_switch(), "consider last ROI as background and do not compute descriptors.")
-            ("decile-threshold,d", bpo::value< float > (), "set (decile) threshold to consider a computed gradient as outlier (ranges 0.0-0.5)");
+            ("decile-threshold,d", bpo::value< float > (), "set (decile) threshold to consider a computed gradient as outlier (ranges 0.0-0.5)")
+            ("energy-maps", bpo::bool_switch(), "precompute per-region energy maps after each descriptors update and interpolate them to compute gradients.")
+            ("narrow-band", bpo::bool_switch(), "update regions only around the faces that moved since the last iteration.");
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
@@ -121,6 +140,20 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
         bpo::variable_value v = this->m_Settings["decile-threshold"];
         this->SetDecileThreshold( v.as<float> () );
     }
+
+    if( this->m_Settings.count( "energy-maps" ) ) {
+        bpo::variable_value v = this->m_Settings["energy-maps"];
+        if ( v.as<bool>() ) {
+            this->SetUseEnergyMaps(true);
+        }
+    }
+
+    if( this->m_Settings.count( "narrow-band" ) ) {
+        bpo::variable_value v = this->m_Settings["narrow-band"];
+        if ( v.as<bool>() ) {
+            this->SetUseNarrowBand(true);
+        }
+    }
     this->Modified();
 }
 
@@ -172,16 +205,13 @@ template< typename TReferenceImageType, typename TCoordRepType >
 size_t
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::AddShapePrior( const typename FunctionalBase<TReferenceImageType, TCoordRepType>::ScalarContourType* prior ) {
-    this->m_Offsets.push_back( this->m_NumberOfVertices );
     this->m_Priors.push_back( prior );
 
     Scalar2VectorCopyPointer copy = Scalar2VectorCopyType::New();
     copy->SetInput( prior );
     copy->Update();
     this->m_CurrentContours.push_back(copy->GetOutput());
-
-    typename ScalarContourType::PointsContainerConstIterator p_it = prior->GetPoints()->Begin();
-    typename ScalarContourType::PointsContainerConstIterator p_end = prior->GetPoints()->End();
+    this->m_ContourStore->AddSurface(copy->GetOutput());
 
     // Increase number of off-grid nodes to set into the sparse-dense interpolator
     this->m_NumberOfVertices+= prior->GetNumberOfPoints();
@@ -218,10 +248,14 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     }
 
     // Initialize corresponding ROI /////////////////////////////
-    // Check that high-res reference sampling grid has been initialized
-    if ( this->m_ReferenceSamplingGrid.IsNull() ) {
-            this->InitializeSamplingGrid();
-    }
+    // Partial volumes are computed straight onto the reference grid
+    this->m_Rasterizer = RasterizerType::New();
+    this->m_Rasterizer->SetGeometry( this->m_ReferenceImage );
+    this->m_Rasterizer->SetSamplingFactor( this->m_SamplingFactor );
+    this->m_Rasterizer->SetThreadPool( this->m_ThreadPool );
+    this->m_CandidateWorkspaces.clear();
+    this->m_CurrentMaps = ITK_NULLPTR;
+    this->m_CurrentRegions = ITK_NULLPTR;
 
     // Initialize interpolators
     this->m_Interp->SetInputImage( this->m_ReferenceImage );
@@ -244,6 +278,7 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     if(this->m_UseBackground)
         this->m_Model->SetNumberOfSpecialRegions(2);
     this->m_Model->Update();
+    this->m_EnergyMaps = ITK_NULLPTR;
 
     this->m_EnergyCalculator = EnergyFilter::New();
     this->m_EnergyCalculator->SetInput(this->m_ReferenceImage);
@@ -310,27 +345,6 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 }
 
 
-template< typename TReferenceImageType, typename TCoordRepType >
-void
-FunctionalBase<TReferenceImageType, TCoordRepType>
-::InitializeSamplingGrid() {
-    typename FieldType::SizeType exp_size;
-    typename FieldType::SpacingType spacing;
-
-    for (size_t i = 0; i<Dimension; i++ ){
-        exp_size[i] = (unsigned int) (this->m_ReferenceSize[i] * this->m_SamplingFactor);
-        spacing[i] = this->m_ReferenceSpacing[i] / this->m_SamplingFactor;
-    }
-
-    this->m_ReferenceSamplingGrid = FieldType::New();
-    this->m_ReferenceSamplingGrid->SetOrigin( this->m_FirstPixelCenter );
-    this->m_ReferenceSamplingGrid->SetDirection( this->m_Direction );
-    this->m_ReferenceSamplingGrid->SetRegions( exp_size );
-    this->m_ReferenceSamplingGrid->SetSpacing( spacing );
-    this->m_ReferenceSamplingGrid->Allocate();
-}
-
-
 template< typename TReferenceImageType, typename TCoordRepType >
 void
 FunctionalBase<TReferenceImageType, TCoordRepType>
@@ -338,57 +352,46 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     this->m_OffMaskVertices.resize(this->m_NumberOfContours);
     std::fill(this->m_OffMaskVertices.begin(), this->m_OffMaskVertices.end(), 0);
 
-    VectorType zerov; zerov.Fill(0.0);
-    this->m_CurrentDisplacements = PointDataContainer::New();
-    this->m_CurrentDisplacements->Reserve( this->m_NumberOfVertices );
+    this->m_ContourStore->ResetDisplacements();
+    this->m_ContourStore->ClearValidVertices();
+    const typename ContourStoreType::IdentifierArray& offsets = this->m_ContourStore->GetSurfaceOffsets();
 
-    ReferenceSpacingType sp = this->m_ReferenceSamplingGrid->GetSpacing();
-    ReferenceIndexType vox, ivox, ovox;
-    ivox.Fill(0);
-    ContinuousIndex cvox;
+    // Regions are probed one subvoxel (reference spacing over sampling factor) away from the vertex
+    ReferenceSpacingType sp;
+    for( size_t d = 0; d < Dimension; d++ ) {
+        sp[d] = this->m_ReferenceSpacing[d] / this->m_SamplingFactor;
+    }
+    ReferenceIndexType vox;
 
-    PointIdentifier uvid = 0; // Universal vertex id
     ROIPixelType inner = 0;
     ROIPixelType outer;
 
+    // Freeze the topology: one-ring adjacency is extracted only once
+    this->m_NormalsEngine = NormalsEngineType::New();
+    this->m_NormalsEngine->SetThreadPool(this->m_ThreadPool);
+    this->m_NormalsEngine->Initialize(this->m_ContourStore);
+    this->m_NormalsEngine->Compute();
+
     // Set up outer regions
     for ( size_t contid = 0; contid < this->m_NumberOfContours; contid ++) {
-        NormalFilterPointer nfilter = NormalFilterType::New();
-        nfilter->SetWeight(NormalFilterType::AREA);
-        nfilter->SetInput(this->m_CurrentContours[contid]);
-        nfilter->Update();
-        PointDataContainer* normals = nfilter->GetOutput()->GetPointData();
-        PointsConstIterator c_it  = this->m_CurrentContours[contid]->GetPoints()->Begin();
-        PointsConstIterator c_end = this->m_CurrentContours[contid]->GetPoints()->End();
-
         PointType ci;
-        VectorType v;
         VectorType ni;
-        size_t pid;
-        float step = 1;
-        while( c_it != c_end ) {
-            pid = c_it.Index();
-            ci = c_it.Value();
 
-            // Initialize this vertex and its displacement
-            this->m_CurrentDisplacements->SetElement(uvid, zerov);
-            this->m_Vertices.push_back(ci);
-            this->m_ContainerId.push_back(contid);
+        // uvid is the universal vertex id
+        for ( size_t uvid = offsets[contid]; uvid < offsets[contid + 1]; uvid++ ) {
+            ci = this->m_ContourStore->GetReferencePoint(uvid);
 
             // Vertex is outside the image
-            if (! this->m_CurrentRegions->TransformPhysicalPointToContinuousIndex(ci, cvox)) {
-                ++c_it;
-                uvid++;
+            if (! this->m_BackgroundMask->TransformPhysicalPointToIndex(ci, vox)) {
                 continue;
             }
-            vox.CopyWithRound(cvox);  // Round continuous index
 
             if (this->m_BackgroundMask->GetPixel(vox) > 1.0e-5 ) {
                 this->m_OffMaskVertices[contid]++;
             }
 
             // Get normal
-            ni = normals->GetElement( pid );
+            ni = this->m_NormalsEngine->GetNormal( uvid );
             ni[0] *= sp[0];
             ni[1] *= sp[1];
             ni[2] *= sp[2];
@@ -396,62 +399,30 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
             // No nested surface inside contid == 0
             inner = contid;
             if (contid > 0) {
-                if(! this->m_CurrentRegions->TransformPhysicalPointToContinuousIndex(ci - ni, cvox)){
-                    ++c_it;
-                    uvid++;
+                if(! this->m_BackgroundMask->TransformPhysicalPointToIndex(ci - ni, vox)){
                     continue;
                 }
-                ivox.CopyWithRound(cvox);  // Round continuous index
-                inner = this->m_CurrentRegions->GetPixel(ivox);
-
-                // Prevent digitization errors
-                step = 1;
-                while ((inner!=contid && ivox == vox) && step < 3) {
-                    if( this->m_CurrentRegions->TransformPhysicalPointToContinuousIndex(ci - ni * (1 + step * 0.1), cvox)){
-                        ivox.CopyWithRound(cvox);  // Round continuous index
-                        inner = this->m_CurrentRegions->GetPixel(ivox);
-                    } else {
-                        step = 10;
-                    }
-                    step++;
-                }
+                inner = this->m_Rasterizer->GetLabel(ci - ni);
                 assert(inner <= this->m_NumberOfContours);
             }
 
             // Vertex is outside the image
-            if (!this->m_CurrentRegions->TransformPhysicalPointToContinuousIndex(ci + ni, cvox)) {
-                ++c_it;
-                uvid++;
+            if (!this->m_BackgroundMask->TransformPhysicalPointToIndex(ci + ni, vox)) {
                 continue;
             }
-
-            ovox.CopyWithRound(cvox);  // Round continuous index
-            outer = this->m_CurrentRegions->GetPixel(ovox);
+            outer = this->m_Rasterizer->GetLabel(ci + ni);
             assert(outer <= this->m_NumberOfContours);
 
-            step = 1;
-            while (ovox==vox && step < 3) {
-                if(this->m_CurrentRegions->TransformPhysicalPointToContinuousIndex(ci + ni * (1 + step * 0.1), cvox)) {
-                    ovox.CopyWithRound(cvox);  // Round continuous index
-                    outer = this->m_CurrentRegions->GetPixel(ovox);
-                    assert(outer <= this->m_NumberOfContours);
-                } else {
-                    step = 10;
-                }
-                step++;
-            }
-
             if(outer!=inner) {
-                this->m_ValidVertices.push_back(uvid);
-                this->m_OuterRegion.push_back(outer);
-                this->m_InnerRegion.push_back(inner);
+                this->m_ContourStore->AddValidVertex(uvid, contid, inner, outer);
             }
-
-            ++c_it;
-            uvid++;
         }
     }
-    std::cout << "Valid vertices: " << this->m_ValidVertices.size() << " of " << this->m_NumberOfVertices << "." << std::endl;
+
+    for( size_t d = 0; d < Dimension; d++ ) {
+        this->m_ShapeGradients[d].assign(this->m_NumberOfVertices, 0.0);
+    }
+    std::cout << "Valid vertices: " << this->m_ContourStore->GetNumberOfValidVertices() << " of " << this->m_NumberOfVertices << "." << std::endl;
 }
 
 
@@ -462,36 +433,42 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     // Update contours and initialize sizes
     this->UpdateContour();
 
-    size_t nvertices = this->m_ValidVertices.size();
+    const ValidVertexTable& valid = this->m_ContourStore->GetValidVertices();
+    size_t nvertices = valid.size();
 
-    PointValuesVector gradients;
+    // Output slots are preallocated once and written by the workers without locking
+    PointValuesVector& gradients = this->m_GradientBuffer;
     gradients.resize(nvertices);
-    std::fill(gradients.begin(), gradients.end(), -1.0);
-
-    struct ParallelGradientStruct str;
-    str.selfptr = this;
-    str.total = nvertices;
-    str.gradients = &gradients;
 
+    this->m_ThreadPool->SetNumberOfThreads(this->m_NumberOfThreads);
 
-    std::vector<PointDataContainerPointer> normals;
-    for (size_t i = 0; i < this->m_NumberOfContours; i++ ) {
-        NormalFilterPointer nfilter = NormalFilterType::New();
-        nfilter->SetWeight(NormalFilterType::AREA);
-        nfilter->SetInput(this->m_CurrentContours[i]);
-        nfilter->Update();
-        normals.push_back(nfilter->GetOutput()->GetPointData() );
+    // One sampling scratch per worker, sized once
+    size_t ncomps = this->m_ReferenceImage->GetNumberOfComponentsPerPixel();
+    this->m_SampleBuffers.resize(this->m_ThreadPool->GetNumberOfThreads());
+    for( size_t t = 0; t < this->m_SampleBuffers.size(); t++ ) {
+        SampleBuffer& buf = this->m_SampleBuffers[t];
+        for( size_t d = 0; d < Dimension; d++ ) {
+            buf.coords[d].resize(SampleBlockSize);
+        }
+        buf.values.resize(SampleBlockSize * ncomps);
+        buf.energies.resize(SampleBlockSize * this->m_Model->GetNumberOfRegions());
+        buf.inside.resize(SampleBlockSize);
+    }
 
-        str.areas.push_back(nfilter->GetVertexAreaContainer());
-        str.points.push_back(this->m_CurrentContours[i]->GetPoints());
-        str.totalAreas.push_back(nfilter->GetTotalArea());
+    if( this->m_UseEnergyMaps ) {
+        this->UpdateEnergyMaps();
     }
 
-    // Start multithreading engine
-    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
-    this->GetMultiThreader()->SetSingleMethod(this->ThreadedDerivativeCallback, &str);
-    this->GetMultiThreader()->SingleMethodExecute();
+    // Update normals and vertex areas on the frozen topology
+    this->m_NormalsEngine->Compute();
+    const typename NormalsEngineType::NormalsContainer& normals = this->m_NormalsEngine->GetNormals();
 
+    // Run on the persistent pool, balancing chunks of valid vertices by work-stealing
+    PointValueType* out = gradients.data();
+    this->m_ThreadPool->ParallelFor(nvertices,
+            [this, out](size_t start, size_t stop, itk::ThreadIdType tid) {
+                this->ThreadedDerivativeCompute(start, stop, tid, out);
+            });
 
     PointValuesVector sample(gradients);
     std::sort(sample.begin(), sample.end());
@@ -508,14 +485,10 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     VectorType ni, v;
     PointValueType g;
     PointIdentifier uvid;  // universal vertex-id
-    PointIdentifier svid;  // surface vertex-id
-    PointIdentifier sid;   // surface id
 
     for(size_t vvid = 0; vvid < nvertices; vvid++ ) {
-        uvid = this->m_ValidVertices[vvid];
-        sid = this->m_ContainerId[uvid];
-        svid = uvid - this->m_Offsets[sid];
-        ni = normals[sid]->ElementAt(svid);
+        uvid = valid[vvid].uvid;
+        ni = normals[uvid];
         g = gradients[vvid];
         if ( g > this->m_GradientStatistics[5] ) g = this->m_GradientStatistics[5];
         if ( g < this->m_GradientStatistics[1] ) g = this->m_GradientStatistics[1];
@@ -528,79 +501,112 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
             } else {
                 grad[vvid + i * nvertices] = 0.0;
             }
+            this->m_ShapeGradients[i][uvid] = v[i];
         }
-
-        this->m_CurrentContours[sid]->GetPointData()->SetElement( svid, v );
     }
+    this->m_MeshDataUpdated = false;
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
-ITK_THREAD_RETURN_TYPE
+void
 FunctionalBase<TReferenceImageType, TCoordRepType>
-::ThreadedDerivativeCallback(void *arg) {
-    itk::ThreadIdType total, threadId, threadCount;
-    threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
-    threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
-
-    ParallelGradientStruct* str = (ParallelGradientStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
-
-    // Compute indices corresponding to each segment
-    size_t nvertices = str->total;
-    size_t ssize = ceil(1.0 * nvertices / threadCount);
-    size_t start = threadId * ssize;
-    size_t stop = ( threadId + 1 ) * ssize - 1;
+::ThreadedDerivativeCompute(size_t start, size_t stop, itk::ThreadIdType tid, PointValueType* gradients) {
+    const ValidVertexTable& valid = this->m_ContourStore->GetValidVertices();
+    const typename NormalsEngineType::AreasContainer& areas = this->m_NormalsEngine->GetAreas();
+    const typename NormalsEngineType::AreasContainer& totalAreas = this->m_NormalsEngine->GetTotalAreas();
+
+    SampleBuffer& buf = this->m_SampleBuffers[tid];
+    size_t ncomps = this->m_ReferenceImage->GetNumberOfComponentsPerPixel();
+    const PointValueType* coords[Dimension];
+    for( size_t d = 0; d < Dimension; d++ ) {
+        coords[d] = buf.coords[d].data();
+    }
 
-    if (threadId == threadCount - 1)
-        stop = nvertices - 1;
+    size_t nregions = this->m_Model->GetNumberOfRegions();
+    double wi = 0.0;
+    MeasureType g;
 
-    PointValuesVector segment = str->selfptr->ThreadedDerivativeCompute(start, stop, str->points, str->areas, str->totalAreas);
+    // Range is [start, stop), each vvid owns gradients[vvid]
+    for(size_t b0 = start; b0 < stop; b0+= SampleBlockSize ) {
+        size_t bn = std::min(SampleBlockSize, stop - b0);
 
-    str->mutex.lock();
-    typename PointValuesVector::const_iterator it = segment.begin();
-    typename PointValuesVector::const_iterator last = segment.end();
-    typename PointValuesVector::iterator dest = str->gradients->begin() + start;
+        // Gather c'_i of the block and sample the reference at once
+        for( size_t d = 0; d < Dimension; d++ ) {
+            const CoordinateArray& cur = this->m_ContourStore->GetCurrent(d);
+            for( size_t i = 0; i < bn; i++ ) {
+                buf.coords[d][i] = cur[valid[b0 + i].uvid];
+            }
+        }
+        if( this->m_UseEnergyMaps ) {
+            // Energies interpolated straight from the cached maps
+            this->m_EnergyMapsInterp->EvaluateBatch(bn, coords, buf.energies.data(), buf.inside.data());
+        } else {
+            // Energies of all regions for the whole block
+            this->m_Interp->EvaluateBatch(bn, coords, buf.values.data(), buf.inside.data());
+            this->m_Model->EvaluateBatch(bn, ncomps, buf.values.data(), buf.energies.data());
+        }
 
-    while(it!=last) {
-        *dest = *it;
-        ++it;
-        ++dest;
+        for( size_t i = 0; i < bn; i++ ) {
+            const ValidVertex& vv = valid[b0 + i];
+            if( !buf.inside[i] || vv.outer == vv.inner ) {
+                gradients[b0 + i] = 0.0;
+                continue;
+            }
+            const MeasureType* e = &buf.energies[i * nregions];
+            g = e[vv.inner] - e[vv.outer];
+            wi = areas[vv.uvid] / totalAreas[vv.sid];
+            gradients[b0 + i] = ((fabs(g)>MIN_GRADIENT)?g:0.0) * wi;
+        }
     }
-    str->mutex.unlock();
-
-    return ITK_THREAD_RETURN_VALUE;
 }
 
+
 template< typename TReferenceImageType, typename TCoordRepType >
-typename FunctionalBase<TReferenceImageType, TCoordRepType>::PointValuesVector
+void
 FunctionalBase<TReferenceImageType, TCoordRepType>
-::ThreadedDerivativeCompute(size_t start, size_t stop,
-        std::vector<PointsContainerPointer> points,
-        std::vector<NormalFilterAreasContainer> areas,
-        std::vector< double > totalAreas) {
-    size_t nvertices = stop - start;
-    size_t fullsize = nvertices * Dimension;
-
-    PointIdentifier uvid;      // universal id of vertex
-    PointIdentifier svid;      // id of vertex in its contour
-    PointIdentifier sid;       // surface id
-
-    VectorContourPointType ci_prime;
-    PointValuesVector sample;
-    double wi = 0.0;
-
-    for(size_t vvid = start; vvid <= stop; vvid++ ) {
-        uvid = this->m_ValidVertices[vvid];
-        sid = this->m_ContainerId[uvid];
-        svid = uvid - this->m_Offsets[sid];
-        ci_prime = points[sid]->ElementAt(svid); // Get c'_i
-        wi = areas[sid][svid] / totalAreas[sid];
-        sample.push_back(this->EvaluateGradient( ci_prime,
-                this->m_OuterRegion[vvid], this->m_InnerRegion[vvid] )  * wi);
+::UpdateEnergyMaps() {
+    // Maps are dropped by UpdateDescriptors and rebuilt if the model changed since
+    if( this->m_EnergyMaps.IsNotNull() && this->m_EnergyMapsTime.GetMTime() > this->m_Model->GetMTime() ) {
+        return;
     }
 
-    return sample;
-}
+    size_t nregions = this->m_Model->GetNumberOfRegions();
+    size_t ncomps = this->m_ReferenceImage->GetNumberOfComponentsPerPixel();
+
+    EnergyMapsPointer maps = EnergyMapsType::New();
+    maps->SetRegions(this->m_ReferenceImage->GetLargestPossibleRegion());
+    maps->SetSpacing(this->m_ReferenceImage->GetSpacing());
+    maps->SetOrigin(this->m_ReferenceImage->GetOrigin());
+    maps->SetDirection(this->m_ReferenceImage->GetDirection());
+    maps->SetNumberOfComponentsPerPixel(nregions);
+    maps->Allocate();
+
+    // Reference pixels are contiguous, evaluate all regions over blocks of them
+    const size_t BlockSize = 4096;
+    size_t npix = this->m_ReferenceImage->GetBufferedRegion().GetNumberOfPixels();
+    size_t nblocks = (npix + BlockSize - 1) / BlockSize;
+    const ChannelPixelType* ref = this->m_ReferenceImage->GetBufferPointer();
+    float* out = maps->GetBufferPointer();
+
+    std::vector< std::vector< MeasureType > > scratch(this->m_ThreadPool->GetNumberOfThreads());
+    this->m_ThreadPool->ParallelFor(nblocks,
+            [&](size_t start, size_t stop, itk::ThreadIdType tid) {
+                std::vector< MeasureType >& e = scratch[tid];
+                e.resize(BlockSize * nregions);
+                for( size_t b = start; b < stop; b++ ) {
+                    size_t first = b * BlockSize;
+                    size_t bn = std::min(BlockSize, npix - first);
+                    this->m_Model->EvaluateBatch(bn, ncomps, ref + first * ncomps, e.data());
+                    for( size_t i = 0; i < bn * nregions; i++ ) {
+                        out[first * nregions + i] = static_cast<float>(e[i]);
+                    }
+                }
+            });
 
+    this->m_EnergyMaps = maps;
+    this->m_EnergyMapsInterp->SetInputImage(this->m_EnergyMaps);
+    this->m_EnergyMapsTime.Modified();
+}
 
 template< typename TReferenceImageType, typename TCoordRepType >
 void
@@ -610,54 +616,51 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
         return;
     }
 
-    VectorContourPointType ci;
-    MeasureType norm;
     ContinuousIndex point_idx;
     size_t changed = 0;
-    size_t uvid = 0;
-    std::vector< size_t > invalid;
 
     std::fill(this->m_OffMaskVertices.begin(), this->m_OffMaskVertices.end(), 0);
 
+    const typename ContourStoreType::IdentifierArray& offsets = this->m_ContourStore->GetSurfaceOffsets();
+    PointValueType* ref[Dimension];
+    PointValueType* disp[Dimension];
+    PointValueType* cur[Dimension];
+    for( size_t d = 0; d < Dimension; d++ ) {
+        ref[d] = this->m_ContourStore->GetReference(d).data();
+        disp[d] = this->m_ContourStore->GetDisplacement(d).data();
+        cur[d] = this->m_ContourStore->GetCurrent(d).data();
+    }
+
+    VectorContourPointType ci_prime;
+    MeasureType norm;
+
     for( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
-        PointsContainerPointer curPoints = this->m_CurrentContours[contid]->GetPoints();
-        PointsIterator p_it = curPoints->Begin();
-        PointsConstIterator p_end = curPoints->End();
-
-        VectorContourPointType ci_prime;
-        VectorType disp;
-        size_t pid;
-
-        // For all the points in the mesh
-        while ( p_it != p_end ) {
-            ci = this->m_Vertices[uvid];
-            disp = this->m_CurrentDisplacements->GetElement( uvid ); // Get the interpolated value of the field in the point
-            norm = disp.GetNorm();
-
-            if( norm > 1.0e-8 ) {
-                ci_prime = ci + disp; // Add displacement vector to the point
+        for( size_t uvid = offsets[contid]; uvid < offsets[contid + 1]; uvid++ ) {
+            norm = 0.0;
+            for( size_t d = 0; d < Dimension; d++ ) {
+                ci_prime[d] = ref[d][uvid] + disp[d][uvid]; // Add displacement vector to the point
+                norm += disp[d][uvid] * disp[d][uvid];
+            }
+
+            if( norm > 1.0e-16 ) {
                 if( ! this->CheckExtent(ci_prime,point_idx) ) {
-                    invalid.push_back( uvid );
                     this->InvokeEvent( WarningEvent() );
                 }
-                curPoints->SetElement( p_it.Index(), ci_prime );
                 changed++;
             }
 
+            for( size_t d = 0; d < Dimension; d++ ) {
+                cur[d][uvid] = ci_prime[d];
+            }
+
             if ( (1.0 - this->m_MaskInterp->Evaluate(ci_prime)) < 1.0e-5 ) {
                 this->m_OffMaskVertices[contid]++;
             }
-
-            ++p_it;
-            uvid++;
         }
     }
 
-//    if ( invalid.size() > 0 ) {
-//        itkWarningMacro(<< "a total of " << invalid.size() << " mesh nodes were to be moved off the image domain." );
-//    }
-
     this->m_DisplacementsUpdated = true;
+    this->m_MeshPointsUpdated = false;
     this->m_RegionsUpdated = (changed==0);
     this->m_EnergyUpdated = (changed==0);
 
@@ -668,20 +671,202 @@ template< typename TReferenceImageType, typename TCoordRepType >
 void
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::ComputeCurrentRegions() {
-    BinarizeMeshFilterPointer newp = BinarizeMeshFilterType::New();
-    newp->SetInputs( this->m_CurrentContours );
-    newp->SetOutputReference( this->m_ReferenceSamplingGrid );
-    newp->Update();
-    this->m_CurrentRegions = newp->GetOutputSegmentation();
-
-    DownsamplePointer p = DownsampleFilter::New();
-    p->SetInput(newp->GetOutput());
-    p->SetOutputParametersFromImage( this->m_ReferenceImage );
-    p->SetMaskImage(m_BackgroundMask);
-    p->Update();
-
-    this->m_CurrentMaps = p->GetOutput();
+    // The rasterizer reads the current positions straight from the store
+    this->m_Rasterizer->SetSurfaces( this->m_ContourStore.GetPointer() );
+    this->m_Rasterizer->Update();
+
+    if( this->m_UseNarrowBand && this->m_CurrentRegions.IsNotNull() && this->m_CurrentMaps.IsNotNull() ) {
+        if( this->UpdateCurrentRegionsNarrowBand() ) {
+            this->m_RegionsUpdated = true;
+            return;
+        }
+    }
+
+    if ( this->m_CurrentMaps.IsNull() ) {
+        this->m_CurrentMaps = this->AllocatePriorsMap();
+
+        this->m_CurrentRegions = ROIType::New();
+        this->m_CurrentRegions->CopyInformation( this->m_CurrentMaps );
+        this->m_CurrentRegions->SetRegions( this->m_CurrentMaps->GetLargestPossibleRegion() );
+        this->m_CurrentRegions->Allocate();
+    }
+
+    typename PriorsImageType::RegionType region = this->m_CurrentMaps->GetLargestPossibleRegion();
+    this->m_Rasterizer->Rasterize( region, this->m_CurrentMaps.GetPointer(), this->m_CurrentRegions.GetPointer() );
+    this->MaskPriorsMap( this->m_CurrentMaps, region );
+    this->m_CurrentRegions->Modified();
+    this->m_CurrentMaps->Modified();
     this->m_RegionsUpdated = true;
+
+    for( size_t d = 0; d < Dimension; d++ ) {
+        this->m_RasterizedPoints[d] = this->m_ContourStore->GetCurrent(d);
+    }
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+bool
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::UpdateCurrentRegionsNarrowBand() {
+    const typename ContourStoreType::IdentifierArray& faces = this->m_ContourStore->GetFaces();
+    size_t nverts = this->m_ContourStore->GetNumberOfVertices();
+    if ( this->m_RasterizedPoints[0].size() != nverts ) {
+        return false;
+    }
+
+    // Vertices that moved since the last rasterization
+    std::vector< unsigned char > moved(nverts, 0);
+    size_t nmoved = 0;
+    for( size_t uvid = 0; uvid < nverts; uvid++ ) {
+        MeasureType diff, norm = 0.0;
+        for( size_t d = 0; d < Dimension; d++ ) {
+            diff = this->m_ContourStore->GetCurrent(d)[uvid] - this->m_RasterizedPoints[d][uvid];
+            norm += diff * diff;
+        }
+        if ( norm > 1.0e-16 ) {
+            moved[uvid] = 1;
+            nmoved++;
+        }
+    }
+
+    if ( nmoved == 0 ) {
+        return true;
+    }
+
+    // Mark the bricks touched by the old and new positions of the moved faces
+    typename PriorsImageType::SizeType rsize = this->m_CurrentMaps->GetLargestPossibleRegion().GetSize();
+    size_t nbricks[Dimension];
+    size_t ntotal = 1;
+    for( size_t d = 0; d < Dimension; d++ ) {
+        nbricks[d] = (rsize[d] + BrickSize - 1) / BrickSize;
+        ntotal *= nbricks[d];
+    }
+    std::vector< unsigned char > dirty(ntotal, 0);
+
+    PointType p;
+    ContinuousIndex cidx;
+    for( size_t f = 0; f < faces.size() / 3; f++ ) {
+        const typename ContourStoreType::IdentifierType* ids = &faces[3 * f];
+        if ( !moved[ids[0]] && !moved[ids[1]] && !moved[ids[2]] ) {
+            continue;
+        }
+
+        double lo[Dimension], hi[Dimension];
+        for( size_t d = 0; d < Dimension; d++ ) {
+            lo[d] = itk::NumericTraits<double>::max();
+            hi[d] = itk::NumericTraits<double>::NonpositiveMin();
+        }
+
+        for( size_t k = 0; k < 6; k++ ) {
+            for( size_t d = 0; d < Dimension; d++ ) {
+                p[d] = (k < 3)?this->m_RasterizedPoints[d][ids[k]]:this->m_ContourStore->GetCurrent(d)[ids[k - 3]];
+            }
+            this->m_CurrentMaps->TransformPhysicalPointToContinuousIndex(p, cidx);
+            for( size_t d = 0; d < Dimension; d++ ) {
+                lo[d] = std::min(lo[d], static_cast<double>(cidx[d]));
+                hi[d] = std::max(hi[d], static_cast<double>(cidx[d]));
+            }
+        }
+
+        long blo[Dimension], bhi[Dimension];
+        bool overlaps = true;
+        for( size_t d = 0; d < Dimension; d++ ) {
+            long l = static_cast<long>(floor(lo[d])) - 1;
+            long h = static_cast<long>(ceil(hi[d])) + 1;
+            l = std::max(l, 0L);
+            h = std::min(h, static_cast<long>(rsize[d]) - 1);
+            overlaps = overlaps && ( h >= l );
+            blo[d] = l / static_cast<long>(BrickSize);
+            bhi[d] = h / static_cast<long>(BrickSize);
+        }
+        if ( !overlaps ) {
+            continue;
+        }
+
+        for( long bz = blo[2]; bz <= bhi[2]; bz++ )
+            for( long by = blo[1]; by <= bhi[1]; by++ )
+                for( long bx = blo[0]; bx <= bhi[0]; bx++ )
+                    dirty[(bz * nbricks[1] + by) * nbricks[0] + bx] = 1;
+    }
+
+    size_t ndirty = std::count(dirty.begin(), dirty.end(), 1);
+    if ( 2 * ndirty > ntotal ) {
+        // Too much motion, a full rasterization is cheaper
+        return false;
+    }
+
+    // Re-rasterize, layer by layer, the box enclosing the dirty bricks
+    for( size_t bz = 0; bz < nbricks[2]; bz++ ) {
+        size_t bxlo = nbricks[0], bxhi = 0, bylo = nbricks[1], byhi = 0;
+        for( size_t by = 0; by < nbricks[1]; by++ ) {
+            for( size_t bx = 0; bx < nbricks[0]; bx++ ) {
+                if ( dirty[(bz * nbricks[1] + by) * nbricks[0] + bx] ) {
+                    bxlo = std::min(bxlo, bx); bxhi = std::max(bxhi, bx);
+                    bylo = std::min(bylo, by); byhi = std::max(byhi, by);
+                }
+            }
+        }
+        if ( bxlo > bxhi ) {
+            continue;
+        }
+
+        typename PriorsImageType::IndexType bindex;
+        typename PriorsImageType::SizeType bsize;
+        size_t blo[Dimension] = { bxlo, bylo, bz };
+        size_t bhi[Dimension] = { bxhi, byhi, bz };
+        for( size_t d = 0; d < Dimension; d++ ) {
+            bindex[d] = blo[d] * BrickSize;
+            bsize[d] = std::min((bhi[d] + 1) * BrickSize, static_cast<size_t>(rsize[d])) - bindex[d];
+        }
+        typename PriorsImageType::RegionType bregion(bindex, bsize);
+
+        this->m_Rasterizer->Rasterize( bregion, this->m_CurrentMaps.GetPointer(), this->m_CurrentRegions.GetPointer() );
+        this->MaskPriorsMap( this->m_CurrentMaps, bregion );
+    }
+    this->m_CurrentRegions->Modified();
+    this->m_CurrentMaps->Modified();
+
+    for( size_t d = 0; d < Dimension; d++ ) {
+        this->m_RasterizedPoints[d] = this->m_ContourStore->GetCurrent(d);
+    }
+    return true;
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+typename FunctionalBase<TReferenceImageType, TCoordRepType>::PriorsImagePointer
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::AllocatePriorsMap() const {
+    PriorsImagePointer maps = PriorsImageType::New();
+    maps->CopyInformation( this->m_ReferenceImage );
+    maps->SetRegions( this->m_ReferenceImage->GetLargestPossibleRegion() );
+    maps->SetNumberOfComponentsPerPixel( this->m_NumberOfRegions );
+    maps->Allocate();
+    return maps;
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::MaskPriorsMap( PriorsImageType* maps, const typename PriorsImageType::RegionType& region ) const {
+    // Same masking as DownsampleAveragingFilter: masked voxels go to the off-mask
+    // region if any contour covers them, and are zeroed otherwise
+    size_t ncomps = maps->GetNumberOfComponentsPerPixel();
+    size_t nlabels = ncomps - 1;
+    PriorsValueType* out = maps->GetBufferPointer();
+
+    itk::ImageRegionConstIteratorWithIndex< ProbabilityMapType > it(this->m_BackgroundMask, region);
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it ) {
+        if ( it.Get() > 0.0 ) {
+            PriorsValueType* px = out + maps->ComputeOffset(it.GetIndex()) * ncomps;
+            bool any = false;
+            for( size_t c = 0; c < nlabels - 1; c++ ) {
+                any = any || (px[c] > 0.0);
+            }
+            std::fill(px, px + ncomps, 0.0);
+            if ( any ) {
+                px[nlabels] = 1.0;
+            }
+        }
+    }
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
@@ -697,23 +882,25 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
         itkExceptionMacro( << "vals contains a wrong number of vectors");
     }
 
-    VectorType new_ci, old_ci;
-    MeasureType norm;
+    PointValueType* disp[Dimension];
+    for( size_t d = 0; d < Dimension; d++ ) {
+        disp[d] = this->m_ContourStore->GetDisplacement(d).data();
+    }
+
+    MeasureType norm, diff;
     size_t modified = 0;
     for( size_t id = 0; id<npoints; id++ ) {
-        new_ci.Fill( 0.0 );
         norm = 0.0;
-
         for( size_t d = 0; d < Dimension; d++) {
-            new_ci[d] = vals[d][id];
+            diff = vals[d][id] - disp[d][id];
+            norm += diff * diff;
         }
 
-        old_ci = this->m_CurrentDisplacements->GetElement( id );
-        norm = (new_ci-old_ci).GetNorm();
-
-        if ( norm > 1.0e-8 ) {
+        if ( norm > 1.0e-16 ) {
             modified++;
-            this->m_CurrentDisplacements->SetElement( id, new_ci );
+            for( size_t d = 0; d < Dimension; d++) {
+                disp[d][id] = vals[d][id];
+            }
         }
     }
 
@@ -722,10 +909,56 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 }
 
 
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::MaterializeContours(bool withData) {
+    withData = withData && !this->m_MeshDataUpdated;
+    if ( this->m_MeshPointsUpdated && !withData ) {
+        return;
+    }
+
+    for( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
+        this->m_ContourStore->CopyToMesh(contid, this->m_CurrentContours[contid].GetPointer(),
+                withData?this->m_ShapeGradients:ITK_NULLPTR);
+    }
+
+    this->m_MeshPointsUpdated = true;
+    if ( withData ) {
+        this->m_MeshDataUpdated = true;
+    }
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+typename FunctionalBase<TReferenceImageType, TCoordRepType>::PointsVector
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::GetVertices() const {
+    PointsVector vertices(this->m_ContourStore->GetNumberOfVertices());
+    for( size_t uvid = 0; uvid < vertices.size(); uvid++ ) {
+        vertices[uvid] = this->m_ContourStore->GetReferencePoint(uvid);
+    }
+    return vertices;
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+typename FunctionalBase<TReferenceImageType, TCoordRepType>::PointIdContainer
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::GetValidVertices() const {
+    const ValidVertexTable& valid = this->m_ContourStore->GetValidVertices();
+    PointIdContainer ids(valid.size());
+    for( size_t vvid = 0; vvid < valid.size(); vvid++ ) {
+        ids[vvid] = valid[vvid].uvid;
+    }
+    return ids;
+}
+
 template< typename TReferenceImageType, typename TCoordRepType >
 typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureType
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::GetValue() {
+    // Displacements set since the last derivative must be rasterized first
+    this->UpdateContour();
+
     if ( !this->m_EnergyUpdated ) {
         this->m_EnergyCalculator->SetPriorsMap(this->m_CurrentMaps);
         this->m_EnergyCalculator->Update();
@@ -740,21 +973,172 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
     return this->m_Value;
 }
 
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::EvaluateCandidates( const std::vector< VNLVectorContainer >& candidates, std::vector< MeasureType >& values ) {
+    size_t ncandidates = candidates.size();
+    values.assign( ncandidates, itk::NumericTraits<MeasureType>::infinity() );
+    if ( ncandidates == 0 ) {
+        return;
+    }
+
+    for( size_t c = 0; c < ncandidates; c++ ) {
+        if ( candidates[c][0].size() != this->m_NumberOfVertices ) {
+            itkExceptionMacro( << "candidate " << c << " contains a wrong number of vectors");
+        }
+    }
+
+    this->InitializeCandidateWorkspaces( ncandidates );
+
+    // Rasterize every candidate concurrently, one task per candidate on the
+    // persistent candidates pool. Each task drives its own workspace pool
+    this->m_CandidatePool->ParallelFor( ncandidates,
+            [&](size_t start, size_t stop, itk::ThreadIdType) {
+        for( size_t c = start; c < stop; c++ ) {
+            this->RasterizeCandidate( candidates[c], this->m_CandidateWorkspaces[c] );
+        }
+    });
+
+    // The energy filters share the reference and the mask as pipeline inputs,
+    // so they are updated one after the other with all the threads
+    for( size_t c = 0; c < ncandidates; c++ ) {
+        EnergyFilterPointer calc = this->m_CandidateWorkspaces[c].calculator;
+        calc->SetModel( this->m_Model );
+        calc->Modified();
+        calc->Update();
+
+        const MeasureArray energies = calc->GetEnergies();
+        MeasureType total = 0.0;
+        for( size_t roi = 0; roi < energies.Size(); roi++ ) {
+            total+= energies[roi];
+        }
+        values[c] = total;
+    }
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::InitializeCandidateWorkspaces( size_t ncandidates ) {
+    itk::ThreadIdType group = std::max< itk::ThreadIdType >( 1, this->m_NumberOfThreads / ncandidates );
+    size_t nverts = this->m_ContourStore->GetNumberOfVertices();
+
+    if ( this->m_CandidatePool.IsNull() ) {
+        this->m_CandidatePool = ThreadPool::New();
+        this->m_CandidatePool->SetChunkSize( 1 );
+    }
+    this->m_CandidatePool->SetNumberOfThreads( ncandidates );
+
+    if ( this->m_CandidateWorkspaces.size() > ncandidates ) {
+        this->m_CandidateWorkspaces.resize( ncandidates );
+    }
+
+    while( this->m_CandidateWorkspaces.size() < ncandidates ) {
+        CandidateWorkspace ws;
+        ws.pool = ThreadPool::New();
+        ws.rasterizer = RasterizerType::New();
+        ws.rasterizer->SetGeometry( this->m_ReferenceImage );
+        ws.rasterizer->SetSamplingFactor( this->m_SamplingFactor );
+        ws.rasterizer->SetThreadPool( ws.pool );
+        ws.maps = this->AllocatePriorsMap();
+
+        ws.calculator = EnergyFilter::New();
+        ws.calculator->SetInput( this->m_ReferenceImage );
+        ws.calculator->SetPriorsMap( ws.maps );
+        ws.calculator->SetMask( this->m_BackgroundMask );
+        this->m_CandidateWorkspaces.push_back( ws );
+    }
+
+    for( size_t c = 0; c < ncandidates; c++ ) {
+        CandidateWorkspace& ws = this->m_CandidateWorkspaces[c];
+        ws.pool->SetNumberOfThreads( group );
+        for( size_t d = 0; d < Dimension; d++ ) {
+            ws.current[d].resize( nverts );
+        }
+    }
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::RasterizeCandidate( const VNLVectorContainer& disp, CandidateWorkspace& ws ) const {
+    size_t nverts = this->m_ContourStore->GetNumberOfVertices();
+    const PointValueType* ref[Dimension];
+    PointValueType* cur[Dimension];
+    const PointValueType* coords[Dimension];
+    for( size_t d = 0; d < Dimension; d++ ) {
+        ref[d] = this->m_ContourStore->GetReference(d).data();
+        cur[d] = ws.current[d].data();
+        coords[d] = cur[d];
+    }
+
+    // Moved vertices are clamped to the reference extent, as in UpdateContour
+    ContinuousIndex point_idx;
+    VectorContourPointType ci_prime;
+    MeasureType norm;
+    for( size_t uvid = 0; uvid < nverts; uvid++ ) {
+        norm = 0.0;
+        for( size_t d = 0; d < Dimension; d++ ) {
+            ci_prime[d] = ref[d][uvid] + disp[d][uvid];
+            norm += disp[d][uvid] * disp[d][uvid];
+        }
+
+        if( norm > 1.0e-16 ) {
+            this->CheckExtent( ci_prime, point_idx );
+        }
+
+        for( size_t d = 0; d < Dimension; d++ ) {
+            cur[d][uvid] = ci_prime[d];
+        }
+    }
+
+    ws.rasterizer->SetSurfaces( this->m_NumberOfContours, coords,
+                                this->m_ContourStore->GetFaces().data(),
+                                this->m_ContourStore->GetFaceOffsets().data() );
+    ws.rasterizer->Update();
+
+    typename PriorsImageType::RegionType region = ws.maps->GetLargestPossibleRegion();
+    ws.rasterizer->Rasterize( region, ws.maps.GetPointer(), static_cast<ROIType*>(ITK_NULLPTR) );
+    this->MaskPriorsMap( ws.maps, region );
+    ws.maps->Modified();
+}
+
 template <typename TReferenceImageType, typename TCoordRepType>
 inline typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureType
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::EvaluateGradient( const typename FunctionalBase<TReferenceImageType, TCoordRepType>::PointType & point,
         size_t outer_roi, size_t inner_roi ) const {
+    if( this->m_UseEnergyMaps && this->m_EnergyMaps.IsNotNull() ) {
+        typename EnergyMapsInterpolatorType::OutputType e;
+        if(outer_roi != inner_roi && this->m_EnergyMapsInterp->SafeEvaluate( point, e )) {
+            MeasureType grad = e[inner_roi] - e[outer_roi];
+            return (fabs(grad)>MIN_GRADIENT)?grad:0.0;
+        }
+        return 0.0;
+    }
+
     typename InterpolatorType::OutputType value;
     if(outer_roi != inner_roi && this->m_Interp->SafeEvaluate( point, value )) {
-        MeasureType gin  = this->m_Model->Evaluate( value, inner_roi );
-        MeasureType gout = this->m_Model->Evaluate( value, outer_roi );
-        MeasureType grad = gin - gout;
-        return (fabs(grad)>MIN_GRADIENT)?grad:0.0;
+        return this->EvaluateGradientOfSample( value, outer_roi, inner_roi );
     }
     return 0.0;
 }
 
+template <typename TReferenceImageType, typename TCoordRepType>
+inline typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureType
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::EvaluateGradientOfSample( const typename FunctionalBase<TReferenceImageType, TCoordRepType>::ReferencePixelType & value,
+        size_t outer_roi, size_t inner_roi ) const {
+    if(outer_roi == inner_roi) {
+        return 0.0;
+    }
+    MeasureType gin  = this->m_Model->Evaluate( value, inner_roi );
+    MeasureType gout = this->m_Model->Evaluate( value, outer_roi );
+    MeasureType grad = gin - gout;
+    return (fabs(grad)>MIN_GRADIENT)?grad:0.0;
+}
+
 
 template <typename TReferenceImageType, typename TCoordRepType>
 inline typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureType
@@ -843,38 +1227,33 @@ template< typename TReferenceImageType, typename TCoordRepType >
 const typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureArray
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::GetFinalEnergy() const {
-    ScalarContourList groundtruth;
-
+    ContourStorePointer groundtruth = ContourStoreType::New();
     for(size_t idx = 0; idx < this->m_Target.size(); idx++) {
-        ScalarContourCopyPointer copy = ScalarContourCopyType::New();
-        copy->SetInput( this->m_Target[idx] );
-        copy->Update();
-        groundtruth.push_back(copy->GetOutput());
+        groundtruth->AddSurface( this->m_Target[idx].GetPointer() );
     }
 
-    typedef MultilabelBinarizeMeshFilter< ScalarContourType > ScalarBinarizeMeshFilterType;
-    typename ScalarBinarizeMeshFilterType::Pointer newp = ScalarBinarizeMeshFilterType::New();
-    newp->SetInputs( groundtruth );
-    newp->SetOutputReference( this->m_ReferenceSamplingGrid );
-    newp->Update();
+    RasterizerPointer r = RasterizerType::New();
+    r->SetGeometry( this->m_ReferenceImage );
+    r->SetSamplingFactor( this->m_SamplingFactor );
+    r->SetThreadPool( this->m_ThreadPool );
+    r->SetSurfaces( groundtruth.GetPointer() );
+    r->Update();
 
-    DownsamplePointer p = DownsampleFilter::New();
-    p->SetInput(newp->GetOutput());
-    p->SetOutputParametersFromImage( this->m_ReferenceImage );
-    p->SetMaskImage(m_BackgroundMask);
-    p->Update();
+    PriorsImagePointer maps = this->AllocatePriorsMap();
+    r->Rasterize( maps->GetLargestPossibleRegion(), maps.GetPointer(), static_cast<ROIType*>(ITK_NULLPTR) );
+    this->MaskPriorsMap( maps, maps->GetLargestPossibleRegion() );
 
     EnergyModelPointer m = EnergyModelType::New();
     m->SetInput(this->m_ReferenceImage);
     m->SetMask(this->m_BackgroundMask);
-    m->SetPriorsMap(p->GetOutput());
+    m->SetPriorsMap(maps);
     if(this->m_UseBackground)
         m->SetNumberOfSpecialRegions(2);
     m->Update();
 
     EnergyFilterPointer calc = EnergyFilter::New();
     calc->SetInput(this->m_ReferenceImage);
-    calc->SetPriorsMap(p->GetOutput());
+    calc->SetPriorsMap(maps);
     calc->SetMask(this->m_BackgroundMask);
     calc->SetModel(m);
     calc->Update();
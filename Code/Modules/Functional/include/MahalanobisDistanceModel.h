@@ -104,6 +104,8 @@ public:
 
 	std::string PrintFormattedDescriptors() override;
 	virtual void ReadDescriptorsFromFile(std::string filename) override;
+	virtual void SaveDescriptors(CheckpointFile& f) const override;
+	virtual void LoadDescriptors(CheckpointFile& f) override;
 
 	inline double Evaluate(const MeasurementVectorType & x, const RegionIdentifier roi) const override {
 		if( x == m_InvalidValue )
@@ -111,6 +113,10 @@ public:
 		return this->m_Memberships[roi]->Evaluate(x);
 	}
 
+	/** Evaluate all the regions for a batch of samples on the compiled form
+	 * of the model (see Compile()), without going through the memberships. */
+	void EvaluateBatch(size_t nsamples, size_t ncomps, const PixelValueType * x, MeasureType * out) const override;
+
 protected:
 	MahalanobisDistanceModel();
 	virtual ~MahalanobisDistanceModel() {}
@@ -131,6 +137,11 @@ protected:
 private:
 	MeasureType ComputeCovarianceDeterminant(CovarianceMatrixType& cov) const;
 
+	/** Pack the means and the whitening of the inverse covariances (W, such
+	 * that W^T W = Sigma^-1) of all regions contiguously, so that the distance
+	 * of a sample to region r is | W_r (x - mu_r) |^2 */
+	void Compile();
+
 	void Estimate();
 	void EstimateRobust();
 
@@ -143,6 +154,13 @@ private:
 	CovariancesContainer  m_Covariances;
 	MeasureTypeContainer  m_RegionOffsetContainer;
 	MeasurementVectorType m_InvalidValue;
+
+	// Compiled form of the model
+	size_t                m_NumberOfComponents;
+	std::vector<double>   m_PackedMeans;       // nregions x ncomps
+	std::vector<double>   m_PackedWhitening;   // nregions x ncomps x ncomps, row-major
+	std::vector<double>   m_PackedMaximum;     // clamping value of each region
+	std::vector<double>   m_SpecialValues;     // constant energy of the special regions
 };
 }
 
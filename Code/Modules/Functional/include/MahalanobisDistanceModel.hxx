@@ -35,7 +35,10 @@
 #include <vnl/vnl_diag_matrix.h>
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 #include <vnl/algo/vnl_ldl_cholesky.h>
+#include <vnl/algo/vnl_cholesky.h>
 
+#include <algorithm>
+#include <limits>
 #include <string>
 #include <fstream>
 #include <streambuf>
@@ -46,7 +49,7 @@
 namespace rstk {
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
 MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
-::MahalanobisDistanceModel(): Superclass() {}
+::MahalanobisDistanceModel(): Superclass(), m_NumberOfComponents(0) {}
 
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
 void
@@ -95,6 +98,140 @@ MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 	for( size_t i = 0; i < ncomps; i++ ) {
 		m_InvalidValue = 0.0;
 	}
+
+	this->Compile();
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::Compile() {
+	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+	size_t ncomps = itk::NumericTraits<MeasurementVectorType>::GetLength(this->m_Means[0]);
+
+	this->m_NumberOfComponents = ncomps;
+	this->m_PackedMeans.resize(nregions * ncomps);
+	this->m_PackedWhitening.assign(nregions * ncomps * ncomps, 0.0);
+	this->m_PackedMaximum.resize(nregions);
+
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		const InternalFunctionType* mf = dynamic_cast<const InternalFunctionType*>(this->m_Memberships[roi].GetPointer());
+		if ( mf == NULL ) {
+			itkExceptionMacro(<< "region " << roi << " is not described by a Mahalanobis distance.");
+		}
+
+		for( size_t c = 0; c < ncomps; c++ ) {
+			this->m_PackedMeans[roi * ncomps + c] = mf->GetMean()[c];
+		}
+		this->m_PackedMaximum[roi] = mf->GetMaximumValue();
+
+		const vnl_matrix<double> invcov = mf->GetInverseCovariance().GetVnlMatrix();
+		double* w = &this->m_PackedWhitening[roi * ncomps * ncomps];
+
+		vnl_cholesky chol(invcov, vnl_cholesky::quiet);
+		if ( chol.rank_deficiency() == 0 ) {
+			// Sigma^-1 = L L^T, then W = L^T is upper triangular
+			vnl_matrix<double> L = chol.lower_triangle();
+			for( size_t r = 0; r < ncomps; r++ )
+				for( size_t c = r; c < ncomps; c++ )
+					w[r * ncomps + c] = L(c, r);
+		} else {
+			// Singular: Sigma^-1 = V D V^T, W = D^1/2 V^T. An indefinite matrix has
+			// no such factor and would yield negative distances, so it is rejected.
+			// Eigenvalues within round-off of zero are taken as zero.
+			vnl_symmetric_eigensystem<double> e(invcov);
+			double tol = 0.0;
+			for( size_t r = 0; r < ncomps; r++ )
+				tol = std::max( tol, fabs(e.D(r, r)) );
+			tol*= ncomps * std::numeric_limits<double>::epsilon();
+
+			for( size_t r = 0; r < ncomps; r++ ) {
+				if ( e.D(r, r) < -tol ) {
+					itkExceptionMacro(<< "inverse covariance of region " << roi << " is not positive semidefinite (eigenvalue "
+							<< e.D(r, r) << ").");
+				}
+				double s = sqrt( std::max(e.D(r, r), 0.0) );
+				for( size_t c = 0; c < ncomps; c++ )
+					w[r * ncomps + c] = s * e.V(c, r);
+			}
+		}
+	}
+
+	this->m_SpecialValues.resize(this->m_NumberOfSpecialRegions);
+	for( size_t s = 0; s < this->m_NumberOfSpecialRegions; s++ ) {
+		UniformFunctionType* uf = dynamic_cast<UniformFunctionType*>(this->m_Memberships[nregions + s].GetPointer());
+		this->m_SpecialValues[s] = (uf != NULL)?uf->GetValue():0.0;
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::EvaluateBatch(size_t nsamples, size_t ncomps, const PixelValueType * x, MeasureType * out) const {
+	if ( ncomps != this->m_NumberOfComponents ) {
+		itkExceptionMacro(<< "model was compiled for " << this->m_NumberOfComponents << " components, got " << ncomps << ".");
+	}
+
+	const size_t nout = this->m_NumberOfRegions;
+	const size_t nregions = nout - this->m_NumberOfSpecialRegions;
+	const size_t BlockSize = 64;
+
+	std::vector<double> xs(ncomps * BlockSize);  // block of samples, one component after another
+	std::vector<double> diff(ncomps * BlockSize);
+	double y[BlockSize], acc[BlockSize];
+	bool valid[BlockSize];
+
+	for( size_t b0 = 0; b0 < nsamples; b0 += BlockSize ) {
+		size_t bn = nsamples - b0;
+		if ( bn > BlockSize ) bn = BlockSize;
+
+		// Transpose the block, and flag invalid samples (all components zero)
+		for( size_t i = 0; i < bn; i++ ) {
+			valid[i] = false;
+			for( size_t c = 0; c < ncomps; c++ ) {
+				xs[c * BlockSize + i] = x[(b0 + i) * ncomps + c];
+				valid[i] = valid[i] || ( x[(b0 + i) * ncomps + c] != 0 );
+			}
+		}
+
+		for( size_t roi = 0; roi < nregions; roi++ ) {
+			const double* mu = &this->m_PackedMeans[roi * ncomps];
+			const double* w = &this->m_PackedWhitening[roi * ncomps * ncomps];
+
+			for( size_t c = 0; c < ncomps; c++ ) {
+				for( size_t i = 0; i < bn; i++ ) {
+					diff[c * BlockSize + i] = xs[c * BlockSize + i] - mu[c];
+				}
+			}
+
+			std::fill(acc, acc + bn, 0.0);
+			for( size_t r = 0; r < ncomps; r++ ) {
+				std::fill(y, y + bn, 0.0);
+				for( size_t c = 0; c < ncomps; c++ ) {
+					double wrc = w[r * ncomps + c];
+					if ( wrc == 0.0 ) continue;
+					const double* d = &diff[c * BlockSize];
+					for( size_t i = 0; i < bn; i++ ) {
+						y[i] += wrc * d[i];
+					}
+				}
+				for( size_t i = 0; i < bn; i++ ) {
+					acc[i] += y[i] * y[i];
+				}
+			}
+
+			double maxv = this->m_PackedMaximum[roi];
+			for( size_t i = 0; i < bn; i++ ) {
+				out[(b0 + i) * nout + roi] = valid[i]?std::min(acc[i], maxv):0.0;
+			}
+		}
+
+		for( size_t s = 0; s < this->m_NumberOfSpecialRegions; s++ ) {
+			for( size_t i = 0; i < bn; i++ ) {
+				out[(b0 + i) * nout + nregions + s] = valid[i]?this->m_SpecialValues[s]:0.0;
+			}
+		}
+	}
 }
 
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
@@ -406,6 +543,84 @@ MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 	this->PostGenerateData();
 }
 
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::SaveDescriptors(CheckpointFile& f) const {
+	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+	f.Write< std::uint64_t >(nregions);
+	f.Write< std::uint64_t >(this->m_NumberOfSpecialRegions);
+	f.Write(this->m_MaxEnergy);
+
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		size_t ncomps = itk::NumericTraits<MeasurementVectorType>::GetLength(this->m_Means[roi]);
+		f.Write< std::uint64_t >(ncomps);
+		for( size_t i = 0; i < ncomps; i++ ) {
+			f.Write(this->m_Means[roi][i]);
+			f.Write(this->m_RangeLower[roi][i]);
+			f.Write(this->m_RangeUpper[roi][i]);
+			for( size_t j = 0; j < ncomps; j++ ) {
+				f.Write(this->m_Covariances[roi](i, j));
+			}
+		}
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::LoadDescriptors(CheckpointFile& f) {
+	size_t nregions = f.Read< std::uint64_t >();
+	this->m_NumberOfSpecialRegions = f.Read< std::uint64_t >();
+	this->m_NumberOfRegions = nregions + this->m_NumberOfSpecialRegions;
+	f.Read(this->m_MaxEnergy);
+
+	this->m_Memberships.resize(this->m_NumberOfRegions);
+	this->m_Means.resize(nregions);
+	this->m_RangeLower.resize(nregions);
+	this->m_RangeUpper.resize(nregions);
+	this->m_Covariances.resize(nregions);
+	this->m_RegionOffsetContainer.SetSize(nregions);
+	this->m_RegionOffsetContainer.Fill(0.0);
+
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		size_t ncomps = f.Read< std::uint64_t >();
+
+		MeasurementVectorType mean;
+		MeasurementVectorType lower;
+		MeasurementVectorType upper;
+		CovarianceMatrixType cov(ncomps, ncomps);
+		mean.SetSize(ncomps);
+		lower.SetSize(ncomps);
+		upper.SetSize(ncomps);
+		for( size_t i = 0; i < ncomps; i++ ) {
+			f.Read(mean[i]);
+			f.Read(lower[i]);
+			f.Read(upper[i]);
+			for( size_t j = 0; j < ncomps; j++ ) {
+				f.Read(cov(i, j));
+			}
+		}
+
+		// Memberships are rebuilt as in EstimateRobust
+		InternalFunctionPointer mf = InternalFunctionType::New();
+		mf->SetMean(mean);
+		mf->SetCovariance(cov);
+		mf->SetRange(lower, upper);
+		mf->Initialize();
+
+		this->m_Memberships[roi] = mf;
+		this->m_RegionOffsetContainer[roi] = mf->GetOffsetTerm();
+		this->m_Means[roi] = mean;
+		this->m_RangeLower[roi] = lower;
+		this->m_RangeUpper[roi] = upper;
+		this->m_Covariances[roi] = cov;
+	}
+
+	this->PostGenerateData();
+	this->Modified();
+}
+
 }
 
 
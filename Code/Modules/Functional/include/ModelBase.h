@@ -32,6 +32,8 @@
 #include <itkNumericTraitsCovariantVectorPixel.h>
 #include <itkVectorImageToImageAdaptor.h>
 
+#include "CheckpointFile.h"
+
 namespace rstk {
 
 template< typename TInputVectorImage, typename TPriorsPrecisionType = float>
@@ -93,6 +95,12 @@ public:
 	 * to a real number. */
 	virtual double Evaluate(const MeasurementVectorType & x, const RegionIdentifier roi) const = 0;
 
+	/** Evaluate all the regions for a batch of nsamples measurements, given
+	 * row-wise in x (ncomps values per sample). The energies are written
+	 * row-wise in out (GetNumberOfRegions() values per sample). The default
+	 * implementation calls Evaluate() for every sample and region. */
+	virtual void EvaluateBatch(size_t nsamples, size_t ncomps, const PixelValueType * x, MeasureType * out) const;
+
     /** Set/Get priors
      *
      */
@@ -122,7 +130,12 @@ public:
 	virtual std::string PrintFormattedDescriptors() = 0;
 	virtual void ReadDescriptorsFromFile(std::string filename) = 0;
 
+	/** Exact binary copy of the descriptors, for checkpointing */
+	virtual void SaveDescriptors(CheckpointFile& f) const = 0;
+	virtual void LoadDescriptors(CheckpointFile& f) = 0;
+
 	itkGetConstMacro(MaxEnergy, MeasureType);
+	itkGetConstMacro(NumberOfRegions, RegionIdentifier);
 
 	itkSetMacro(NumberOfSpecialRegions, size_t);
 	itkGetMacro(NumberOfSpecialRegions, size_t);
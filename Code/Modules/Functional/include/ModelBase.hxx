@@ -50,5 +50,22 @@ ModelBase< TInputVectorImage, TPriorsPrecisionType >
   return MembershipFunctionsObject::New().GetPointer();
 }
 
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+ModelBase< TInputVectorImage, TPriorsPrecisionType >
+::EvaluateBatch(size_t nsamples, size_t ncomps, const PixelValueType * x, MeasureType * out) const {
+	MeasurementVectorType v;
+	itk::NumericTraits<MeasurementVectorType>::SetLength(v, ncomps);
+
+	for( size_t i = 0; i < nsamples; i++ ) {
+		for( size_t c = 0; c < ncomps; c++ ) {
+			v[c] = x[i * ncomps + c];
+		}
+		for( RegionIdentifier roi = 0; roi < this->m_NumberOfRegions; roi++ ) {
+			out[i * this->m_NumberOfRegions + roi] = this->Evaluate(v, roi);
+		}
+	}
+}
+
 } // namespace rstk
 #endif /* _MODELBASE_HXX_ */
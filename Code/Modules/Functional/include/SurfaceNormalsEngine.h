@@ -0,0 +1,129 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SURFACENORMALSENGINE_H_
+#define SURFACENORMALSENGINE_H_
+
+#include <vector>
+
+#include <itkObject.h>
+#include <itkVector.h>
+
+#include "ThreadPool.h"
+
+namespace rstk {
+/** \class SurfaceNormalsEngine
+ *  \brief Computes vertex normals and areas of a set of triangulated surfaces
+ *  with frozen topology.
+ *
+ *  The one-ring (vertex to incident faces) adjacency of all the surfaces held
+ *  by a FlatContourStore is built once, in CSR form, by Initialize().
+ *  Compute() only reads the current vertex coordinates from the store, so no
+ *  mesh copy nor cell traversal is required between iterations.
+ *
+ *  Vertex normals are the area-weighted average of the incident face normals,
+ *  as NormalQuadEdgeMeshFilter with the AREA weight. Vertex areas are the
+ *  mixed Voronoi areas (Meyer et al., 2003), which sum up to the total area of
+ *  each surface.
+ *
+ *  Vertices are identified by their universal id in the store.
+ *
+ *  \ingroup Functional
+ *  \ingroup RSTK
+ */
+template< typename TStore >
+class SurfaceNormalsEngine: public itk::Object {
+public:
+	typedef SurfaceNormalsEngine             Self;
+	typedef itk::Object                      Superclass;
+	typedef itk::SmartPointer<Self>          Pointer;
+	typedef itk::SmartPointer< const Self >  ConstPointer;
+
+	itkTypeMacro(SurfaceNormalsEngine, itk::Object);
+	itkNewMacro(Self);
+
+	itkStaticConstMacro( Dimension, unsigned int, TStore::Dimension );
+
+	typedef TStore                                           StoreType;
+	typedef typename StoreType::ConstPointer                 StoreConstPointer;
+	typedef typename StoreType::ValueType                    ValueType;
+	typedef typename StoreType::VectorType                   VectorType;
+
+	typedef std::vector< VectorType >                        NormalsContainer;
+	typedef std::vector< double >                            AreasContainer;
+	typedef std::vector< size_t >                            IndexContainer;
+
+	/** Freeze the topology of the surfaces in store */
+	void Initialize( const StoreType* store );
+
+	/** Recompute normals and areas from the current coordinates in the store */
+	void Compute();
+
+	itkSetObjectMacro( ThreadPool, ThreadPool );
+	itkGetObjectMacro( ThreadPool, ThreadPool );
+
+	const NormalsContainer& GetNormals() const { return this->m_Normals; }
+	const AreasContainer& GetAreas() const { return this->m_Areas; }
+	const AreasContainer& GetTotalAreas() const { return this->m_TotalAreas; }
+
+	const VectorType& GetNormal( size_t uvid ) const { return this->m_Normals[uvid]; }
+	double GetArea( size_t uvid ) const { return this->m_Areas[uvid]; }
+
+protected:
+	SurfaceNormalsEngine();
+	~SurfaceNormalsEngine() {}
+
+	void PrintSelf( std::ostream & os, itk::Indent indent ) const override;
+
+	void ComputeFaces( size_t start, size_t stop );
+	void ComputeVertices( size_t start, size_t stop );
+
+private:
+	SurfaceNormalsEngine(const Self &);  //purposely not implemented
+	void operator=(const Self &);        //purposely not implemented
+
+	StoreConstPointer m_Store;
+
+	std::vector< ValueType > m_FaceSign; // orientation sign of each triangle
+	IndexContainer m_RingOffsets;        // CSR row pointers (one row per vertex)
+	IndexContainer m_RingCorners;        // CSR columns, face * 3 + corner
+
+	std::vector< VectorType > m_FaceNormals;   // area-weighted face normals
+	std::vector< double > m_CornerAreas;       // Voronoi area of each corner
+
+	NormalsContainer m_Normals;
+	AreasContainer m_Areas;
+	AreasContainer m_TotalAreas;
+
+	ThreadPool::Pointer m_ThreadPool;
+};
+
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SurfaceNormalsEngine.hxx"
+#endif
+
+#endif /* SURFACENORMALSENGINE_H_ */
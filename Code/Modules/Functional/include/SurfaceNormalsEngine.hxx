@@ -0,0 +1,210 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SURFACENORMALSENGINE_HXX_
+#define SURFACENORMALSENGINE_HXX_
+
+#include "SurfaceNormalsEngine.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vnl/vnl_cross.h>
+
+namespace rstk {
+
+template< typename TStore >
+SurfaceNormalsEngine<TStore>
+::SurfaceNormalsEngine() {}
+
+template< typename TStore >
+void
+SurfaceNormalsEngine<TStore>
+::Initialize( const StoreType* store ) {
+	this->m_Store = store;
+
+	const typename StoreType::IdentifierArray& faces = store->GetFaces();
+	const typename StoreType::IdentifierArray& foffsets = store->GetFaceOffsets();
+	size_t nfaces = store->GetNumberOfFaces();
+	size_t nverts = store->GetNumberOfVertices();
+	size_t nsurfs = store->GetNumberOfSurfaces();
+
+	// Same winding test as NormalQuadEdgeMeshFilter, evaluated only once per surface
+	this->m_FaceSign.resize( nfaces );
+	for( size_t sid = 0; sid < nsurfs; sid++ ) {
+		double center[3][2] = { { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 } };
+		for( size_t f = foffsets[sid], k = 0; f < foffsets[sid + 1] && k < 3; f++, k++ ) {
+			for( size_t c = 0; c < 3; c++ ) {
+				center[k][0] += store->GetCurrent(0)[faces[3 * f + c]] / 3.0;
+				center[k][1] += store->GetCurrent(1)[faces[3 * f + c]] / 3.0;
+			}
+		}
+		double test = (center[1][0] - center[0][0]) * (center[1][1] + center[0][1]) +
+		              (center[2][0] - center[1][0]) * (center[2][1] + center[1][1]) +
+		              (center[0][0] - center[2][0]) * (center[0][1] + center[2][1]);
+		std::fill( this->m_FaceSign.begin() + foffsets[sid], this->m_FaceSign.begin() + foffsets[sid + 1],
+		           (test < 0)?-1.0:1.0 );
+	}
+
+	// Count incident faces per vertex, then fill in place
+	this->m_RingOffsets.assign( nverts + 1, 0 );
+	for( size_t i = 0; i < faces.size(); i++ ) {
+		this->m_RingOffsets[faces[i] + 1]++;
+	}
+	for( size_t v = 0; v < nverts; v++ ) {
+		this->m_RingOffsets[v + 1] += this->m_RingOffsets[v];
+	}
+
+	IndexContainer fill( this->m_RingOffsets.begin(), this->m_RingOffsets.end() - 1 );
+	this->m_RingCorners.resize( faces.size() );
+	for( size_t i = 0; i < faces.size(); i++ ) {
+		this->m_RingCorners[fill[faces[i]]++] = i;
+	}
+
+	this->m_Normals.resize( nverts );
+	this->m_Areas.resize( nverts );
+	this->m_TotalAreas.resize( nsurfs );
+	this->m_FaceNormals.resize( nfaces );
+	this->m_CornerAreas.resize( faces.size() );
+	this->Modified();
+}
+
+template< typename TStore >
+void
+SurfaceNormalsEngine<TStore>
+::Compute() {
+	if ( this->m_Store.IsNull() ) {
+		itkExceptionMacro(<< "engine has not been initialized.");
+	}
+
+	if ( this->m_ThreadPool.IsNull() ) {
+		this->m_ThreadPool = ThreadPool::New();
+	}
+
+	this->m_ThreadPool->ParallelFor( this->m_Store->GetNumberOfFaces(),
+			[this](size_t start, size_t stop, itk::ThreadIdType) { this->ComputeFaces(start, stop); });
+	this->m_ThreadPool->ParallelFor( this->m_Store->GetNumberOfVertices(),
+			[this](size_t start, size_t stop, itk::ThreadIdType) { this->ComputeVertices(start, stop); });
+
+	const typename StoreType::IdentifierArray& offsets = this->m_Store->GetSurfaceOffsets();
+	for( size_t sid = 0; sid < this->m_TotalAreas.size(); sid++ ) {
+		double total = 0.0;
+		for( size_t v = offsets[sid]; v < offsets[sid + 1]; v++ ) {
+			total += this->m_Areas[v];
+		}
+		this->m_TotalAreas[sid] = total;
+	}
+}
+
+template< typename TStore >
+void
+SurfaceNormalsEngine<TStore>
+::ComputeFaces( size_t start, size_t stop ) {
+	const typename StoreType::IdentifierArray& faces = this->m_Store->GetFaces();
+	const typename StoreType::CoordinateArray* x[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		x[d] = &this->m_Store->GetCurrent(d);
+	}
+
+	VectorType ab, ac, bc;
+	for( size_t f = start; f < stop; f++ ) {
+		const typename StoreType::IdentifierType* ids = &faces[3 * f];
+		for( size_t d = 0; d < Dimension; d++ ) {
+			ab[d] = (*x[d])[ids[1]] - (*x[d])[ids[0]];
+			ac[d] = (*x[d])[ids[2]] - (*x[d])[ids[0]];
+			bc[d] = (*x[d])[ids[2]] - (*x[d])[ids[1]];
+		}
+
+		// |cross| is twice the triangle area, so half of it is the area-weighted unit normal
+		VectorType cr;
+		cr.SetVnlVector( vnl_cross_3d( ab.GetVnlVector(), ac.GetVnlVector() ) );
+		double area2 = cr.GetNorm();
+		this->m_FaceNormals[f] = cr * static_cast<ValueType>( 0.5 * this->m_FaceSign[f] );
+
+		double* corner = &this->m_CornerAreas[3 * f];
+		if ( area2 < 1.0e-12 ) {
+			corner[0] = corner[1] = corner[2] = 0.0;
+			continue;
+		}
+
+		double area = 0.5 * area2;
+		double da = ab * ac;            // cos at a, times |ab||ac|
+		double db = -1.0 * (ab * bc);   // cos at b
+		double dc = ac * bc;            // cos at c
+
+		if ( da < 0.0 || db < 0.0 || dc < 0.0 ) {
+			// Obtuse triangle: half the area to the obtuse corner, a quarter to the others
+			corner[0] = (da < 0.0)?(0.5 * area):(0.25 * area);
+			corner[1] = (db < 0.0)?(0.5 * area):(0.25 * area);
+			corner[2] = (dc < 0.0)?(0.5 * area):(0.25 * area);
+		} else {
+			double cota = da / area2;
+			double cotb = db / area2;
+			double cotc = dc / area2;
+			double lab = ab.GetSquaredNorm();
+			double lac = ac.GetSquaredNorm();
+			double lbc = bc.GetSquaredNorm();
+			corner[0] = 0.125 * ( lab * cotc + lac * cotb );
+			corner[1] = 0.125 * ( lab * cotc + lbc * cota );
+			corner[2] = 0.125 * ( lac * cotb + lbc * cota );
+		}
+	}
+}
+
+template< typename TStore >
+void
+SurfaceNormalsEngine<TStore>
+::ComputeVertices( size_t start, size_t stop ) {
+	for( size_t v = start; v < stop; v++ ) {
+		VectorType n;
+		n.Fill(0.0);
+		double a = 0.0;
+
+		for( size_t r = this->m_RingOffsets[v]; r < this->m_RingOffsets[v + 1]; r++ ) {
+			size_t corner = this->m_RingCorners[r];
+			n += this->m_FaceNormals[corner / 3];
+			a += this->m_CornerAreas[corner];
+		}
+
+		double norm = n.GetNorm();
+		if ( norm > 1.0e-12 ) {
+			n /= static_cast<ValueType>( norm );
+		}
+		this->m_Normals[v] = n;
+		this->m_Areas[v] = a;
+	}
+}
+
+template< typename TStore >
+void
+SurfaceNormalsEngine<TStore>
+::PrintSelf( std::ostream & os, itk::Indent indent ) const {
+	Superclass::PrintSelf( os, indent );
+	os << indent << "NumberOfVertices: " << this->m_Normals.size() << std::endl;
+	os << indent << "NumberOfFaces: " << this->m_FaceNormals.size() << std::endl;
+}
+
+} // end namespace rstk
+
+#endif /* SURFACENORMALSENGINE_HXX_ */
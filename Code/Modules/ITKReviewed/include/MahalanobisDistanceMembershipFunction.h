@@ -113,6 +113,9 @@ public:
    * VariableSizeMatrix of doubles. */
   itkGetConstReferenceMacro(Covariance, CovarianceMatrixType);
 
+  /** Get the inverse of the covariance matrix, as used by Evaluate() */
+  itkGetConstReferenceMacro(InverseCovariance, CovarianceMatrixType);
+
   /**
    * Evaluate the Mahalanobis distance of a measurement using the
    * prescribed mean and covariance. Note that the Mahalanobis
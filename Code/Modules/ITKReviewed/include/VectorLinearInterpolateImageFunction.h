@@ -95,6 +95,24 @@ public:
   virtual OutputType EvaluateAtContinuousIndex(
     const ContinuousIndexType & index) const override;
 
+  /** Evaluate the function at a batch of points
+   *
+   * Physical coordinates of the npoints points are given in structure-of-arrays
+   * form, i.e. coords[dim][i]. The interpolated values are written row-wise in
+   * the dense buffer out, which must hold npoints * ncomps elements. The
+   * physical-to-index transform is computed once per call and indices are
+   * computed in blocks, before gathering the channels of each neighbour
+   * contiguously from the pixel buffer.
+   *
+   * Points outside the largest possible region (the same test used by
+   * SafeEvaluate) get a row of zeros and, if inside is not null, a zero in
+   * inside[i]. Returns the number of points inside. */
+  template< typename TPointValue, typename TOutputValue >
+  size_t EvaluateBatch( size_t npoints,
+                        const TPointValue * const coords[ImageDimension],
+                        TOutputValue * out,
+                        unsigned char * inside = ITK_NULLPTR ) const;
+
 protected:
   VectorLinearInterpolateImageFunction();
   ~VectorLinearInterpolateImageFunction(){}
@@ -108,6 +126,9 @@ private:
 
   /** Number of neighbors used in the interpolation */
   static const unsigned long m_Neighbors;
+
+  /** Number of points whose indices are computed together in EvaluateBatch */
+  static const size_t m_BatchBlockSize = 64;
 };
 } // end namespace itk
 
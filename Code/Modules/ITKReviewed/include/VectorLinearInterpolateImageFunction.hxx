@@ -29,6 +29,11 @@
 #include "VectorLinearInterpolateImageFunction.h"
 
 #include "vnl/vnl_math.h"
+#include "vnl/vnl_matrix.h"
+#include "vnl/algo/vnl_matrix_inverse.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace rstk
 {
@@ -40,6 +45,11 @@ const unsigned long
 VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
 ::m_Neighbors = 1 << TInputImage::ImageDimension;
 
+template< typename TInputImage, typename TCoordRep >
+const size_t
+VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::m_BatchBlockSize;
+
 /**
  * Constructor
  */
@@ -150,6 +160,143 @@ VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
 
   return ( output );
 }
+
+/**
+ * Evaluate at a batch of physical points
+ */
+template< typename TInputImage, typename TCoordRep >
+template< typename TPointValue, typename TOutputValue >
+size_t
+VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::EvaluateBatch( size_t npoints,
+                 const TPointValue * const coords[ImageDimension],
+                 TOutputValue * out,
+                 unsigned char * inside ) const
+{
+  const TInputImage * const inputImgPtr = this->GetInputImage();
+  const size_t ncomps = inputImgPtr->GetNumberOfComponentsPerPixel();
+  const ValueType * buffer = reinterpret_cast< const ValueType * >( inputImgPtr->GetBufferPointer() );
+
+  // Physical point to continuous index transform, computed once
+  vnl_matrix< double > indexToPhysical( ImageDimension, ImageDimension );
+  for ( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    for ( unsigned int j = 0; j < ImageDimension; ++j )
+      {
+      indexToPhysical( i, j ) = inputImgPtr->GetDirection()( i, j ) * inputImgPtr->GetSpacing()[j];
+      }
+    }
+  const vnl_matrix< double > physicalToIndex = vnl_matrix_inverse< double >( indexToPhysical );
+  const typename TInputImage::PointType origin = inputImgPtr->GetOrigin();
+
+  // Bounds for the inside test (as TransformPhysicalPointToContinuousIndex),
+  // for neighbour clamping and buffer strides
+  const typename TInputImage::RegionType & largest = inputImgPtr->GetLargestPossibleRegion();
+  const typename TInputImage::RegionType & buffered = inputImgPtr->GetBufferedRegion();
+  double lower[ImageDimension], upper[ImageDimension];
+  itk::IndexValueType bufferStart[ImageDimension];
+  itk::OffsetValueType stride[ImageDimension];
+  itk::OffsetValueType s = 1;
+  for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+    {
+    lower[dim] = largest.GetIndex()[dim] - 0.5;
+    upper[dim] = largest.GetIndex()[dim] + static_cast< double >( largest.GetSize()[dim] ) - 1.0;
+    bufferStart[dim] = buffered.GetIndex()[dim];
+    stride[dim] = s;
+    s *= buffered.GetSize()[dim];
+    }
+
+  double cidx[ImageDimension][m_BatchBlockSize];
+  std::vector< InternalComputationType > acc( ncomps );
+  size_t ninside = 0;
+
+  for ( size_t b0 = 0; b0 < npoints; b0 += m_BatchBlockSize )
+    {
+    const size_t bn = std::min( m_BatchBlockSize, npoints - b0 );
+
+    // Continuous indices of the block, one dimension at a time
+    for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+      {
+      for ( size_t i = 0; i < bn; ++i )
+        {
+        double c = 0.0;
+        for ( unsigned int k = 0; k < ImageDimension; ++k )
+          {
+          c += physicalToIndex( dim, k ) * ( coords[k][b0 + i] - origin[k] );
+          }
+        cidx[dim][i] = c;
+        }
+      }
+
+    for ( size_t i = 0; i < bn; ++i )
+      {
+      TOutputValue * row = out + ( b0 + i ) * ncomps;
+
+      bool isInside = true;
+      for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+        {
+        isInside = isInside && ( cidx[dim][i] >= lower[dim] ) && ( cidx[dim][i] <= upper[dim] );
+        }
+
+      if ( inside != ITK_NULLPTR )
+        {
+        inside[b0 + i] = isInside;
+        }
+
+      if ( !isInside )
+        {
+        std::fill( row, row + ncomps, itk::NumericTraits< TOutputValue >::ZeroValue() );
+        continue;
+        }
+      ninside++;
+
+      // Offsets and weights of the lower/upper neighbour along each axis
+      itk::OffsetValueType offset[ImageDimension][2];
+      InternalComputationType weight[ImageDimension][2];
+      for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+        {
+        const itk::IndexValueType base = itk::Math::Floor< itk::IndexValueType >( cidx[dim][i] );
+        const InternalComputationType distance = cidx[dim][i] - static_cast< InternalComputationType >( base );
+        const itk::IndexValueType lo = std::max( base, this->m_StartIndex[dim] );
+        const itk::IndexValueType hi = std::min( base + 1, this->m_EndIndex[dim] );
+        offset[dim][0] = ( lo - bufferStart[dim] ) * stride[dim];
+        offset[dim][1] = ( hi - bufferStart[dim] ) * stride[dim];
+        weight[dim][0] = 1.0 - distance;
+        weight[dim][1] = distance;
+        }
+
+      std::fill( acc.begin(), acc.end(), 0.0 );
+      for ( unsigned int counter = 0; counter < m_Neighbors; ++counter )
+        {
+        InternalComputationType overlap = 1.0;
+        itk::OffsetValueType neighOffset = 0;
+        unsigned int upperBits = counter;
+        for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+          {
+          overlap *= weight[dim][upperBits & 1];
+          neighOffset += offset[dim][upperBits & 1];
+          upperBits >>= 1;
+          }
+
+        if ( overlap )
+          {
+          const ValueType * px = buffer + neighOffset * ncomps;
+          for ( size_t k = 0; k < ncomps; ++k )
+            {
+            acc[k] += overlap * static_cast< InternalComputationType >( px[k] );
+            }
+          }
+        }
+
+      for ( size_t k = 0; k < ncomps; ++k )
+        {
+        row[k] = static_cast< TOutputValue >( acc[k] );
+        }
+      }
+    }
+
+  return ninside;
+}
 } // end namespace itk
 
 #endif
@@ -0,0 +1,96 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef ITERATIONCHECKPOINTUPDATE_H_
+#define ITERATIONCHECKPOINTUPDATE_H_
+
+#include <itkCommand.h>
+#include <itkWeakPointer.h>
+
+
+namespace rstk {
+
+/** \class IterationCheckpointUpdate
+ *  \brief Asks the registration method to store a checkpoint every
+ *  Period iterations of the optimizer.
+ */
+template< typename TOptimizer, typename TRegistrationMethod >
+class IterationCheckpointUpdate: public itk::Command
+{
+public:
+	typedef IterationCheckpointUpdate                          Self;
+	typedef TOptimizer                                         OptimizerType;
+	typedef typename itk::WeakPointer<OptimizerType>           OptimizerPointer;
+	typedef TRegistrationMethod                                RegistrationMethodType;
+	typedef typename itk::WeakPointer<RegistrationMethodType>  RegistrationMethodPointer;
+	typedef itk::Command                                       Superclass;
+	typedef itk::SmartPointer<Self>                            Pointer;
+	typedef itk::SmartPointer< const Self >                    ConstPointer;
+
+	itkTypeMacro( IterationCheckpointUpdate, itk::Command ); // Run-time type information (and related methods)
+	itkNewMacro( Self );
+
+    void Execute(itk::Object *caller, const itk::EventObject & event) override {
+        Execute( (const itk::Object *)caller, event);
+    }
+
+    void Execute(const itk::Object * object, const itk::EventObject & event) override {
+    	if( this->m_Period == 0 ) return;
+
+    	if( typeid( event ) == typeid( itk::IterationEvent ) ) {
+    		if ( this->m_Optimizer->GetCurrentIteration() % this->m_Period == 0 ) {
+    			this->m_RegistrationMethod->SaveCheckpoint();
+    		}
+    	}
+    }
+
+    void SetOptimizer( OptimizerType * optimizer ) {
+      m_Optimizer = optimizer;
+      m_Optimizer->AddObserver( itk::IterationEvent(), this );
+    }
+
+    void SetRegistrationMethod( RegistrationMethodType * _arg ) {
+      m_RegistrationMethod = _arg;
+    }
+
+    itkSetMacro( Period, size_t );
+    itkGetConstMacro( Period, size_t );
+protected:
+	IterationCheckpointUpdate(): m_Period(0) {}
+	~IterationCheckpointUpdate(){}
+
+private:
+	IterationCheckpointUpdate( const Self & ); // purposely not implemented
+	void operator=( const Self & ); // purposely not implemented
+
+	OptimizerPointer            m_Optimizer;
+	RegistrationMethodPointer   m_RegistrationMethod;
+	size_t                      m_Period;
+};
+
+} // end namespace rstk
+
+
+#endif /* ITERATIONCHECKPOINTUPDATE_H_ */
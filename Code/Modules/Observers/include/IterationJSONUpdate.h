@@ -134,6 +134,14 @@ public:
 				gnode.append(Json::Value(arr[a]));
 			itnode["gradient_stats"] = gnode;
 
+			typename OptimizerType::FunctionalType::LoadStatistics ls = this->m_Optimizer->GetFunctional()->GetLoadStatistics();
+			itnode["load_balance"]["wall"] = ls.wall;
+			itnode["load_balance"]["max_busy"] = ls.maxBusy;
+			itnode["load_balance"]["mean_busy"] = ls.meanBusy;
+			itnode["load_balance"]["imbalance"] = ls.imbalance;
+			itnode["load_balance"]["chunks"] = static_cast<Json::UInt64>( ls.chunks );
+			itnode["load_balance"]["stolen"] = static_cast<Json::UInt64>( ls.stolen );
+
 			std::vector< size_t > off = this->m_Optimizer->GetFunctional()->GetOffMaskVertices();
 			JSONValue offnode = Json::Value( Json::arrayValue );
 			for (size_t c = 0; c<off.size(); c++) {
@@ -32,6 +32,7 @@
 #include <itkObjectToObjectOptimizerBase.h>
 
 #include <itkWindowConvergenceMonitoringFunction.h>
+#include <deque>
 #include <vector>
 
 #include <itkImageIteratorWithIndex.h>
@@ -39,6 +40,7 @@
 
 #include "rstkMacro.h"
 #include "ConfigurableObject.h"
+#include "CheckpointFile.h"
 
 using namespace itk;
 namespace bpo = boost::program_options;
@@ -213,6 +215,11 @@ public:
 	itkSetMacro(Coefficients, CoefficientsImageArray);
 	itkGetConstMacro(Coefficients, CoefficientsImageArray);
 
+	/** Coefficients left on the transform once the optimization finished */
+	virtual const CoefficientsImageArray & GetOutputCoefficients() const {
+		return this->m_Coefficients;
+	}
+
 	itkSetMacro(DerivativeCoefficients, CoefficientsImageArray);
 	itkGetConstMacro(DerivativeCoefficients, CoefficientsImageArray);
 
@@ -234,6 +241,24 @@ public:
 	virtual MeasureType GetCurrentRegularizationEnergy() = 0;
 	virtual MeasureType GetCurrentEnergy() = 0;
 
+	/** Append the state needed to continue the optimization (iterates, step
+	 *  control, convergence window and functional descriptors) to f */
+	virtual void SaveState( CheckpointFile& f ) const;
+
+	/** State saved by SaveState, restored by Start() once the parameters are
+	 *  initialized. The file must be positioned at the optimizer state. */
+	void SetInitialState( CheckpointFile* f ) { this->m_InitialState = f; }
+
+	/** Coefficients to start from instead of the zero displacement. They
+	 *  must be defined on the control grid of this optimizer */
+	void SetInitialCoefficients( const CoefficientsImageArray& c ) {
+		this->m_InitialCoefficients = c;
+		this->Modified();
+	}
+
+	/** Dense displacement to start from, fitted onto the control grid */
+	itkSetObjectMacro( InitialDisplacementField, FieldType );
+
 	static void AddOptions( SettingsDesc& opts );
 protected:
 	OptimizerBase();
@@ -246,6 +271,21 @@ protected:
 	virtual void ComputeDerivative() = 0;
 	virtual void Iterate() = 0;
 	virtual void PostIteration() = 0;
+	virtual void UpdateStepSize();
+	virtual void FinalizeParameters() {}
+	virtual void LoadState( CheckpointFile& f );
+
+	/** Propagate the restored iterate to the transform and the functional */
+	virtual void SynchronizeState() {}
+
+	/** Set the initial coefficients from InitialCoefficients or
+	 *  InitialDisplacementField, once the control grid is initialized */
+	virtual void SeedCoefficients() {
+		itkExceptionMacro(<< "this optimizer cannot start from a given displacement.");
+	}
+
+	/** Scheme-specific convergence test, checked after the convergence monitor */
+	virtual bool HasConverged() { return false; }
 
 	virtual bool DoDescriptorsUpdate();
 
@@ -276,6 +316,10 @@ protected:
 
 	/** The convergence checker. */
 	typename ConvergenceMonitoringType::Pointer m_ConvergenceMonitoring;
+	std::deque< MeasureType > m_ConvergenceHistory;  // values held by the checker window
+	CheckpointFile* m_InitialState;
+	CoefficientsImageArray m_InitialCoefficients;
+	FieldPointer m_InitialDisplacementField;
 
 
 	/* Common variables for optimization control and reporting */
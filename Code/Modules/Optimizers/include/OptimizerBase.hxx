@@ -60,6 +60,7 @@ m_MaximumGradient(itk::NumericTraits<InternalComputationValueType>::infinity()),
 m_MinimumConvergenceValue( 1e-5 ),
 m_ConvergenceWindowSize( 10 ),
 m_ConvergenceValue( itk::NumericTraits<InternalComputationValueType>::infinity() ),
+m_InitialState( ITK_NULLPTR ),
 m_Stop( false ),
 m_StopCondition(MAXIMUM_NUMBER_OF_ITERATIONS),
 m_DescriptorRecompPeriod(0),
@@ -115,6 +116,12 @@ void OptimizerBase<TFunctional>::Start() {
 
 	/* Check & initialize parameter fields */
 	this->InitializeParameters();
+
+	bool seeded = this->m_InitialDisplacementField.IsNotNull() || this->m_InitialCoefficients[0].IsNotNull();
+	if ( seeded ) {
+		this->SeedCoefficients();
+	}
+
 	this->InitializeAuxiliarParameters();
 
 	if (this->m_UseAdaptativeDescriptors ) {
@@ -130,6 +137,15 @@ void OptimizerBase<TFunctional>::Start() {
 	/* Initialize convergence checker */
 	this->m_ConvergenceMonitoring = ConvergenceMonitoringType::New();
 	this->m_ConvergenceMonitoring->SetWindowSize( this->m_ConvergenceWindowSize );
+	this->m_ConvergenceHistory.clear();
+
+	if ( this->m_InitialState != ITK_NULLPTR ) {
+		this->LoadState( *this->m_InitialState );
+		this->m_InitialState = ITK_NULLPTR;
+		this->SynchronizeState();
+	} else if ( seeded ) {
+		this->SynchronizeState();
+	}
 
 //	if( this->m_ReturnBestParametersAndValue )	{
 //		this->m_BestParameters = this->GetCurrentPosition( );
@@ -212,6 +228,10 @@ void OptimizerBase<TFunctional>::Resume() {
 		 * Check the convergence by WindowConvergenceMonitoringFunction.
 		 */
 		this->m_ConvergenceMonitoring->AddEnergyValue( this->m_CurrentValue );
+		this->m_ConvergenceHistory.push_back( this->m_CurrentValue );
+		while ( this->m_ConvergenceHistory.size() > this->m_ConvergenceWindowSize ) {
+			this->m_ConvergenceHistory.pop_front();
+		}
 
 		try {
 			this->m_ConvergenceValue = this->m_ConvergenceMonitoring->GetConvergenceValue();
@@ -226,6 +246,13 @@ void OptimizerBase<TFunctional>::Resume() {
 			std::cerr << "GetConvergenceValue() failed with exception: " << e.what() << std::endl;
 		}
 
+		if ( this->HasConverged() ) {
+			this->m_StopConditionDescription << "Convergence criteria met at iteration " << this->m_CurrentIteration << ".";
+			this->m_StopCondition = Self::CONVERGENCE_CHECKER_PASSED;
+			this->Stop();
+			break;
+		}
+
 		/* Update and check iteration count */
 		if ( this->m_CurrentIteration >= this->m_NumberOfIterations ) {
 			this->m_StopConditionDescription << "Maximum number of iterations (" << this->m_NumberOfIterations << ") exceeded.";
@@ -242,32 +269,7 @@ void OptimizerBase<TFunctional>::Resume() {
 		}
 
 
-		if (this->m_CurrentIteration > 0){
-			float inc = 1.0;
-			if (this->m_ConvergenceValue != itk::NumericTraits<InternalComputationValueType>::infinity() ) {
-				inc+= this->m_ConvergenceValue;
-			} else {
-				inc = this->m_LastEnergy / this->m_CurrentEnergy;
-			}
-			if (inc < 1.0) {
-				this->m_ValueOscillations += 1;
-				this->m_ValueOscillationsLast = this->m_CurrentIteration;
-			} else if (inc >= 1.0) {
-				if ((this->m_CurrentIteration - this->m_ValueOscillationsLast) > this->m_ValueOscillationsMax) {
-					float factor = inc * (1.0 - ((this->m_CurrentIteration * this->m_CurrentIteration) / this->m_NumberOfIterations));
-					if (factor < 1.0) {
-						factor = 1.0;
-					}
-					this->m_ValueOscillations = 0;
-					this->m_StepSize *=  factor;
-				}
-			}
-
-			if (this->m_ValueOscillations >= this->m_ValueOscillationsMax) {
-				this->m_StepSize *= 0.5;
-				this->m_ValueOscillations = 0;
-			}
-		}
+		this->UpdateStepSize();
 
 		if( this->m_StepSize < 1e-8 ) {
 			this->m_StopConditionDescription << "step size fell below the minimum.";
@@ -281,6 +283,39 @@ void OptimizerBase<TFunctional>::Resume() {
 		this->InvokeEvent( itk::IterationEvent() );
 		this->m_CurrentIteration++;
 	} //while (!m_Stop)
+
+	this->FinalizeParameters();
+}
+
+template< typename TFunctional >
+void OptimizerBase<TFunctional>
+::UpdateStepSize() {
+	if (this->m_CurrentIteration == 0) return;
+
+	float inc = 1.0;
+	if (this->m_ConvergenceValue != itk::NumericTraits<InternalComputationValueType>::infinity() ) {
+		inc+= this->m_ConvergenceValue;
+	} else {
+		inc = this->m_LastEnergy / this->m_CurrentEnergy;
+	}
+	if (inc < 1.0) {
+		this->m_ValueOscillations += 1;
+		this->m_ValueOscillationsLast = this->m_CurrentIteration;
+	} else if (inc >= 1.0) {
+		if ((this->m_CurrentIteration - this->m_ValueOscillationsLast) > this->m_ValueOscillationsMax) {
+			float factor = inc * (1.0 - ((this->m_CurrentIteration * this->m_CurrentIteration) / this->m_NumberOfIterations));
+			if (factor < 1.0) {
+				factor = 1.0;
+			}
+			this->m_ValueOscillations = 0;
+			this->m_StepSize *=  factor;
+		}
+	}
+
+	if (this->m_ValueOscillations >= this->m_ValueOscillationsMax) {
+		this->m_StepSize *= 0.5;
+		this->m_ValueOscillations = 0;
+	}
 }
 
 template< typename TFunctional >
@@ -302,6 +337,73 @@ bool OptimizerBase<TFunctional>
 }
 
 
+template< typename TFunctional >
+void OptimizerBase<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	f.Write< std::uint64_t >( this->m_CurrentIteration );
+	f.Write( this->m_StepSize );
+	f.Write( this->m_LearningRate );
+	f.Write( this->m_Momentum );
+	f.Write( this->m_MaximumGradient );
+	f.Write( this->m_LastMaximumGradient );
+	f.Write( this->m_ConvergenceValue );
+	f.Write( this->m_MaxSpeed );
+	f.Write( this->m_MeanSpeed );
+	f.Write( this->m_AvgSpeed );
+	f.Write( this->m_CurrentValue );
+	f.Write( this->m_CurrentEnergy );
+	f.Write( this->m_LastEnergy );
+	f.Write< std::uint64_t >( this->m_NextRecompIteration );
+	f.Write< std::uint64_t >( this->m_ValueOscillations );
+	f.Write< std::uint64_t >( this->m_ValueOscillationsLast );
+	f.Write( this->m_UseDescriptorRecomputation );
+
+	std::vector< MeasureType > history( this->m_ConvergenceHistory.begin(), this->m_ConvergenceHistory.end() );
+	f.WriteVector( history );
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.WriteImage( this->m_Coefficients[d].GetPointer() );
+	}
+
+	this->m_Functional->SaveState( f );
+}
+
+template< typename TFunctional >
+void OptimizerBase<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	this->m_CurrentIteration = f.Read< std::uint64_t >();
+	f.Read( this->m_StepSize );
+	f.Read( this->m_LearningRate );
+	f.Read( this->m_Momentum );
+	f.Read( this->m_MaximumGradient );
+	f.Read( this->m_LastMaximumGradient );
+	f.Read( this->m_ConvergenceValue );
+	f.Read( this->m_MaxSpeed );
+	f.Read( this->m_MeanSpeed );
+	f.Read( this->m_AvgSpeed );
+	f.Read( this->m_CurrentValue );
+	f.Read( this->m_CurrentEnergy );
+	f.Read( this->m_LastEnergy );
+	this->m_NextRecompIteration = f.Read< std::uint64_t >();
+	this->m_ValueOscillations = f.Read< std::uint64_t >();
+	this->m_ValueOscillationsLast = f.Read< std::uint64_t >();
+	f.Read( this->m_UseDescriptorRecomputation );
+
+	// Replaying the window leaves the checker as it was when saved
+	std::vector< MeasureType > history;
+	f.ReadVector( history );
+	this->m_ConvergenceHistory.assign( history.begin(), history.end() );
+	for( size_t i = 0; i < history.size(); i++ ) {
+		this->m_ConvergenceMonitoring->AddEnergyValue( history[i] );
+	}
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.ReadImage( this->m_Coefficients[d].GetPointer() );
+	}
+
+	this->m_Functional->LoadState( f );
+}
+
 template< typename TFunctional >
 void OptimizerBase<TFunctional>
 ::SetStepSize (const InternalComputationValueType _arg) {
@@ -325,6 +427,12 @@ void OptimizerBase<TFunctional>
 			("convergence-thresh,t", bpo::value< double > (), "convergence value")
 			("grid-size", bpo::value< std::vector<size_t> >()->multitoken(), "size of control points grid")
 			("grid-spacing", bpo::value< std::vector<float> >()->multitoken(), "spacing between control points ")
+			("matrix-cache", bpo::value< std::string >(), "directory to reuse the interpolation matrices across runs")
+			("optimizer", bpo::value< std::string >(), "optimization scheme: gd (gradient descent, default), nesterov (accelerated, with adaptive restart), bb (Barzilai-Borwein step), lbfgs or admm")
+			("lbfgs-memory", bpo::value< size_t >(), "number of correction pairs kept by the lbfgs optimizer")
+			("admm-rho", bpo::value< double >(), "initial penalty of the admm optimizer (default: inverse of the step size)")
+			("line-search", bpo::value< size_t >(), "number of step sizes evaluated concurrently per iteration by the gd optimizer (0=disabled)")
+			("spectral-solver", bpo::value< std::string > (), "regularization solver: fft (periodic boundaries) or dct (symmetric boundaries)")
 			("update-descriptors,u", bpo::value< size_t > (), "frequency (iterations) to update descriptors of regions (0=no update)")
 			("adaptative-descriptors", bpo::bool_switch(), "recomputes descriptors more often at the beginning of the process")
 			("step-auto", bpo::bool_switch(), "guess appropriate step size depending on first iteration")
@@ -379,6 +487,11 @@ void OptimizerBase<TFunctional>
 			this->m_MinimumConvergenceValue = v.as< double >();
 	}
 
+	if( this->m_Settings.count( "matrix-cache" ) ){
+		bpo::variable_value v = this->m_Settings["matrix-cache"];
+		this->m_Transform->SetCacheDirectory( v.as< std::string >() );
+	}
+
 	if (this->m_Settings.count("update-descriptors")) {
 		bpo::variable_value v = this->m_Settings["update-descriptors"];
 		size_t updDesc =  v.as<size_t>();
@@ -38,7 +38,17 @@ namespace rstk
  * lagrangian descent optimizer.
  *
  * The alternating direction method of multipliers (ADMM) is a variant of the augmented
- * Lagrangian scheme that uses partial updates for the dual variables
+ * Lagrangian scheme that uses partial updates for the dual variables. The
+ * data term and the regularization are split on u = v, with scaled dual w:
+ * \f[
+ *        u^{t+1} = \frac{ u^{t} + \delta g(u^{t}) + \delta \rho ( v^{t} - w^{t} ) }{ 1 + \delta \rho }, \quad
+ *        v^{t+1} = \left( ( 2 \alpha + \rho ) - 2 \beta \mathcal{L} \right)^{-1} \rho ( u^{t+1} + w^{t} ), \quad
+ *        w^{t+1} = w^{t} + u^{t+1} - v^{t+1}
+ * \f]
+ * The data step is a linearized proximal step on the functional gradient and
+ * the regularization step is solved exactly in the spectral domain. The
+ * penalty \f$ \rho \f$ is balanced with the primal and dual residuals, which
+ * also define the stopping criterion (Boyd et al., 2011, sec. 3.3-3.4).
  */
 
 template< typename TFunctional >
@@ -71,52 +81,52 @@ public:
 
 	/** Functional definitions */
 	typedef typename Superclass::FunctionalPointer                FunctionalPointer;
-	typedef typename Superclass::ParametersType                   ParametersType;
-	typedef typename Superclass::DerivativeType                   DerivativeType;
 	typedef typename Superclass::MeasureType                      MeasureType;
 	typedef typename Superclass::PointType                        PointType;
 	typedef typename Superclass::VectorType                       VectorType;
 	typedef typename Superclass::PointValueType                   PointValueType;
-	typedef typename Superclass::ParametersPointer                ParametersPointer;
-	typedef typename Superclass::ParametersConstPointer           ParametersConstPointer;
-	typedef typename Superclass::ParametersPointType              ParametersPointType;
-	typedef typename Superclass::ParametersDirectionType          ParametersDirectionType;
-	typedef typename Superclass::GridSizeType                     GridSizeType;
-	typedef typename Superclass::ParametersComponentType          ParametersComponentType;
-	typedef typename Superclass::ParametersComponentPointer       ParametersComponentPointer;
-	typedef typename Superclass::FFTType                          FFTType;
-	typedef typename Superclass::FFTPointer                       FFTPointer;
-	typedef typename Superclass::FTDomainType                     FTDomainType;
-	typedef typename Superclass::FTDomainPointer                  FTDomainPointer;
-	typedef typename Superclass::ComplexType                      ComplexType;
-	typedef typename Superclass::ComplexValueType                 ComplexValueType;
-	typedef typename Superclass::IFFTType                         IFFTType;
-	typedef typename Superclass::IFFTPointer                      IFFTPointer;
-	typedef typename Superclass::RealPartType                     RealPartType;
-	typedef typename Superclass::ComplexValuesVector              ComplexValuesVector;
-	typedef typename Superclass::ComplexFieldValue                ComplexFieldValue;
-	typedef typename Superclass::ComplexFieldType                 ComplexFieldType;
-	typedef typename Superclass::ComplexFieldPointer              ComplexFieldPointer;
-	typedef typename Superclass::MatrixType                       MatrixType;
-	typedef typename Superclass::TensorFieldType                  TensorFieldType;
-	typedef typename Superclass::TensorFieldPointer               TensorFieldPointer;
 	typedef typename Superclass::SizeValueType                    SizeValueType;
+	typedef typename Superclass::CoefficientsImageType            CoefficientsImageType;
+	typedef typename Superclass::CoefficientsImageArray           CoefficientsImageArray;
 
 	/** Type for the convergence checker */
 	typedef typename Superclass::ConvergenceMonitoringType        ConvergenceMonitoringType;
 
+	/** Penalty parameter, guessed from the step size if not set */
 	itkSetMacro( Rho, InternalComputationValueType);
 	itkGetConstMacro( Rho, InternalComputationValueType);
 
+	itkSetMacro( UseAdaptiveRho, bool );
+	itkGetConstMacro( UseAdaptiveRho, bool );
+
+	itkSetMacro( AbsoluteTolerance, InternalComputationValueType );
+	itkGetConstMacro( AbsoluteTolerance, InternalComputationValueType );
+
+	itkSetMacro( RelativeTolerance, InternalComputationValueType );
+	itkGetConstMacro( RelativeTolerance, InternalComputationValueType );
+
+	itkGetConstMacro( PrimalResidual, InternalComputationValueType );
+	itkGetConstMacro( DualResidual, InternalComputationValueType );
+
+	const CoefficientsImageArray & GetOutputCoefficients() const override {
+		return this->m_vField;
+	}
+
+	void SaveState( CheckpointFile& f ) const override;
 protected:
 	SpectralADMMOptimizer();
 	~SpectralADMMOptimizer() {}
 
-	void PrintSelf( std::ostream &os, itk::Indent indent ) const;
+	void PrintSelf( std::ostream &os, itk::Indent indent ) const override;
+	void ParseSettings() override;
 
-	void InitializeAuxiliarParameters( void );
-	void Iterate(void);
-	void SetUpdate();
+	void InitializeAuxiliarParameters( void ) override;
+	void LoadState( CheckpointFile& f ) override;
+	void Iterate(void) override;
+	void SetUpdate() override;
+	void UpdateStepSize() override {}
+	bool HasConverged() override { return this->m_ResidualsConverged; }
+	void FinalizeParameters() override;
 
 private:
 	SpectralADMMOptimizer( const Self & ); // purposely not implemented
@@ -127,10 +137,16 @@ private:
 	void UpdateLambda(void);
 
 	InternalComputationValueType m_Rho;
-	ParametersPointer m_vField;
-	ParametersPointer m_vFieldNext;
-	ParametersPointer m_lambdaField;
-	ParametersPointer m_lambdaFieldNext;
+	InternalComputationValueType m_PrimalResidual;
+	InternalComputationValueType m_DualResidual;
+	InternalComputationValueType m_AbsoluteTolerance;
+	InternalComputationValueType m_RelativeTolerance;
+	bool                         m_UseAdaptiveRho;
+	bool                         m_ResidualsConverged;
+
+	CoefficientsImageArray       m_vField;
+	CoefficientsImageArray       m_vFieldNext;
+	CoefficientsImageArray       m_lambdaField;   // scaled dual variable
 
 }; // End of Class
 
@@ -28,6 +28,10 @@
 
 #include "SpectralADMMOptimizer.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+
 using namespace std;
 
 namespace rstk {
@@ -36,21 +40,73 @@ namespace rstk {
  * Default constructor
  */
 template< typename TFunctional >
-SpectralADMMOptimizer<TFunctional>::SpectralADMMOptimizer() {
-	this->m_Rho = 0.80 * (1.0/this->m_StepSize);
-}
+SpectralADMMOptimizer<TFunctional>::SpectralADMMOptimizer():
+Superclass(),
+m_Rho(0.0),
+m_PrimalResidual(0.0),
+m_DualResidual(0.0),
+m_AbsoluteTolerance(1.0e-4),
+m_RelativeTolerance(1.0e-3),
+m_UseAdaptiveRho(true),
+m_ResidualsConverged(false)
+{}
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>
 ::PrintSelf(std::ostream &os, itk::Indent indent) const {
 	Superclass::PrintSelf(os,indent);
+	os << indent << "Rho: " << this->m_Rho << std::endl;
+	os << indent << "Primal residual: " << this->m_PrimalResidual << std::endl;
+	os << indent << "Dual residual: " << this->m_DualResidual << std::endl;
 }
 
+template< typename TFunctional >
+void SpectralADMMOptimizer<TFunctional>
+::ParseSettings() {
+	Superclass::ParseSettings();
+
+	if( this->m_Settings.count( "admm-rho" ) ){
+		bpo::variable_value v = this->m_Settings["admm-rho"];
+		this->SetRho( v.as< double >() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralADMMOptimizer<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	Superclass::SaveState( f );
+	f.Write( this->m_Rho );
+	f.Write( this->m_PrimalResidual );
+	f.Write( this->m_DualResidual );
+	f.Write( this->m_ResidualsConverged );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.WriteImage( this->m_vField[d].GetPointer() );
+		f.WriteImage( this->m_lambdaField[d].GetPointer() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralADMMOptimizer<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	Superclass::LoadState( f );
+	f.Read( this->m_Rho );
+	f.Read( this->m_PrimalResidual );
+	f.Read( this->m_DualResidual );
+	f.Read( this->m_ResidualsConverged );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.ReadImage( this->m_vField[d].GetPointer() );
+		f.ReadImage( this->m_lambdaField[d].GetPointer() );
+	}
+}
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>::Iterate() {
 	itkDebugMacro("Optimizer Iteration");
 
+	if ( this->m_Rho <= 0.0 ) {
+		this->m_Rho = 1.0 / this->m_StepSize;
+	}
+
 	this->UpdateU();
 	this->UpdateV();
 	this->UpdateLambda();
@@ -60,145 +116,190 @@ template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>::UpdateU(){
 	itkDebugMacro("Optimizer Update u_k");
 
-	ParametersConstPointer shapeGradient = this->m_Functional->GetDerivative();
-
-	VectorType* uFieldBuffer = this->m_NextParameters->GetBufferPointer();
-	const VectorType* vFieldBuffer = this->m_vField->GetBufferPointer();
-	const VectorType* lFieldBuffer = this->m_lambdaField->GetBufferPointer();
-	const VectorType* sFieldBuffer = shapeGradient->GetBufferPointer();
-	size_t nPix = this->m_Parameters->GetLargestPossibleRegion().GetNumberOfPixels();
-
-	for ( size_t p = 0; p<nPix; p++ ) {
-		*( uFieldBuffer + p ) = *( vFieldBuffer+p ) - *( lFieldBuffer+p ) * this->m_StepSize - *( sFieldBuffer+p ) * this->m_StepSize * this->m_LearningRate;
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	CoefficientValueType* uNext[Dimension];
+	const CoefficientValueType* u[Dimension];
+	const CoefficientValueType* g[Dimension];
+	const CoefficientValueType* v[Dimension];
+	const CoefficientValueType* l[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		uNext[d] = this->m_NextCoefficients[d]->GetBufferPointer();
+		u[d] = this->m_Coefficients[d]->GetBufferPointer();
+		g[d] = this->m_DerivativeCoefficients[d]->GetBufferPointer();
+		v[d] = this->m_vField[d]->GetBufferPointer();
+		l[d] = this->m_lambdaField[d]->GetBufferPointer();
 	}
 
-//#ifndef NDEBUG
-//	typedef rstk::DisplacementFieldComponentsFileWriter<DeformationFieldType> Writer;
-//	typename Writer::Pointer p = Writer::New();
-//	std::stringstream ss;
-//	ss << "gradient_" << std::setfill('0')  << std::setw(3) << this->m_CurrentIteration << ".nii.gz";
-//	p->SetFileName( ss.str().c_str() );
-//	p->SetInput( shapeGradient );
-//	p->Update();
-//	ss.str("");
-//	ss << "nextu_" << std::setfill('0')  << std::setw(3) << this->m_CurrentIteration << ".nii.gz";
-//	p->SetFileName( ss.str().c_str() );
-//	p->SetInput( this->m_ParametersNext );
-//	p->Update();
-//#endif
-
+	// Linearized data step: gradient step on the functional plus the proximal
+	// pull towards v - w
+	const InternalComputationValueType step = this->m_StepSize;
+	const InternalComputationValueType dr = step * this->m_Rho;
+	const InternalComputationValueType norm = 1.0 / ( 1.0 + dr );
+	this->m_ThreadPool->ParallelFor( nPix,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				uNext[d][i] = ( u[d][i] + step * g[d][i] + dr * ( v[d][i] - l[d][i] ) ) * norm;
+			}
+		}
+	});
 }
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>::UpdateV() {
 	itkDebugMacro("Optimizer Update v");
 
-	this->ComputeUpdate( this->m_NextParameters, this->m_CurrentSpeeds, this->m_vFieldNext, true);
-
-//#ifndef NDEBUG
-//	typedef rstk::DisplacementFieldComponentsFileWriter<DeformationFieldType> Writer;
-//	typename Writer::Pointer p = Writer::New();
-//	std::stringstream ss;
-//	ss << "nextv_" << std::setfill('0')  << std::setw(3) << this->m_CurrentIteration << ".nii.gz";
-//	p->SetFileName( ss.str().c_str() );
-//	p->SetInput( this->m_vFieldNext );
-//	p->Update();
-//	ss.str("");
-//	ss << "nextu2_" << std::setfill('0')  << std::setw(3) << this->m_CurrentIteration << ".nii.gz";
-//	p->SetFileName( ss.str().c_str() );
-//	p->SetInput( this->m_ParametersNext );
-//	p->Update();
-//#endif
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	// Exact regularization step: ((2 alpha + rho) - 2 beta L) v = rho (u + w)
+	for( size_t d = 0; d < Dimension; d++ ) {
+		InternalComputationValueType s = 1.0;
+		if( this->m_Alpha[d] > 1.0e-8 ) {
+			s = 1.0 / ( 1.0 + 2.0 * this->m_Alpha[d] / this->m_Rho );
+		}
+		bool haveBeta = this->m_Beta[d] > 1.0e-8;
+
+		const CoefficientValueType* u = this->m_NextCoefficients[d]->GetBufferPointer();
+		const CoefficientValueType* l = this->m_lambdaField[d]->GetBufferPointer();
+		CoefficientValueType* r = haveBeta?this->m_UpdateBuffer[d]->GetBufferPointer():this->m_vFieldNext[d]->GetBufferPointer();
+		this->m_ThreadPool->ParallelFor( nPix,
+				[&](size_t start, size_t stop, itk::ThreadIdType) {
+			for( size_t i = start; i < stop; i++ ) {
+				r[i] = ( u[i] + l[i] ) * s;
+			}
+		});
+
+		if ( haveBeta ) {
+			InternalComputationValueType scaler = 2.0 * this->m_Beta[d] * s / this->m_Rho;
+			this->BetaRegularization( this->m_UpdateBuffer[d], this->m_vFieldNext, scaler, d );
+		}
+	}
 }
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>::UpdateLambda() {
-	VectorType* lFieldNextBuffer = this->m_lambdaFieldNext->GetBufferPointer();
-	const VectorType* uFieldBuffer = this->m_NextParameters->GetBufferPointer();
-	const VectorType* vFieldBuffer = this->m_vFieldNext->GetBufferPointer();
-	const VectorType* lFieldBuffer = this->m_lambdaField->GetBufferPointer();
-	size_t nPix = this->m_NextParameters->GetLargestPossibleRegion().GetNumberOfPixels();
-
-	VectorType diff;
-	for ( size_t p = 0; p<nPix; p++ ) {
-		diff = ( *( uFieldBuffer+p ) - *( vFieldBuffer+p ) );
-		*( lFieldNextBuffer+p ) = *( lFieldBuffer+p ) + diff * this->m_Rho;
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	const CoefficientValueType* u[Dimension];
+	const CoefficientValueType* v[Dimension];
+	const CoefficientValueType* vNext[Dimension];
+	CoefficientValueType* l[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		u[d] = this->m_NextCoefficients[d]->GetBufferPointer();
+		v[d] = this->m_vField[d]->GetBufferPointer();
+		vNext[d] = this->m_vFieldNext[d]->GetBufferPointer();
+		l[d] = this->m_lambdaField[d]->GetBufferPointer();
+	}
+
+	// Dual ascent and squared norms for the residuals, in one sweep
+	enum { PRIMAL, DUAL, UNORM, VNORM, LNORM, NSUMS };
+	typedef std::array< double, NSUMS > SumsType;
+	SumsType zero;
+	zero.fill( 0.0 );
+	SumsType total = this->m_ThreadPool->ParallelReduce( nPix, zero,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		SumsType acc = zero;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				double r = u[d][i] - vNext[d][i];
+				double dv = vNext[d][i] - v[d][i];
+				l[d][i]+= r;
+				acc[PRIMAL]+= r * r;
+				acc[DUAL]+= dv * dv;
+				acc[UNORM]+= u[d][i] * u[d][i];
+				acc[VNORM]+= vNext[d][i] * vNext[d][i];
+				acc[LNORM]+= l[d][i] * l[d][i];
+			}
+		}
+		return acc;
+	},
+	[](const SumsType& a, const SumsType& b) {
+		SumsType r;
+		for( size_t k = 0; k < NSUMS; k++ ) r[k] = a[k] + b[k];
+		return r;
+	});
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		std::swap( this->m_vField[d], this->m_vFieldNext[d] );
 	}
 
-//#ifndef NDEBUG
-//	typedef rstk::DisplacementFieldComponentsFileWriter<DeformationFieldType> Writer;
-//	typename Writer::Pointer p = Writer::New();
-//	std::stringstream ss;
-//	ss << "nextlambda_" << std::setfill('0')  << std::setw(3) << this->m_CurrentIteration << ".nii.gz";
-//	p->SetFileName( ss.str().c_str() );
-//	p->SetInput( this->m_lambdaFieldNext );
-//	p->Update();
-//#endif
+	this->m_PrimalResidual = sqrt( total[PRIMAL] );
+	this->m_DualResidual = this->m_Rho * sqrt( total[DUAL] );
+
+	double sqn = sqrt( static_cast< double >( nPix * Dimension ) );
+	double epsPrimal = sqn * this->m_AbsoluteTolerance +
+			this->m_RelativeTolerance * std::max( sqrt( total[UNORM] ), sqrt( total[VNORM] ) );
+	double epsDual = sqn * this->m_AbsoluteTolerance +
+			this->m_RelativeTolerance * this->m_Rho * sqrt( total[LNORM] );
+	this->m_ResidualsConverged = ( this->m_CurrentIteration > 1 ) &&
+			( this->m_PrimalResidual <= epsPrimal ) && ( this->m_DualResidual <= epsDual );
+
+	// Residual balancing: keep both residuals within a factor mu of each other.
+	// The dual variable is scaled, so it is rescaled with rho.
+	const double mu = 10.0;
+	const double tau = 2.0;
+	double factor = 1.0;
+	if ( this->m_UseAdaptiveRho ) {
+		if ( this->m_PrimalResidual > mu * this->m_DualResidual ) {
+			factor = tau;
+		} else if ( this->m_DualResidual > mu * this->m_PrimalResidual ) {
+			factor = 1.0 / tau;
+		}
+	}
 
+	if ( factor != 1.0 ) {
+		this->m_Rho *= factor;
+		const double lscale = 1.0 / factor;
+		this->m_ThreadPool->ParallelFor( nPix,
+				[&](size_t start, size_t stop, itk::ThreadIdType) {
+			for( size_t d = 0; d < Dimension; d++ ) {
+				for( size_t i = start; i < stop; i++ ) {
+					l[d][i]*= lscale;
+				}
+			}
+		});
+	}
 }
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>
 ::SetUpdate() {
-	const VectorType* uNext = this->m_NextParameters->GetBufferPointer();
-	const VectorType* vNext = this->m_vFieldNext->GetBufferPointer();
-	const VectorType* lNext = this->m_lambdaFieldNext->GetBufferPointer();
-
-	VectorType* uCurr = this->m_Parameters->GetBufferPointer();
-	VectorType* vCurr = this->m_vField->GetBufferPointer();
-	VectorType* lCurr = this->m_lambdaField->GetBufferPointer();
-
-	size_t nPix = this->m_Parameters->GetLargestPossibleRegion().GetNumberOfPixels();
-
-	for( size_t pix = 0; pix<nPix; pix++){
-		*(uCurr+pix) = *(uNext+pix);
-		*(vCurr+pix) = *(vNext+pix);
-		*(lCurr+pix) = *(lNext+pix);
+	for (size_t i = 0; i < Dimension; i++) {
+		std::swap( this->m_Coefficients[i], this->m_NextCoefficients[i] );
 	}
+	this->UpdateCurrentCoefficients();
 }
 
+template< typename TFunctional >
+void SpectralADMMOptimizer<TFunctional>
+::FinalizeParameters() {
+	// Return the regularized split, u and v agree up to the primal residual
+	this->m_Transform->SetCoefficientsImages( this->m_vField );
+	this->m_Transform->InterpolatePoints();
+	this->m_Functional->SetCurrentDisplacements( this->m_Transform->GetPointValues() );
+}
 
 template< typename TFunctional >
 void SpectralADMMOptimizer<TFunctional>
 ::InitializeAuxiliarParameters() {
-	VectorType zerov;
-	zerov.Fill(0.0);
-
-	typename ParametersType::SpacingType spacing = this->m_Parameters->GetSpacing();
-	typename ParametersType::DirectionType dir = this->m_Parameters->GetDirection();
-	typename ParametersType::PointType orig = this->m_Parameters->GetOrigin();
-
-	this->m_vField = ParametersType::New();
-	this->m_vField->SetRegions( this->m_GridSize );
-	this->m_vField->SetSpacing( spacing );
-	this->m_vField->SetDirection( dir );
-	this->m_vField->SetOrigin( orig );
-	this->m_vField->Allocate();
-	this->m_vField->FillBuffer( zerov );
-
-	this->m_lambdaField = ParametersType::New();
-	this->m_lambdaField->SetRegions( this->m_GridSize );
-	this->m_lambdaField->SetSpacing( spacing );
-	this->m_lambdaField->SetDirection( dir );
-	this->m_lambdaField->SetOrigin( orig );
-	this->m_lambdaField->Allocate();
-	this->m_lambdaField->FillBuffer( zerov );
-
-	this->m_vFieldNext = ParametersType::New();
-	this->m_vFieldNext->SetRegions( this->m_GridSize );
-	this->m_vFieldNext->SetSpacing( spacing );
-	this->m_vFieldNext->SetDirection( dir );
-	this->m_vFieldNext->SetOrigin( orig );
-	this->m_vFieldNext->Allocate();
-	this->m_vFieldNext->FillBuffer( zerov );
-
-	this->m_lambdaFieldNext = ParametersType::New();
-	this->m_lambdaFieldNext->SetRegions( this->m_GridSize );
-	this->m_lambdaFieldNext->SetSpacing( spacing );
-	this->m_lambdaFieldNext->SetDirection( dir );
-	this->m_lambdaFieldNext->SetOrigin( orig );
-	this->m_lambdaFieldNext->Allocate();
-	this->m_lambdaFieldNext->FillBuffer( zerov );
+	this->InitializeCoefficientsArray( this->m_vField );
+	this->InitializeCoefficientsArray( this->m_vFieldNext );
+	this->InitializeCoefficientsArray( this->m_lambdaField );
+
+	// v^0 = u^0, so a seeded run starts on a consistent split
+	for( size_t d = 0; d < Dimension; d++ ) {
+		itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
+			this->m_Coefficients[d], this->m_vField[d],
+			this->m_Coefficients[d]->GetLargestPossibleRegion(),
+			this->m_vField[d]->GetLargestPossibleRegion() );
+	}
+	this->m_PrimalResidual = 0.0;
+	this->m_DualResidual = 0.0;
+	this->m_ResidualsConverged = false;
 }
 
 } // end namespace rstk
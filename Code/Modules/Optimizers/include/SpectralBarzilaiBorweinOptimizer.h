@@ -0,0 +1,122 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALBARZILAIBORWEINOPTIMIZER_H_
+#define SPECTRALBARZILAIBORWEINOPTIMIZER_H_
+
+#include "SpectralGradientDescentOptimizer.h"
+
+#include <deque>
+
+using namespace itk;
+
+namespace rstk
+{
+/**
+ * \class SpectralBarzilaiBorweinOptimizer
+ *  \brief Gradient descent with Barzilai-Borwein step sizes.
+ *
+ * The update is the one of SpectralGradientDescentOptimizer, but the step
+ * size is set each iteration from the last two iterates and gradients:
+ * \f[
+ *        \delta^{t} = \frac{ s^{T} s }{ s^{T} y }, \quad
+ *        s = u^{t} - u^{t-1}, \quad y = \nabla E^{t} - \nabla E^{t-1}
+ * \f]
+ * A non-monotone line search safeguards the step: it is halved until the
+ * total energy (data and regularization terms) of the next iterate does not
+ * exceed the maximum over the last NonMonotoneWindow iterates, or until it
+ * reaches the lower bound of the step range. The energies of the accepted
+ * iterates are kept, so each iterate is evaluated once, also under
+ * lightweight convergence checking. A zero NonMonotoneWindow disables it.
+ */
+
+template< typename TFunctional >
+class SpectralBarzilaiBorweinOptimizer: public SpectralGradientDescentOptimizer<TFunctional> {
+public:
+	/** Standard class typedefs and macros */
+	typedef SpectralBarzilaiBorweinOptimizer           Self;
+	typedef SpectralGradientDescentOptimizer<TFunctional> Superclass;
+	typedef itk::SmartPointer<Self>                    Pointer;
+	typedef itk::SmartPointer< const Self >            ConstPointer;
+
+	itkTypeMacro( SpectralBarzilaiBorweinOptimizer, SpectralGradientDescentOptimizer ); // Run-time type information (and related methods)
+	itkNewMacro( Self );                                             // New macro for creation of through a Smart Pointer
+
+	/** Metric type over which this class is templated */
+	typedef typename Superclass::FunctionalType                   FunctionalType;
+	itkStaticConstMacro( Dimension, unsigned int, FunctionalType::Dimension );
+
+	/** Functional definitions */
+	typedef typename Superclass::MeasureType                      MeasureType;
+	typedef typename Superclass::VectorType                       VectorType;
+	typedef typename Superclass::PointValueType                   PointValueType;
+	typedef typename Superclass::InternalComputationValueType     InternalComputationValueType;
+	typedef typename Superclass::SizeValueType                    SizeValueType;
+
+	typedef typename Superclass::CoefficientsImageType            CoefficientsImageType;
+	typedef typename Superclass::CoefficientsImageArray           CoefficientsImageArray;
+
+	/** Number of past energies checked by the non-monotone safeguard (0 disables it) */
+	itkSetMacro( NonMonotoneWindow, SizeValueType );
+	itkGetConstMacro( NonMonotoneWindow, SizeValueType );
+
+	/** Bounds of the step, relative to the initial step size */
+	itkSetMacro( StepSizeRange, InternalComputationValueType );
+	itkGetConstMacro( StepSizeRange, InternalComputationValueType );
+
+	void SaveState( CheckpointFile& f ) const override;
+protected:
+	SpectralBarzilaiBorweinOptimizer();
+	~SpectralBarzilaiBorweinOptimizer() {}
+
+	void PrintSelf( std::ostream &os, itk::Indent indent ) const override;
+
+	void InitializeAuxiliarParameters( void ) override;
+	void LoadState( CheckpointFile& f ) override;
+	void Iterate(void) override;
+	void UpdateStepSize() override {}
+
+	/** Total energy of the coefficients u, evaluated off the current contours */
+	MeasureType EvaluateEnergy( const CoefficientsImageArray & u );
+
+	CoefficientsImageArray          m_PreviousCoefficients;
+	CoefficientsImageArray          m_PreviousDerivative;
+	std::deque< MeasureType >       m_EnergyHistory;
+	SizeValueType                   m_NonMonotoneWindow;
+	InternalComputationValueType    m_StepSizeRange;
+	InternalComputationValueType    m_InitialStepSize;
+
+private:
+	SpectralBarzilaiBorweinOptimizer( const Self & ); // purposely not implemented
+	void operator=( const Self & ); // purposely not implemented
+}; // End of Class
+
+} // End of namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SpectralBarzilaiBorweinOptimizer.hxx"
+#endif
+
+#endif /* SPECTRALBARZILAIBORWEINOPTIMIZER_H_ */
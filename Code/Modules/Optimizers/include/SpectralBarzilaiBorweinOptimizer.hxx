@@ -0,0 +1,193 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALBARZILAIBORWEINOPTIMIZER_HXX_
+#define SPECTRALBARZILAIBORWEINOPTIMIZER_HXX_
+
+#include "SpectralBarzilaiBorweinOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace std;
+
+namespace rstk {
+
+/**
+ * Default constructor
+ */
+template< typename TFunctional >
+SpectralBarzilaiBorweinOptimizer<TFunctional>::SpectralBarzilaiBorweinOptimizer():
+Superclass(),
+m_NonMonotoneWindow(10),
+m_StepSizeRange(1.0e3),
+m_InitialStepSize(0.0)
+{}
+
+template< typename TFunctional >
+void SpectralBarzilaiBorweinOptimizer<TFunctional>
+::PrintSelf(std::ostream &os, itk::Indent indent) const {
+	Superclass::PrintSelf(os,indent);
+	os << indent << "Non-monotone window: " << this->m_NonMonotoneWindow << std::endl;
+	os << indent << "Step size range: " << this->m_StepSizeRange << std::endl;
+}
+
+template< typename TFunctional >
+void SpectralBarzilaiBorweinOptimizer<TFunctional>
+::InitializeAuxiliarParameters() {
+	this->InitializeCoefficientsArray( this->m_PreviousCoefficients );
+	this->InitializeCoefficientsArray( this->m_PreviousDerivative );
+	this->InitializeCoefficientsArray( this->m_CandidateScratch );
+	this->m_CandidateDisplacements.resize( 1 );
+	this->m_EnergyHistory.clear();
+	this->m_InitialStepSize = 0.0;
+}
+
+template< typename TFunctional >
+void SpectralBarzilaiBorweinOptimizer<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	Superclass::SaveState( f );
+	f.Write( this->m_InitialStepSize );
+	std::vector< MeasureType > history( this->m_EnergyHistory.begin(), this->m_EnergyHistory.end() );
+	f.WriteVector( history );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.WriteImage( this->m_PreviousCoefficients[d].GetPointer() );
+		f.WriteImage( this->m_PreviousDerivative[d].GetPointer() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralBarzilaiBorweinOptimizer<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	Superclass::LoadState( f );
+	f.Read( this->m_InitialStepSize );
+	std::vector< MeasureType > history;
+	f.ReadVector( history );
+	this->m_EnergyHistory.assign( history.begin(), history.end() );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.ReadImage( this->m_PreviousCoefficients[d].GetPointer() );
+		f.ReadImage( this->m_PreviousDerivative[d].GetPointer() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralBarzilaiBorweinOptimizer<TFunctional>::Iterate() {
+	itkDebugMacro("Optimizer Iteration");
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	CoefficientValueType* u0[Dimension];
+	CoefficientValueType* g0[Dimension];
+	const CoefficientValueType* u[Dimension];
+	const CoefficientValueType* g[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		u0[d] = this->m_PreviousCoefficients[d]->GetBufferPointer();
+		g0[d] = this->m_PreviousDerivative[d]->GetBufferPointer();
+		u[d] = this->m_Coefficients[d]->GetBufferPointer();
+		g[d] = this->m_DerivativeCoefficients[d]->GetBufferPointer();
+	}
+
+	// s^T s and s^T y in one sweep, storing the current iterate for the next one.
+	// The derivative coefficients are the descent direction, so y = g^{t-1} - g^{t}
+	typedef std::pair< double, double > ProductsType;
+	ProductsType products = this->m_ThreadPool->ParallelReduce( nPix, ProductsType( 0.0, 0.0 ),
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		ProductsType p( 0.0, 0.0 );
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				double s = u[d][i] - u0[d][i];
+				p.first+= s * s;
+				p.second+= s * ( g0[d][i] - g[d][i] );
+				u0[d][i] = u[d][i];
+				g0[d][i] = g[d][i];
+			}
+		}
+		return p;
+	},
+	[](const ProductsType& a, const ProductsType& b) {
+		return ProductsType( a.first + b.first, a.second + b.second );
+	});
+
+	if ( this->m_InitialStepSize == 0.0 ) {
+		// First iteration: no curvature information yet (step-auto may have set the step)
+		this->m_InitialStepSize = this->m_StepSize;
+	} else {
+		double sTs = products.first;
+		double sTy = products.second;
+
+		InternalComputationValueType step = this->m_StepSize;
+		if ( sTy > 0.0 && sTs > 0.0 ) {
+			step = sTs / sTy;
+		}
+
+		InternalComputationValueType minStep = this->m_InitialStepSize / this->m_StepSizeRange;
+		InternalComputationValueType maxStep = this->m_InitialStepSize * this->m_StepSizeRange;
+		this->m_StepSize = std::max( minStep, std::min( maxStep, step ) );
+	}
+
+	this->ComputeUpdate(this->m_Coefficients, this->m_DerivativeCoefficients, this->m_NextCoefficients, true);
+
+	if ( this->m_NonMonotoneWindow == 0 ) {
+		return;
+	}
+
+	// Non-monotone line search: backtrack until the energy of the next iterate
+	// does not exceed the maximum over the last iterates. The energy of each
+	// accepted iterate is kept, so every iterate is evaluated only once
+	if ( this->m_EnergyHistory.empty() ) {
+		this->m_EnergyHistory.push_back( this->EvaluateEnergy( this->m_Coefficients ) );
+	}
+	MeasureType maxEnergy = *std::max_element( this->m_EnergyHistory.begin(), this->m_EnergyHistory.end() );
+	InternalComputationValueType minStep = this->m_InitialStepSize / this->m_StepSizeRange;
+
+	MeasureType energy = this->EvaluateEnergy( this->m_NextCoefficients );
+	while ( energy > maxEnergy && 0.5 * this->m_StepSize >= minStep ) {
+		this->m_StepSize*= 0.5;
+		this->ComputeUpdate(this->m_Coefficients, this->m_DerivativeCoefficients, this->m_NextCoefficients, true);
+		energy = this->EvaluateEnergy( this->m_NextCoefficients );
+	}
+
+	this->m_EnergyHistory.push_back( energy );
+	if ( this->m_EnergyHistory.size() > this->m_NonMonotoneWindow ) {
+		this->m_EnergyHistory.pop_front();
+	}
+}
+
+template< typename TFunctional >
+typename SpectralBarzilaiBorweinOptimizer<TFunctional>::MeasureType
+SpectralBarzilaiBorweinOptimizer<TFunctional>
+::EvaluateEnergy( const CoefficientsImageArray & u ) {
+	this->m_Transform->SetCoefficientsImages( u );
+	this->m_Transform->InterpolatePoints();
+	this->m_CandidateDisplacements[0] = this->m_Transform->GetPointValues();
+
+	this->m_Functional->EvaluateCandidates( this->m_CandidateDisplacements, this->m_CandidateValues );
+	return this->m_CandidateValues[0] + this->EvaluateRegularization( u, this->m_CandidateScratch );
+}
+
+} // end namespace rstk
+
+#endif /* SPECTRALBARZILAIBORWEINOPTIMIZER_HXX_ */
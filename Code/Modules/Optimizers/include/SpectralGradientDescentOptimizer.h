@@ -41,6 +41,11 @@ namespace rstk
  * \f[
  *        u^{t+1} = \mathcal{FT^{-1}}
  * \f]
+ *
+ * With LineSearchCandidates > 1, every iteration computes the update for
+ * several step sizes spread geometrically around the current one, evaluates
+ * the functional of all of them concurrently and keeps the one of lowest
+ * total (data and regularization) energy.
  */
 
 template< typename TFunctional >
@@ -100,15 +105,36 @@ public:
 	typedef typename Superclass::ConvergenceMonitoringType        ConvergenceMonitoringType;
 
 	typedef typename Superclass::CoefficientsImageType            CoefficientsImageType;
+	typedef typename Superclass::CoefficientsImageArray           CoefficientsImageArray;
+	typedef typename FunctionalType::VNLVectorContainer           DisplacementsContainer;
+
+	/** Number of step sizes evaluated per iteration (0 or 1 disables the line search) */
+	itkSetMacro( LineSearchCandidates, SizeValueType );
+	itkGetConstMacro( LineSearchCandidates, SizeValueType );
+
+	/** Ratio between consecutive candidate step sizes */
+	itkSetMacro( LineSearchFactor, InternalComputationValueType );
+	itkGetConstMacro( LineSearchFactor, InternalComputationValueType );
 protected:
 	SpectralGradientDescentOptimizer();
 	~SpectralGradientDescentOptimizer() {}
 
 	void PrintSelf( std::ostream &os, itk::Indent indent ) const override;
 
-	void InitializeAuxiliarParameters( void ) override {}
+	void InitializeAuxiliarParameters( void ) override;
 	void Iterate(void) override;
 	void SetUpdate() override;
+	void UpdateStepSize() override;
+	void ParseSettings() override;
+
+	void SpeculativeLineSearch();
+
+	SizeValueType                          m_LineSearchCandidates;
+	InternalComputationValueType           m_LineSearchFactor;
+	std::vector< CoefficientsImageArray >  m_CandidateCoefficients;
+	std::vector< DisplacementsContainer >  m_CandidateDisplacements;
+	std::vector< MeasureType >             m_CandidateValues;
+	CoefficientsImageArray                 m_CandidateScratch;     // gradient of the regularization, discarded
 
 private:
 	SpectralGradientDescentOptimizer( const Self & ); // purposely not implemented
@@ -28,7 +28,8 @@
 
 #include "SpectralGradientDescentOptimizer.h"
 
-#include <itkImageAlgorithm.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -38,46 +39,110 @@ namespace rstk {
  * Default constructor
  */
 template< typename TFunctional >
-SpectralGradientDescentOptimizer<TFunctional>::SpectralGradientDescentOptimizer() {}
+SpectralGradientDescentOptimizer<TFunctional>::SpectralGradientDescentOptimizer():
+Superclass(),
+m_LineSearchCandidates(0),
+m_LineSearchFactor(2.0)
+{}
 
 template< typename TFunctional >
 void SpectralGradientDescentOptimizer<TFunctional>
 ::PrintSelf(std::ostream &os, itk::Indent indent) const {
 	Superclass::PrintSelf(os,indent);
+	os << indent << "Line search candidates: " << this->m_LineSearchCandidates << std::endl;
+	os << indent << "Line search factor: " << this->m_LineSearchFactor << std::endl;
 }
 
+template< typename TFunctional >
+void SpectralGradientDescentOptimizer<TFunctional>
+::ParseSettings() {
+	Superclass::ParseSettings();
+
+	if( this->m_Settings.count( "line-search" ) ){
+		bpo::variable_value v = this->m_Settings["line-search"];
+		this->SetLineSearchCandidates( v.as< size_t >() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralGradientDescentOptimizer<TFunctional>
+::InitializeAuxiliarParameters() {
+	// Candidate buffers are allocated lazily on the control grid of this run
+	this->m_CandidateCoefficients.clear();
+	this->m_CandidateDisplacements.clear();
+	this->m_CandidateValues.clear();
+}
 
 template< typename TFunctional >
 void SpectralGradientDescentOptimizer<TFunctional>::Iterate() {
 	itkDebugMacro("Optimizer Iteration");
+	if ( this->m_LineSearchCandidates > 1 ) {
+		this->SpeculativeLineSearch();
+		return;
+	}
 	this->ComputeUpdate(this->m_Coefficients, this->m_DerivativeCoefficients, this->m_NextCoefficients, true);
 }
 
 template< typename TFunctional >
 void SpectralGradientDescentOptimizer<TFunctional>
-::SetUpdate() {
-	const typename CoefficientsImageType::PixelType* current[Dimension];
-	for (size_t i = 0; i < Dimension; i++) {
-		current[i] = this->m_NextCoefficients[i]->GetBufferPointer();
-		itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType > (
-			this->m_NextCoefficients[i],
-			this->m_Coefficients[i],
-			this->m_NextCoefficients[i]->GetLargestPossibleRegion(),
-			this->m_Coefficients[i]->GetLargestPossibleRegion()
-		);
+::SpeculativeLineSearch() {
+	size_t ncandidates = this->m_LineSearchCandidates;
+	if ( this->m_CandidateCoefficients.size() != ncandidates ) {
+		this->m_CandidateCoefficients.resize( ncandidates );
+		for( size_t c = 0; c < ncandidates; c++ ) {
+			this->InitializeCoefficientsArray( this->m_CandidateCoefficients[c] );
+		}
+		this->m_CandidateDisplacements.resize( ncandidates );
+		this->InitializeCoefficientsArray( this->m_CandidateScratch );
 	}
 
-	VectorType v;
-	VectorType* buffer = this->m_CurrentCoefficients->GetBufferPointer();
-	size_t nPix = this->m_NextCoefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+	// Steps delta * f^(c - K/2): the current step is always among the candidates
+	InternalComputationValueType step = this->m_StepSize;
+	std::vector< InternalComputationValueType > steps( ncandidates );
+	for( size_t c = 0; c < ncandidates; c++ ) {
+		steps[c] = step * std::pow( this->m_LineSearchFactor, double(c) - double(ncandidates / 2) );
 
-	for(size_t i = 0; i < nPix; i++) {
-		for(size_t d=0; d < Dimension; d++) {
-			v[d] = *(current[d] + i);
-		}
-		*(buffer + i) = v;
+		this->m_StepSize = steps[c];
+		this->ComputeUpdate( this->m_Coefficients, this->m_DerivativeCoefficients, this->m_CandidateCoefficients[c], true );
+
+		this->m_Transform->SetCoefficientsImages( this->m_CandidateCoefficients[c] );
+		this->m_Transform->InterpolatePoints();
+		this->m_CandidateDisplacements[c] = this->m_Transform->GetPointValues();
+	}
+
+	// Candidates are ranked by their total energy, data and regularization terms
+	this->m_Functional->EvaluateCandidates( this->m_CandidateDisplacements, this->m_CandidateValues );
+	for( size_t c = 0; c < ncandidates; c++ ) {
+		this->m_CandidateValues[c]+= this->EvaluateRegularization( this->m_CandidateCoefficients[c], this->m_CandidateScratch );
+	}
+
+	size_t best = std::min_element( this->m_CandidateValues.begin(), this->m_CandidateValues.end() )
+	              - this->m_CandidateValues.begin();
+	this->m_StepSize = steps[best];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		std::swap( this->m_NextCoefficients[d], this->m_CandidateCoefficients[best][d] );
+	}
+}
 
+template< typename TFunctional >
+void SpectralGradientDescentOptimizer<TFunctional>
+::UpdateStepSize() {
+	// The line search already picked the step of this iteration
+	if ( this->m_LineSearchCandidates > 1 ) {
+		return;
+	}
+	Superclass::UpdateStepSize();
+}
+
+template< typename TFunctional >
+void SpectralGradientDescentOptimizer<TFunctional>
+::SetUpdate() {
+	// The next coefficients become the current ones, the old buffers are
+	// fully overwritten by the next ComputeUpdate
+	for (size_t i = 0; i < Dimension; i++) {
+		std::swap( this->m_Coefficients[i], this->m_NextCoefficients[i] );
 	}
+	this->UpdateCurrentCoefficients();
 }
 
 } // end namespace rstk
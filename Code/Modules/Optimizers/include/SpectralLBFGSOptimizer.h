@@ -0,0 +1,154 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALLBFGSOPTIMIZER_H_
+#define SPECTRALLBFGSOPTIMIZER_H_
+
+#include "SpectralOptimizer.h"
+
+#include <deque>
+
+using namespace itk;
+
+namespace rstk
+{
+/**
+ * \class SpectralLBFGSOptimizer
+ *  \brief Limited-memory BFGS optimizer on the spline coefficients.
+ *
+ * Minimizes the functional plus the regularization energy
+ * \f$ \sum_d \alpha_d \| u_d \|^2 + \beta_d \| \nabla u_d \|^2 \f$. The initial
+ * inverse hessian of the two-loop recursion is the linear part of the
+ * spectral gradient descent step,
+ * \f$ H_0 = \gamma \, \delta \left( (1 + 2 \alpha \delta) - 2 \beta \delta \mathcal{L} \right)^{-1} \f$,
+ * with \f$ \delta \f$ the step size and \f$ \gamma \f$ the usual
+ * \f$ s^T y / y^T H_0 y \f$ scaling. Steps are accepted by an Armijo
+ * backtracking line search on the total energy, which only requires
+ * functional values.
+ */
+
+template< typename TFunctional >
+class SpectralLBFGSOptimizer: public SpectralOptimizer<TFunctional> {
+public:
+	/** Standard class typedefs and macros */
+	typedef SpectralLBFGSOptimizer                     Self;
+	typedef SpectralOptimizer<TFunctional>             Superclass;
+	typedef itk::SmartPointer<Self>                    Pointer;
+	typedef itk::SmartPointer< const Self >            ConstPointer;
+
+	itkTypeMacro( SpectralLBFGSOptimizer, SpectralOptimizer ); // Run-time type information (and related methods)
+	itkNewMacro( Self );                                   // New macro for creation of through a Smart Pointer
+
+	/** Metric type over which this class is templated */
+	typedef typename Superclass::FunctionalType                   FunctionalType;
+	itkStaticConstMacro( Dimension, unsigned int, FunctionalType::Dimension );
+
+	/** Configurable object typedefs */
+	typedef typename Superclass::SettingsMap                      SettingsMap;
+	typedef typename Superclass::SettingsDesc                     SettingsDesc;
+
+	/** Functional definitions */
+	typedef typename Superclass::MeasureType                      MeasureType;
+	typedef typename Superclass::VectorType                       VectorType;
+	typedef typename Superclass::PointValueType                   PointValueType;
+	typedef typename Superclass::InternalComputationValueType     InternalComputationValueType;
+	typedef typename Superclass::SizeValueType                    SizeValueType;
+
+	typedef typename Superclass::CoefficientsImageType            CoefficientsImageType;
+	typedef typename Superclass::CoefficientsImageArray           CoefficientsImageArray;
+
+	/** Number of correction pairs kept */
+	itkSetMacro( HistorySize, SizeValueType );
+	itkGetConstMacro( HistorySize, SizeValueType );
+
+	itkSetMacro( MaximumLineSearchIterations, SizeValueType );
+	itkGetConstMacro( MaximumLineSearchIterations, SizeValueType );
+
+	itkGetConstMacro( LineSearchStep, InternalComputationValueType );
+	itkGetConstMacro( NumberOfEvaluations, SizeValueType );
+
+	MeasureType GetCurrentRegularizationEnergy() override { return this->m_RegularizationEnergy; }
+	MeasureType GetCurrentEnergy() override { return this->m_CurrentTotalEnergy; }
+
+	void SaveState( CheckpointFile& f ) const override;
+protected:
+	SpectralLBFGSOptimizer();
+	~SpectralLBFGSOptimizer() {}
+
+	void PrintSelf( std::ostream &os, itk::Indent indent ) const override;
+	void ParseSettings() override;
+
+	void InitializeAuxiliarParameters( void ) override;
+	void LoadState( CheckpointFile& f ) override;
+	void Iterate(void) override;
+	void SetUpdate() override;
+	void UpdateStepSize() override {}
+
+	/** Total energy with the transform moved to u */
+	MeasureType EvaluateEnergy( const CoefficientsImageArray & u );
+
+	/** out = H_0 in */
+	void ApplyInitialHessian( const CoefficientsImageArray & in, CoefficientsImageArray & out );
+
+	double InnerProduct( const CoefficientsImageArray & a, const CoefficientsImageArray & b ) const;
+
+	/** out = ca * a + cb * b, out may alias a or b */
+	void Combine( double ca, const CoefficientsImageArray & a, double cb, const CoefficientsImageArray & b,
+			CoefficientsImageArray & out ) const;
+
+	struct CorrectionPair {
+		CoefficientsImageArray s;
+		CoefficientsImageArray y;
+		double rho;
+	};
+
+	std::deque< CorrectionPair >     m_History;
+	SizeValueType                    m_HistorySize;
+	SizeValueType                    m_MaximumLineSearchIterations;
+	SizeValueType                    m_NumberOfEvaluations;
+	InternalComputationValueType     m_HessianScale;
+	InternalComputationValueType     m_LineSearchStep;
+	InternalComputationValueType     m_ArmijoFactor;
+	bool                             m_HasPrevious;
+
+	CoefficientsImageArray           m_Gradient;
+	CoefficientsImageArray           m_PreviousGradient;
+	CoefficientsImageArray           m_PreviousCoefficients;
+	CoefficientsImageArray           m_Direction;
+	CoefficientsImageArray           m_Scratch;
+	CoefficientsImageArray           m_ZeroCoefficients;
+
+private:
+	SpectralLBFGSOptimizer( const Self & ); // purposely not implemented
+	void operator=( const Self & ); // purposely not implemented
+}; // End of Class
+
+} // End of namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SpectralLBFGSOptimizer.hxx"
+#endif
+
+#endif /* SPECTRALLBFGSOPTIMIZER_H_ */
@@ -0,0 +1,341 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALLBFGSOPTIMIZER_HXX_
+#define SPECTRALLBFGSOPTIMIZER_HXX_
+
+#include "SpectralLBFGSOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace rstk {
+
+/**
+ * Default constructor
+ */
+template< typename TFunctional >
+SpectralLBFGSOptimizer<TFunctional>::SpectralLBFGSOptimizer():
+Superclass(),
+m_HistorySize(5),
+m_MaximumLineSearchIterations(10),
+m_NumberOfEvaluations(0),
+m_HessianScale(1.0),
+m_LineSearchStep(1.0),
+m_ArmijoFactor(1.0e-4),
+m_HasPrevious(false)
+{}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::PrintSelf(std::ostream &os, itk::Indent indent) const {
+	Superclass::PrintSelf(os,indent);
+	os << indent << "History size: " << this->m_HistorySize << std::endl;
+	os << indent << "Maximum line search iterations: " << this->m_MaximumLineSearchIterations << std::endl;
+	os << indent << "Number of energy evaluations: " << this->m_NumberOfEvaluations << std::endl;
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::ParseSettings() {
+	Superclass::ParseSettings();
+
+	if( this->m_Settings.count( "lbfgs-memory" ) ){
+		bpo::variable_value v = this->m_Settings["lbfgs-memory"];
+		this->SetHistorySize( v.as< size_t >() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::InitializeAuxiliarParameters() {
+	this->InitializeCoefficientsArray( this->m_Gradient );
+	this->InitializeCoefficientsArray( this->m_PreviousGradient );
+	this->InitializeCoefficientsArray( this->m_PreviousCoefficients );
+	this->InitializeCoefficientsArray( this->m_Direction );
+	this->InitializeCoefficientsArray( this->m_Scratch );
+	this->InitializeCoefficientsArray( this->m_ZeroCoefficients );
+
+	this->m_History.clear();
+	this->m_HasPrevious = false;
+	this->m_HessianScale = 1.0;
+	this->m_LineSearchStep = 1.0;
+	this->m_NumberOfEvaluations = 0;
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	Superclass::SaveState( f );
+	f.Write( this->m_HasPrevious );
+	f.Write( this->m_HessianScale );
+	f.Write( this->m_LineSearchStep );
+	f.Write< std::uint64_t >( this->m_NumberOfEvaluations );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.WriteImage( this->m_PreviousCoefficients[d].GetPointer() );
+		f.WriteImage( this->m_PreviousGradient[d].GetPointer() );
+	}
+
+	f.Write< std::uint64_t >( this->m_History.size() );
+	for( size_t k = 0; k < this->m_History.size(); k++ ) {
+		const CorrectionPair & p = this->m_History[k];
+		f.Write( p.rho );
+		for( size_t d = 0; d < Dimension; d++ ) {
+			f.WriteImage( p.s[d].GetPointer() );
+			f.WriteImage( p.y[d].GetPointer() );
+		}
+	}
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	Superclass::LoadState( f );
+	f.Read( this->m_HasPrevious );
+	f.Read( this->m_HessianScale );
+	f.Read( this->m_LineSearchStep );
+	this->m_NumberOfEvaluations = f.Read< std::uint64_t >();
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.ReadImage( this->m_PreviousCoefficients[d].GetPointer() );
+		f.ReadImage( this->m_PreviousGradient[d].GetPointer() );
+	}
+
+	size_t m = f.Read< std::uint64_t >();
+	this->m_History.clear();
+	for( size_t k = 0; k < m; k++ ) {
+		CorrectionPair p;
+		this->InitializeCoefficientsArray( p.s );
+		this->InitializeCoefficientsArray( p.y );
+		f.Read( p.rho );
+		for( size_t d = 0; d < Dimension; d++ ) {
+			f.ReadImage( p.s[d].GetPointer() );
+			f.ReadImage( p.y[d].GetPointer() );
+		}
+		this->m_History.push_back( p );
+	}
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>::Iterate() {
+	itkDebugMacro("Optimizer Iteration");
+
+	// Gradient of the total energy. The derivative coefficients hold the
+	// descent direction of the functional, hence the sign.
+	MeasureType value = this->EvaluateRegularization( this->m_Coefficients, this->m_Gradient );
+	this->Combine( 1.0, this->m_Gradient, -1.0, this->m_DerivativeCoefficients, this->m_Gradient );
+	value+= this->m_Functional->GetValue();
+
+	// Update the history with the last step
+	if ( this->m_HasPrevious && this->m_HistorySize > 0 ) {
+		CorrectionPair pair;
+		if ( this->m_History.size() >= this->m_HistorySize ) {
+			pair = this->m_History.front();
+			this->m_History.pop_front();
+		} else {
+			this->InitializeCoefficientsArray( pair.s );
+			this->InitializeCoefficientsArray( pair.y );
+		}
+		this->Combine( 1.0, this->m_Coefficients, -1.0, this->m_PreviousCoefficients, pair.s );
+		this->Combine( 1.0, this->m_Gradient, -1.0, this->m_PreviousGradient, pair.y );
+
+		double sy = this->InnerProduct( pair.s, pair.y );
+		double yy = this->InnerProduct( pair.y, pair.y );
+
+		// Skip pairs that do not satisfy the curvature condition
+		if ( sy > 1.0e-10 * yy && sy > 0.0 ) {
+			pair.rho = 1.0 / sy;
+			this->ApplyInitialHessian( pair.y, this->m_Scratch );
+			double yHy = this->InnerProduct( pair.y, this->m_Scratch );
+			if ( yHy > 0.0 ) {
+				this->m_HessianScale = sy / yHy;
+			}
+			this->m_History.push_back( pair );
+		}
+	}
+	this->Combine( 1.0, this->m_Coefficients, 0.0, this->m_Coefficients, this->m_PreviousCoefficients );
+	this->Combine( 1.0, this->m_Gradient, 0.0, this->m_Gradient, this->m_PreviousGradient );
+	this->m_HasPrevious = true;
+
+	// Two-loop recursion, q is kept in m_Direction and r in m_Scratch
+	size_t m = this->m_History.size();
+	std::vector< double > a( m, 0.0 );
+	this->Combine( 1.0, this->m_Gradient, 0.0, this->m_Gradient, this->m_Direction );
+	for( size_t k = m; k-- > 0; ) {
+		const CorrectionPair & p = this->m_History[k];
+		a[k] = p.rho * this->InnerProduct( p.s, this->m_Direction );
+		this->Combine( 1.0, this->m_Direction, -a[k], p.y, this->m_Direction );
+	}
+
+	this->ApplyInitialHessian( this->m_Direction, this->m_Scratch );
+	if ( m > 0 ) {
+		this->Combine( this->m_HessianScale, this->m_Scratch, 0.0, this->m_Scratch, this->m_Scratch );
+	}
+
+	for( size_t k = 0; k < m; k++ ) {
+		const CorrectionPair & p = this->m_History[k];
+		double b = p.rho * this->InnerProduct( p.y, this->m_Scratch );
+		this->Combine( 1.0, this->m_Scratch, a[k] - b, p.s, this->m_Scratch );
+	}
+	this->Combine( -1.0, this->m_Scratch, 0.0, this->m_Scratch, this->m_Direction );
+
+	double slope = this->InnerProduct( this->m_Gradient, this->m_Direction );
+	if ( slope > 0.0 ) {
+		// Not a descent direction, restart from the preconditioned gradient
+		this->m_History.clear();
+		this->m_HessianScale = 1.0;
+		this->ApplyInitialHessian( this->m_Gradient, this->m_Direction );
+		this->Combine( -1.0, this->m_Direction, 0.0, this->m_Direction, this->m_Direction );
+		slope = this->InnerProduct( this->m_Gradient, this->m_Direction );
+	}
+
+	// Armijo backtracking on the total energy
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+	CoefficientValueType* next[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		next[d] = this->m_NextCoefficients[d]->GetBufferPointer();
+	}
+	const VectorType maxDisp = this->m_MaxDisplacement;
+
+	InternalComputationValueType t = 1.0;
+	MeasureType trial = value;
+	for( size_t it = 0; ; it++ ) {
+		this->Combine( 1.0, this->m_Coefficients, t, this->m_Direction, this->m_NextCoefficients );
+		if ( this->m_ForceDiffeomorphic ) {
+			this->m_ThreadPool->ParallelFor( nPix,
+					[&](size_t start, size_t stop, itk::ThreadIdType) {
+				for( size_t d = 0; d < Dimension; d++ ) {
+					for( size_t i = start; i < stop; i++ ) {
+						if ( fabs( next[d][i] ) > maxDisp[d] ) {
+							next[d][i] = maxDisp[d] * ((next[d][i]>0)?1.0:-1.0);
+						}
+					}
+				}
+			});
+		}
+
+		trial = this->EvaluateEnergy( this->m_NextCoefficients );
+		if ( trial <= value + this->m_ArmijoFactor * t * slope ) {
+			break;
+		}
+
+		if ( ( it + 1 ) >= this->m_MaximumLineSearchIterations ) {
+			// Keep the shortest step and drop the curvature information
+			this->m_History.clear();
+			this->m_HessianScale = 1.0;
+			break;
+		}
+		t *= 0.5;
+	}
+
+	this->m_LineSearchStep = t;
+	this->m_CurrentTotalEnergy = trial;
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::SetUpdate() {
+	for (size_t i = 0; i < Dimension; i++) {
+		std::swap( this->m_Coefficients[i], this->m_NextCoefficients[i] );
+	}
+	this->UpdateCurrentCoefficients();
+}
+
+template< typename TFunctional >
+typename SpectralLBFGSOptimizer<TFunctional>::MeasureType
+SpectralLBFGSOptimizer<TFunctional>
+::EvaluateEnergy( const CoefficientsImageArray & u ) {
+	this->m_Transform->SetCoefficientsImages( u );
+	this->m_Transform->InterpolatePoints();
+	this->m_Functional->SetCurrentDisplacements( this->m_Transform->GetPointValues() );
+	this->m_NumberOfEvaluations++;
+
+	this->m_RegularizationEnergy = this->EvaluateRegularization( u, this->m_Scratch );
+	this->m_RegularizationEnergyUpdated = true;
+	return this->m_Functional->GetValue() + this->m_RegularizationEnergy;
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::ApplyInitialHessian( const CoefficientsImageArray & in, CoefficientsImageArray & out ) {
+	// The spectral update of a zero field along in: delta * ((1 + 2 alpha delta) - 2 beta delta L)^-1 in
+	this->ComputeUpdate( this->m_ZeroCoefficients, in, out );
+}
+
+template< typename TFunctional >
+double SpectralLBFGSOptimizer<TFunctional>
+::InnerProduct( const CoefficientsImageArray & a, const CoefficientsImageArray & b ) const {
+	size_t nPix = a[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	const typename CoefficientsImageType::PixelType* pa[Dimension];
+	const typename CoefficientsImageType::PixelType* pb[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		pa[d] = a[d]->GetBufferPointer();
+		pb[d] = b[d]->GetBufferPointer();
+	}
+
+	return this->m_ThreadPool->ParallelReduce( nPix, 0.0,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		double sum = 0.0;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				sum+= pa[d][i] * pb[d][i];
+			}
+		}
+		return sum;
+	});
+}
+
+template< typename TFunctional >
+void SpectralLBFGSOptimizer<TFunctional>
+::Combine( double ca, const CoefficientsImageArray & a, double cb, const CoefficientsImageArray & b,
+		CoefficientsImageArray & out ) const {
+	size_t nPix = a[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	const CoefficientValueType* pa[Dimension];
+	const CoefficientValueType* pb[Dimension];
+	CoefficientValueType* po[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		pa[d] = a[d]->GetBufferPointer();
+		pb[d] = b[d]->GetBufferPointer();
+		po[d] = out[d]->GetBufferPointer();
+	}
+
+	this->m_ThreadPool->ParallelFor( nPix,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				po[d][i] = ca * pa[d][i] + cb * pb[d][i];
+			}
+		}
+	});
+}
+
+} // end namespace rstk
+
+#endif /* SPECTRALLBFGSOPTIMIZER_HXX_ */
@@ -0,0 +1,115 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALNESTEROVOPTIMIZER_H_
+#define SPECTRALNESTEROVOPTIMIZER_H_
+
+#include "SpectralOptimizer.h"
+
+using namespace itk;
+
+namespace rstk
+{
+/**
+ * \class SpectralNesterovOptimizer
+ *  \brief Accelerated (Nesterov/FISTA) gradient descent optimizer.
+ *
+ * The spectral regularization step is used as the proximal operator and
+ * the functional is evaluated on the extrapolated coefficients:
+ * \f[
+ *        u^{t+1} = \mathrm{prox}( y^{t} + \delta g(y^{t}) ), \quad
+ *        y^{t+1} = u^{t+1} + \frac{\tau_{t}-1}{\tau_{t+1}} ( u^{t+1} - u^{t} )
+ * \f]
+ * The momentum is reset whenever the generalized gradient stops pointing
+ * along the last step (adaptive restart, O'Donoghue and Candes 2015).
+ */
+
+template< typename TFunctional >
+class SpectralNesterovOptimizer: public SpectralOptimizer<TFunctional> {
+public:
+	/** Standard class typedefs and macros */
+	typedef SpectralNesterovOptimizer                  Self;
+	typedef SpectralOptimizer<TFunctional>             Superclass;
+	typedef itk::SmartPointer<Self>                    Pointer;
+	typedef itk::SmartPointer< const Self >            ConstPointer;
+
+	itkTypeMacro( SpectralNesterovOptimizer, SpectralOptimizer ); // Run-time type information (and related methods)
+	itkNewMacro( Self );                                      // New macro for creation of through a Smart Pointer
+
+	/** Metric type over which this class is templated */
+	typedef typename Superclass::FunctionalType                   FunctionalType;
+	itkStaticConstMacro( Dimension, unsigned int, FunctionalType::Dimension );
+
+	/** Functional definitions */
+	typedef typename Superclass::MeasureType                      MeasureType;
+	typedef typename Superclass::VectorType                       VectorType;
+	typedef typename Superclass::PointValueType                   PointValueType;
+	typedef typename Superclass::InternalComputationValueType     InternalComputationValueType;
+	typedef typename Superclass::SizeValueType                    SizeValueType;
+
+	typedef typename Superclass::CoefficientsImageType            CoefficientsImageType;
+	typedef typename Superclass::CoefficientsImageArray           CoefficientsImageArray;
+
+	itkSetMacro( UseAdaptiveRestart, bool );
+	itkGetConstMacro( UseAdaptiveRestart, bool );
+
+	itkGetConstMacro( NumberOfRestarts, SizeValueType );
+
+	void SaveState( CheckpointFile& f ) const override;
+protected:
+	SpectralNesterovOptimizer();
+	~SpectralNesterovOptimizer() {}
+
+	void PrintSelf( std::ostream &os, itk::Indent indent ) const override;
+
+	void InitializeAuxiliarParameters( void ) override;
+	void LoadState( CheckpointFile& f ) override;
+	void Iterate(void) override;
+	void SetUpdate() override;
+	void UpdateStepSize() override {}
+	void FinalizeParameters() override;
+
+	const CoefficientsImageArray & GetEvaluationCoefficients() const override {
+		return this->m_Extrapolated;
+	}
+
+	/** Extrapolated coefficients y, where the derivative is computed */
+	CoefficientsImageArray       m_Extrapolated;
+	InternalComputationValueType m_Tau;
+	bool                         m_UseAdaptiveRestart;
+	SizeValueType                m_NumberOfRestarts;
+
+private:
+	SpectralNesterovOptimizer( const Self & ); // purposely not implemented
+	void operator=( const Self & ); // purposely not implemented
+}; // End of Class
+
+} // End of namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SpectralNesterovOptimizer.hxx"
+#endif
+
+#endif /* SPECTRALNESTEROVOPTIMIZER_H_ */
@@ -0,0 +1,177 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALNESTEROVOPTIMIZER_HXX_
+#define SPECTRALNESTEROVOPTIMIZER_HXX_
+
+#include "SpectralNesterovOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace rstk {
+
+/**
+ * Default constructor
+ */
+template< typename TFunctional >
+SpectralNesterovOptimizer<TFunctional>::SpectralNesterovOptimizer():
+Superclass(),
+m_Tau(1.0),
+m_UseAdaptiveRestart(true),
+m_NumberOfRestarts(0)
+{}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::PrintSelf(std::ostream &os, itk::Indent indent) const {
+	Superclass::PrintSelf(os,indent);
+	os << indent << "Adaptive restart: " << this->m_UseAdaptiveRestart << std::endl;
+	os << indent << "Number of restarts: " << this->m_NumberOfRestarts << std::endl;
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::InitializeAuxiliarParameters() {
+	// y^0 = u^0 (zero, unless the optimizer was seeded)
+	this->InitializeCoefficientsArray( this->m_Extrapolated );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
+			this->m_Coefficients[d], this->m_Extrapolated[d],
+			this->m_Coefficients[d]->GetLargestPossibleRegion(),
+			this->m_Extrapolated[d]->GetLargestPossibleRegion() );
+	}
+	this->m_Tau = 1.0;
+	this->m_Momentum = 0.0;
+	this->m_NumberOfRestarts = 0;
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	Superclass::SaveState( f );
+	f.Write( this->m_Tau );
+	f.Write< std::uint64_t >( this->m_NumberOfRestarts );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.WriteImage( this->m_Extrapolated[d].GetPointer() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	Superclass::LoadState( f );
+	f.Read( this->m_Tau );
+	this->m_NumberOfRestarts = f.Read< std::uint64_t >();
+	for( size_t d = 0; d < Dimension; d++ ) {
+		f.ReadImage( this->m_Extrapolated[d].GetPointer() );
+	}
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>::Iterate() {
+	itkDebugMacro("Optimizer Iteration");
+	this->ComputeUpdate(this->m_Extrapolated, this->m_DerivativeCoefficients, this->m_NextCoefficients, true);
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::SetUpdate() {
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	CoefficientValueType* y[Dimension];
+	const CoefficientValueType* u[Dimension];
+	const CoefficientValueType* next[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		y[d] = this->m_Extrapolated[d]->GetBufferPointer();
+		u[d] = this->m_Coefficients[d]->GetBufferPointer();
+		next[d] = this->m_NextCoefficients[d]->GetBufferPointer();
+	}
+
+	// Restart test: (y^t - u^{t+1}) . (u^{t+1} - u^t) > 0
+	bool restart = false;
+	if ( this->m_UseAdaptiveRestart ) {
+		double dot = this->m_ThreadPool->ParallelReduce( nPix, 0.0,
+				[&](size_t start, size_t stop, itk::ThreadIdType) {
+			double sum = 0.0;
+			for( size_t d = 0; d < Dimension; d++ ) {
+				for( size_t i = start; i < stop; i++ ) {
+					sum+= ( y[d][i] - next[d][i] ) * ( next[d][i] - u[d][i] );
+				}
+			}
+			return sum;
+		});
+		restart = dot > 0.0;
+	}
+
+	InternalComputationValueType momentum = 0.0;
+	if ( restart ) {
+		this->m_Tau = 1.0;
+		this->m_NumberOfRestarts++;
+	} else {
+		InternalComputationValueType tau = 0.5 * ( 1.0 + std::sqrt( 1.0 + 4.0 * this->m_Tau * this->m_Tau ) );
+		momentum = ( this->m_Tau - 1.0 ) / tau;
+		this->m_Tau = tau;
+	}
+	this->m_Momentum = momentum;
+
+	// y^{t+1} = u^{t+1} + momentum * ( u^{t+1} - u^t ), kept within the
+	// displacement bounds as the iterates are
+	const VectorType maxDisp = this->m_MaxDisplacement;
+	const bool force = this->m_ForceDiffeomorphic;
+	this->m_ThreadPool->ParallelFor( nPix,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				CoefficientValueType v = next[d][i] + momentum * ( next[d][i] - u[d][i] );
+				if ( force && fabs(v) > maxDisp[d] ) {
+					v = maxDisp[d] * ((v>0)?1.0:-1.0);
+				}
+				y[d][i] = v;
+			}
+		}
+	});
+
+	for (size_t i = 0; i < Dimension; i++) {
+		std::swap( this->m_Coefficients[i], this->m_NextCoefficients[i] );
+	}
+	this->UpdateCurrentCoefficients();
+}
+
+template< typename TFunctional >
+void SpectralNesterovOptimizer<TFunctional>
+::FinalizeParameters() {
+	// The transform holds the extrapolated point, leave it on the estimate
+	this->m_Transform->SetCoefficientsImages( this->m_Coefficients );
+	this->m_Transform->InterpolatePoints();
+	this->m_Functional->SetCurrentDisplacements( this->m_Transform->GetPointValues() );
+}
+
+} // end namespace rstk
+
+#endif /* SPECTRALNESTEROVOPTIMIZER_HXX_ */
@@ -45,6 +45,7 @@
 #include "rstkMacro.h"
 #include "OptimizerBase.h"
 #include "BSplineSparseMatrixTransform.h"
+#include "SpectralRegularizer.h"
 
 using namespace itk;
 namespace bpo = boost::program_options;
@@ -133,12 +134,8 @@ public:
 	typedef typename FTDomainType::Pointer                          FTDomainPointer;
 	typedef itk::FixedArray< FTDomainPointer, Dimension >           FTDomainArray;
 	typedef typename FTDomainType::PixelType                        ComplexType;
-	typedef itk::AddImageFilter<FTDomainType, FTDomainType, FTDomainType>
-																	FTAddFilterType;
-	typedef itk::MultiplyImageFilter<FTDomainType, FTDomainType, FTDomainType>
-																	FTMultiplyFilterType;
-	typedef itk::DivideImageFilter<FTDomainType, FTDomainType, FTDomainType>
-																	FTDivideFilterType;
+	typedef SpectralRegularizer< CoefficientsImageType >            RegularizerType;
+	typedef typename RegularizerType::Pointer                       RegularizerPointer;
 
 	/** Internal computation value type */
 	typedef typename ComplexType::value_type                        InternalComputationValueType;
@@ -189,6 +186,11 @@ public:
 		return this->m_Transform->GetCoefficientsField();
 	}
 
+	itkSetObjectMacro( ThreadPool, ThreadPool );
+	itkGetObjectMacro( ThreadPool, ThreadPool );
+
+	void SaveState( CheckpointFile& f ) const override;
+
 	static void AddOptions( SettingsDesc& opts );
 protected:
 	SpectralOptimizer();
@@ -214,10 +216,23 @@ protected:
 
 	virtual void SetUpdate() = 0;
 
-	virtual void ParseSettings() override;
+	/** Coefficients where the functional is evaluated in the next iteration
+	 *  (the current estimate, unless the scheme extrapolates) */
+	virtual const CoefficientsImageArray & GetEvaluationCoefficients() const {
+		return this->m_Coefficients;
+	}
 
-	/* Common variables for optimization control and reporting */
-	bool                          m_DenominatorCached;
+	void InitializeCoefficientsArray( CoefficientsImageArray & array ) const;
+	void UpdateCurrentCoefficients();
+
+	/** Regularization energy of u, its gradient is written in grad */
+	MeasureType EvaluateRegularization( const CoefficientsImageArray & u, CoefficientsImageArray & grad );
+
+	void LoadState( CheckpointFile& f ) override;
+	void SynchronizeState() override;
+	void SeedCoefficients() override;
+
+	virtual void ParseSettings() override;
 
 	/** Particular parameter definitions from our method */
 	InternalVectorType m_Alpha;
@@ -229,9 +244,10 @@ protected:
 	bool m_RegularizationEnergyUpdated;
 
 	CoefficientsImageArray       m_NextCoefficients;
-	CoefficientsImageArray       m_Denominator;
-	FTDomainPointer              m_FTLaplacian;
-	FTDomainPointer              m_FTOnes;
+	RegularizerPointer           m_Regularizer;
+	ThreadPool::Pointer          m_ThreadPool;
+	CoefficientsImageArray       m_UpdateBuffer;   // u + step * g, before regularization
+	std::vector< double >        m_SpeedNorms;
 	FieldPointer                 m_LastCoeff;
 	FieldPointer                 m_CurrentCoefficients;
 	AddFieldFilterPointer        m_FieldCoeffAdder;
@@ -239,9 +255,6 @@ private:
 	SpectralOptimizer( const Self & ); // purposely not implemented
 	void operator=( const Self & ); // purposely not implemented
 
-	void ApplyRegularizationTerm( ComplexFieldType* reference );
-	void ApplyRegularizationComponent( size_t d, FTDomainType *reference );
-	void InitializeDenominator( itk::ImageBase<Dimension> *reference );
 	void UpdateField();
 }; // End of Class
 
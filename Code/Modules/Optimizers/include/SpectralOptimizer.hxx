@@ -52,7 +52,6 @@ namespace rstk {
 template< typename TFunctional >
 SpectralOptimizer<TFunctional>::SpectralOptimizer():
 Superclass(),
-m_DenominatorCached( false ),
 m_RegularizationEnergy( 0.0 ),
 m_CurrentTotalEnergy(itk::NumericTraits<MeasureType>::infinity()),
 m_RegularizationEnergyUpdated(true)
@@ -60,6 +59,9 @@ m_RegularizationEnergyUpdated(true)
 	this->m_Alpha.Fill( 0.0 );
 	this->m_Beta.Fill( 0.0 );
 	this->m_StopConditionDescription << this->GetNameOfClass() << ": ";
+	this->m_ThreadPool = ThreadPool::New();
+	this->m_Regularizer = RegularizerType::New();
+	this->m_Regularizer->SetThreadPool( this->m_ThreadPool );
 	SplineTransformPointer defaultTransform = SplineTransformType::New();
 	this->m_Transform = itkDynamicCastInDebugMode< TransformType* >( defaultTransform.GetPointer() );
 	this->m_Transform->SetNumberOfThreads( this->GetNumberOfThreads() );
@@ -83,9 +85,6 @@ void SpectralOptimizer<TFunctional>
 
 template< typename TFunctional >
 void SpectralOptimizer<TFunctional>::ComputeDerivative() {
-	// Multiply phi and copy reshaped on this->m_Derivative
-	WeightsMatrix phi = this->m_Transform->GetPhi()->transpose();
-
 	size_t dimsize = this->m_Functional->GetValidVertices().size();
 	size_t fullsize = dimsize * Dimension;
 
@@ -100,32 +99,38 @@ void SpectralOptimizer<TFunctional>::ComputeDerivative() {
 	//this->m_MaximumGradient = fabs(this->m_Functional->GetGradientStatistics()[4] -
 	//		this->m_Functional->GetGradientStatistics()[2]);
 
+	size_t nPix = this->m_LastCoeff->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	// Multiply phi^T and copy reshaped on this->m_Derivative, all dimensions at once
 	ParametersContainer derivative;
-	ParametersVector dimVector = ParametersVector(dimsize);
+	const float* dimdata[Dimension];
+	float* dimderiv[Dimension];
+	size_t nvec = 0;
+	for ( size_t i = 0; i<Dimension; i++) {
+		if( this->m_Scales[i] > 1.0e-8 ) {
+			derivative[i].set_size( nPix );
+			dimdata[nvec] = &gvdata[i*dimsize];
+			dimderiv[nvec] = derivative[i].data_block();
+			nvec++;
+		}
+	}
+	this->m_Transform->MultiplyPhiTranspose( dimdata, dimderiv, nvec );
 
 	typename CoefficientsImageType::PixelType* buff[Dimension];
-	float* dimdata;
-
 	double norm = 1.0;
 	for ( size_t i = 0; i<Dimension; i++) {
 		if( this->m_Scales[i] > 1.0e-8 ) {
-			dimdata = &gvdata[i*dimsize];
-			dimVector.copy_in(dimdata);
-			phi.mult( dimVector, derivative[i] );
-
 			double m = derivative[i].inf_norm();
 			if ( m > norm )	norm = m;
 		}
 		this->m_DerivativeCoefficients[i]->FillBuffer( 0.0 );
 		buff[i] = this->m_DerivativeCoefficients[i]->GetBufferPointer();
 	}
-
-	size_t nPix = this->m_LastCoeff->GetLargestPossibleRegion().GetNumberOfPixels();
 	InternalComputationValueType val;
 	size_t dim;
 	VectorType vs;
 
-	std::vector< double > speednorms;
+	double maxGradient = 0.0;
 	for( size_t r = 0; r<nPix; r++ ){
 		vs.Fill(0.0);
 		for( size_t c=0; c<Dimension; c++) {
@@ -137,11 +142,10 @@ void SpectralOptimizer<TFunctional>::ComputeDerivative() {
 					*( buff[c] + r ) = val;
 			}
 		}
-		speednorms.push_back(vs.GetNorm());
+		maxGradient = std::max( maxGradient, static_cast< double >( vs.GetNorm() ) );
 	}
-	std::sort(speednorms.begin(), speednorms.end());
 
-	this->m_MaximumGradient = speednorms.back();
+	this->m_MaximumGradient = maxGradient;
 
 	if( this->m_AutoStepSize && this->m_CurrentIteration == 1 ) {
 		this->m_StepSize = (this->m_MaxDisplacement.GetNorm() * this->m_NumberOfIterations) / ( this->m_MaximumGradient * 2000 );
@@ -163,9 +167,9 @@ void SpectralOptimizer<TFunctional>::PostIteration() {
 	}
 
 	this->m_CurrentValue = this->m_CurrentEnergy;
-	this->m_Transform->SetCoefficientsImages( this->m_NextCoefficients );
-	this->m_Transform->InterpolatePoints();
 	this->SetUpdate();
+	this->m_Transform->SetCoefficientsImages( this->GetEvaluationCoefficients() );
+	this->m_Transform->InterpolatePoints();
 
 	this->m_Functional->SetCurrentDisplacements( this->m_Transform->GetPointValues() );
 }
@@ -239,6 +243,38 @@ SpectralOptimizer<TFunctional>::GetCurrentRegularizationEnergy() {
 	return this->m_RegularizationEnergy;
 }
 
+template< typename TFunctional >
+typename SpectralOptimizer<TFunctional>::MeasureType
+SpectralOptimizer<TFunctional>
+::EvaluateRegularization( const CoefficientsImageArray & u, CoefficientsImageArray & grad ) {
+	size_t nPix = u[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+	MeasureType energy = 0.0;
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		const double alpha = ( this->m_Alpha[d] > 1.0e-8 )?this->m_Alpha[d]:0.0;
+		const double beta = ( this->m_Beta[d] > 1.0e-8 )?this->m_Beta[d]:0.0;
+
+		// grad = u - L u, the laplacian term is recovered below
+		if ( beta > 0.0 ) {
+			this->m_Regularizer->ApplyOperator( u[d], 1.0, grad[d] );
+		}
+
+		const typename CoefficientsImageType::PixelType* ud = u[d]->GetBufferPointer();
+		typename CoefficientsImageType::PixelType* gd = grad[d]->GetBufferPointer();
+		energy+= this->m_ThreadPool->ParallelReduce( nPix, 0.0,
+				[&](size_t start, size_t stop, itk::ThreadIdType) {
+			double e = 0.0;
+			for( size_t i = start; i < stop; i++ ) {
+				double nl = ( beta > 0.0 )?( gd[i] - ud[i] ):0.0;   // -L u
+				e+= alpha * ud[i] * ud[i] + beta * ud[i] * nl;
+				gd[i] = 2.0 * ( alpha * ud[i] + beta * nl );
+			}
+			return e;
+		});
+	}
+	return energy;
+}
+
 template< typename TFunctional >
 void SpectralOptimizer<TFunctional>::ComputeUpdate(
 		CoefficientsImageArray uk,
@@ -246,42 +282,38 @@ void SpectralOptimizer<TFunctional>::ComputeUpdate(
 		CoefficientsImageArray next_uk,
 		bool changeDirection){
 
-	CoefficientsImagePointer result;
-	InternalVectorType s;
+	typedef typename CoefficientsImageType::PixelType CoefficientValueType;
+	size_t nPix = uk[0]->GetLargestPossibleRegion().GetNumberOfPixels();
 
+	InternalVectorType s;
+	const CoefficientValueType* u[Dimension];
+	const CoefficientValueType* g[Dimension];
+	CoefficientValueType* r[Dimension];
 	for( size_t d = 0; d < Dimension; d++ ) {
-		typename MultiplyFilterType::Pointer step_f = MultiplyFilterType::New();
-		step_f->SetConstant( this->m_StepSize );
-		step_f->SetInput( gk[d] );
-		step_f->Update();
-
-		typename AddFilterType::Pointer add_f = AddFilterType::New();
-		add_f->SetInput1( uk[d] );
-		add_f->SetInput2( step_f->GetOutput() );
-		add_f->Update();
 		s[d] = 1.0;
-
 		if( this->m_Alpha[d] > 1.0e-8) {
-			typename MultiplyFilterType::Pointer scale_f = MultiplyFilterType::New();
 			s[d] = 1.0 / (1.0 + 2.0 * this->m_Alpha[d] * this->m_StepSize);
-			scale_f->SetConstant( s[d] );
-			scale_f->SetInput(add_f->GetOutput());
-			scale_f->Update();
-			result = scale_f->GetOutput();
-		} else {
-			result = add_f->GetOutput();
 		}
+		u[d] = uk[d]->GetBufferPointer();
+		g[d] = gk[d]->GetBufferPointer();
+		r[d] = ( this->m_Beta[d] > 1.0e-8 )?this->m_UpdateBuffer[d]->GetBufferPointer():next_uk[d]->GetBufferPointer();
+	}
 
+	// Fused (u + step * g) * s of all the components, in place on the preallocated buffers
+	const InternalComputationValueType step = this->m_StepSize;
+	this->m_ThreadPool->ParallelFor( nPix,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			for( size_t i = start; i < stop; i++ ) {
+				r[d][i] = ( u[d][i] + step * g[d][i] ) * s[d];
+			}
+		}
+	});
+
+	for( size_t d = 0; d < Dimension; d++ ) {
 		if( this->m_Beta[d] > 1.0e-8) {
 			InternalComputationValueType scaler = 2.0 * this->m_Beta[d] * this->m_StepSize * s[d];
-			this->BetaRegularization(result, next_uk, scaler, d);
-		} else {
-			// Set component in destination buffer of coefficients
-			itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
-				result, next_uk[d],
-				result->GetLargestPossibleRegion(),
-				next_uk[d]->GetLargestPossibleRegion()
-			);
+			this->BetaRegularization(this->m_UpdateBuffer[d], next_uk, scaler, d);
 		}
 	}
 
@@ -314,31 +346,8 @@ void SpectralOptimizer<TFunctional>::BetaRegularization(
 		size_t d) {
 	itkDebugMacro("Optimizer Spectral Update");
 
-	FFTPointer fftFilter = FFTType::New();
-	fftFilter->SetInput( numerator );
-	fftFilter->Update();  // This is required for computing the denominator for first time
-
-	if ( !this->m_DenominatorCached )
-		this->InitializeDenominator( fftFilter->GetOutput() );
-
-	typename FTMultiplyFilterType::Pointer scale_f = FTMultiplyFilterType::New();
-	scale_f->SetInput(this->m_FTLaplacian);
-	scale_f->SetConstant( -1.0 * s);
-
-	typename FTAddFilterType::Pointer add_f = FTAddFilterType::New();
-	add_f->SetInput1(this->m_FTOnes);
-	add_f->SetInput2(scale_f->GetOutput());
-
-	typename FTDivideFilterType::Pointer div_f = FTDivideFilterType::New();
-	div_f->SetInput1(fftFilter->GetOutput());
-	div_f->SetInput2(add_f->GetOutput());
-	div_f->Update();
-
-	IFFTPointer ifft = IFFTType::New();
-	ifft->SetInput( div_f->GetOutput() );
-
 	try {
-		ifft->Update();
+		this->m_Regularizer->Apply( numerator, s, next_uk[d] );
 	}
 	catch ( itk::ExceptionObject & err ) {
 		this->m_StopCondition = Superclass::UPDATE_PARAMETERS_ERROR;
@@ -347,66 +356,8 @@ void SpectralOptimizer<TFunctional>::BetaRegularization(
 		// Pass exception to caller
 		throw err;
 	}
-
-	// Set component in destination buffer of coefficients
-	itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
-		ifft->GetOutput(),
-		next_uk[d],
-		ifft->GetOutput()->GetLargestPossibleRegion(),
-		next_uk[d]->GetLargestPossibleRegion()
-	);
-
-	// typedef itk::ComplexToRealImageFilter<FTDomainType, CoefficientsImageType> RealFilterType;
-	// typename RealFilterType::Pointer realFilter = RealFilterType::New();
-	// realFilter->SetInput(add_f->GetOutput());
-	// realFilter->Update();
-    //
-	// std::stringstream ss;
-	// ss << "test_coeff" << d << "_it" << this->m_CurrentIteration << ".nii.gz";
-	// typename itk::ImageFileWriter<CoefficientsImageType>::Pointer w = itk::ImageFileWriter<CoefficientsImageType>::New();
-	// w->SetFileName(ss.str().c_str());
-	// w->SetInput(realFilter->GetOutput());
-	// w->Update();
-}
-
-template< typename TFunctional >
-void SpectralOptimizer<TFunctional>
-::InitializeDenominator( itk::ImageBase<Dimension>* reference ){
-	PointValueType pi2 = 2* vnl_math::pi;
-	size_t nPix = reference->GetLargestPossibleRegion().GetNumberOfPixels();
-	ControlPointsGridSizeType size = reference->GetLargestPossibleRegion().GetSize();
-
-	ComplexType one = itk::NumericTraits<ComplexType>::One;
-	this->m_FTOnes = FTDomainType::New();
-	this->m_FTOnes->SetSpacing(   reference->GetSpacing() );
-	this->m_FTOnes->SetDirection( reference->GetDirection() );
-	this->m_FTOnes->SetRegions(   reference->GetLargestPossibleRegion().GetSize() );
-	this->m_FTOnes->Allocate();
-	this->m_FTOnes->FillBuffer(one);
-
-	this->m_FTLaplacian = FTDomainType::New();
-	this->m_FTLaplacian->SetSpacing(   reference->GetSpacing() );
-	this->m_FTLaplacian->SetDirection( reference->GetDirection() );
-	this->m_FTLaplacian->SetRegions(   reference->GetLargestPossibleRegion().GetSize() );
-	this->m_FTLaplacian->Allocate();
-	this->m_FTLaplacian->FillBuffer( itk::NumericTraits<ComplexType>::Zero);
-
-	// Fill Buffer with denominator data
-	ComplexType* buffer = this->m_FTLaplacian->GetBufferPointer();
-	InternalComputationValueType lag_el; // accumulates the FT{lagrange operator}.
-	typename FTDomainType::IndexType idx;
-	for (size_t pix = 0; pix < nPix; pix++ ) {
-		lag_el = 0.0;
-		idx = this->m_FTLaplacian->ComputeIndex(pix);
-		for(size_t d = 0; d < Dimension; d++ ) {
-			lag_el+= 2.0 * cos( (pi2*idx[d])/size[d] ) - 2.0;
-		}
-		*(buffer+pix) = one * lag_el;
-	}
-	this->m_DenominatorCached = true;
 }
 
-
 template< typename TFunctional >
 void
 SpectralOptimizer<TFunctional>::UpdateField() {
@@ -422,50 +373,109 @@ SpectralOptimizer<TFunctional>::UpdateField() {
 template< typename TFunctional >
 void
 SpectralOptimizer<TFunctional>::ComputeIterationSpeed() {
-	VectorType* fBuffer = this->m_CurrentCoefficients->GetBufferPointer();
+	const VectorType* fBuffer = this->m_CurrentCoefficients->GetBufferPointer();
 	size_t nPix = this->m_CurrentCoefficients->GetLargestPossibleRegion().GetNumberOfPixels();
 
 	PointValueType* fnextBuffer[Dimension];
 	for(size_t d = 0; d < Dimension; d++)
 		fnextBuffer[d] = this->m_NextCoefficients[d]->GetBufferPointer();
 
-	InternalComputationValueType totalNorm = 0;
-	VectorType t0,t1;
-	InternalComputationValueType diff = 0.0;
-
-	this->m_DiffeomorphismForced = false;
-	this->m_IsDiffeomorphic = true;
-	std::vector< InternalComputationValueType > speednorms;
-	std::vector< double > speedangs;
-	typedef vnl_vector< PointValueType > VNLVector;
-	VNLVector v(Dimension);
-	for (size_t pix = 0; pix < nPix; pix++ ) {
-		t0 = *(fBuffer+pix);
-		for( size_t d = 0; d<Dimension; d++) {
-			t1[d] = *(fnextBuffer[d]+pix);
-
-			if ( fabs(t1[d]) > this->m_MaxDisplacement[d] ) {
-				if (this->m_ForceDiffeomorphic) {
-					t1[d] = this->m_MaxDisplacement[d] * ((t1[d]>0)?1.0:-1.0);
-					this->m_DiffeomorphismForced = true;
-					*(fnextBuffer[d]+pix) = t1[d];
-				} else {
-					this->m_IsDiffeomorphic = false;
+	// Reductions over the speed norms, combined in a fixed order
+	struct SpeedSummary {
+		double total;
+		double max;
+		bool forced;
+		bool folded;
+	};
+	const SpeedSummary none = { 0.0, 0.0, false, false };
+
+	this->m_SpeedNorms.resize( nPix );
+	double* speednorms = &this->m_SpeedNorms[0];
+	const VectorType maxDisp = this->m_MaxDisplacement;
+	const bool force = this->m_ForceDiffeomorphic;
+
+	SpeedSummary summary = this->m_ThreadPool->ParallelReduce( nPix, none,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		SpeedSummary s = none;
+		VectorType t0,t1;
+		for (size_t pix = start; pix < stop; pix++ ) {
+			t0 = *(fBuffer+pix);
+			for( size_t d = 0; d<Dimension; d++) {
+				t1[d] = *(fnextBuffer[d]+pix);
+
+				if ( fabs(t1[d]) > maxDisp[d] ) {
+					if (force) {
+						t1[d] = maxDisp[d] * ((t1[d]>0)?1.0:-1.0);
+						s.forced = true;
+						*(fnextBuffer[d]+pix) = t1[d];
+					} else {
+						s.folded = true;
+					}
 				}
 			}
-
+			double diff = ( t1 - t0 ).GetNorm();
+			speednorms[pix] = diff;
+			s.total+= diff;
+			if ( diff > s.max ) s.max = diff;
 		}
-		diff = ( t1 - t0 ).GetNorm();
-		speednorms.push_back(diff);
-		totalNorm+= diff;
-	}
+		return s;
+	},
+	[](const SpeedSummary& a, const SpeedSummary& b) {
+		SpeedSummary r = { a.total + b.total, std::max( a.max, b.max ), a.forced || b.forced, a.folded || b.folded };
+		return r;
+	});
+
+	double totalNorm = summary.total;
+	double maxSpeed = summary.max;
+	this->m_DiffeomorphismForced = summary.forced;
+	this->m_IsDiffeomorphic = !summary.folded;
+
+	// Median by selection, no full sort needed
+	size_t mid = int(0.5*(nPix-1));
+	std::nth_element( this->m_SpeedNorms.begin(), this->m_SpeedNorms.begin() + mid, this->m_SpeedNorms.end() );
+
 	this->m_RegularizationEnergyUpdated = (totalNorm==0);
-	std::sort(speednorms.begin(), speednorms.end());
-	this->m_MaxSpeed = speednorms.back();
-	this->m_MeanSpeed = speednorms[int(0.5*(speednorms.size()-1))];
+	this->m_MaxSpeed = maxSpeed;
+	this->m_MeanSpeed = this->m_SpeedNorms[mid];
 	this->m_AvgSpeed = totalNorm / nPix;
 }
 
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::InitializeCoefficientsArray( CoefficientsImageArray & array ) const {
+	for ( size_t i=0; i<Dimension; i++ ) {
+		array[i] = CoefficientsImageType::New();
+		array[i]->SetRegions(   this->m_Transform->GetControlGridSize() );
+		array[i]->SetSpacing(   this->m_Transform->GetControlGridSpacing() );
+		array[i]->SetOrigin(    this->m_Transform->GetControlGridOrigin() );
+		array[i]->Allocate();
+		array[i]->FillBuffer( 0.0 );
+	}
+}
+
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::UpdateCurrentCoefficients() {
+	const typename CoefficientsImageType::PixelType* current[Dimension];
+	for (size_t i = 0; i < Dimension; i++) {
+		current[i] = this->m_Coefficients[i]->GetBufferPointer();
+	}
+
+	VectorType* buffer = this->m_CurrentCoefficients->GetBufferPointer();
+	size_t nPix = this->m_Coefficients[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	this->m_ThreadPool->ParallelFor( nPix,
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		VectorType v;
+		for(size_t i = start; i < stop; i++) {
+			for(size_t d=0; d < Dimension; d++) {
+				v[d] = *(current[d] + i);
+			}
+			*(buffer + i) = v;
+		}
+	});
+}
+
 template< typename TFunctional >
 void SpectralOptimizer<TFunctional>::InitializeParameters() {
 	// Check functional exists and hold a reference image
@@ -498,6 +508,12 @@ void SpectralOptimizer<TFunctional>::InitializeParameters() {
 		this->m_NextCoefficients[i]->Allocate();
 		this->m_NextCoefficients[i]->FillBuffer( 0.0 );
 
+		this->m_UpdateBuffer[i] = CoefficientsImageType::New();
+		this->m_UpdateBuffer[i]->SetRegions(   this->m_Transform->GetControlGridSize() );
+		this->m_UpdateBuffer[i]->SetSpacing(   this->m_Transform->GetControlGridSpacing() );
+		this->m_UpdateBuffer[i]->SetOrigin(    this->m_Transform->GetControlGridOrigin() );
+		this->m_UpdateBuffer[i]->Allocate();
+
 		this->m_DerivativeCoefficients[i] = CoefficientsImageType::New();
 		this->m_DerivativeCoefficients[i]->SetRegions(   this->m_Transform->GetControlGridSize() );
 		this->m_DerivativeCoefficients[i]->SetSpacing(   this->m_Transform->GetControlGridSpacing() );
@@ -530,6 +546,70 @@ SpectralOptimizer<TFunctional>::GetCurrentEnergy() {
 }
 
 
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::SaveState( CheckpointFile& f ) const {
+	Superclass::SaveState( f );
+	f.Write( this->m_RegularizationEnergy );
+	f.Write( this->m_CurrentTotalEnergy );
+	f.Write( this->m_RegularizationEnergyUpdated );
+}
+
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::LoadState( CheckpointFile& f ) {
+	Superclass::LoadState( f );
+	f.Read( this->m_RegularizationEnergy );
+	f.Read( this->m_CurrentTotalEnergy );
+	f.Read( this->m_RegularizationEnergyUpdated );
+}
+
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::SynchronizeState() {
+	// Same state PostIteration leaves behind
+	this->UpdateCurrentCoefficients();
+	this->m_Transform->SetCoefficientsImages( this->GetEvaluationCoefficients() );
+	this->m_Transform->InterpolatePoints();
+	this->m_Functional->SetCurrentDisplacements( this->m_Transform->GetPointValues() );
+}
+
+template< typename TFunctional >
+void SpectralOptimizer<TFunctional>
+::SeedCoefficients() {
+	typename CoefficientsImageType::RegionType region = this->m_Coefficients[0]->GetLargestPossibleRegion();
+
+	if ( this->m_InitialCoefficients[0].IsNotNull() ) {
+		for( size_t d = 0; d < Dimension; d++ ) {
+			if ( this->m_InitialCoefficients[d]->GetLargestPossibleRegion().GetSize() != region.GetSize() ) {
+				itkExceptionMacro(<< "initial coefficients of size " << this->m_InitialCoefficients[d]->GetLargestPossibleRegion().GetSize()
+						<< " do not match the control grid of size " << region.GetSize() << "." );
+			}
+			itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
+				this->m_InitialCoefficients[d], this->m_Coefficients[d],
+				this->m_InitialCoefficients[d]->GetLargestPossibleRegion(), region );
+		}
+		return;
+	}
+
+	// The dense field lies on the reference grid, it is sampled at the control
+	// points of this level before fitting the coefficients
+	SplineTransformPointer fit = SplineTransformType::New();
+	fit->SetDomainExtent( this->m_Functional->GetReferenceImage() );
+	fit->SetControlGridInformation( this->m_Coefficients[0] );
+	fit->SetDisplacementField( this->m_InitialDisplacementField );
+	fit->ComputeCoefficients();
+
+	const ParametersType& params = fit->GetParameters();
+	size_t nPix = region.GetNumberOfPixels();
+	for( size_t d = 0; d < Dimension; d++ ) {
+		CoefficientsValueType* buff = this->m_Coefficients[d]->GetBufferPointer();
+		for( size_t i = 0; i < nPix; i++ ) {
+			buff[i] = params[i + d * nPix];
+		}
+	}
+}
+
 template< typename TFunctional >
 void SpectralOptimizer<TFunctional>
 ::AddOptions( SettingsDesc& opts ) {
@@ -569,6 +649,18 @@ void SpectralOptimizer<TFunctional>
 		}
 	}
 
+	if( this->m_Settings.count( "spectral-solver" ) ){
+		bpo::variable_value v = this->m_Settings["spectral-solver"];
+		std::string solver = v.as< std::string > ();
+		if ( solver == "dct" ) {
+			this->m_Regularizer->SetSolver( RegularizerType::DCT_SOLVER );
+		} else if ( solver == "fft" ) {
+			this->m_Regularizer->SetSolver( RegularizerType::FFT_SOLVER );
+		} else {
+			itkExceptionMacro(<< "unknown spectral solver " << solver << ".");
+		}
+	}
+
 	if( this->m_Settings.count( "grid-size" ) ){
 		bpo::variable_value v = this->m_Settings["grid-size"];
 		std::vector<size_t> s = v.as< std::vector<size_t> > ();
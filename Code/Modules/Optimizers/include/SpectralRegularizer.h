@@ -0,0 +1,140 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALREGULARIZER_H_
+#define SPECTRALREGULARIZER_H_
+
+#include <vector>
+
+#include <itkObject.h>
+#include <itkRealToHalfHermitianForwardFFTImageFilter.h>
+#include <itkHalfHermitianToRealInverseFFTImageFilter.h>
+
+#include "ThreadPool.h"
+
+namespace rstk {
+/** \class SpectralRegularizer
+ *  \brief Solves the (1 - s L) u = f step of the spectral optimizers, L being
+ *  the discrete laplacian, by division in the Fourier domain.
+ *
+ *  Two solvers are available. FFT_SOLVER uses the complex FFT, thus periodic
+ *  boundary conditions. DCT_SOLVER uses a real DCT-II/DCT-III pair along each
+ *  axis, that diagonalizes the laplacian with Neumann (symmetric) boundaries
+ *  and avoids the coupling of opposite faces of the grid.
+ *
+ *  Transforms, buffers and the eigenvalues of the laplacian are kept between
+ *  calls and only rebuilt when the size of the coefficients grid changes. The
+ *  division is applied in a single threaded pass over the spectrum.
+ *
+ *  \ingroup Optimizers
+ *  \ingroup RSTK
+ */
+template< typename TCoefficientsImage >
+class SpectralRegularizer: public itk::Object {
+public:
+	typedef SpectralRegularizer              Self;
+	typedef itk::Object                      Superclass;
+	typedef itk::SmartPointer<Self>          Pointer;
+	typedef itk::SmartPointer< const Self >  ConstPointer;
+
+	itkTypeMacro(SpectralRegularizer, itk::Object);
+	itkNewMacro(Self);
+
+	itkStaticConstMacro( Dimension, unsigned int, TCoefficientsImage::ImageDimension );
+
+	typedef TCoefficientsImage                                      CoefficientsImageType;
+	typedef typename CoefficientsImageType::SizeType                SizeType;
+	typedef itk::RealToHalfHermitianForwardFFTImageFilter
+			                          < CoefficientsImageType >     FFTType;
+	typedef typename FFTType::Pointer                               FFTPointer;
+	typedef typename FFTType::OutputImageType                       FTDomainType;
+	typedef typename FTDomainType::Pointer                          FTDomainPointer;
+	typedef typename FTDomainType::PixelType                        ComplexType;
+	typedef typename ComplexType::value_type                        RealValueType;
+	typedef itk::HalfHermitianToRealInverseFFTImageFilter
+			        < FTDomainType, CoefficientsImageType >         IFFTType;
+	typedef typename IFFTType::Pointer                              IFFTPointer;
+
+	typedef enum {
+		FFT_SOLVER,
+		DCT_SOLVER
+	} SolverType;
+
+	/** output = FT^-1 { FT{numerator} / (1 - s * FT{L}) } */
+	void Apply( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output );
+
+	/** output = FT^-1 { FT{input} * (1 - s * FT{L}) }, the operator inverted by Apply */
+	void ApplyOperator( const CoefficientsImageType* input, RealValueType s, CoefficientsImageType* output );
+
+	itkSetMacro( Solver, SolverType );
+	itkGetConstMacro( Solver, SolverType );
+
+	itkSetObjectMacro( ThreadPool, ThreadPool );
+	itkGetObjectMacro( ThreadPool, ThreadPool );
+
+protected:
+	SpectralRegularizer();
+	~SpectralRegularizer() {}
+
+	void PrintSelf( std::ostream & os, itk::Indent indent ) const override;
+
+	/** Allocate the spectrum and tabulate the laplacian for a real grid of the
+	 *  given size. The half-Hermitian reference only keeps size[0] / 2 + 1
+	 *  frequencies along x */
+	void Initialize( const FTDomainType* reference, const SizeType& size );
+	void InitializeDCT( const SizeType& size );
+
+	void ApplyFFT( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output, bool inverse = true );
+	void ApplyDCT( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output, bool inverse = true );
+
+	/** Orthonormal DCT-II (or its inverse, DCT-III) of every grid line along each axis */
+	void TransformLines( bool inverse );
+
+private:
+	SpectralRegularizer(const Self &);  //purposely not implemented
+	void operator=(const Self &);       //purposely not implemented
+
+	FFTPointer m_FFT;
+	IFFTPointer m_IFFT;
+	FTDomainPointer m_Spectrum;
+	SizeType m_FFTSize;                        // real grid size of m_Spectrum
+	std::vector< RealValueType > m_Laplacian;  // FT of the laplacian, real valued
+
+	SolverType m_Solver;
+	SizeType m_DCTSize;
+	std::vector< double > m_DCTMatrix[Dimension];   // row j holds the j-th cosine basis
+	std::vector< double > m_DCTEigenvalues;         // laplacian, Neumann boundaries
+	std::vector< double > m_DCTBuffer;
+
+	ThreadPool::Pointer m_ThreadPool;
+};
+
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SpectralRegularizer.hxx"
+#endif
+
+#endif /* SPECTRALREGULARIZER_H_ */
@@ -0,0 +1,256 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SPECTRALREGULARIZER_HXX_
+#define SPECTRALREGULARIZER_HXX_
+
+#include "SpectralRegularizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <itkImageAlgorithm.h>
+#include <vnl/vnl_math.h>
+
+namespace rstk {
+
+template< typename TCoefficientsImage >
+SpectralRegularizer<TCoefficientsImage>
+::SpectralRegularizer():
+m_Solver( FFT_SOLVER ) {
+	this->m_FFTSize.Fill( 0 );
+	this->m_DCTSize.Fill( 0 );
+	this->m_FFT = FFTType::New();
+	this->m_IFFT = IFFTType::New();
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::Apply( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output ) {
+	if ( this->m_ThreadPool.IsNull() ) {
+		this->m_ThreadPool = ThreadPool::New();
+	}
+
+	if ( this->m_Solver == DCT_SOLVER ) {
+		this->ApplyDCT( numerator, s, output );
+	} else {
+		this->ApplyFFT( numerator, s, output );
+	}
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::ApplyOperator( const CoefficientsImageType* input, RealValueType s, CoefficientsImageType* output ) {
+	if ( this->m_ThreadPool.IsNull() ) {
+		this->m_ThreadPool = ThreadPool::New();
+	}
+
+	if ( this->m_Solver == DCT_SOLVER ) {
+		this->ApplyDCT( input, s, output, false );
+	} else {
+		this->ApplyFFT( input, s, output, false );
+	}
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::ApplyFFT( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output, bool inverse ) {
+	// Callers rewrite the same buffers in place without touching their
+	// modification time, so the transform must be forced to rerun
+	this->m_FFT->SetInput( numerator );
+	this->m_FFT->Modified();
+	this->m_FFT->Update();
+
+	// Real sizes n and n + 1 share the same half spectrum when n is even
+	const FTDomainType* ft = this->m_FFT->GetOutput();
+	SizeType size = numerator->GetLargestPossibleRegion().GetSize();
+	if ( this->m_Spectrum.IsNull() || size != this->m_FFTSize ) {
+		this->Initialize( ft, size );
+		this->m_IFFT->SetActualXDimensionIsOdd( size[0] % 2 == 1 );
+	}
+
+	const ComplexType* in = ft->GetBufferPointer();
+	ComplexType* out = this->m_Spectrum->GetBufferPointer();
+	const RealValueType* lap = &this->m_Laplacian[0];
+	this->m_ThreadPool->ParallelFor( this->m_Laplacian.size(),
+			[in, out, lap, s, inverse](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t i = start; i < stop; i++ ) {
+			RealValueType den = 1.0 - s * lap[i];
+			out[i] = in[i] * ( inverse?static_cast< RealValueType >( 1.0 / den ):den );
+		}
+	});
+	this->m_Spectrum->Modified();
+	this->m_IFFT->Update();
+
+	itk::ImageAlgorithm::Copy< CoefficientsImageType, CoefficientsImageType >(
+		this->m_IFFT->GetOutput(), output,
+		this->m_IFFT->GetOutput()->GetLargestPossibleRegion(),
+		output->GetLargestPossibleRegion()
+	);
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::Initialize( const FTDomainType* reference, const SizeType& size ) {
+	this->m_Spectrum = FTDomainType::New();
+	this->m_Spectrum->CopyInformation( reference );
+	this->m_Spectrum->SetRegions( reference->GetLargestPossibleRegion() );
+	this->m_Spectrum->Allocate();
+	this->m_IFFT->SetInput( this->m_Spectrum );
+
+	// Frequencies are indexed on the real grid, also along the halved x axis
+	const RealValueType pi2 = 2.0 * vnl_math::pi;
+	this->m_FFTSize = size;
+	size_t nPix = reference->GetLargestPossibleRegion().GetNumberOfPixels();
+	this->m_Laplacian.resize( nPix );
+	for( size_t pix = 0; pix < nPix; pix++ ) {
+		typename FTDomainType::IndexType idx = this->m_Spectrum->ComputeIndex( pix );
+		RealValueType lag_el = 0.0;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			lag_el += 2.0 * cos( ( pi2 * idx[d] ) / size[d] ) - 2.0;
+		}
+		this->m_Laplacian[pix] = lag_el;
+	}
+	this->Modified();
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::ApplyDCT( const CoefficientsImageType* numerator, RealValueType s, CoefficientsImageType* output, bool inverse ) {
+	SizeType size = numerator->GetLargestPossibleRegion().GetSize();
+	if ( size != this->m_DCTSize ) {
+		this->InitializeDCT( size );
+	}
+
+	const typename CoefficientsImageType::PixelType* in = numerator->GetBufferPointer();
+	typename CoefficientsImageType::PixelType* out = output->GetBufferPointer();
+	double* buf = &this->m_DCTBuffer[0];
+	const double* lap = &this->m_DCTEigenvalues[0];
+	const size_t nPix = this->m_DCTBuffer.size();
+
+	std::copy( in, in + nPix, buf );
+	this->TransformLines( false );
+	this->m_ThreadPool->ParallelFor( nPix,
+			[buf, lap, s, inverse](size_t start, size_t stop, itk::ThreadIdType) {
+		for( size_t i = start; i < stop; i++ ) {
+			if ( inverse ) buf[i] /= ( 1.0 - s * lap[i] );
+			else           buf[i] *= ( 1.0 - s * lap[i] );
+		}
+	});
+	this->TransformLines( true );
+	std::copy( buf, buf + nPix, out );
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::InitializeDCT( const SizeType& size ) {
+	size_t nPix = 1;
+	for( size_t k = 0; k < Dimension; k++ ) {
+		size_t n = size[k];
+		nPix *= n;
+
+		std::vector< double >& c = this->m_DCTMatrix[k];
+		c.resize( n * n );
+		for( size_t j = 0; j < n; j++ ) {
+			double a = ( j == 0 )?sqrt( 1.0 / n ):sqrt( 2.0 / n );
+			for( size_t i = 0; i < n; i++ ) {
+				c[j * n + i] = a * cos( vnl_math::pi * ( i + 0.5 ) * j / n );
+			}
+		}
+	}
+
+	// Eigenvalues of the 3-point laplacian with symmetric boundaries
+	this->m_DCTEigenvalues.resize( nPix );
+	this->m_DCTBuffer.resize( nPix );
+	for( size_t pix = 0; pix < nPix; pix++ ) {
+		size_t rem = pix;
+		double lag_el = 0.0;
+		for( size_t k = 0; k < Dimension; k++ ) {
+			size_t j = rem % size[k];
+			rem /= size[k];
+			lag_el += 2.0 * cos( ( vnl_math::pi * j ) / size[k] ) - 2.0;
+		}
+		this->m_DCTEigenvalues[pix] = lag_el;
+	}
+
+	this->m_DCTSize = size;
+	this->Modified();
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::TransformLines( bool inverse ) {
+	const size_t nPix = this->m_DCTBuffer.size();
+	double* buf = &this->m_DCTBuffer[0];
+
+	std::vector< std::vector< double > > scratch( this->m_ThreadPool->GetNumberOfThreads() );
+	size_t stride = 1;
+	for( size_t k = 0; k < Dimension; k++ ) {
+		const size_t n = this->m_DCTSize[k];
+		const double* c = &this->m_DCTMatrix[k][0];
+
+		this->m_ThreadPool->ParallelFor( nPix / n,
+				[&, n, stride, c](size_t start, size_t stop, itk::ThreadIdType tid) {
+			std::vector< double >& x = scratch[tid];
+			x.resize( n );
+			for( size_t line = start; line < stop; line++ ) {
+				// First element of the line, lines run along axis k
+				double* v = buf + ( line / stride ) * stride * n + ( line % stride );
+				for( size_t i = 0; i < n; i++ ) {
+					x[i] = v[i * stride];
+				}
+				for( size_t j = 0; j < n; j++ ) {
+					double acc = 0.0;
+					if ( inverse ) {
+						for( size_t i = 0; i < n; i++ ) acc += c[i * n + j] * x[i];
+					} else {
+						for( size_t i = 0; i < n; i++ ) acc += c[j * n + i] * x[i];
+					}
+					v[j * stride] = acc;
+				}
+			}
+		});
+		stride *= n;
+	}
+}
+
+template< typename TCoefficientsImage >
+void
+SpectralRegularizer<TCoefficientsImage>
+::PrintSelf( std::ostream & os, itk::Indent indent ) const {
+	Superclass::PrintSelf( os, indent );
+	os << indent << "Solver: " << ( ( this->m_Solver == DCT_SOLVER )?"DCT":"FFT" ) << std::endl;
+	os << indent << "SpectrumSize: " << this->m_Laplacian.size() << std::endl;
+}
+
+} // end namespace rstk
+
+#endif /* SPECTRALREGULARIZER_HXX_ */
@@ -0,0 +1,219 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <itkCommand.h>
+#include <itkImage.h>
+#include <itkImageFileWriter.h>
+#include <itkRegularSphereMeshSource.h>
+#include <itkVectorImage.h>
+
+#include "CheckpointFile.h"
+#include "FunctionalBase.h"
+#include "SpectralGradientDescentOptimizer.h"
+#include "SpectralNesterovOptimizer.h"
+#include "SpectralBarzilaiBorweinOptimizer.h"
+#include "SpectralLBFGSOptimizer.h"
+#include "SpectralADMMOptimizer.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace rstk {
+
+/** Runs every optimizer on a synthetic sphere three times: uninterrupted,
+ *  stopped after saving its state at an intermediate iteration, and resumed
+ *  from that state. The resumed run must end where the uninterrupted one did. */
+class OptimizerCheckpointTests : public ::testing::Test {
+public:
+	typedef itk::VectorImage< float, 3u >                   ImageType;
+	typedef FunctionalBase< ImageType >                     FunctionalType;
+	typedef FunctionalType::ChannelType                     ChannelType;
+	typedef FunctionalType::ScalarContourType               ContourType;
+	typedef OptimizerBase< FunctionalType >                 OptimizerType;
+	typedef OptimizerType::CoefficientsImageArray           CoefficientsImageArray;
+	typedef OptimizerType::CoefficientsImageType            CoefficientsImageType;
+	typedef itk::RegularSphereMeshSource< ContourType >     SphereSourceType;
+	typedef itk::SimpleMemberCommand< OptimizerCheckpointTests > InterruptCommandType;
+
+	virtual void SetUp() {
+		m_iterations = 12;
+		m_interrupt = 5;
+		m_image = "optimizercheckpoint_test.nii.gz";
+		m_checkpoint = "optimizercheckpoint_test.ckp";
+		std::remove( m_checkpoint.c_str() );
+
+		// A noisy ball, off the center of the initial contour
+		ChannelType::SizeType size;
+		size.Fill( 40 );
+		ChannelType::Pointer im = ChannelType::New();
+		im->SetRegions( size );
+		im->Allocate();
+
+		srand( 7 );
+		ChannelType::IndexType idx;
+		for( idx[2] = 0; idx[2] < 40; idx[2]++ ) {
+			for( idx[1] = 0; idx[1] < 40; idx[1]++ ) {
+				for( idx[0] = 0; idx[0] < 40; idx[0]++ ) {
+					double r2 = 0.0;
+					double c[3] = { 21.5, 19.5, 18.5 };
+					for( size_t d = 0; d < 3; d++ ) r2+= ( idx[d] - c[d] ) * ( idx[d] - c[d] );
+					float value = ( r2 < 81.0 )?100.0:20.0;
+					im->SetPixel( idx, value + ( rand() % 1001 ) * 0.01 );
+				}
+			}
+		}
+
+		typedef itk::ImageFileWriter< ChannelType > WriterType;
+		WriterType::Pointer w = WriterType::New();
+		w->SetInput( im );
+		w->SetFileName( m_image );
+		w->Update();
+
+		ContourType::PointType center;
+		center.Fill( 19.5 );
+		SphereSourceType::VectorType scale;
+		scale.Fill( 8.0 );
+		SphereSourceType::Pointer sphere = SphereSourceType::New();
+		sphere->SetCenter( center );
+		sphere->SetScale( scale );
+		sphere->SetResolution( 2 );
+		sphere->Update();
+		m_prior = sphere->GetOutput();
+	}
+
+	virtual void TearDown() {
+		std::remove( m_image.c_str() );
+		std::remove( m_checkpoint.c_str() );
+	}
+
+	template< typename TOptimizer >
+	typename TOptimizer::Pointer NewOptimizer() {
+		FunctionalType::Pointer functional = FunctionalType::New();
+		functional->LoadReferenceImage( std::vector< std::string >( 1, m_image ) );
+		functional->AddShapePrior( m_prior );
+
+		typename TOptimizer::ControlPointsGridSizeType grid;
+		grid.Fill( 6 );
+		typename TOptimizer::Pointer opt = TOptimizer::New();
+		opt->SetFunctional( functional );
+		opt->SetGridSize( grid );
+		opt->SetNumberOfIterations( m_iterations );
+		opt->SetMinimumConvergenceValue( -1.0 );
+		opt->SetAlpha( 1.0e-3 );
+		opt->SetBeta( 1.0e-2 );
+		return opt;
+	}
+
+	/** Saves the state of the running optimizer and stops it */
+	void Interrupt() {
+		if ( m_running->GetCurrentIteration() != m_interrupt ) return;
+		CheckpointFile f;
+		m_running->SaveState( f );
+		m_saved = f.Save( m_checkpoint );
+		m_running->Stop();
+	}
+
+	template< typename TOptimizer >
+	void CheckResume() {
+		typename TOptimizer::Pointer full = this->NewOptimizer< TOptimizer >();
+		full->Start();
+		ASSERT_GT( full->GetCurrentIteration(), m_interrupt ) << full->GetStopConditionDescription();
+
+		typename TOptimizer::Pointer interrupted = this->NewOptimizer< TOptimizer >();
+		InterruptCommandType::Pointer cmd = InterruptCommandType::New();
+		cmd->SetCallbackFunction( this, &OptimizerCheckpointTests::Interrupt );
+		interrupted->AddObserver( itk::IterationEvent(), cmd );
+		m_running = interrupted.GetPointer();
+		m_saved = false;
+		interrupted->Start();
+		ASSERT_TRUE( m_saved );
+
+		CheckpointFile state;
+		ASSERT_TRUE( state.Load( m_checkpoint ) );
+		typename TOptimizer::Pointer resumed = this->NewOptimizer< TOptimizer >();
+		resumed->SetInitialState( &state );
+		resumed->Start();
+
+		EXPECT_EQ( full->GetCurrentIteration(), resumed->GetCurrentIteration() );
+		EXPECT_DOUBLE_EQ( full->GetCurrentValue(), resumed->GetCurrentValue() );
+
+		const CoefficientsImageArray& expected = full->GetOutputCoefficients();
+		const CoefficientsImageArray& actual = resumed->GetOutputCoefficients();
+		size_t nPix = expected[0]->GetLargestPossibleRegion().GetNumberOfPixels();
+		double moved = 0.0;
+		for( size_t d = 0; d < 3; d++ ) {
+			ASSERT_EQ( nPix, actual[d]->GetLargestPossibleRegion().GetNumberOfPixels() );
+			const CoefficientsImageType::PixelType* e = expected[d]->GetBufferPointer();
+			const CoefficientsImageType::PixelType* a = actual[d]->GetBufferPointer();
+			for( size_t i = 0; i < nPix; i++ ) {
+				ASSERT_FLOAT_EQ( e[i], a[i] ) << "component " << d << ", control point " << i;
+				moved+= fabs( e[i] );
+			}
+		}
+		EXPECT_GT( moved, 0.0 );
+	}
+
+	size_t m_iterations;
+	size_t m_interrupt;
+	std::string m_image;
+	std::string m_checkpoint;
+	ContourType::Pointer m_prior;
+	OptimizerType* m_running;
+	bool m_saved;
+};
+
+TEST_F( OptimizerCheckpointTests, ResumeGradientDescent ) {
+	this->CheckResume< SpectralGradientDescentOptimizer< FunctionalType > >();
+}
+
+TEST_F( OptimizerCheckpointTests, ResumeNesterov ) {
+	this->CheckResume< SpectralNesterovOptimizer< FunctionalType > >();
+}
+
+TEST_F( OptimizerCheckpointTests, ResumeBarzilaiBorwein ) {
+	this->CheckResume< SpectralBarzilaiBorweinOptimizer< FunctionalType > >();
+}
+
+TEST_F( OptimizerCheckpointTests, ResumeLBFGS ) {
+	this->CheckResume< SpectralLBFGSOptimizer< FunctionalType > >();
+}
+
+TEST_F( OptimizerCheckpointTests, ResumeADMM ) {
+	this->CheckResume< SpectralADMMOptimizer< FunctionalType > >();
+}
+
+} // namespace rstk
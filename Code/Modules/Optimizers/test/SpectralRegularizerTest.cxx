@@ -0,0 +1,176 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+
+#include <itkImage.h>
+
+#include "SpectralRegularizer.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace rstk {
+
+class SpectralRegularizerTests : public ::testing::Test {
+public:
+	typedef itk::Image< float, 3u >                    ImageType;
+	typedef SpectralRegularizer< ImageType >           RegularizerType;
+
+	static ImageType::Pointer MakeImage( const ImageType::SizeType& size ) {
+		ImageType::Pointer im = ImageType::New();
+		im->SetRegions( size );
+		im->Allocate();
+		im->FillBuffer( 0.0 );
+		return im;
+	}
+
+	static ImageType::Pointer MakeRandomImage( const ImageType::SizeType& size ) {
+		ImageType::Pointer im = MakeImage( size );
+		float* buf = im->GetBufferPointer();
+		for( size_t i = 0; i < im->GetLargestPossibleRegion().GetNumberOfPixels(); i++ ) {
+			buf[i] = ( rand() % 2001 - 1000 ) * 1.0e-3;
+		}
+		return im;
+	}
+
+	/** (1 - s L) u with the 7-point laplacian, with periodic or symmetric boundaries */
+	static ImageType::Pointer ApplyStencil( const ImageType* u, double s, bool periodic ) {
+		ImageType::SizeType size = u->GetLargestPossibleRegion().GetSize();
+		ImageType::Pointer out = MakeImage( size );
+		ImageType::IndexType idx, nb;
+		for( idx[2] = 0; idx[2] < static_cast< long >( size[2] ); idx[2]++ ) {
+			for( idx[1] = 0; idx[1] < static_cast< long >( size[1] ); idx[1]++ ) {
+				for( idx[0] = 0; idx[0] < static_cast< long >( size[0] ); idx[0]++ ) {
+					double c = u->GetPixel( idx );
+					double lap = 0.0;
+					for( size_t d = 0; d < 3; d++ ) {
+						const long n = size[d];
+						for( long step = -1; step <= 1; step += 2 ) {
+							nb = idx;
+							nb[d] += step;
+							if ( nb[d] < 0 || nb[d] >= n ) {
+								nb[d] = periodic?( ( nb[d] + n ) % n ):idx[d];
+							}
+							lap += u->GetPixel( nb ) - c;
+						}
+					}
+					out->SetPixel( idx, c - s * lap );
+				}
+			}
+		}
+		return out;
+	}
+
+	void ExpectOperatorMatchesStencil( RegularizerType::SolverType solver, const ImageType::SizeType& size ) {
+		const double s = 0.7;
+		ImageType::Pointer u = MakeRandomImage( size );
+		ImageType::Pointer expected = ApplyStencil( u, s, solver == RegularizerType::FFT_SOLVER );
+
+		RegularizerType::Pointer reg = RegularizerType::New();
+		reg->SetSolver( solver );
+		ImageType::Pointer actual = MakeImage( size );
+		reg->ApplyOperator( u, s, actual );
+
+		ImageType::Pointer recovered = MakeImage( size );
+		reg->Apply( actual, s, recovered );
+
+		size_t npix = u->GetLargestPossibleRegion().GetNumberOfPixels();
+		for( size_t i = 0; i < npix; i++ ) {
+			ASSERT_NEAR( expected->GetBufferPointer()[i], actual->GetBufferPointer()[i], 1.0e-4 ) << "pixel " << i << ", size " << size;
+			ASSERT_NEAR( u->GetBufferPointer()[i], recovered->GetBufferPointer()[i], 1.0e-4 ) << "pixel " << i << ", size " << size;
+		}
+	}
+};
+
+TEST_F( SpectralRegularizerTests, FFTEvenSize ) {
+	ImageType::SizeType size = {{ 8, 6, 4 }};
+	this->ExpectOperatorMatchesStencil( RegularizerType::FFT_SOLVER, size );
+}
+
+TEST_F( SpectralRegularizerTests, FFTOddSize ) {
+	ImageType::SizeType size = {{ 9, 10, 5 }};
+	this->ExpectOperatorMatchesStencil( RegularizerType::FFT_SOLVER, size );
+}
+
+TEST_F( SpectralRegularizerTests, FFTSizeSharingHalfSpectrum ) {
+	// 8 and 9 samples along x both keep 5 frequencies
+	const double s = 0.7;
+	RegularizerType::Pointer reg = RegularizerType::New();
+	ImageType::SizeType sizes[2] = {{{ 8, 6, 4 }}, {{ 9, 6, 4 }}};
+	for( size_t k = 0; k < 2; k++ ) {
+		ImageType::Pointer u = MakeRandomImage( sizes[k] );
+		ImageType::Pointer expected = ApplyStencil( u, s, true );
+		ImageType::Pointer actual = MakeImage( sizes[k] );
+		reg->ApplyOperator( u, s, actual );
+		for( size_t i = 0; i < u->GetLargestPossibleRegion().GetNumberOfPixels(); i++ ) {
+			ASSERT_NEAR( expected->GetBufferPointer()[i], actual->GetBufferPointer()[i], 1.0e-4 ) << "pixel " << i << ", size " << sizes[k];
+		}
+	}
+}
+
+TEST_F( SpectralRegularizerTests, InputRewrittenInPlace ) {
+	// The optimizers refill the same buffer every iteration
+	const double s = 0.7;
+	ImageType::SizeType size = {{ 8, 6, 4 }};
+	RegularizerType::SolverType solvers[2] = { RegularizerType::FFT_SOLVER, RegularizerType::DCT_SOLVER };
+	for( size_t k = 0; k < 2; k++ ) {
+		RegularizerType::Pointer reg = RegularizerType::New();
+		reg->SetSolver( solvers[k] );
+		ImageType::Pointer u = MakeRandomImage( size );
+		ImageType::Pointer first = MakeImage( size );
+		reg->ApplyOperator( u, s, first );
+
+		ImageType::Pointer v = MakeRandomImage( size );
+		size_t npix = u->GetLargestPossibleRegion().GetNumberOfPixels();
+		std::copy( v->GetBufferPointer(), v->GetBufferPointer() + npix, u->GetBufferPointer() );
+		ImageType::Pointer second = MakeImage( size );
+		reg->ApplyOperator( u, s, second );
+
+		ImageType::Pointer expected = ApplyStencil( v, s, solvers[k] == RegularizerType::FFT_SOLVER );
+		double change = 0.0;
+		for( size_t i = 0; i < npix; i++ ) {
+			ASSERT_NEAR( expected->GetBufferPointer()[i], second->GetBufferPointer()[i], 1.0e-4 ) << "pixel " << i << ", solver " << k;
+			change+= fabs( second->GetBufferPointer()[i] - first->GetBufferPointer()[i] );
+		}
+		EXPECT_GT( change, 0.0 );
+	}
+}
+
+TEST_F( SpectralRegularizerTests, DCT ) {
+	ImageType::SizeType size = {{ 9, 6, 5 }};
+	this->ExpectOperatorMatchesStencil( RegularizerType::DCT_SOLVER, size );
+}
+
+}
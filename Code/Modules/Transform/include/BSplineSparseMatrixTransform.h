@@ -34,6 +34,61 @@
 
 namespace rstk {
 
+/** \struct BSplineKernelTraits
+ *  \brief Inlined B-spline kernels of compile-time order, with the same values
+ *  as itk::BSplineKernelFunction and itk::BSplineDerivativeKernelFunction.
+ */
+template< unsigned int VSplineOrder, typename TReal > struct BSplineKernelTraits;
+
+template< typename TReal >
+struct BSplineKernelTraits< 0, TReal > {
+	static inline TReal Evaluate( TReal u ) {
+		TReal a = fabs( u );
+		if ( a < 0.5 ) return 1.0;
+		if ( a == 0.5 ) return 0.5;
+		return 0.0;
+	}
+	static inline TReal EvaluateDerivative( TReal ) { return 0.0; }
+};
+
+template< typename TReal >
+struct BSplineKernelTraits< 1, TReal > {
+	static inline TReal Evaluate( TReal u ) {
+		TReal a = fabs( u );
+		return ( a < 1.0 )?( 1.0 - a ):0.0;
+	}
+	static inline TReal EvaluateDerivative( TReal u ) {
+		return BSplineKernelTraits< 0, TReal >::Evaluate( u + 0.5 ) - BSplineKernelTraits< 0, TReal >::Evaluate( u - 0.5 );
+	}
+};
+
+template< typename TReal >
+struct BSplineKernelTraits< 2, TReal > {
+	static inline TReal Evaluate( TReal u ) {
+		TReal a = fabs( u );
+		if ( a < 0.5 ) return 0.75 - a * a;
+		if ( a < 1.5 ) return ( 9.0 - 12.0 * a + 4.0 * a * a ) / 8.0;
+		return 0.0;
+	}
+	static inline TReal EvaluateDerivative( TReal u ) {
+		return BSplineKernelTraits< 1, TReal >::Evaluate( u + 0.5 ) - BSplineKernelTraits< 1, TReal >::Evaluate( u - 0.5 );
+	}
+};
+
+template< typename TReal >
+struct BSplineKernelTraits< 3, TReal > {
+	static inline TReal Evaluate( TReal u ) {
+		TReal a = fabs( u );
+		TReal a2 = a * a;
+		if ( a < 1.0 ) return ( 4.0 - 6.0 * a2 + 3.0 * a2 * a ) / 6.0;
+		if ( a < 2.0 ) return ( 8.0 - 12.0 * a + 6.0 * a2 - a2 * a ) / 6.0;
+		return 0.0;
+	}
+	static inline TReal EvaluateDerivative( TReal u ) {
+		return BSplineKernelTraits< 2, TReal >::Evaluate( u + 0.5 ) - BSplineKernelTraits< 2, TReal >::Evaluate( u - 0.5 );
+	}
+};
+
 template< class TScalar, unsigned int NDimensions = 3u, unsigned int VSplineOrder = 3u >
 class BSplineSparseMatrixTransform: public SparseMatrixTransform< TScalar, NDimensions > {
 public:
@@ -101,6 +156,20 @@ protected:
 		return SplineOrder;
 	}
 
+	/** Tabulate the 1-D weights with the inlined kernel of this order */
+	void EvaluateKernelWeights( ScalarType u0, ScalarType step, size_t n, bool derivative, ScalarType* w ) const override {
+		typedef BSplineKernelTraits< SplineOrder, ScalarType > KernelTraits;
+		if ( derivative ) {
+			for( size_t l = 0; l < n; l++ ) {
+				w[l] = KernelTraits::EvaluateDerivative( u0 - l * step );
+			}
+		} else {
+			for( size_t l = 0; l < n; l++ ) {
+				w[l] = KernelTraits::Evaluate( u0 - l * step );
+			}
+		}
+	}
+
 private:
 	BSplineSparseMatrixTransform( const Self & );
 	void operator=( const Self & );
@@ -0,0 +1,190 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CSRMATRIX_H_
+#define CSRMATRIX_H_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vnl/vnl_sparse_matrix.h>
+
+namespace rstk {
+
+/** 64-bit FNV-1a hash of n bytes, chained through h */
+inline std::uint64_t HashBytes( const void* data, size_t n, std::uint64_t h = 14695981039346656037ULL ) {
+	const unsigned char* c = static_cast< const unsigned char* >( data );
+	for( size_t i = 0; i < n; i++ ) {
+		h = ( h ^ c[i] ) * 1099511628211ULL;
+	}
+	return h;
+}
+
+/** Write n sections of data to filename through a temporary file with a
+ *  unique name in the same directory, renamed over filename once complete.
+ *  Concurrent writers never share the temporary file and readers never see
+ *  a partial file. Returns false, leaving filename untouched, on failure */
+inline bool WriteFileAtomically( const std::string& filename, const void* const* data, const size_t* sizes, size_t n ) {
+	std::string tmpname = filename + ".XXXXXX";
+	std::vector< char > name( tmpname.c_str(), tmpname.c_str() + tmpname.size() + 1 );
+	int fd = mkstemp( name.data() );
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	bool ok = ( fchmod( fd, 0644 ) == 0 );
+	for( size_t i = 0; ok && i < n; i++ ) {
+		const char* c = static_cast< const char* >( data[i] );
+		size_t left = sizes[i];
+		while( left > 0 ) {
+			ssize_t written = write( fd, c, left );
+			if ( written < 0 ) {
+				if ( errno == EINTR ) continue;
+				ok = false;
+				break;
+			}
+			c += written;
+			left -= written;
+		}
+	}
+	ok = ( close( fd ) == 0 ) && ok;
+
+	if ( !ok || std::rename( name.data(), filename.c_str() ) != 0 ) {
+		std::remove( name.data() );
+		return false;
+	}
+	return true;
+}
+
+/** \class CSRMatrix
+ *  \brief Sparse matrix in compressed sparse row format.
+ *
+ *  Rows are stored contiguously: the entries of row r are found at positions
+ *  [GetRowPointers()[r], GetRowPointers()[r + 1]) of the columns and values
+ *  arrays. The structure is meant to be filled in place, in parallel, once
+ *  the number of entries of every row is known (see SetRowSizes()).
+ *
+ *  vnl_sparse_matrix is only produced on demand with CopyTo().
+ *
+ *  \ingroup Transform
+ *  \ingroup RSTK
+ */
+template< typename TValue, typename TIndex = std::uint32_t >
+class CSRMatrix {
+public:
+	typedef CSRMatrix                           Self;
+	typedef TValue                              ValueType;
+	typedef TIndex                              IndexType;
+	typedef std::vector< size_t >               PointerArray;
+	typedef std::vector< IndexType >            IndexArray;
+	typedef std::vector< ValueType >            ValueArray;
+	typedef vnl_sparse_matrix< ValueType >      VNLMatrixType;
+
+	CSRMatrix(): m_Rows(0), m_Cols(0), m_RowPointers(1, 0) {}
+
+	/** Empty the matrix and set its dimensions */
+	void SetSize( size_t rows, size_t cols );
+
+	/** Allocate the storage given the number of entries of each row */
+	void SetRowSizes( const std::vector< size_t >& sizes );
+
+	/** Drop the unused tail of each row, used[r] <= row size */
+	void Compact( const std::vector< size_t >& used );
+
+	/** Copy the given subset of rows, in order, into out */
+	template< typename TRowId >
+	void SelectRows( const std::vector< TRowId >& rows, Self& out ) const;
+
+	/** Build the transpose (i.e. the CSC form of this matrix) into out */
+	void Transpose( Self& out ) const;
+
+	/** y = A x, with y of GetNumberOfRows() elements */
+	void Multiply( const ValueType* x, ValueType* y ) const;
+
+	/** y[v] = A x[v] for nvec vectors, restricted to rows [first, last) */
+	template< typename TInput >
+	void MultiplyRows( const TInput* const* x, ValueType* const* y, size_t nvec, size_t first, size_t last ) const;
+
+	/** Convert to vnl_sparse_matrix */
+	void CopyTo( VNLMatrixType& m ) const;
+
+	/** Write the arrays to a versioned binary file, tagged with key */
+	bool WriteFile( const std::string& filename, std::uint64_t key ) const;
+
+	/** Load a matrix stored by WriteFile through a read-only memory map.
+	 *  Returns false if the file is missing, truncated, corrupted, of another
+	 *  version or value type, or tagged with another key */
+	bool ReadFile( const std::string& filename, std::uint64_t key );
+
+	size_t GetNumberOfRows() const { return this->m_Rows; }
+	size_t GetNumberOfColumns() const { return this->m_Cols; }
+	size_t GetNumberOfNonZeros() const { return this->m_RowPointers.back(); }
+	bool IsEmpty() const { return this->m_Rows == 0 || this->m_Cols == 0; }
+
+	const PointerArray& GetRowPointers() const { return this->m_RowPointers; }
+	const IndexArray& GetColumns() const { return this->m_Columns; }
+	IndexArray& GetColumns() { return this->m_Columns; }
+	const ValueArray& GetValues() const { return this->m_Values; }
+	ValueArray& GetValues() { return this->m_Values; }
+
+private:
+	/** Layout of the files written by WriteFile, followed by the row pointers
+	 *  (64-bit), the columns and the values */
+	struct FileHeader {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t valueSize;
+		std::uint32_t indexSize;
+		std::uint32_t reserved;
+		std::uint64_t key;
+		std::uint64_t rows;
+		std::uint64_t cols;
+		std::uint64_t nnz;
+		std::uint64_t checksum;  // HashBytes of the sections following the header
+	};
+
+	static const std::uint32_t FileVersion = 2;
+
+	size_t m_Rows;
+	size_t m_Cols;
+	PointerArray m_RowPointers;
+	IndexArray m_Columns;
+	ValueArray m_Values;
+};
+
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "CSRMatrix.hxx"
+#endif
+
+#endif /* CSRMATRIX_H_ */
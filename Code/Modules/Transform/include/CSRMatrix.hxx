@@ -0,0 +1,265 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef CSRMATRIX_HXX_
+#define CSRMATRIX_HXX_
+
+#include "CSRMatrix.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vcl_vector.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rstk {
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::SetSize( size_t rows, size_t cols ) {
+	this->m_Rows = rows;
+	this->m_Cols = cols;
+	this->m_RowPointers.assign( rows + 1, 0 );
+	this->m_Columns.clear();
+	this->m_Values.clear();
+}
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::SetRowSizes( const std::vector< size_t >& sizes ) {
+	this->m_RowPointers.resize( this->m_Rows + 1 );
+	this->m_RowPointers[0] = 0;
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		this->m_RowPointers[r + 1] = this->m_RowPointers[r] + sizes[r];
+	}
+	this->m_Columns.resize( this->m_RowPointers.back() );
+	this->m_Values.resize( this->m_RowPointers.back() );
+}
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::Compact( const std::vector< size_t >& used ) {
+	// New offsets never exceed the old ones, so entries can be moved forward in place
+	size_t pos = 0;
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		size_t first = this->m_RowPointers[r];
+		if ( pos != first ) {
+			std::copy( this->m_Columns.begin() + first, this->m_Columns.begin() + first + used[r], this->m_Columns.begin() + pos );
+			std::copy( this->m_Values.begin() + first, this->m_Values.begin() + first + used[r], this->m_Values.begin() + pos );
+		}
+		this->m_RowPointers[r] = pos;
+		pos += used[r];
+	}
+	this->m_RowPointers[this->m_Rows] = pos;
+	this->m_Columns.resize( pos );
+	this->m_Values.resize( pos );
+}
+
+template< typename TValue, typename TIndex >
+template< typename TRowId >
+void
+CSRMatrix< TValue, TIndex >
+::SelectRows( const std::vector< TRowId >& rows, Self& out ) const {
+	out.SetSize( rows.size(), this->m_Cols );
+	std::vector< size_t > sizes( rows.size() );
+	for( size_t i = 0; i < rows.size(); i++ ) {
+		sizes[i] = this->m_RowPointers[rows[i] + 1] - this->m_RowPointers[rows[i]];
+	}
+	out.SetRowSizes( sizes );
+
+	for( size_t i = 0; i < rows.size(); i++ ) {
+		size_t first = this->m_RowPointers[rows[i]];
+		std::copy( this->m_Columns.begin() + first, this->m_Columns.begin() + first + sizes[i],
+		           out.m_Columns.begin() + out.m_RowPointers[i] );
+		std::copy( this->m_Values.begin() + first, this->m_Values.begin() + first + sizes[i],
+		           out.m_Values.begin() + out.m_RowPointers[i] );
+	}
+}
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::Transpose( Self& out ) const {
+	out.SetSize( this->m_Cols, this->m_Rows );
+
+	// Counting sort of the entries by column, rows come out in increasing order
+	std::vector< size_t > sizes( this->m_Cols, 0 );
+	for( size_t k = 0; k < this->m_Columns.size(); k++ ) {
+		sizes[this->m_Columns[k]]++;
+	}
+	out.SetRowSizes( sizes );
+
+	std::vector< size_t > fill( out.m_RowPointers.begin(), out.m_RowPointers.end() - 1 );
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		for( size_t k = this->m_RowPointers[r]; k < this->m_RowPointers[r + 1]; k++ ) {
+			size_t pos = fill[this->m_Columns[k]]++;
+			out.m_Columns[pos] = static_cast< IndexType >( r );
+			out.m_Values[pos] = this->m_Values[k];
+		}
+	}
+}
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::Multiply( const ValueType* x, ValueType* y ) const {
+	this->MultiplyRows( &x, &y, 1, 0, this->m_Rows );
+}
+
+template< typename TValue, typename TIndex >
+template< typename TInput >
+void
+CSRMatrix< TValue, TIndex >
+::MultiplyRows( const TInput* const* x, ValueType* const* y, size_t nvec, size_t first, size_t last ) const {
+	const IndexType* cols = this->m_Columns.data();
+	const ValueType* vals = this->m_Values.data();
+
+	for( size_t r = first; r < last; r++ ) {
+		size_t kbegin = this->m_RowPointers[r];
+		size_t kend = this->m_RowPointers[r + 1];
+		// The row is short and stays in cache across the input vectors
+		for( size_t v = 0; v < nvec; v++ ) {
+			const TInput* xv = x[v];
+			ValueType acc = 0.0;
+			for( size_t k = kbegin; k < kend; k++ ) {
+				acc += vals[k] * xv[cols[k]];
+			}
+			y[v][r] = acc;
+		}
+	}
+}
+
+template< typename TValue, typename TIndex >
+void
+CSRMatrix< TValue, TIndex >
+::CopyTo( VNLMatrixType& m ) const {
+	m = VNLMatrixType( this->m_Rows, this->m_Cols );
+
+	vcl_vector< int > cols;
+	vcl_vector< ValueType > vals;
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		size_t first = this->m_RowPointers[r];
+		size_t last = this->m_RowPointers[r + 1];
+		if ( first == last ) {
+			continue;
+		}
+		cols.assign( this->m_Columns.begin() + first, this->m_Columns.begin() + last );
+		vals.assign( this->m_Values.begin() + first, this->m_Values.begin() + last );
+		m.set_row( r, cols, vals );
+	}
+}
+
+template< typename TValue, typename TIndex >
+bool
+CSRMatrix< TValue, TIndex >
+::WriteFile( const std::string& filename, std::uint64_t key ) const {
+	FileHeader h;
+	std::memset( &h, 0, sizeof( FileHeader ) );
+	std::memcpy( h.magic, "RSTKCSR", 8 );
+	h.version = FileVersion;
+	h.valueSize = sizeof( ValueType );
+	h.indexSize = sizeof( IndexType );
+	h.key = key;
+	h.rows = this->m_Rows;
+	h.cols = this->m_Cols;
+	h.nnz = this->GetNumberOfNonZeros();
+
+	std::vector< std::uint64_t > rowptr( this->m_RowPointers.begin(), this->m_RowPointers.end() );
+
+	const void* data[4] = { &h, rowptr.data(), this->m_Columns.data(), this->m_Values.data() };
+	size_t sizes[4] = { sizeof( FileHeader ), rowptr.size() * sizeof( std::uint64_t ),
+	                    h.nnz * sizeof( IndexType ), h.nnz * sizeof( ValueType ) };
+	h.checksum = HashBytes( data[1], sizes[1] );
+	h.checksum = HashBytes( data[2], sizes[2], h.checksum );
+	h.checksum = HashBytes( data[3], sizes[3], h.checksum );
+
+	// Concurrent runs sharing a cache directory may write the same matrix
+	return WriteFileAtomically( filename, data, sizes, 4 );
+}
+
+template< typename TValue, typename TIndex >
+bool
+CSRMatrix< TValue, TIndex >
+::ReadFile( const std::string& filename, std::uint64_t key ) {
+	int fd = open( filename.c_str(), O_RDONLY );
+	if ( fd < 0 ) {
+		return false;
+	}
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 || static_cast< size_t >( st.st_size ) < sizeof( FileHeader ) ) {
+		close( fd );
+		return false;
+	}
+
+	size_t length = st.st_size;
+	void* map = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED ) {
+		return false;
+	}
+
+	const char* base = static_cast< const char* >( map );
+	const FileHeader* h = reinterpret_cast< const FileHeader* >( base );
+	bool valid = std::memcmp( h->magic, "RSTKCSR", 8 ) == 0 &&
+			h->version == FileVersion &&
+			h->valueSize == sizeof( ValueType ) &&
+			h->indexSize == sizeof( IndexType ) &&
+			h->key == key &&
+			length == sizeof( FileHeader ) + ( h->rows + 1 ) * sizeof( std::uint64_t ) +
+			          h->nnz * ( sizeof( IndexType ) + sizeof( ValueType ) ) &&
+			HashBytes( base + sizeof( FileHeader ), length - sizeof( FileHeader ) ) == h->checksum;
+
+	if ( valid ) {
+		// Sections are not necessarily aligned to their value type, copy bytes
+		const char* rowptr = base + sizeof( FileHeader );
+		const char* cols = rowptr + ( h->rows + 1 ) * sizeof( std::uint64_t );
+		const char* vals = cols + h->nnz * sizeof( IndexType );
+
+		std::vector< std::uint64_t > pointers( h->rows + 1 );
+		std::memcpy( pointers.data(), rowptr, pointers.size() * sizeof( std::uint64_t ) );
+
+		this->m_Rows = h->rows;
+		this->m_Cols = h->cols;
+		this->m_RowPointers.assign( pointers.begin(), pointers.end() );
+		this->m_Columns.resize( h->nnz );
+		this->m_Values.resize( h->nnz );
+		std::memcpy( this->m_Columns.data(), cols, h->nnz * sizeof( IndexType ) );
+		std::memcpy( this->m_Values.data(), vals, h->nnz * sizeof( ValueType ) );
+	}
+
+	munmap( map, length );
+	return valid;
+}
+
+} // end namespace rstk
+
+#endif /* CSRMATRIX_HXX_ */
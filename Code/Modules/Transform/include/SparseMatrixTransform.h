@@ -29,6 +29,8 @@
 #include <functional>
 
 #include "CachedMatrixTransform.h"
+#include "CSRMatrix.h"
+#include "ThreadPool.h"
 #include <itkTransform.h>
 #include <itkPoint.h>
 #include <itkVector.h>
@@ -153,6 +155,8 @@ public:
 
     typedef typename Superclass::PointIdContainer              PointIdContainer;
 
+    typedef CSRMatrix< ScalarType >                            CSRMatrixType;
+
 
     typedef itk::KernelFunctionBase<ScalarType>      KernelFunctionType;
     typedef typename KernelFunctionType::Pointer     KernelFunctionPointer;
@@ -216,12 +220,21 @@ public:
 
     //void ComputeCoeffDerivatives( void );
     void ComputeGradientField();
+    /** Fit the coefficients to the displacement field. A field that does not
+     *  lie on the control grid (e.g. one defined on the reference image) is
+     *  first linearly interpolated at the control points */
     void ComputeCoefficients();
 
 	// Values off-grid (displacement vector of a node)
 	inline bool       SetPointValue( const size_t id, VectorType pi );
 
 	virtual const WeightsMatrix*  GetPhi (const bool onlyvalid = true);
+
+	/** y[v] = Phi x[v] for nvec vectors, threaded over the rows of Phi */
+	void MultiplyPhi( const ScalarType* const* x, ScalarType* const* y, size_t nvec, const bool onlyvalid = true );
+
+	/** y[v] = Phi^T x[v] for nvec vectors. The transpose is built once per Phi */
+	void MultiplyPhiTranspose( const ScalarType* const* x, ScalarType* const* y, size_t nvec, const bool onlyvalid = true );
 	virtual const WeightsMatrix*  GetS (){
 		return &this->m_S;
 	}
@@ -247,6 +260,15 @@ public:
     itk::MultiThreader * GetMultiThreader() const { return m_Threader; }
     itkSetClampMacro( NumberOfThreads, itk::ThreadIdType, 1, ITK_MAX_THREADS);
     itkGetConstReferenceMacro(NumberOfThreads, itk::ThreadIdType);
+
+    /** Share a pool with other components. Otherwise a pool of
+     *  GetNumberOfThreads() workers is created on first use */
+    void SetThreadPool( ThreadPool* pool );
+    itkGetObjectMacro( ThreadPool, ThreadPool );
+
+    /** Directory where assembled matrices are kept between runs (disabled if empty) */
+    itkSetMacro( CacheDirectory, std::string );
+    itkGetConstMacro( CacheDirectory, std::string );
 protected:
 	SparseMatrixTransform();
 	~SparseMatrixTransform(){};
@@ -254,7 +276,11 @@ protected:
 	enum WeightsMatrixType { PHI, PHI_FIELD, S, SPRIME, PHI_INV };
 
 	struct MatrixSectionType {
-		WeightsMatrix *matrix;
+		CSRMatrixType *matrix;
+		std::vector< size_t > *sizes;
+		bool normalize;
+		bool separable;     // weights from per-axis tables
+		bool derivative;    // derivative kernel along dim
 		PointsList *vrows;
 		PointsList *vcols;
 		size_t section_id;
@@ -268,7 +294,10 @@ protected:
 	struct SMTStruct {
 		SparseMatrixTransform *Transform;
 		WeightsMatrixType type;
-		WeightsMatrix* matrix;
+		CSRMatrixType* matrix;
+		std::vector< size_t >* sizes;   // entries of each row
+		bool count;                     // first (counting) or second (filling) pass
+		bool separable;                 // control grid aligned with the axes
 		size_t dim;
 		PointsList *vrows;
 		PointsList *vcols;
@@ -278,6 +307,26 @@ protected:
 	void UpdateField( const DimensionParameters& coeff );
 	void InvertPhi();
 
+	/** True when the field and the control grid are aligned with the axes, so
+	 *  the kernel weights factorize into one 1-D table per axis */
+	bool IsFieldSeparable() const;
+	/** Matrix-free evaluation of the dense field by three 1-D contractions */
+	void InterpolateFieldSeparable();
+	/** Fit the coefficients by 1-D recursive filtering along each axis, when the
+	 *  field samples lie on the axis-aligned control grid. Returns false otherwise */
+	bool ComputeCoefficientsSeparable( const FieldType* field );
+	/** Fit the coefficients with a sparse LU solve of the S matrix, the field
+	 *  holding one sample per control point */
+	void ComputeCoefficientsSparse( const FieldType* field );
+	/** True when the field has the geometry of the control grid */
+	bool IsFieldOnControlGrid( const FieldType* field ) const;
+	/** Linear interpolation of field at the control points, on the control grid */
+	FieldPointer SampleFieldAtControlPoints( const FieldType* field );
+
+	void ParallelMultiply( const CSRMatrixType& m, const ScalarType* const* x, ScalarType* const* y, size_t nvec );
+	/** Create the pool if none was set, and size it from GetNumberOfThreads() if owned */
+	void InitializeThreadPool();
+	void ThreadedCountNonZeros( MatrixSectionType& section, itk::ThreadIdType threadId );
 	void ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId );
 	itk::ThreadIdType SplitMatrixSection( itk::ThreadIdType i, itk::ThreadIdType num, MatrixSectionType& section );
 	static ITK_THREAD_RETURN_TYPE ComputeThreaderCallback(void *arg);
@@ -293,6 +342,9 @@ protected:
 	inline ScalarType EvaluateKernel( const VectorType r, const size_t dim = 0 );
 	inline ScalarType EvaluateDerivative( const VectorType r, const size_t dim );
 
+	/** 1-D weights w[l] = K(u0 - l * step), l < n, of the kernel (or its derivative) */
+	virtual void EvaluateKernelWeights( ScalarType u0, ScalarType step, size_t n, bool derivative, ScalarType* w ) const;
+
 
 	/* Field domain definitions */
 	SizeType                     m_ControlGridSize;
@@ -311,6 +363,19 @@ protected:
 	//DimensionParameters m_CoeffDerivative;  // Serialized k values in a grid
 	//DimensionVector m_Jacobian[Dimension][Dimension]; // Serialized k dimxdim matrices in a grid
 
+	CSRMatrixType   m_PhiCSR;          // assembled Phi, rows normalized
+	CSRMatrixType   m_PhiValidCSR;     // rows of m_PhiCSR at m_ValidLocations
+	CSRMatrixType   m_PhiTransposeCSR;
+	CSRMatrixType   m_PhiValidTransposeCSR;
+	bool            m_PhiUpdated;      // m_Phi mirrors m_PhiCSR
+	bool            m_PhiValidUpdated; // m_Phi_valid mirrors m_PhiValidCSR
+	bool            m_PhiTransposeUpdated;
+	bool            m_PhiValidTransposeUpdated;
+	ThreadPool::Pointer m_ThreadPool;
+	bool            m_OwnsThreadPool;  // created here, follows m_NumberOfThreads
+	std::string     m_CacheDirectory;
+	std::uint64_t   m_PhiKey;
+
 	WeightsMatrix   m_Phi;
 	WeightsMatrix   m_Phi_inverse;
 	WeightsMatrix   m_Phi_valid;
@@ -328,6 +393,12 @@ protected:
 	virtual void AfterComputeMatrix( WeightsMatrixType type );
 	virtual size_t ComputeRegionOfPoint(const PointType& point, VectorType& cvector, IndexType& start, IndexType& end, OffsetTableType offsetTable );
 
+	/** Content hash of everything a matrix depends on: rows, control grid and kernel */
+	std::uint64_t ComputeMatrixKey( WeightsMatrixType type, size_t dim, const PointsList& rows, size_t ncols ) const;
+	std::uint64_t ComputeTransposeKey( const bool onlyvalid ) const;
+	bool ReadCachedMatrix( std::uint64_t key, CSRMatrixType& m ) const;
+	void WriteCachedMatrix( std::uint64_t key, const CSRMatrixType& m ) const;
+
 	/** Support processing data in multiple threads. */
 	itk::MultiThreader::Pointer m_Threader;
 	itk::ThreadIdType           m_NumberOfThreads;
@@ -27,6 +27,8 @@
 #define SPARSEMATRIXTRANSFORM_HXX_
 
 #include "SparseMatrixTransform.h"
+#include <algorithm>
+#include <cstdio>
 #include <itkGaussianKernelFunction.h>
 #include <itkBSplineKernelFunction.h>
 #include <itkBSplineDerivativeKernelFunction.h>
@@ -35,6 +37,8 @@
 #include <itkImage.h>
 #include <itkImageFileWriter.h>
 #include <itkImageAlgorithm.h>
+#include <itkContinuousIndex.h>
+#include <itkVectorLinearInterpolateImageFunction.h>
 
 #include <vnl/algo/vnl_sparse_lu.h>
 #include <vnl/vnl_copy.h>
@@ -54,8 +58,15 @@ Superclass() {
 	this->m_ControlGridDirectionInverse.SetIdentity();
 	this->m_MaximumDisplacement.Fill(0.0);
 
+	this->m_PhiUpdated = true;
+	this->m_PhiValidUpdated = true;
+	this->m_PhiTransposeUpdated = true;
+	this->m_PhiValidTransposeUpdated = true;
+	this->m_PhiKey = 0;
+
 	this->m_Threader = itk::MultiThreader::New();
 	this->m_NumberOfThreads = this->m_Threader->GetNumberOfThreads();
+	this->m_OwnsThreadPool = false;
 
 	this->m_ControlGridIndexToPhysicalPoint.SetIdentity();
 	this->m_ControlGridPhysicalPointToIndex.SetIdentity();
@@ -90,6 +101,16 @@ SparseMatrixTransform<TScalar,NDimensions>
 	return wi;
 }
 
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::EvaluateKernelWeights( ScalarType u0, ScalarType step, size_t n, bool derivative, ScalarType* w ) const {
+	const KernelFunctionType* k = derivative?this->m_DerivativeKernel.GetPointer():this->m_KernelFunction.GetPointer();
+	for( size_t l = 0; l < n; l++ ) {
+		w[l] = k->Evaluate( u0 - l * step );
+	}
+}
+
 template< class TScalar, unsigned int NDimensions >
 inline size_t
 SparseMatrixTransform<TScalar,NDimensions>
@@ -137,6 +158,7 @@ SparseMatrixTransform<TScalar,NDimensions>
 	this->m_ControlGridSize      = image->GetLargestPossibleRegion().GetSize();
 	this->m_ControlGridOrigin    = image->GetOrigin();
 	this->m_ControlGridSpacing   = image->GetSpacing();
+	this->m_ControlGridDirection = image->GetDirection();
 	this->InitializeCoefficientsImages();
 }
 
@@ -213,8 +235,22 @@ SparseMatrixTransform<TScalar,NDimensions>
 	str.Transform = this;
 	str.type = type;
 	str.dim = dim;
+
+	// With an axis-aligned control grid, weights are tabulated once per point and axis
+	str.separable = true;
+	for( size_t i = 0; i < Dimension; i++ ) {
+		for( size_t j = 0; j < Dimension; j++ ) {
+			if ( i != j && fabs( this->m_ControlGridIndexToPhysicalPoint[i][j] ) > 1.0e-6 ) {
+				str.separable = false;
+			}
+		}
+	}
 	size_t nCols = this->m_ParamLocations.size();
 
+	// Phi is kept in CSR form, the rest are converted to vnl right after assembly
+	CSRMatrixType assembled;
+	str.matrix = &assembled;
+
 	switch( type ) {
 	case Self::PHI:
 		str.vrows = &this->m_PointLocations;
@@ -222,36 +258,67 @@ SparseMatrixTransform<TScalar,NDimensions>
 		if ( this->m_PointLocations.size() != this->m_NumberOfPoints ) {
 			itkExceptionMacro(<< "OffGrid positions are not initialized");
 		}
-		this->m_Phi = WeightsMatrix( this->m_NumberOfPoints , nCols );
-		str.matrix = &this->m_Phi;
+		str.matrix = &this->m_PhiCSR;
 		break;
 
 	case Self::PHI_FIELD:
 		str.vrows = &this->m_FieldLocations;
 		str.vcols = &this->m_ParamLocations;
-		this->m_FieldPhi = WeightsMatrix( this->m_FieldLocations.size() , nCols );
-		str.matrix = &this->m_FieldPhi;
 		break;
 
 	case Self::S:
-		this->m_S = WeightsMatrix( nCols, nCols );
-
-		str.vrows = &this->m_ParamLocations;
-		str.matrix = &this->m_S;
-		break;
 	case Self::SPRIME:
-		this->m_SPrime[dim] = WeightsMatrix( nCols, nCols );
 		str.vrows = &this->m_ParamLocations;
-		str.matrix = &this->m_SPrime[dim];
 		break;
 	default:
 		itkExceptionMacro(<< "Matrix computation not implemented" );
 		break;
 	}
 
-	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
-	this->GetMultiThreader()->SetSingleMethod( this->ComputeThreaderCallback, &str );
-	this->GetMultiThreader()->SingleMethodExecute();
+	std::uint64_t key = 0;
+	if ( !this->m_CacheDirectory.empty() ) {
+		key = this->ComputeMatrixKey( type, dim, *str.vrows, nCols );
+	}
+	if ( type == Self::PHI ) {
+		this->m_PhiKey = key;
+	}
+
+	if ( !this->ReadCachedMatrix( key, *str.matrix ) ) {
+		size_t nRows = str.vrows->size();
+		str.matrix->SetSize( nRows, nCols );
+		std::vector< size_t > sizes( nRows, 0 );
+		str.sizes = &sizes;
+
+		this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+		this->GetMultiThreader()->SetSingleMethod( this->ComputeThreaderCallback, &str );
+
+		// First pass: size of the kernel support of each row (upper bound of its entries)
+		str.count = true;
+		this->GetMultiThreader()->SingleMethodExecute();
+		str.matrix->SetRowSizes( sizes );
+
+		// Second pass: each row is filled in place, sizes are set to the entries kept
+		str.count = false;
+		this->GetMultiThreader()->SingleMethodExecute();
+		str.matrix->Compact( sizes );
+
+		this->WriteCachedMatrix( key, *str.matrix );
+	}
+
+	switch( type ) {
+	case Self::PHI_FIELD:
+		assembled.CopyTo( this->m_FieldPhi );
+		break;
+	case Self::S:
+		assembled.CopyTo( this->m_S );
+		break;
+	case Self::SPRIME:
+		assembled.CopyTo( this->m_SPrime[dim] );
+		break;
+	default:
+		break;
+	}
+
 	this->AfterComputeMatrix(type);
 }
 
@@ -259,37 +326,22 @@ template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
 ::AfterComputeMatrix(WeightsMatrixType type) {
-	size_t numvalid = this->m_ValidLocations.size();
-	this->m_Phi.normalize_rows();
-	if(numvalid > 0 &&  numvalid <= this->m_NumberOfPoints ) {
-		if (type == Self::PHI)  {
-			this->m_Phi_valid = WeightsMatrix( numvalid , this->m_NumberOfDimParameters );
-
-			size_t rid = 0;
-			typename PointIdContainer::iterator it = this->m_ValidLocations.begin();
-			typename PointIdContainer::iterator end = this->m_ValidLocations.end();
-			typename WeightsMatrix::row row;
-			vcl_vector< int > cols;
-			vcl_vector< ScalarType > vals;
-
-			while( it != end ) {
-				row = this->m_Phi.get_row(*it);
-				cols.resize(0);
-				vals.resize(0);
-
-				for(size_t i = 0; i < row.size(); i++) {
-					cols.push_back(row[i].first);
-					vals.push_back(row[i].second);
-				}
-
-				this->m_Phi_valid.set_row(rid, cols, vals);
-				rid++;
-				++it;
-			}
-		}
+	if ( type != Self::PHI ) {
+		return;
 	}
 
+	// vnl copies of Phi are only built if requested through GetPhi()
+	this->m_PhiUpdated = false;
+	this->m_PhiValidUpdated = false;
+	this->m_PhiTransposeUpdated = false;
+	this->m_PhiValidTransposeUpdated = false;
 
+	size_t numvalid = this->m_ValidLocations.size();
+	if(numvalid > 0 &&  numvalid <= this->m_NumberOfPoints ) {
+		this->m_PhiCSR.SelectRows( this->m_ValidLocations, this->m_PhiValidCSR );
+	} else {
+		this->m_PhiValidCSR.SetSize( 0, 0 );
+	}
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -305,12 +357,18 @@ SparseMatrixTransform<TScalar,NDimensions>
 
 	MatrixSectionType splitSection;
 	splitSection.matrix = str->matrix;
+	splitSection.sizes = str->sizes;
+	splitSection.normalize = ( str->type == Self::PHI );
+	splitSection.separable = str->separable;
+	splitSection.derivative = ( str->type == Self::SPRIME );
 	splitSection.vrows = str->vrows;
 	splitSection.dim = str->dim;
 	total = str->Transform->SplitMatrixSection( threadId, threadCount, splitSection );
 
 	if( threadId < total ) {
-		if (str->type == Self::SPRIME )
+		if ( str->count )
+			str->Transform->ThreadedCountNonZeros( splitSection, threadId );
+		else if (str->type == Self::SPRIME )
 			str->Transform->ThreadedComputeMatrix( splitSection, &Self::EvaluateDerivative, threadId );
 		else
 			str->Transform->ThreadedComputeMatrix( splitSection, &Self::EvaluateKernel, threadId );
@@ -342,51 +400,97 @@ SparseMatrixTransform<TScalar,NDimensions>
 }
 
 
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::ThreadedCountNonZeros( MatrixSectionType& section, itk::ThreadIdType threadId ) {
+	size_t last = section.first_row + section.num_rows;
+	const PointsList& vrows = *(section.vrows);
+	std::vector< size_t >& sizes = *(section.sizes);
+
+	VectorType cindex;
+	IndexType start, end;
+	OffsetTableType rOffsetTable;
+
+	for ( size_t row = section.first_row; row < last; row++ ) {
+		sizes[row] = this->ComputeRegionOfPoint( vrows[row], cindex, start, end, rOffsetTable );
+	}
+}
+
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
 ::ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId ) {
 	size_t last = section.first_row + section.num_rows;
-	itk::SizeValueType nRows = section.num_rows;
-	PointsList vrows = *(section.vrows);
+	const PointsList& vrows = *(section.vrows);
+	std::vector< size_t >& sizes = *(section.sizes);
 	size_t dim = section.dim;
 
+	const typename CSRMatrixType::PointerArray& rowptr = section.matrix->GetRowPointers();
+	typename CSRMatrixType::IndexType* cols = section.matrix->GetColumns().data();
+	ScalarType* vals = section.matrix->GetValues().data();
+
+	// Window of ComputeRegionOfPoint: at most 5 control points per axis
+	const size_t Width = 5;
+	ScalarType weights[Dimension * Width];
+
 	ScalarType wi;
 	PointType ci, uk;
-	size_t row, col, number_of_pixels;
+	size_t row, number_of_pixels;
 	VectorType r,cindex;
 	IndexType start, end, current;
 	OffsetTableType rOffsetTable;
 
-	vcl_vector< int > cols;
-	vcl_vector< ScalarType > vals;
-	cols.resize(0);
-	vals.resize(0);
-
 	FieldPointer ref = this->m_CoefficientsField;
 	// Walk the grid region
 	for ( row = section.first_row; row < last; row++ ) {
-		cols.clear();
-		vals.clear();
+		size_t pos = rowptr[row];
+		size_t nnz = 0;
 		ci = vrows[row];
 		number_of_pixels = this->ComputeRegionOfPoint( ci, cindex, start, end, rOffsetTable );
 
+		if ( section.separable && number_of_pixels > 0 ) {
+			for( size_t k = 0; k < Dimension; k++ ) {
+				ScalarType step = this->m_ControlGridIndexToPhysicalPoint[k][k] / this->m_ControlGridSpacing[k];
+				ScalarType u0 = ( ci[k] - this->m_ControlGridOrigin[k] ) / this->m_ControlGridSpacing[k] - step * start[k];
+				this->EvaluateKernelWeights( u0, step, end[k] - start[k] + 1, section.derivative && k == dim, &weights[k * Width] );
+			}
+		}
+
 		for( size_t rOffset = 0; rOffset<number_of_pixels; rOffset++) {
 			Helper::ComputeIndex( start, rOffset, rOffsetTable, current );
-			TransformHelper::TransformIndexToPhysicalPoint( this->m_ControlGridIndexToPhysicalPoint, this->m_ControlGridOrigin, current, uk);
-			r = ci - uk;
-			wi = (this->*func)(r, dim);
+			if ( section.separable ) {
+				wi = 1.0;
+				for( size_t k = 0; k < Dimension; k++ ) {
+					wi *= weights[k * Width + current[k] - start[k]];
+				}
+			} else {
+				TransformHelper::TransformIndexToPhysicalPoint( this->m_ControlGridIndexToPhysicalPoint, this->m_ControlGridOrigin, current, uk);
+				r = ci - uk;
+				wi = (this->*func)(r, dim);
+			}
 
 			if ( fabs(wi) > 1.0e-5) {
-				col = ref->ComputeOffset( current );
-				cols.push_back( col );
-				vals.push_back( wi );
+				cols[pos + nnz] = ref->ComputeOffset( current );
+				vals[pos + nnz] = wi;
+				nnz++;
 			}
 		}
 
-		if ( cols.size() > 0 ) {
-			section.matrix->set_row( row, cols, vals );
+		// Unit euclidean norm, as vnl_sparse_matrix::normalize_rows
+		if ( section.normalize && nnz > 0 ) {
+			ScalarType norm = 0.0;
+			for( size_t k = 0; k < nnz; k++ ) {
+				norm += vals[pos + k] * vals[pos + k];
+			}
+			norm = sqrt( norm );
+			if ( norm > 0.0 ) {
+				for( size_t k = 0; k < nnz; k++ ) {
+					vals[pos + k] /= norm;
+				}
+			}
 		}
+		sizes[row] = nnz;
 	}
 }
 
@@ -396,19 +500,28 @@ SparseMatrixTransform<TScalar,NDimensions>
 ::InterpolatePoints() {
 	const DimensionParameters coeff = this->VectorizeCoefficients();
 	// Check m_Phi and initializations
-	if( this->m_Phi.rows() == 0 || this->m_Phi.cols() == 0 ) {
+	if( this->m_PhiCSR.IsEmpty() ) {
 		this->ComputeMatrix( Self::PHI );
 	}
+	const ScalarType* x[Dimension];
+	ScalarType* y[Dimension];
 	for( size_t i = 0; i<Dimension; i++ ) {
 		this->m_PointValues[i].set_size( this->m_NumberOfPoints );
-		this->m_Phi.mult( coeff[i], this->m_PointValues[i] );
+		x[i] = coeff[i].data_block();
+		y[i] = this->m_PointValues[i].data_block();
 	}
+	this->ParallelMultiply( this->m_PhiCSR, x, y, Dimension );
 }
 
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
 ::InterpolateField() {
+	if ( this->IsFieldSeparable() ) {
+		this->InterpolateFieldSeparable();
+		return;
+	}
+
 	const DimensionParameters coeff = this->VectorizeCoefficients();
 	// Check m_Phi and initializations
 	if( this->m_FieldPhi.rows() == 0 || this->m_FieldPhi.cols() == 0 ) {
@@ -456,6 +569,143 @@ SparseMatrixTransform<TScalar,NDimensions>
 	this->SetDisplacementField( field );
 }
 
+template< class TScalar, unsigned int NDimensions >
+bool
+SparseMatrixTransform<TScalar,NDimensions>
+::IsFieldSeparable() const {
+	if ( Dimension != 3 || this->m_DisplacementField.IsNull() ) {
+		return false;
+	}
+
+	DirectionType fdir = this->m_DisplacementField->GetDirection();
+	for( size_t i = 0; i < Dimension; i++ ) {
+		for( size_t j = 0; j < Dimension; j++ ) {
+			if ( i != j && ( fabs( fdir[i][j] ) > 1.0e-6 ||
+					fabs( this->m_ControlGridPhysicalPointToIndex[i][j] ) > 1.0e-6 ) ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::InterpolateFieldSeparable() {
+	// Window of ComputeRegionOfPoint: control points within +/-2 grid units
+	const size_t Width = 5;
+	const DimensionParameters coeff = this->VectorizeCoefficients();
+
+	FieldPointer field = FieldType::New();
+	field->SetRegions( this->m_DisplacementField->GetLargestPossibleRegion().GetSize() );
+	field->SetOrigin( this->m_DisplacementField->GetOrigin() );
+	field->SetSpacing( this->m_DisplacementField->GetSpacing() );
+	field->SetDirection( this->m_DisplacementField->GetDirection() );
+	field->Allocate();
+
+	SizeType fsize = field->GetLargestPossibleRegion().GetSize();
+	PointType forigin = field->GetOrigin();
+	typename FieldType::SpacingType fspacing = field->GetSpacing();
+	DirectionType fdir = field->GetDirection();
+
+	// 1-D weight tables: first control point and weights of each output index, per axis
+	std::vector< long > first[Dimension];
+	std::vector< size_t > length[Dimension];
+	std::vector< ScalarType > weights[Dimension];
+	for( size_t k = 0; k < Dimension; k++ ) {
+		long ncp = this->m_ControlGridSize[k];
+		first[k].resize( fsize[k] );
+		length[k].resize( fsize[k] );
+		weights[k].resize( fsize[k] * Width );
+
+		for( size_t j = 0; j < fsize[k]; j++ ) {
+			ScalarType p = forigin[k] + fdir[k][k] * fspacing[k] * j;
+			ScalarType c = this->m_ControlGridPhysicalPointToIndex[k][k] * ( p - this->m_ControlGridOrigin[k] );
+			long start = std::max( static_cast< long >( ceil( c - 2.0 ) ), 0l );
+			long end = std::min( static_cast< long >( floor( c + 2.0 ) ), ncp - 1 );
+
+			first[k][j] = start;
+			length[k][j] = ( end < start )?0:( end - start + 1 );
+			for( size_t l = 0; l < length[k][j]; l++ ) {
+				ScalarType uk = this->m_ControlGridOrigin[k] + this->m_ControlGridIndexToPhysicalPoint[k][k] * ( start + l );
+				weights[k][j * Width + l] = this->m_KernelFunction->Evaluate( ( p - uk ) / this->m_ControlGridSpacing[k] );
+			}
+		}
+	}
+
+	const size_t nx = this->m_ControlGridSize[0];
+	const size_t ny = this->m_ControlGridSize[1];
+	const size_t nxy = nx * ny;
+	const size_t fx = fsize[0];
+	const size_t fy = fsize[1];
+	const ScalarType* cbuf[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		cbuf[d] = coeff[d].data_block();
+	}
+	VectorType* obuf = field->GetBufferPointer();
+
+	this->InitializeThreadPool();
+
+	// Each output slice is produced by contracting z, then y, then x
+	std::vector< std::vector< ScalarType > > scratch( this->m_ThreadPool->GetNumberOfThreads() );
+	this->m_ThreadPool->ParallelFor( fsize[2],
+			[&](size_t start, size_t stop, itk::ThreadIdType tid) {
+		std::vector< ScalarType >& buf = scratch[tid];
+		buf.resize( Dimension * ( nxy + nx * fy ) );
+		ScalarType* tz = &buf[0];                   // [d][y][x], control grid
+		ScalarType* ty = &buf[Dimension * nxy];     // [d][fy][x]
+
+		for( size_t z = start; z < stop; z++ ) {
+			std::fill( buf.begin(), buf.end(), 0.0 );
+
+			const ScalarType* wz = &weights[2][z * Width];
+			for( size_t l = 0; l < length[2][z]; l++ ) {
+				size_t base = nxy * ( first[2][z] + l );
+				for( size_t d = 0; d < Dimension; d++ ) {
+					const ScalarType* src = cbuf[d] + base;
+					ScalarType* dst = tz + d * nxy;
+					for( size_t i = 0; i < nxy; i++ ) {
+						dst[i] += wz[l] * src[i];
+					}
+				}
+			}
+
+			for( size_t y = 0; y < fy; y++ ) {
+				const ScalarType* wy = &weights[1][y * Width];
+				for( size_t l = 0; l < length[1][y]; l++ ) {
+					for( size_t d = 0; d < Dimension; d++ ) {
+						const ScalarType* src = tz + d * nxy + nx * ( first[1][y] + l );
+						ScalarType* dst = ty + d * nx * fy + nx * y;
+						for( size_t i = 0; i < nx; i++ ) {
+							dst[i] += wy[l] * src[i];
+						}
+					}
+				}
+			}
+
+			VectorType* out = obuf + z * fx * fy;
+			VectorType v;
+			for( size_t y = 0; y < fy; y++ ) {
+				for( size_t x = 0; x < fx; x++ ) {
+					const ScalarType* wx = &weights[0][x * Width];
+					const ScalarType* src = ty + nx * y + first[0][x];
+					for( size_t d = 0; d < Dimension; d++ ) {
+						ScalarType val = 0.0;
+						for( size_t l = 0; l < length[0][x]; l++ ) {
+							val += wx[l] * src[d * nx * fy + l];
+						}
+						v[d] = ( fabs(val) > 1.0e-5 )?val:0.0;
+					}
+					out[y * fx + x] = v;
+				}
+			}
+		}
+	});
+
+	this->SetDisplacementField( field );
+}
+
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
@@ -508,13 +758,105 @@ SparseMatrixTransform<TScalar,NDimensions>
 		this->InitializeCoefficientsImages();
 	}
 
+	if ( this->m_DisplacementField.IsNull() ) {
+		itkExceptionMacro(<< "no displacement field to compute the coefficients from." );
+	}
+
+	// Fields on another grid (e.g. the reference image) are first sampled at the control points
+	FieldConstPointer samples = this->m_DisplacementField.GetPointer();
+	if ( !this->IsFieldOnControlGrid( samples ) ) {
+		samples = this->SampleFieldAtControlPoints( samples ).GetPointer();
+	}
+
+	if ( !this->ComputeCoefficientsSeparable( samples ) ) {
+		this->ComputeCoefficientsSparse( samples );
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+bool
+SparseMatrixTransform<TScalar,NDimensions>
+::IsFieldOnControlGrid( const FieldType* field ) const {
+	SizeType fsize = field->GetLargestPossibleRegion().GetSize();
+	PointType forigin = field->GetOrigin();
+	typename FieldType::SpacingType fspacing = field->GetSpacing();
+	DirectionType fdir = field->GetDirection();
+	for( size_t i = 0; i < Dimension; i++ ) {
+		if ( fsize[i] != this->m_ControlGridSize[i] ||
+				fabs( fspacing[i] - this->m_ControlGridSpacing[i] ) > 1.0e-6 * this->m_ControlGridSpacing[i] ||
+				fabs( forigin[i] - this->m_ControlGridOrigin[i] ) > 1.0e-3 * this->m_ControlGridSpacing[i] ) {
+			return false;
+		}
+		for( size_t j = 0; j < Dimension; j++ ) {
+			if ( fabs( fdir[i][j] - this->m_ControlGridDirection[i][j] ) > 1.0e-6 ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template< class TScalar, unsigned int NDimensions >
+typename SparseMatrixTransform<TScalar,NDimensions>::FieldPointer
+SparseMatrixTransform<TScalar,NDimensions>
+::SampleFieldAtControlPoints( const FieldType* field ) {
+	typedef itk::VectorLinearInterpolateImageFunction< FieldType, double > FieldInterpolatorType;
+	typedef itk::ContinuousIndex< double, Dimension >                    FieldContinuousIndex;
+	typedef itk::Point< double, Dimension >                              FieldPointType;
+
+	FieldPointer samples = FieldType::New();
+	samples->SetRegions(   this->m_ControlGridSize );
+	samples->SetOrigin(    this->m_ControlGridOrigin );
+	samples->SetSpacing(   this->m_ControlGridSpacing );
+	samples->SetDirection( this->m_ControlGridDirection );
+	samples->Allocate();
+
+	typename FieldInterpolatorType::Pointer interp = FieldInterpolatorType::New();
+	interp->SetInputImage( field );
+
+	const typename FieldType::RegionType fregion = field->GetLargestPossibleRegion();
+	VectorType* buf = samples->GetBufferPointer();
+
+	this->InitializeThreadPool();
+	this->m_ThreadPool->ParallelFor( samples->GetLargestPossibleRegion().GetNumberOfPixels(),
+			[&](size_t start, size_t stop, itk::ThreadIdType) {
+		FieldPointType p;
+		FieldContinuousIndex cidx;
+		for( size_t i = start; i < stop; i++ ) {
+			samples->TransformIndexToPhysicalPoint( samples->ComputeIndex( i ), p );
+			field->TransformPhysicalPointToContinuousIndex( p, cidx );
+
+			// Control points beyond the field take the value at its boundary
+			for( size_t d = 0; d < Dimension; d++ ) {
+				double lo = fregion.GetIndex()[d];
+				double hi = lo + fregion.GetSize()[d] - 1;
+				cidx[d] = std::max( lo, std::min( hi, static_cast< double >( cidx[d] ) ) );
+			}
+
+			typename FieldInterpolatorType::OutputType v = interp->EvaluateAtContinuousIndex( cidx );
+			for( size_t d = 0; d < Dimension; d++ ) {
+				buf[i][d] = v[d];
+			}
+		}
+	});
+	return samples;
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeCoefficientsSparse( const FieldType* field ) {
+	if ( field->GetLargestPossibleRegion().GetNumberOfPixels() != this->m_NumberOfDimParameters ) {
+		itkExceptionMacro(<< "the sparse fit needs one field sample per control point." );
+	}
+
 	if( this->m_S.rows() == 0 || this->m_S.cols() == 0 ) {
 		this->ComputeMatrix( Self::S );
 	}
 
 	SolverVector X[Dimension], Y[Dimension];
 
-	DimensionParameters fieldValues = this->VectorizeField( this->m_DisplacementField );
+	DimensionParameters fieldValues = this->VectorizeField( field );
 	DimensionParameters coeffs;
 
 	for ( size_t i = 0; i<Dimension; i++) {
@@ -528,13 +870,12 @@ SparseMatrixTransform<TScalar,NDimensions>
 	size_t nRows = this->m_S.rows();
 	SolverMatrix S( nRows, this->m_S.cols() );
 	SparseMatrixRowType row;
-	typedef typename SolverMatrix::row SolverRow;
-	SolverRow row_s;
 	vcl_vector< int > cols;
 	vcl_vector< double > vals;
 
 	for( size_t i = 0; i < nRows; i++ ){
-		row_s.clear();
+		cols.clear();
+		vals.clear();
 		row = this->m_S.get_row( i );
 
 		for( size_t j = 0; j< row.size(); j++ ) {
@@ -565,6 +906,115 @@ SparseMatrixTransform<TScalar,NDimensions>
 	this->Modified();
 }
 
+template< class TScalar, unsigned int NDimensions >
+bool
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeCoefficientsSeparable( const FieldType* field ) {
+	// Band of the 1-D collocation matrices, same +/-2 window as ComputeRegionOfPoint
+	const size_t Band = 2;
+	const size_t Width = 2 * Band + 1;
+
+	// The samples must be the control points themselves, on an axis-aligned grid
+	if ( !this->IsFieldOnControlGrid( field ) ) {
+		return false;
+	}
+	for( size_t i = 0; i < Dimension; i++ ) {
+		for( size_t j = 0; j < Dimension; j++ ) {
+			if ( i != j && fabs( this->m_ControlGridDirection[i][j] ) > 1.0e-6 ) {
+				return false;
+			}
+		}
+	}
+
+	// S factorizes as the Kronecker product of one banded matrix per axis. Each
+	// one is LU-factored in place (no pivoting, B-spline collocation matrices are
+	// diagonally dominant), so solving a grid line is a causal and an anti-causal
+	// recursion. Matrix ends are truncated exactly as in S.
+	std::vector< double > lu[Dimension];
+	for( size_t k = 0; k < Dimension; k++ ) {
+		size_t n = this->m_ControlGridSize[k];
+		std::vector< double >& a = lu[k];
+		a.assign( n * Width, 0.0 );
+		for( size_t i = 0; i < n; i++ ) {
+			for( size_t j = ( i > Band )?( i - Band ):0; j <= std::min( n - 1, i + Band ); j++ ) {
+				a[i * Width + j + Band - i] = this->m_KernelFunction->Evaluate( static_cast< double >( i ) - j );
+			}
+		}
+
+		for( size_t p = 0; p < n; p++ ) {
+			double piv = a[p * Width + Band];
+			if ( fabs( piv ) < 1.0e-8 ) {
+				return false;
+			}
+			for( size_t i = p + 1; i <= std::min( n - 1, p + Band ); i++ ) {
+				double f = a[i * Width + p + Band - i] / piv;
+				a[i * Width + p + Band - i] = f;
+				for( size_t j = p + 1; j <= std::min( n - 1, p + Band ); j++ ) {
+					a[i * Width + j + Band - i] -= f * a[p * Width + j + Band - p];
+				}
+			}
+		}
+	}
+
+	DimensionParameters values = this->VectorizeField( field );
+	ScalarType* vbuf[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		vbuf[d] = values[d].data_block();
+	}
+
+	this->InitializeThreadPool();
+
+	size_t npix = this->m_NumberOfDimParameters;
+	std::vector< std::vector< double > > scratch( this->m_ThreadPool->GetNumberOfThreads() );
+	size_t stride = 1;
+	for( size_t k = 0; k < Dimension; k++ ) {
+		const size_t n = this->m_ControlGridSize[k];
+		const size_t nlines = npix / n;
+		const double* a = &lu[k][0];
+
+		this->m_ThreadPool->ParallelFor( nlines,
+				[&, n, stride](size_t start, size_t stop, itk::ThreadIdType tid) {
+			std::vector< double >& y = scratch[tid];
+			y.resize( n );
+			for( size_t line = start; line < stop; line++ ) {
+				// First element of the line, lines run along axis k
+				size_t base = ( line / stride ) * stride * n + ( line % stride );
+				for( size_t d = 0; d < Dimension; d++ ) {
+					ScalarType* v = vbuf[d] + base;
+					for( size_t i = 0; i < n; i++ ) {
+						y[i] = v[i * stride];
+					}
+					for( size_t i = 1; i < n; i++ ) {
+						for( size_t j = ( i > Band )?( i - Band ):0; j < i; j++ ) {
+							y[i] -= a[i * Width + j + Band - i] * y[j];
+						}
+					}
+					for( size_t i = n; i-- > 0; ) {
+						for( size_t j = i + 1; j <= std::min( n - 1, i + Band ); j++ ) {
+							y[i] -= a[i * Width + j + Band - i] * y[j];
+						}
+						y[i] /= a[i * Width + Band];
+					}
+					for( size_t i = 0; i < n; i++ ) {
+						v[i * stride] = y[i];
+					}
+				}
+			}
+		});
+		stride *= n;
+	}
+
+	for( size_t col = 0; col < Dimension; col++ ) {
+		size_t offset = col * this->m_NumberOfDimParameters;
+		for( size_t k = 0; k<this->m_NumberOfDimParameters; k++) {
+			this->m_Parameters[k + offset] = values[col][k];
+		}
+	}
+
+	this->Modified();
+	return true;
+}
+
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
@@ -629,30 +1079,29 @@ void
 SparseMatrixTransform<TScalar,NDimensions>
 ::InvertPhi() {
 	// Check m_Phi
-	if( this->m_Phi.rows() == 0 || this->m_Phi.cols() == 0 ) {
+	if( this->m_PhiCSR.IsEmpty() ) {
 		this->ComputeMatrix( Self::PHI );
 	}
 
-	size_t nRows = this->m_Phi.rows();
-	size_t nCols = this->m_Phi.cols();
+	size_t nRows = this->m_PhiCSR.GetNumberOfRows();
+	size_t nCols = this->m_PhiCSR.GetNumberOfColumns();
+	const typename CSRMatrixType::PointerArray& rowptr = this->m_PhiCSR.GetRowPointers();
+	const typename CSRMatrixType::IndexArray& phicols = this->m_PhiCSR.GetColumns();
+	const typename CSRMatrixType::ValueArray& phivals = this->m_PhiCSR.GetValues();
 
 	this->m_Phi_inverse = WeightsMatrix( nCols, nRows );
 
 	ScalarType val;
 	SolverMatrix A( nRows, nCols );
-	SparseMatrixRowType row;
-	typedef typename SolverMatrix::row SolverRow;
-	SolverRow row_s;
 	vcl_vector< int > cols;
 	vcl_vector< double > vals;
 
 	for( size_t i = 0; i < nRows; i++ ){
-		row_s.clear();
-		row = this->m_Phi.get_row( i );
-
-		for( size_t j = 0; j< row.size(); j++ ) {
-			cols.push_back( row[j].first );
-			vals.push_back( static_cast< double >( row[j].second ) );
+		cols.clear();
+		vals.clear();
+		for( size_t j = rowptr[i]; j < rowptr[i + 1]; j++ ) {
+			cols.push_back( phicols[j] );
+			vals.push_back( static_cast< double >( phivals[j] ) );
 		}
 		A.set_row( i, cols, vals );
 	}
@@ -683,17 +1132,169 @@ const typename SparseMatrixTransform<TScalar,NDimensions>::WeightsMatrix*
 SparseMatrixTransform<TScalar,NDimensions>
 ::GetPhi(const bool onlyvalid) {
 	// Check m_Phi and initializations
-	if( this->m_Phi.rows()==0 || this->m_Phi.cols()==0 ) {
+	if( this->m_PhiCSR.IsEmpty() ) {
 		this->ComputeMatrix( Self::PHI );
 	}
 
 	if (onlyvalid) {
+		if ( !this->m_PhiValidUpdated ) {
+			this->m_PhiValidCSR.CopyTo( this->m_Phi_valid );
+			this->m_PhiValidUpdated = true;
+		}
 		return &this->m_Phi_valid;
 	} else {
+		if ( !this->m_PhiUpdated ) {
+			this->m_PhiCSR.CopyTo( this->m_Phi );
+			this->m_PhiUpdated = true;
+		}
 		return &this->m_Phi;
 	}
 }
 
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::MultiplyPhi( const ScalarType* const* x, ScalarType* const* y, size_t nvec, const bool onlyvalid ) {
+	if( this->m_PhiCSR.IsEmpty() ) {
+		this->ComputeMatrix( Self::PHI );
+	}
+	this->ParallelMultiply( onlyvalid?this->m_PhiValidCSR:this->m_PhiCSR, x, y, nvec );
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::MultiplyPhiTranspose( const ScalarType* const* x, ScalarType* const* y, size_t nvec, const bool onlyvalid ) {
+	if( this->m_PhiCSR.IsEmpty() ) {
+		this->ComputeMatrix( Self::PHI );
+	}
+
+	if ( onlyvalid ) {
+		if ( !this->m_PhiValidTransposeUpdated ) {
+			std::uint64_t key = this->ComputeTransposeKey( true );
+			if ( !this->ReadCachedMatrix( key, this->m_PhiValidTransposeCSR ) ) {
+				this->m_PhiValidCSR.Transpose( this->m_PhiValidTransposeCSR );
+				this->WriteCachedMatrix( key, this->m_PhiValidTransposeCSR );
+			}
+			this->m_PhiValidTransposeUpdated = true;
+		}
+		this->ParallelMultiply( this->m_PhiValidTransposeCSR, x, y, nvec );
+	} else {
+		if ( !this->m_PhiTransposeUpdated ) {
+			std::uint64_t key = this->ComputeTransposeKey( false );
+			if ( !this->ReadCachedMatrix( key, this->m_PhiTransposeCSR ) ) {
+				this->m_PhiCSR.Transpose( this->m_PhiTransposeCSR );
+				this->WriteCachedMatrix( key, this->m_PhiTransposeCSR );
+			}
+			this->m_PhiTransposeUpdated = true;
+		}
+		this->ParallelMultiply( this->m_PhiTransposeCSR, x, y, nvec );
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+std::uint64_t
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeMatrixKey( WeightsMatrixType type, size_t dim, const PointsList& rows, size_t ncols ) const {
+	std::uint64_t header[5] = { static_cast< std::uint64_t >( type ), dim, Dimension, sizeof( ScalarType ), ncols };
+	std::uint64_t h = HashBytes( header, sizeof( header ) );
+	h = HashBytes( rows.data(), rows.size() * sizeof( PointType ), h );
+
+	for( size_t i = 0; i < Dimension; i++ ) {
+		double grid[3] = { static_cast< double >( this->m_ControlGridSize[i] ),
+		                   static_cast< double >( this->m_ControlGridOrigin[i] ),
+		                   static_cast< double >( this->m_ControlGridSpacing[i] ) };
+		h = HashBytes( grid, sizeof( grid ), h );
+		for( size_t j = 0; j < Dimension; j++ ) {
+			double dir = this->m_ControlGridDirection[i][j];
+			h = HashBytes( &dir, sizeof( double ), h );
+		}
+	}
+
+	// Fingerprint of the kernel and its derivative, sampled over the support
+	const size_t NumberOfSamples = 17;
+	ScalarType samples[2 * NumberOfSamples];
+	this->EvaluateKernelWeights( -2.0, -0.25, NumberOfSamples, false, samples );
+	this->EvaluateKernelWeights( -2.0, -0.25, NumberOfSamples, true, samples + NumberOfSamples );
+	return HashBytes( samples, sizeof( samples ), h );
+}
+
+template< class TScalar, unsigned int NDimensions >
+std::uint64_t
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeTransposeKey( const bool onlyvalid ) const {
+	std::uint64_t header[2] = { this->m_PhiKey, onlyvalid?1u:0u };
+	std::uint64_t h = HashBytes( "transpose", 9, HashBytes( header, sizeof( header ) ) );
+	if ( onlyvalid ) {
+		h = HashBytes( this->m_ValidLocations.data(), this->m_ValidLocations.size() * sizeof( typename PointIdContainer::value_type ), h );
+	}
+	return h;
+}
+
+template< class TScalar, unsigned int NDimensions >
+bool
+SparseMatrixTransform<TScalar,NDimensions>
+::ReadCachedMatrix( std::uint64_t key, CSRMatrixType& m ) const {
+	if ( this->m_CacheDirectory.empty() ) {
+		return false;
+	}
+
+	char name[32];
+	snprintf( name, sizeof( name ), "/rstk_%016llx.csr", static_cast< unsigned long long >( key ) );
+	return m.ReadFile( this->m_CacheDirectory + name, key );
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::WriteCachedMatrix( std::uint64_t key, const CSRMatrixType& m ) const {
+	if ( this->m_CacheDirectory.empty() ) {
+		return;
+	}
+
+	char name[32];
+	snprintf( name, sizeof( name ), "/rstk_%016llx.csr", static_cast< unsigned long long >( key ) );
+	if ( !m.WriteFile( this->m_CacheDirectory + name, key ) ) {
+		itkWarningMacro(<< "could not write matrix cache file " << this->m_CacheDirectory << name );
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::ParallelMultiply( const CSRMatrixType& m, const ScalarType* const* x, ScalarType* const* y, size_t nvec ) {
+	this->InitializeThreadPool();
+
+	this->m_ThreadPool->ParallelFor( m.GetNumberOfRows(),
+			[&m, x, y, nvec](size_t start, size_t stop, itk::ThreadIdType) { m.MultiplyRows( x, y, nvec, start, stop ); });
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::SetThreadPool( ThreadPool* pool ) {
+	if ( this->m_ThreadPool != pool ) {
+		this->m_ThreadPool = pool;
+		this->m_OwnsThreadPool = false;
+		this->Modified();
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::InitializeThreadPool() {
+	if ( this->m_ThreadPool.IsNull() ) {
+		this->m_ThreadPool = ThreadPool::New();
+		this->m_OwnsThreadPool = true;
+	}
+
+	// A pool shared through SetThreadPool keeps the size given by its owner
+	if ( this->m_OwnsThreadPool ) {
+		this->m_ThreadPool->SetNumberOfThreads( this->GetNumberOfThreads() );
+	}
+}
+
 template< class TScalar, unsigned int NDimensions >
 inline bool
 SparseMatrixTransform<TScalar,NDimensions>
@@ -0,0 +1,516 @@
+// This file is part of RegSeg
+//
+// Copyright 2014-2017, Oscar Esteban <code@oscaresteban.es>
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <itkPoint.h>
+#include <itkVector.h>
+#include <itkImage.h>
+#include <itkImageAlgorithm.h>
+#include <vnl/vnl_sparse_matrix.h>
+#include <vnl/vnl_vector.h>
+#include "BSplineSparseMatrixTransform.h"
+#include "CSRMatrix.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+
+typedef float ScalarType;
+typedef itk::ContinuousIndex< ScalarType, 3> CIndex;
+
+typedef itk::Point<ScalarType, 3> PointType;
+typedef itk::Vector<ScalarType, 3 > VectorType;
+typedef itk::Image<ScalarType, 3> ComponentType;
+typedef itk::Image< VectorType, 3 > FieldType;
+
+typedef BSplineSparseMatrixTransform<ScalarType, 3, 3> Transform;
+
+typedef CSRMatrix< ScalarType >            CSRType;
+typedef vnl_sparse_matrix< ScalarType >    VNLSparseType;
+
+
+namespace rstk {
+
+class CSRMatrixTests : public ::testing::Test {
+public:
+	/** Random matrix with some empty rows, assembled in CSR form and through
+	 *  vnl_sparse_matrix::put, as before */
+	virtual void SetUp() {
+		const size_t rows = 97, cols = 61;
+		srand( 7 );
+
+		std::vector< std::vector< std::pair< unsigned int, ScalarType > > > entries( rows );
+		std::vector< size_t > sizes( rows, 0 );
+		m_vnl = VNLSparseType( rows, cols );
+		for( size_t r = 0; r < rows; r++ ) {
+			if ( r % 5 == 3 ) continue;
+			for( size_t c = rand() % 4; c < cols; c+= 1 + rand() % 9 ) {
+				ScalarType v = ( rand() % 2000 - 1000 ) * 1.0e-3;
+				entries[r].push_back( std::make_pair( c, v ) );
+				m_vnl.put( r, c, v );
+			}
+			// Upper bound on the row size, as the counting pass of ComputeMatrix
+			sizes[r] = entries[r].size() + 3;
+		}
+
+		m_csr.SetSize( rows, cols );
+		m_csr.SetRowSizes( sizes );
+		std::vector< size_t > used( rows );
+		for( size_t r = 0; r < rows; r++ ) {
+			size_t pos = m_csr.GetRowPointers()[r];
+			for( size_t k = 0; k < entries[r].size(); k++ ) {
+				m_csr.GetColumns()[pos + k] = entries[r][k].first;
+				m_csr.GetValues()[pos + k] = entries[r][k].second;
+			}
+			used[r] = entries[r].size();
+		}
+		m_csr.Compact( used );
+	}
+
+	static void ExpectEqual( VNLSparseType& expected, VNLSparseType& actual ) {
+		ASSERT_EQ( expected.rows(), actual.rows() );
+		ASSERT_EQ( expected.cols(), actual.cols() );
+		for( unsigned int r = 0; r < expected.rows(); r++ ) {
+			const VNLSparseType::row& e = expected.get_row( r );
+			const VNLSparseType::row& a = actual.get_row( r );
+			ASSERT_EQ( e.size(), a.size() ) << "row " << r;
+			for( size_t k = 0; k < e.size(); k++ ) {
+				EXPECT_EQ( e[k].first, a[k].first ) << "row " << r;
+				EXPECT_EQ( e[k].second, a[k].second ) << "row " << r;
+			}
+		}
+	}
+
+	CSRType m_csr;
+	VNLSparseType m_vnl;
+};
+
+TEST_F( CSRMatrixTests, AssemblyCopyTo ) {
+	VNLSparseType copy;
+	m_csr.CopyTo( copy );
+	ExpectEqual( m_vnl, copy );
+	EXPECT_EQ( m_csr.GetNumberOfNonZeros(), m_csr.GetColumns().size() );
+}
+
+TEST_F( CSRMatrixTests, Transpose ) {
+	VNLSparseType expected( m_vnl.cols(), m_vnl.rows() );
+	for( m_vnl.reset(); m_vnl.next(); ) {
+		expected.put( m_vnl.getcolumn(), m_vnl.getrow(), m_vnl.value() );
+	}
+
+	CSRType t;
+	m_csr.Transpose( t );
+	VNLSparseType copy;
+	t.CopyTo( copy );
+	ExpectEqual( expected, copy );
+}
+
+TEST_F( CSRMatrixTests, SelectRows ) {
+	std::vector< size_t > ids;
+	for( size_t r = 0; r < m_vnl.rows(); r+= 2 ) ids.push_back( r );
+	ids.push_back( 1 );
+
+	VNLSparseType expected( ids.size(), m_vnl.cols() );
+	for( size_t i = 0; i < ids.size(); i++ ) {
+		const VNLSparseType::row& row = m_vnl.get_row( ids[i] );
+		for( size_t k = 0; k < row.size(); k++ ) {
+			expected.put( i, row[k].first, row[k].second );
+		}
+	}
+
+	CSRType sel;
+	m_csr.SelectRows( ids, sel );
+	VNLSparseType copy;
+	sel.CopyTo( copy );
+	ExpectEqual( expected, copy );
+}
+
+TEST_F( CSRMatrixTests, MultiplyRows ) {
+	const size_t nvec = 3;
+	vnl_vector< ScalarType > x[nvec], expected[nvec], y[nvec];
+	const ScalarType* xp[nvec];
+	ScalarType* yp[nvec];
+	for( size_t v = 0; v < nvec; v++ ) {
+		x[v].set_size( m_vnl.cols() );
+		for( size_t c = 0; c < x[v].size(); c++ ) x[v][c] = ( rand() % 200 - 100 ) * 1.0e-2;
+		m_vnl.mult( x[v], expected[v] );
+		y[v].set_size( m_vnl.rows() );
+		y[v].fill( -1.0 );
+		xp[v] = x[v].data_block();
+		yp[v] = y[v].data_block();
+	}
+
+	// In two row ranges, as ParallelMultiply splits them
+	size_t half = m_vnl.rows() / 2;
+	m_csr.MultiplyRows( xp, yp, nvec, 0, half );
+	m_csr.MultiplyRows( xp, yp, nvec, half, m_vnl.rows() );
+
+	for( size_t v = 0; v < nvec; v++ ) {
+		for( size_t r = 0; r < m_vnl.rows(); r++ ) {
+			EXPECT_NEAR( expected[v][r], y[v][r], 1.0e-5 ) << "vector " << v << ", row " << r;
+		}
+	}
+}
+
+TEST_F( CSRMatrixTests, FileRoundTrip ) {
+	const std::string filename = "csrmatrix_test.bin";
+	ASSERT_TRUE( m_csr.WriteFile( filename, 42 ) );
+
+	CSRType loaded;
+	EXPECT_FALSE( loaded.ReadFile( filename, 43 ) );
+	ASSERT_TRUE( loaded.ReadFile( filename, 42 ) );
+	EXPECT_EQ( m_csr.GetRowPointers(), loaded.GetRowPointers() );
+	EXPECT_EQ( m_csr.GetColumns(), loaded.GetColumns() );
+	EXPECT_EQ( m_csr.GetValues(), loaded.GetValues() );
+
+	// Flip one bit of the last value
+	std::vector< char > bytes;
+	{
+		std::ifstream in( filename.c_str(), std::ios::binary );
+		bytes.assign( std::istreambuf_iterator< char >( in ), std::istreambuf_iterator< char >() );
+	}
+	bytes.back() ^= 0x10;
+	{
+		std::ofstream out( filename.c_str(), std::ios::binary | std::ios::trunc );
+		out.write( bytes.data(), bytes.size() );
+	}
+	EXPECT_FALSE( loaded.ReadFile( filename, 42 ) );
+
+	// Drop the last byte
+	{
+		std::ofstream out( filename.c_str(), std::ios::binary | std::ios::trunc );
+		out.write( bytes.data(), bytes.size() - 1 );
+	}
+	EXPECT_FALSE( loaded.ReadFile( filename, 42 ) );
+	std::remove( filename.c_str() );
+}
+
+/** Exposes the separable and matrix-based code paths of the transform */
+class ExposedTransform: public Transform {
+public:
+	typedef ExposedTransform                 Self;
+	typedef itk::SmartPointer< Self >        Pointer;
+	itkNewMacro( Self );
+
+	using Transform::IsFieldSeparable;
+	using Transform::InterpolateFieldSeparable;
+	using Transform::ComputeCoefficientsSeparable;
+	using Transform::ComputeCoefficientsSparse;
+	using Transform::IsFieldOnControlGrid;
+	using Transform::SampleFieldAtControlPoints;
+
+	/** Field values at the output reference through the PHI_FIELD product */
+	DimensionParameters InterpolateFieldMatrix() {
+		this->ComputeMatrix( Transform::PHI_FIELD );
+		const DimensionParameters coeff = this->VectorizeCoefficients();
+		DimensionParameters values;
+		for( size_t i = 0; i < 3; i++ ) {
+			this->m_FieldPhi.mult( coeff[i], values[i] );
+		}
+		return values;
+	}
+};
+
+class SeparableTransformTests : public ::testing::Test {
+public:
+	static ComponentType::Pointer MakeImage( const double size[3], const double spacing[3],
+	                                         const double origin[3], const double direction[3] ) {
+		ComponentType::SizeType s;
+		ComponentType::SpacingType sp;
+		ComponentType::PointType o;
+		ComponentType::DirectionType d;
+		d.Fill( 0.0 );
+		for( size_t i = 0; i < 3; i++ ) {
+			s[i] = size[i];
+			sp[i] = spacing[i];
+			o[i] = origin[i];
+			d[i][i] = direction[i];
+		}
+
+		ComponentType::Pointer im = ComponentType::New();
+		im->SetRegions( s );
+		im->SetSpacing( sp );
+		im->SetOrigin( o );
+		im->SetDirection( d );
+		im->Allocate();
+		im->FillBuffer( 0.0 );
+		return im;
+	}
+
+	/** Control grid and an axis-aligned reference grid within it, with the
+	 *  given signs of the direction cosines */
+	void InitGrids( const double direction[3] ) {
+		const double gsize[3] = { 9, 8, 7 };
+		const double gspacing[3] = { 2.0, 2.5, 3.0 };
+		const double rsize[3] = { 17, 19, 15 };
+		const double rspacing[3] = { 0.9, 0.8, 1.1 };
+		double gorigin[3], rorigin[3];
+		for( size_t i = 0; i < 3; i++ ) {
+			// Centered at the physical origin whatever the direction
+			gorigin[i] = -0.5 * direction[i] * gspacing[i] * ( gsize[i] - 1 );
+			rorigin[i] = -0.5 * direction[i] * rspacing[i] * ( rsize[i] - 1 ) + 0.3;
+		}
+		m_grid = MakeImage( gsize, gspacing, gorigin, direction );
+		m_ref = MakeImage( rsize, rspacing, rorigin, direction );
+	}
+
+	/** Transform on m_grid with pseudo-random coefficients */
+	ExposedTransform::Pointer MakeTransform() {
+		srand( 5 );
+		Transform::CoefficientsImageArray coeffs;
+		for( size_t i = 0; i < 3; i++ ) {
+			coeffs[i] = ComponentType::New();
+			coeffs[i]->CopyInformation( m_grid );
+			coeffs[i]->SetRegions( m_grid->GetLargestPossibleRegion() );
+			coeffs[i]->Allocate();
+			ScalarType* buf = coeffs[i]->GetBufferPointer();
+			for( size_t k = 0; k < m_grid->GetLargestPossibleRegion().GetNumberOfPixels(); k++ ) {
+				buf[k] = ( rand() % 2001 - 1000 ) * 1.0e-3;
+			}
+		}
+
+		ExposedTransform::Pointer tfm = ExposedTransform::New();
+		tfm->SetDomainExtent( m_grid );
+		tfm->SetCoefficientsImages( coeffs );
+		return tfm;
+	}
+
+	/** Pseudo-random displacements on the geometry of reference */
+	static FieldType::Pointer MakeField( const ComponentType* reference ) {
+		FieldType::Pointer field = FieldType::New();
+		field->CopyInformation( reference );
+		field->SetRegions( reference->GetLargestPossibleRegion() );
+		field->Allocate();
+
+		VectorType* buf = field->GetBufferPointer();
+		for( size_t k = 0; k < reference->GetLargestPossibleRegion().GetNumberOfPixels(); k++ ) {
+			for( size_t i = 0; i < 3; i++ ) buf[k][i] = ( rand() % 2001 - 1000 ) * 1.0e-3;
+		}
+		return field;
+	}
+
+	void ExpectSeparableMatchesMatrix( const double dir[3] ) {
+		this->InitGrids( dir );
+		ExposedTransform::Pointer tfm = this->MakeTransform();
+		tfm->SetOutputReference( m_ref );
+		ASSERT_TRUE( tfm->IsFieldSeparable() );
+
+		Transform::DimensionParameters expected = tfm->InterpolateFieldMatrix();
+		tfm->InterpolateFieldSeparable();
+
+		const VectorType* buf = tfm->GetDisplacementField()->GetBufferPointer();
+		size_t npix = m_ref->GetLargestPossibleRegion().GetNumberOfPixels();
+		ASSERT_EQ( npix, expected[0].size() );
+		for( size_t k = 0; k < npix; k++ ) {
+			for( size_t i = 0; i < 3; i++ ) {
+				ASSERT_NEAR( expected[i][k], buf[k][i], 1.0e-4 ) << "pixel " << k << ", component " << i;
+			}
+		}
+	}
+
+	ComponentType::Pointer m_grid, m_ref;
+};
+
+TEST_F( SeparableTransformTests, InterpolateFieldAxisAligned ) {
+	const double dir[3] = { 1.0, 1.0, 1.0 };
+	this->ExpectSeparableMatchesMatrix( dir );
+}
+
+TEST_F( SeparableTransformTests, InterpolateFieldNegativeDirection ) {
+	const double dir[3] = { 1.0, -1.0, -1.0 };
+	this->ExpectSeparableMatchesMatrix( dir );
+}
+TEST_F( SeparableTransformTests, ComputeCoefficientsMatchesSparseLU ) {
+	const double dir[3] = { 1.0, -1.0, 1.0 };
+	this->InitGrids( dir );
+	FieldType::Pointer field = MakeField( m_grid );
+
+	ExposedTransform::Pointer separable = this->MakeTransform();
+	ASSERT_TRUE( separable->ComputeCoefficientsSeparable( field ) );
+
+	ExposedTransform::Pointer sparse = this->MakeTransform();
+	sparse->ComputeCoefficientsSparse( field );
+
+	const Transform::ParametersType& expected = sparse->GetParameters();
+	const Transform::ParametersType& actual = separable->GetParameters();
+	ASSERT_EQ( expected.Size(), actual.Size() );
+	for( size_t k = 0; k < expected.Size(); k++ ) {
+		ASSERT_NEAR( expected[k], actual[k], 1.0e-3 ) << "parameter " << k;
+	}
+}
+
+TEST_F( SeparableTransformTests, ComputeCoefficientsOffGridFallsBack ) {
+	const double dir[3] = { 1.0, 1.0, 1.0 };
+	this->InitGrids( dir );
+	ExposedTransform::Pointer tfm = this->MakeTransform();
+	const Transform::ParametersType initial = tfm->GetParameters();
+
+	// Finer grid, shifted origin and rotated axes are all rejected
+	EXPECT_FALSE( tfm->ComputeCoefficientsSeparable( MakeField( m_ref ) ) );
+
+	ComponentType::Pointer shifted = ComponentType::New();
+	shifted->CopyInformation( m_grid );
+	shifted->SetRegions( m_grid->GetLargestPossibleRegion() );
+	ComponentType::PointType origin = m_grid->GetOrigin();
+	origin[0] += 0.5 * m_grid->GetSpacing()[0];
+	shifted->SetOrigin( origin );
+	EXPECT_FALSE( tfm->ComputeCoefficientsSeparable( MakeField( shifted ) ) );
+
+	ComponentType::Pointer rotated = ComponentType::New();
+	rotated->CopyInformation( m_grid );
+	rotated->SetRegions( m_grid->GetLargestPossibleRegion() );
+	ComponentType::DirectionType r;
+	r.Fill( 0.0 );
+	r[0][1] = -1.0;
+	r[1][0] = 1.0;
+	r[2][2] = 1.0;
+	rotated->SetDirection( r );
+	EXPECT_FALSE( tfm->ComputeCoefficientsSeparable( MakeField( rotated ) ) );
+
+	const Transform::ParametersType& after = tfm->GetParameters();
+	for( size_t k = 0; k < initial.Size(); k++ ) {
+		ASSERT_EQ( initial[k], after[k] ) << "parameter " << k;
+	}
+}
+
+TEST_F( SeparableTransformTests, ComputeCoefficientsFromReferenceField ) {
+	const double dir[3] = { 1.0, -1.0, 1.0 };
+	this->InitGrids( dir );
+	ExposedTransform::Pointer known = this->MakeTransform();
+
+	// Twice as fine as the control grid, every other voxel is a control point
+	double rsize[3], rspacing[3], rorigin[3];
+	for( size_t i = 0; i < 3; i++ ) {
+		rsize[i] = 2 * ( m_grid->GetLargestPossibleRegion().GetSize()[i] - 1 ) + 1;
+		rspacing[i] = 0.5 * m_grid->GetSpacing()[i];
+		rorigin[i] = m_grid->GetOrigin()[i];
+	}
+	ComponentType::Pointer reference = MakeImage( rsize, rspacing, rorigin, dir );
+	known->SetOutputReference( reference );
+	known->InterpolateField();
+
+	// Copy the B-spline field, as seeded from --initial-field
+	FieldType::Pointer field = FieldType::New();
+	field->CopyInformation( reference );
+	field->SetRegions( reference->GetLargestPossibleRegion() );
+	field->Allocate();
+	itk::ImageAlgorithm::Copy< FieldType, FieldType >( known->GetDisplacementField(), field,
+			field->GetLargestPossibleRegion(), field->GetLargestPossibleRegion() );
+
+	ExposedTransform::Pointer fit = ExposedTransform::New();
+	fit->SetDomainExtent( reference );
+	fit->SetControlGridInformation( m_grid );
+	fit->SetDisplacementField( field );
+	EXPECT_FALSE( fit->IsFieldOnControlGrid( field ) );
+	fit->ComputeCoefficients();
+
+	const Transform::ParametersType& expected = known->GetParameters();
+	const Transform::ParametersType& actual = fit->GetParameters();
+	ASSERT_EQ( expected.Size(), actual.Size() );
+	for( size_t k = 0; k < expected.Size(); k++ ) {
+		ASSERT_NEAR( expected[k], actual[k], 1.0e-3 ) << "parameter " << k;
+	}
+
+	// The samples at the control points reproduce the field there
+	FieldType::Pointer samples = fit->SampleFieldAtControlPoints( field );
+	EXPECT_TRUE( fit->IsFieldOnControlGrid( samples ) );
+	FieldType::IndexType gidx, ridx;
+	size_t ncp = m_grid->GetLargestPossibleRegion().GetNumberOfPixels();
+	for( size_t k = 0; k < ncp; k++ ) {
+		gidx = m_grid->ComputeIndex( k );
+		for( size_t i = 0; i < 3; i++ ) ridx[i] = 2 * gidx[i];
+		for( size_t i = 0; i < 3; i++ ) {
+			ASSERT_NEAR( field->GetPixel( ridx )[i], samples->GetPixel( gidx )[i], 1.0e-5 ) << "control point " << k;
+		}
+	}
+}
+
+TEST_F( SeparableTransformTests, PhiMatchesReferenceAssembly ) {
+	const double dir[3] = { 1.0, -1.0, 1.0 };
+	this->InitGrids( dir );
+
+	// Off-grid points within the reference, which lies inside the control grid
+	ComponentType::SizeType s = m_ref->GetLargestPossibleRegion().GetSize();
+	Transform::PointsList points;
+	CIndex cidx;
+	PointType p;
+	srand( 11 );
+	for( size_t i = 0; i < 50; i++ ) {
+		for( size_t d = 0; d < 3; d++ ) cidx[d] = ( rand() % 1000 ) * 1.0e-3 * ( s[d] - 1 );
+		m_ref->TransformContinuousIndexToPhysicalPoint( cidx, p );
+		points.push_back( p );
+	}
+
+	ExposedTransform::Pointer tfm = ExposedTransform::New();
+	tfm->SetDomainExtent( m_ref );
+	tfm->SetControlGridInformation( m_grid );
+	tfm->SetOutputPoints( points );
+	VNLSparseType phi( *( tfm->GetPhi( false ) ) );
+
+	// vnl_sparse_matrix assembly: every kernel weight above the threshold,
+	// then normalize_rows
+	Transform::FieldPointer coeff = tfm->GetCoefficientsField();
+	size_t ncoeff = coeff->GetLargestPossibleRegion().GetNumberOfPixels();
+	const Transform::SpacingType spacing = tfm->GetControlGridSpacing();
+	VNLSparseType expected( points.size(), ncoeff );
+	PointType uk;
+	for( size_t r = 0; r < points.size(); r++ ) {
+		for( size_t k = 0; k < ncoeff; k++ ) {
+			coeff->TransformIndexToPhysicalPoint( coeff->ComputeIndex( k ), uk );
+			double wi = 1.0;
+			for( size_t d = 0; d < 3; d++ ) {
+				wi *= tfm->GetKernelFunction()->Evaluate( ( points[r][d] - uk[d] ) / spacing[d] );
+			}
+			if ( fabs( wi ) > 1.0e-5 ) {
+				expected.put( r, k, wi );
+			}
+		}
+	}
+	expected.normalize_rows();
+
+	ASSERT_EQ( expected.rows(), phi.rows() );
+	ASSERT_EQ( expected.cols(), phi.cols() );
+	for( unsigned int r = 0; r < expected.rows(); r++ ) {
+		const VNLSparseType::row& e = expected.get_row( r );
+		const VNLSparseType::row& a = phi.get_row( r );
+		ASSERT_EQ( e.size(), a.size() ) << "row " << r;
+		for( size_t k = 0; k < e.size(); k++ ) {
+			EXPECT_EQ( e[k].first, a[k].first ) << "row " << r;
+			EXPECT_NEAR( e[k].second, a[k].second, 1.0e-5 ) << "row " << r;
+		}
+	}
+}
+} // namespace rstk